@@ -1,21 +1,206 @@
 ﻿#include <string>
+#include <string_view>
 #include <vector>
+#include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <format>
 #include <memory>
 #include <variant>
 #include <type_traits>
 #include <optional>
+#include <deque>
+#include <utility>
+#include <tuple>
+#include <cstdint>
+#include <bit>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#if defined(INFERENCE_STATS) || defined(INFERENCE_TRACE)
+#include <chrono>
+#endif
+#ifdef INFERENCE_TRACE
+#include <fstream>
+#endif
+#ifdef BENCHMARK
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#endif
 
 #include <iostream>
 
+/// <summary>
+/// <para>追記のみ可能なリスト</para>
+/// <para>要素数を倍々に増やしたセグメントに格納するため要素のアドレスは移動せず、追記と並行してロックなしで追記済みの要素を読み取れる</para>
+/// <para>追記同士の排他は呼び出し側で行う</para>
+/// </summary>
+template <class T>
+struct AppendOnlyList {
+    /// <summary>
+    /// 先頭のセグメントの要素数
+    /// </summary>
+    static constexpr std::size_t FIRST = 64;
+
+    /// <summary>
+    /// <para>セグメントの先頭のポインタ</para>
+    /// <para>k番目のセグメントはFIRST * 2^k個の要素を格納する</para>
+    /// </summary>
+    std::array<std::atomic<T*>, 48> segments = {};
+
+    /// <summary>
+    /// 要素数
+    /// </summary>
+    std::atomic<std::size_t> count = 0;
+
+    AppendOnlyList() = default;
+    AppendOnlyList(const AppendOnlyList&) = delete;
+    AppendOnlyList& operator=(const AppendOnlyList&) = delete;
+    ~AppendOnlyList() {
+        for (auto& segment : this->segments) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// インデックスからセグメントとセグメント内の位置を求める
+    /// </summary>
+    /// <param name="i">インデックス</param>
+    /// <returns>セグメントの番号とセグメント内の位置の組</returns>
+    [[nodiscard]] static std::pair<std::size_t, std::size_t> locate(std::size_t i) {
+        auto k = static_cast<std::size_t>(std::bit_width(i / FIRST + 1) - 1);
+        return { k, i - FIRST * ((std::size_t(1) << k) - 1) };
+    }
+
+    /// <summary>
+    /// 追記済みの要素を取得する
+    /// </summary>
+    /// <param name="i">インデックス</param>
+    /// <returns>要素</returns>
+    [[nodiscard]] const T& operator[](std::size_t i) const {
+        auto [k, offset] = AppendOnlyList::locate(i);
+        return this->segments[k].load(std::memory_order_acquire)[offset];
+    }
+
+    /// <summary>
+    /// 要素数を取得する
+    /// </summary>
+    [[nodiscard]] std::size_t size() const {
+        return this->count.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// 末尾に要素を追記する
+    /// </summary>
+    /// <param name="value">追記する要素</param>
+    /// <returns>追記した要素</returns>
+    const T& push_back(T value) {
+        auto i = this->count.load(std::memory_order_relaxed);
+        auto [k, offset] = AppendOnlyList::locate(i);
+        auto segment = this->segments[k].load(std::memory_order_relaxed);
+        if (!segment) {
+            segment = new T[FIRST << k];
+            this->segments[k].store(segment, std::memory_order_release);
+        }
+        segment[offset] = std::move(value);
+        this->count.store(i + 1, std::memory_order_release);
+        return segment[offset];
+    }
+};
+
+/// <summary>
+/// <para>識別子名とシンボルの識別番号の対応表</para>
+/// <para>モジュールの並列な型推論から並行して利用するため、登録は排他し識別子名の取得はロックなしで行う</para>
+/// </summary>
+struct SymbolTable {
+    /// <summary>
+    /// <para>識別番号から識別子名への表</para>
+    /// <para>識別子名への参照をキーとして保持するため要素のアドレスが移動しないAppendOnlyListで保持する</para>
+    /// </summary>
+    AppendOnlyList<std::string> names = {};
+
+    /// <summary>
+    /// 識別子名から識別番号への表
+    /// </summary>
+    std::unordered_map<std::string_view, std::uint32_t> ids = {};
+
+    /// <summary>
+    /// 登録の排他制御
+    /// </summary>
+    std::mutex mutex = {};
+
+    /// <summary>
+    /// 識別子名の登録
+    /// </summary>
+    /// <param name="name">識別子名</param>
+    /// <returns>nameに対応する識別番号</returns>
+    [[nodiscard]] std::uint32_t intern(std::string_view name) {
+        std::lock_guard lock(this->mutex);
+        if (auto itr = this->ids.find(name); itr != this->ids.end()) {
+            return itr->second;
+        }
+        auto id = static_cast<std::uint32_t>(this->names.size());
+        this->ids.insert({ this->names.push_back(std::string(name)), id });
+        return id;
+    }
+
+    /// <summary>
+    /// 全体で共有するシンボル表の取得
+    /// </summary>
+    /// <returns>シンボル表</returns>
+    [[nodiscard]] static SymbolTable& instance() {
+        static SymbolTable table;
+        return table;
+    }
+};
+
+/// <summary>
+/// <para>識別子のシンボル</para>
+/// <para>識別子名は構文木の構築時にシンボル表へ登録し、型環境では32bitの識別番号をキーとして扱う</para>
+/// </summary>
+struct Symbol {
+    /// <summary>
+    /// シンボル表における識別番号
+    /// </summary>
+    std::uint32_t id = 0;
+
+    Symbol() = default;
+    explicit Symbol(std::string_view name) : id(SymbolTable::instance().intern(name)) {}
+
+    /// <summary>
+    /// 識別子名の取得
+    /// </summary>
+    /// <returns>シンボルに対応する識別子名</returns>
+    [[nodiscard]] const std::string& name() const {
+        return SymbolTable::instance().names[this->id];
+    }
+
+    [[nodiscard]] bool operator==(const Symbol&) const = default;
+};
+
+/// <summary>
+/// Symbolのハッシュ関数
+/// </summary>
+template<>
+struct std::hash<Symbol> {
+    [[nodiscard]] std::size_t operator()(const Symbol& symbol) const noexcept {
+        return symbol.id;
+    }
+};
+
 struct Type;
 
 /// <summary>
-/// 型への参照
+/// <para>型への参照</para>
+/// <para>型の実体はTypeArenaが所有するため参照カウントはもたない</para>
 /// </summary>
-using RefType = std::shared_ptr<Type>;
+using RefType = Type*;
 
 /// <summary>
 /// 型の表現
@@ -27,9 +212,10 @@ struct Type {
     /// </summary>
     struct Base {
         /// <summary>
-        /// 型名
+        /// <para>型名</para>
+        /// <para>型の節点を小さく保つためにシンボルとして保持する</para>
         /// </summary>
-        const std::string name;
+        const Symbol name;
     };
 
     /// <summary>
@@ -54,14 +240,21 @@ struct Type {
         // 型制約については未実装
 
         /// <summary>
-        /// 型変数の解決結果の型
+        /// <para>型変数の解決結果の型</para>
+        /// <para>未解決の場合はnullptr</para>
+        /// </summary>
+        RefType solve = nullptr;
+
+        /// <summary>
+        /// <para>スコープの深さ</para>
+        /// <para>代表元の場合は併合された型変数のうち最も浅いスコープの深さを保持する</para>
         /// </summary>
-        std::optional<RefType> solve = std::nullopt;
+        std::size_t depth = 1;
 
         /// <summary>
-        /// スコープの深さ
+        /// 型変数同士の併合における木の高さの上界(ランク)
         /// </summary>
-        const std::size_t depth = 1;
+        std::size_t rank = 0;
     };
 
     /// <summary>
@@ -90,745 +283,3615 @@ struct Type {
     kind_type kind;
 };
 
+struct Generic;
+
 /// <summary>
-/// ジェネリック型
+/// <para>ジェネリック型のinstantiateの雛形</para>
+/// <para>型変数を含む部分型(骨格)のみを後行順に並べたもので、型変数を含まない部分型はinstantiate結果で共有する</para>
 /// </summary>
-struct Generic {
+struct GenericTemplate {
     /// <summary>
-    /// 型変数のリスト
+    /// 雛形における部分型の参照
     /// </summary>
-    std::vector<RefType> vals;
+    struct Operand {
+        /// <summary>
+        /// 参照先の種類
+        /// </summary>
+        enum struct Kind {
+            /// <summary>
+            /// 型変数を含まないため共有する型
+            /// </summary>
+            SHARED,
+            /// <summary>
+            /// ジェネリック型の型変数のインデックス
+            /// </summary>
+            VAL,
+            /// <summary>
+            /// 骨格の節点のインデックス
+            /// </summary>
+            NODE
+        } kind = Kind::SHARED;
 
-    /// <summary>
-    /// 型変数valsを内部で持つ型
-    /// </summary>
-    RefType type;
-};
+        /// <summary>
+        /// kindがSHAREDの場合の共有する型
+        /// </summary>
+        RefType type = nullptr;
 
-/// <summary>
-/// 解決済みの型を取得する
-/// </summary>
-/// <param name="type">チェックを行う型</param>
-/// <returns>解決済みの型</returns>
-RefType solved(RefType type) {
-    if (std::holds_alternative<Type::Variable>(type->kind)) {
-        auto& val = std::get<Type::Variable>(type->kind);
-        if (val.solve) {
-            // 解決結果が再適用されないように適用しておく
-            return val.solve.emplace(solved(val.solve.value()));
-        }
-    }
-    return type;
-}
+        /// <summary>
+        /// kindがVALまたはNODEの場合のインデックス
+        /// </summary>
+        std::size_t index = 0;
+    };
 
-/// <summary>
-/// 型環境
-/// </summary>
-struct TypeEnvironment {
     /// <summary>
-    /// スコープにおいて1つ上の型環境
+    /// 骨格の節点(関数型)
     /// </summary>
-    TypeEnvironment* parent = nullptr;
+    struct Node {
+        /// <summary>
+        /// 引数型
+        /// </summary>
+        Operand paramType;
+
+        /// <summary>
+        /// 戻り値型
+        /// </summary>
+        Operand returnType;
+    };
 
     /// <summary>
-    /// スコープの深さ
+    /// 後行順に並べた骨格の節点のリスト
     /// </summary>
-    std::size_t depth = 1;
+    std::vector<Node> nodes = {};
 
     /// <summary>
-    /// 型環境についての識別子と型のペアの表
+    /// ジェネリック型の本体の型
     /// </summary>
-    std::unordered_map<std::string, std::variant<RefType, Generic>> map = {};
+    Operand root;
 
     /// <summary>
-    /// 識別子の名称から型を取り出す
+    /// ジェネリック型から雛形を構築する
     /// </summary>
-    /// <param name="name">識別子の名称</param>
-    /// <returns>nameに対応する型</returns>
-    [[nodiscard]] std::optional<const std::variant<RefType, Generic>*> lookup(const std::string& name) const {
-        if (auto itr = this->map.find(name); itr != this->map.end()) {
-            // std::optionalは参照型は返せないのでポインタを返す
-            return std::addressof(itr->second);
-        }
-        else if (this->depth != 0 && this->parent) {
-            // 見つからないかつ1つ上の型環境が存在するならそこから取得
-            return this->parent->lookup(name);
-        }
-        return std::nullopt;
-    }
+    /// <param name="generic">雛形の構築対象のジェネリック型</param>
+    /// <returns>構築した雛形</returns>
+    [[nodiscard]] static std::shared_ptr<const GenericTemplate> build(const Generic& generic);
+};
 
+/// <summary>
+/// ジェネリック型
+/// </summary>
+struct Generic {
     /// <summary>
-    /// 型の生成
+    /// 型変数のリスト
     /// </summary>
-    /// <param name="kind">型の固有情報</param>
-    /// <returns>生成した型</returns>
-    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
-        return RefType(new Type({ .kind = std::move(kind) }));
-    }
+    std::vector<RefType> vals;
 
     /// <summary>
-    /// 自由な型変数について型をgeneralizeする
+    /// 型変数valsを内部で持つ型
     /// </summary>
-    /// <param name="type">複製対象の型</param>
-    /// <param name="env">型環境</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type);
+    RefType type;
 
     /// <summary>
-    /// ジェネリック型の型変数についてinstantiateする
+    /// <para>instantiateの雛形</para>
+    /// <para>初回のinstantiate時に構築して以降のinstantiateで再利用する</para>
     /// </summary>
-    /// <param name="type">複製対象の型</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] RefType instantiate(Generic type);
+    mutable std::shared_ptr<const GenericTemplate> spine = nullptr;
 };
 
 /// <summary>
-/// 自由な型変数について型をgeneralizeする
+/// ジェネリック型から雛形を構築する
 /// </summary>
-/// <param name="type">複製対象の型</param>
-/// <param name="env">型環境</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type) {
-    // generalizeした対象の型変数のリスト
-    std::vector<RefType> vals;
-    std::unordered_map<RefType, typename std::vector<RefType>::size_type> map;
+/// <param name="generic">雛形の構築対象のジェネリック型</param>
+/// <returns>構築した雛形</returns>
+[[nodiscard]] std::shared_ptr<const GenericTemplate> GenericTemplate::build(const Generic& generic) {
+    auto spine = std::make_shared<GenericTemplate>();
+    // 構築済みの部分型の参照(共有された部分型は1度のみ構築する)
+    std::unordered_map<const Type*, Operand> memo;
 
     struct fn {
-        RefType& t;
-        TypeEnvironment& e;
-        std::vector<RefType>& v;
-        std::unordered_map<RefType, typename std::vector<RefType>::size_type>& m;
+        RefType t;
+        GenericTemplate& s;
+        std::unordered_map<const Type*, Operand>& m;
+        const std::vector<RefType>& p;
 
-        RefType operator()([[maybe_unused]] Type::Base& x) {
-            // generalizeしない
-            return this->t;
+        Operand operator()([[maybe_unused]] const Type::Base& x) {
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
-        RefType operator()(Type::Function& x) {
-            // 引数型と戻り値型をgeneralizeする
-            auto genParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .m = this->m }, x.paramType->kind);
-            if (x.paramType != genParamType) {
-                x.paramType = genParamType;
-            }
-            auto genReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .m = this->m }, x.returnType->kind);
-            if (x.returnType != genReturnType) {
-                x.returnType = genReturnType;
+        Operand operator()(const Type::Function& x) {
+            auto paramType = this->m.at(x.paramType);
+            auto returnType = this->m.at(x.returnType);
+            if (paramType.kind == Operand::Kind::SHARED && returnType.kind == Operand::Kind::SHARED) {
+                // 型変数を含まない場合は共有する
+                return { .kind = Operand::Kind::SHARED, .type = this->t };
             }
-            return this->t;
+            this->s.nodes.push_back({ .paramType = paramType, .returnType = returnType });
+            return { .kind = Operand::Kind::NODE, .index = this->s.nodes.size() - 1 };
         }
-        RefType operator()(Type::Variable& x) {
-            if (x.solve) {
-                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
-                // この際にGeneric型から完全に型変数を除去するために簡約
-                this->t = solved(x.solve.value());
-                return std::visit(fn{ .t = this->t, .e = this->e, .v = this->v, .m = this->m }, this->t->kind);
-            }
-
-            if (this->e.depth < x.depth) {
-                // 自由な型変数のためgeneralizeする
-                if (auto itr = this->m.find(this->t); itr != this->m.end()) {
-                    return this->v[itr->second];
-                }
-                else {
-                    this->m.insert({ this->t, this->v.size() });
-                    this->v.push_back(this->e.newType(Type::Param{ .index = this->v.size() }));
-                    return this->v.back();
-                }
-            }
-            else {
-                // 束縛された型変数のためgeneralizeしない
-                return this->t;
-            }
+        Operand operator()([[maybe_unused]] const Type::Variable& x) {
+            // 外のスコープから与えられた型変数のため共有する
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
-        RefType operator()([[maybe_unused]] Type::Param& x) {
-            // 外のスコープから与えられた型変数のためgeneralizeしない
-            // 現状の実装ではこのシチュエーションは(おそらく)生じない
-            return this->t;
+        Operand operator()(const Type::Param& x) {
+            // ジェネリック型の型変数と等しい場合はinstantiateの対象とする
+            if (x.index < this->p.size() && this->p[x.index] == this->t) {
+                return { .kind = Operand::Kind::VAL, .index = x.index };
+            }
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
     };
 
-    auto t = std::visit(fn{ .t = type, .e = *this, .v = vals, .m = map }, type->kind);
-    if (vals.size() > 0) {
-        return Generic{ .vals = std::move(vals), .type = std::move(t) };
-    }
-    else {
-        return t;
+    // 構築対象の部分型と部分型を展開済みであるかのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+    std::vector<std::pair<RefType, bool>> stack = { { generic.type, false } };
+    while (!stack.empty()) {
+        auto [t, expanded] = stack.back();
+        if (memo.contains(t)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!expanded) {
+            // 部分型を先に構築する
+            stack.back().second = true;
+            if (std::holds_alternative<Type::Function>(t->kind)) {
+                // 引数型の部分型から順に構築するため戻り値型から積む
+                auto& x = std::get<Type::Function>(t->kind);
+                stack.push_back({ x.returnType, false });
+                stack.push_back({ x.paramType, false });
+            }
+            continue;
+        }
+        stack.pop_back();
+        memo.insert({ t, std::visit(fn{ .t = t, .s = *spine, .m = memo, .p = generic.vals }, t->kind) });
     }
+
+    spine->root = memo.at(generic.type);
+    return spine;
 }
 
 /// <summary>
-/// ジェネリック型の型変数についてinstantiateする
+/// <para>型推論の処理ごとの呼び出し回数と処理時間の計測結果</para>
+/// <para>INFERENCE_STATSを定義した場合のみ計測し、定義しない場合はProbeが空の型となり計測処理はコンパイル時に除去される</para>
+/// <para>スレッドごとに計測し、並列に型推論したスレッドの計測結果は終了時に呼び出し元のスレッドの計測結果へ加算する</para>
 /// </summary>
-/// <param name="type">複製対象の型</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] RefType TypeEnvironment::instantiate(Generic type) {
-    // instantiateした対象の型変数のリスト
-    std::vector<RefType> vals(type.vals.size());
-
-    struct fn {
-        RefType t;
-        TypeEnvironment& e;
-        std::vector<RefType>& v;
-        const std::vector<RefType>& p;
+struct InferenceStats {
+    /// <summary>
+    /// 1つの処理の計測結果
+    /// </summary>
+    struct Counter {
+        /// <summary>
+        /// 処理名
+        /// </summary>
+        const char* name = "";
+        /// <summary>
+        /// <para>処理時間を計測するか</para>
+        /// <para>呼び出し回数が多く処理が軽いものは計測自体が支配的になるため計測しない</para>
+        /// </summary>
+        bool timed = false;
+        /// <summary>
+        /// 呼び出し回数
+        /// </summary>
+        std::size_t calls = 0;
+        /// <summary>
+        /// 処理した要素数の合計
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 1回の呼び出しで処理した要素数の最大値
+        /// </summary>
+        std::size_t maxItems = 0;
+        /// <summary>
+        /// 処理時間の合計[ns]
+        /// </summary>
+        std::int64_t nanoseconds = 0;
+        /// <summary>
+        /// <para>実行中の呼び出しの数</para>
+        /// <para>再帰的な呼び出しの処理時間を重複して計上しないために最も外側の呼び出しのみ計測する</para>
+        /// </summary>
+        std::size_t active = 0;
+    };
 
-        RefType operator()([[maybe_unused]] const Type::Base& x) {
-            // instantiateしない
-            return this->t;
-        }
-        RefType operator()(const Type::Function& x) {
-            // 引数型と戻り値型をinstantiateする
-            auto instParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .p = this->p }, x.paramType->kind);
-            auto instReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .p = this->p }, x.returnType->kind);
+    /// <summary>
+    /// 計測中の1回の呼び出し
+    /// </summary>
+    struct Probe {
+#ifdef INFERENCE_STATS
+        /// <summary>
+        /// 計上先
+        /// </summary>
+        Counter& counter;
+        /// <summary>
+        /// この呼び出しで処理した要素数
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 最も外側の呼び出しであるか
+        /// </summary>
+        bool outermost = false;
+        /// <summary>
+        /// 開始時刻
+        /// </summary>
+        std::chrono::steady_clock::time_point start = {};
 
-            if (x.paramType == instParamType && x.returnType == instReturnType) {
-                // instantiateされなかった場合は新規にインスタンスを生成しない
-                return this->t;
-            }
-            else {
-                // instantiateが生じた場合は新規にインスタンスを生成する
-                return this->e.newType(Type::Function{ .paramType = std::move(instParamType), .returnType = std::move(instReturnType) });
+        explicit Probe(Counter& counter) : counter(counter) {
+            ++this->counter.calls;
+            this->outermost = this->counter.active++ == 0;
+            if (this->counter.timed && this->outermost) {
+                this->start = std::chrono::steady_clock::now();
             }
         }
-        RefType operator()([[maybe_unused]] const Type::Variable& x) {
-            // 外のスコープから与えられた型変数のためinstantiateしない
-            return this->t;
-        }
-        RefType operator()(const Type::Param& x) {
-            // ジェネリック型の型変数と等しい場合はinstantiateする
-            if (x.index < this->p.size() && this->p[x.index] == this->t) {
-                if (this->v[x.index]) {
-                    // 既に型変数を割り当て済みの場合はそこから持ってくる
-                    return this->v[x.index];
-                }
-                else {
-                    auto type = this->e.newType(Type::Variable{ .depth = this->e.depth });
-                    return this->v[x.index] = type;
-                }
-            }
-            else {
-                return this->t;
+        ~Probe() {
+            if (this->counter.timed && this->outermost) {
+                this->counter.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count();
             }
+            --this->counter.active;
+            this->counter.items += this->items;
+            this->counter.maxItems = std::max(this->counter.maxItems, this->items);
         }
-    };
-
-    return std::visit(fn{ .t = type.type, .e = *this, .v = vals, .p = type.vals }, type.type->kind);
-}
+#else
+        explicit Probe([[maybe_unused]] Counter& counter) {}
+#endif
+        Probe(const Probe&) = delete;
+        Probe& operator=(const Probe&) = delete;
 
-/// <summary>
-/// typeがtargetに依存しているかの判定(参照先の型が一致するかを判定する)
-/// </summary>
-/// <param name="type">検査対象の型1</param>
-/// <param name="target">検査対象の型2</param>
-/// <returns>typeがtargetに依存している場合にtrue、依存していない場合にfalse</returns>
-[[nodiscard]] bool depend(const RefType& type, const RefType& target) {
-    struct fn {
-        const RefType& t;
-
-        bool operator()([[maybe_unused]] const Type::Base& x) {
-            return false;
-        }
-        bool operator()(const Type::Function& x) {
-            return x.paramType == this->t || x.returnType == this->t || depend(x.paramType, this->t) || depend(x.returnType, this->t);
-        }
-        bool operator()([[maybe_unused]] const Type::Variable& x) {
-            return x.solve ? depend(x.solve.value(), this->t) : false;
-        }
-        bool operator()([[maybe_unused]] const Type::Param& x) {
-            return false;
+        /// <summary>
+        /// 処理した要素数を計上する
+        /// </summary>
+        /// <param name="n">処理した要素数</param>
+        void add([[maybe_unused]] std::size_t n) {
+#ifdef INFERENCE_STATS
+            this->items += n;
+#endif
         }
     };
 
-    return type == target || std::visit(fn{ .t = target }, type->kind);
-}
-
-/// <summary>
-/// 副作用付きの2つの型の単一化
-/// </summary>
-/// <param name="type1">単一化の対象の型1</param>
-/// <param name="type2">単一化の対象の型2</param>
-void unify(RefType type1, RefType type2) {
-
-    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
-    auto t1 = solved(type1);
-    auto t2 = solved(type2);
+    /// <summary>
+    /// 単一化(要素数は単一化した型のペアの数)
+    /// </summary>
+    Counter unify = { .name = "unify", .timed = true };
+    /// <summary>
+    /// 解決済みの型の取得(要素数は辿った型変数の解決結果の数)
+    /// </summary>
+    Counter solved = { .name = "solved" };
+    /// <summary>
+    /// 出現検査(要素数は走査した型の数)
+    /// </summary>
+    Counter occurs = { .name = "occurs", .timed = true };
+    /// <summary>
+    /// generalize(要素数は走査した型の数)
+    /// </summary>
+    Counter generalize = { .name = "generalize", .timed = true };
+    /// <summary>
+    /// instantiate(要素数は骨格から生成した型の数)
+    /// </summary>
+    Counter instantiate = { .name = "instantiate", .timed = true };
+    /// <summary>
+    /// 識別子の型の取り出し(要素数は辿った束縛の数)
+    /// </summary>
+    Counter lookup = { .name = "lookup" };
 
-    if (t1 != t2) {
-        if (std::holds_alternative<Type::Variable>(t1->kind)) {
-            auto& t1v = std::get<Type::Variable>(t1->kind);
+    /// <summary>
+    /// 計測結果を初期化する
+    /// </summary>
+    void reset() {
+        *this = InferenceStats{};
+    }
 
-            if (std::holds_alternative<Type::Variable>(t2->kind)) {
-                // 型変数同士の場合は型の循環が起きないように外のスコープのものを設定
-                auto& t2v = std::get<Type::Variable>(t2->kind);
-                if (t1v.depth < t2v.depth) {
-                    t2v.solve = t1;
-                }
-                else {
-                    t1v.solve = t2;
-                }
-            }
-            else {
-                if (depend(t1, t2)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                t1v.solve = t2;
-            }
-        }
-        else {
-            if (std::holds_alternative<Type::Variable>(t2->kind)) {
-                auto& t2v = std::get<Type::Variable>(t2->kind);
-                if (depend(t2, t1)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                t2v.solve = t1;
-            }
-            else {
-                // 型が一致する場合に部分型について再帰的に単一化
-                // 制約付きの場合は「C ⊨ type1 ∼ type2」のような同値の条件によりキャストを行うが未実装
-                if (t1->kind.index() == t2->kind.index()) {
-                    if (std::holds_alternative<Type::Function>(t1->kind)) {
-                        auto& k1 = std::get<Type::Function>(t1->kind);
-                        auto& k2 = std::get<Type::Function>(t2->kind);
-                        unify(k1.paramType, k2.paramType);
-                        unify(k1.returnType, k2.returnType);
-                    }
-                    else {
-                        // 部分型をもたないため型は一致しない
-                        throw std::runtime_error("型の不一致");
-                    }
-                }
-                else {
-                    // 型の種類が一致しない
-                    throw std::runtime_error("型の不一致");
-                }
-            }
+    /// <summary>
+    /// <para>他のスレッドの計測結果を加算する</para>
+    /// <para>複数のスレッドから並行して加算されるため排他する</para>
+    /// </summary>
+    /// <param name="other">加算する計測結果</param>
+    void merge(const InferenceStats& other) {
+        static std::mutex mutex;
+        std::lock_guard lock(mutex);
+        for (auto counter : { &InferenceStats::unify, &InferenceStats::solved, &InferenceStats::occurs, &InferenceStats::generalize, &InferenceStats::instantiate, &InferenceStats::lookup }) {
+            auto& to = this->*counter;
+            auto& from = other.*counter;
+            to.calls += from.calls;
+            to.items += from.items;
+            to.maxItems = std::max(to.maxItems, from.maxItems);
+            to.nanoseconds += from.nanoseconds;
         }
     }
-}
-
-/// <summary>
-/// 式を示す構文木
-/// </summary>
-struct Expression {
-    virtual ~Expression() {};
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// <para>出現検査とgeneralizeで走査した型の数</para>
+    /// <para>INFERENCE_STATSを定義しない場合は計上されないため常に0</para>
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    virtual RefType J(TypeEnvironment& env) = 0;
+    /// <returns>走査した型の数</returns>
+    [[nodiscard]] std::size_t traversed() const {
+        return this->occurs.items + this->generalize.items;
+    }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 計測結果を出力する
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    virtual void M(TypeEnvironment& env, RefType rho) = 0;
+    /// <param name="os">出力先</param>
+    void dump(std::ostream& os) const {
+        os << std::format("  {:<16} {:>8} {:>10} {:>8} {:>12}", "phase", "calls", "items", "max", "time[us]") << std::endl;
+        for (auto counter : { &this->unify, &this->solved, &this->occurs, &this->generalize, &this->instantiate, &this->lookup }) {
+            os << std::format(
+                "  {:<16} {:>8} {:>10} {:>8} {:>12}",
+                counter->name,
+                counter->calls,
+                counter->items,
+                counter->maxItems,
+                counter->timed ? std::format("{:.1f}", counter->nanoseconds / 1000.0) : std::string("-")
+            ) << std::endl;
+        }
+    }
 };
+constinit thread_local InferenceStats inferenceStats = {};
 
 /// <summary>
-/// 定数を示す構文木(簡単のために値はもたない)
+/// <para>型推論のイベントトレース</para>
+/// <para>INFERENCE_TRACEを定義した場合のみ、区間をChromeのtrace_event形式(JSON)でファイルへ逐次書き出す</para>
+/// <para>区間の開始と終了をその場で書き出すため、巨大な入力でもイベントをメモリに溜めない</para>
+/// <para>複数のスレッドのイベントは排他して書き出し、スレッドごとに別のtidを割り当てる</para>
 /// </summary>
-struct Constant : Expression {
+struct InferenceTrace {
+#ifdef INFERENCE_TRACE
     /// <summary>
-    /// 定数の型
+    /// 出力先
     /// </summary>
-    RefType b;
-
-    Constant(RefType b) : b(b) {}
-    ~Constant() override {}
+    std::ofstream os = {};
+    /// <summary>
+    /// タイムスタンプの基準時刻
+    /// </summary>
+    std::chrono::steady_clock::time_point origin = {};
+    /// <summary>
+    /// 最初のイベントであるか
+    /// </summary>
+    bool first = true;
+    /// <summary>
+    /// 書き出しの排他制御
+    /// </summary>
+    std::mutex mutex = {};
+    /// <summary>
+    /// tidを割り当てたスレッドの数
+    /// </summary>
+    std::size_t threads = 0;
+#endif
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 計測中の区間
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J([[maybe_unused]] TypeEnvironment& env) override {
-        return this->b;
-    }
+    struct Span {
+#ifdef INFERENCE_TRACE
+        explicit Span(std::string_view category, std::string_view name, const std::string& id);
+        explicit Span(std::string_view category, std::string_view name, std::optional<Symbol> x = std::nullopt);
+        ~Span();
+#else
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] const std::string& id) {}
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] std::optional<Symbol> x = std::nullopt) {}
+#endif
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
 
+#ifdef INFERENCE_TRACE
     /// <summary>
-    /// Algorithm Mの適用
+    /// トレースの出力を開始する
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        unify(rho, this->b);
+    /// <param name="path">出力先のファイル名</param>
+    void open(const std::string& path) {
+        std::lock_guard lock(this->mutex);
+        this->os.open(path);
+        if (!this->os) {
+            throw std::runtime_error(std::format("トレースの出力先{}を開けない", path));
+        }
+        this->os << "[\n";
+        this->origin = std::chrono::steady_clock::now();
+        this->first = true;
     }
-};
 
-/// <summary>
-/// 識別子を示す構文木
-/// </summary>
-struct Identifier : Expression {
     /// <summary>
-    /// 識別子名
+    /// トレースの出力を終了する
     /// </summary>
-    std::string x;
-
-    Identifier(std::string_view x) : x(x) {}
-    ~Identifier() override {}
+    void close() {
+        std::lock_guard lock(this->mutex);
+        if (this->os.is_open()) {
+            this->os << "\n]\n";
+            this->os.close();
+        }
+    }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// <para>イベントを書き出す</para>
+    /// <para>出力を開始していない場合は何もしない</para>
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeEnvironment& env) override {
-        struct fn {
-            TypeEnvironment& e;
-
-            RefType operator()(const RefType& x) {
-                return x;
-            }
-            RefType operator()(const Generic& x) {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                return this->e.instantiate(x);
+    /// <param name="phase">イベントの種類(B：区間の開始、E：区間の終了)</param>
+    /// <param name="category">イベントの分類</param>
+    /// <param name="name">イベント名</param>
+    /// <param name="id">識別子名</param>
+    void event(char phase, std::string_view category, std::string_view name, std::string_view id) {
+        std::lock_guard lock(this->mutex);
+        if (!this->os.is_open()) {
+            return;
+        }
+        thread_local auto tid = ++this->threads;
+        auto ts = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->origin).count();
+        this->os << (std::exchange(this->first, false) ? "" : ",\n");
+        this->os << R"({"ph":")" << phase << R"(","ts":)" << std::format("{:.3f}", ts) << R"(,"pid":1,"tid":)" << tid;
+        if (phase == 'B') {
+            this->os << R"(,"cat":")";
+            this->escape(category);
+            this->os << R"(","name":")";
+            this->escape(name);
+            this->os << '"';
+            if (!id.empty()) {
+                this->os << R"(,"args":{"id":")";
+                this->escape(id);
+                this->os << R"("})";
             }
-        };
-
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
-        if (tau) {
-            return std::visit(fn{ .e = env }, *tau.value());
         }
-        throw std::runtime_error(std::format("不明な識別子：{}", this->x));
+        this->os << '}';
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// JSONの文字列としてエスケープして書き出す
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        struct fn {
-            TypeEnvironment& e;
-
-            RefType operator()(const RefType& x) {
-                return x;
+    /// <param name="s">書き出す文字列</param>
+    void escape(std::string_view s) {
+        for (auto c : s) {
+            if (c == '"' || c == '\\') {
+                this->os << '\\' << c;
             }
-            RefType operator()(const Generic& x) {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                return this->e.instantiate(x);
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                this->os << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+            }
+            else {
+                this->os << c;
             }
-        };
-
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
-
-        if (tau) {
-            unify(rho, std::visit(fn{ .e = env }, *tau.value()));
-        }
-        else {
-            throw std::runtime_error(std::format("不明な識別子：{}", this->x));
         }
     }
+#endif
 };
+InferenceTrace inferenceTrace = {};
+
+#ifdef INFERENCE_TRACE
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, const std::string& id) {
+    inferenceTrace.event('B', category, name, id);
+}
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, std::optional<Symbol> x) {
+    inferenceTrace.event('B', category, name, x ? std::string_view(x->name()) : std::string_view());
+}
+InferenceTrace::Span::~Span() {
+    inferenceTrace.event('E', {}, {}, {});
+}
+#endif
 
 /// <summary>
-/// ラムダ抽象を示す構文木
+/// <para>単一化による書き換えの記録(トレイル)</para>
+/// <para>チェックポイントを開いている間のみ書き換え前の値を記録し、書き換えの数に比例する時間で巻き戻す</para>
+/// <para>記録の対象は単一化(solved, unite, occurs, unify)とgeneralizeによる書き換えのみ</para>
 /// </summary>
-struct Lambda : Expression {
+struct Trail {
     /// <summary>
-    /// 引数名
+    /// 書き換え前の値
     /// </summary>
-    std::string x;
+    template <class T>
+    struct Entry {
+        /// <summary>
+        /// 書き換えた場所
+        /// </summary>
+        T* slot;
+        /// <summary>
+        /// 書き換え前の値
+        /// </summary>
+        T value;
+    };
+
     /// <summary>
-    /// 関数本体の式
+    /// 書き換え前の値の記録
     /// </summary>
-    std::shared_ptr<Expression> e;
-
-    Lambda(std::string_view x, std::shared_ptr<Expression> e) : x(x), e(e) {}
-    ~Lambda() override {}
+    using Record = std::variant<Entry<RefType>, Entry<std::size_t>>;
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 記録を書き戻す
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeEnvironment& env) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
-
-        // 型環境にxを登録してeを評価
-        auto t = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        newEnv.map.insert({ this->x, t });
-        auto tau = this->e->J(newEnv);
-
-        return env.newType(Type::Function{ .paramType = t, .returnType = tau });
-    }
+    struct fn {
+        template <class T>
+        void operator()(Entry<T>& entry) const {
+            *entry.slot = std::move(entry.value);
+        }
+    };
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// チェックポイント
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
-
-        auto t1 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        auto t2 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        unify(rho, env.newType(Type::Function{ .paramType = t1, .returnType = t2 }));
-
-        // 型環境にxを登録してeを評価
-        newEnv.map.insert({ this->x, t1 });
-        this->e->M(newEnv, t2);
-    }
-};
+    struct Checkpoint {
+        /// <summary>
+        /// チェックポイントを取得した時点の記録の数
+        /// </summary>
+        std::size_t size;
+    };
 
-/// <summary>
-/// 関数適用を示す構文木
-/// </summary>
-struct Apply : Expression {
     /// <summary>
-    /// 関数を示す式
+    /// 書き換え前の値の記録のリスト
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    std::vector<Record> records = {};
+
     /// <summary>
-    /// 引数の式
+    /// 開いているチェックポイントの数
     /// </summary>
-    std::shared_ptr<Expression> e2;
-
-    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), e2(e2) {}
-    ~Apply() override {}
+    std::size_t open = 0;
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// チェックポイントを開いていれば書き換える前の値を記録する
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeEnvironment& env) override {
-        auto tau1 = this->e1->J(env);
-        auto tau2 = this->e2->J(env);
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-
-        // 制約付きの場合は適用可能かの検査等を行うが未実装
-        unify(tau1, env.newType(Type::Function{ .paramType = tau2, .returnType = t }));
-
-        return t;
+    /// <param name="slot">書き換える場所</param>
+    template <class T>
+    void save(T& slot) {
+        if (this->open > 0) {
+            this->records.push_back(Entry<T>{ .slot = std::addressof(slot), .value = slot });
+        }
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 書き換え前の値を記録して書き換える
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-
-        this->e1->M(env, env.newType(Type::Function{ .paramType = t, .returnType = rho }));
-        this->e2->M(env, t);
+    /// <param name="slot">書き換える場所</param>
+    /// <param name="value">書き換え後の値</param>
+    template <class T>
+    void assign(T& slot, T value) {
+        if (slot != value) {
+            this->save(slot);
+            slot = std::move(value);
+        }
     }
-};
 
-/// <summary>
-/// Let束縛を示す構文木
-/// </summary>
-struct Let : Expression {
     /// <summary>
-    /// 束縛先の識別子名
+    /// チェックポイントを開く
     /// </summary>
-    std::string x;
+    /// <returns>チェックポイント</returns>
+    [[nodiscard]] Checkpoint checkpoint() {
+        ++this->open;
+        return Checkpoint{ .size = this->records.size() };
+    }
+
     /// <summary>
-    /// 束縛する式
+    /// チェックポイント以降の書き換えを巻き戻してチェックポイントを閉じる
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    /// <param name="checkpoint">巻き戻し先のチェックポイント</param>
+    void rollback(Checkpoint checkpoint) {
+        while (this->records.size() > checkpoint.size) {
+            std::visit(fn{}, this->records.back());
+            this->records.pop_back();
+        }
+        this->close();
+    }
+
     /// <summary>
-    /// xを利用する式
+    /// <para>チェックポイント以降の書き換えを確定してチェックポイントを閉じる</para>
+    /// <para>外側のチェックポイントが開いている場合は外側で巻き戻せるように記録を残す</para>
     /// </summary>
-    std::shared_ptr<Expression> e2;
+    /// <param name="checkpoint">確定するチェックポイント</param>
+    void commit([[maybe_unused]] Checkpoint checkpoint) {
+        this->close();
+    }
 
-    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    ~Let() override {}
+    /// <summary>
+    /// <para>処理を投機的に実行する</para>
+    /// <para>型推論の異常で失敗した場合は処理による書き換えを巻き戻す</para>
+    /// <para>それ以外の例外でもチェックポイントを開いたままにしないように巻き戻してから再送出する</para>
+    /// </summary>
+    /// <param name="f">実行する処理</param>
+    /// <returns>成功した場合はtrue、失敗して巻き戻した場合はfalse</returns>
+    template <class F>
+    bool speculate(F&& f) {
+        auto checkpoint = this->checkpoint();
+        try {
+            std::forward<F>(f)();
+        }
+        catch (const std::runtime_error&) {
+            this->rollback(checkpoint);
+            return false;
+        }
+        catch (...) {
+            this->rollback(checkpoint);
+            throw;
+        }
+        this->commit(checkpoint);
+        return true;
+    }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// チェックポイントを閉じ、全て閉じた場合は記録を破棄する
     /// </summary>
-    /// <param name="env">型環境</param>
+    void close() {
+        assert(this->open > 0);
+        if (--this->open == 0) {
+            this->records.clear();
+        }
+    }
+};
+/// <summary>
+/// スレッドごとの単一化による書き換えの記録
+/// </summary>
+constinit thread_local Trail trail = {};
+
+/// <summary>
+/// <para>解決済みの型を取得する</para>
+/// <para>型変数の解決結果を代表元として辿り、経路上の型変数を全て代表元へ直接つなぎ替える</para>
+/// </summary>
+/// <param name="type">チェックを行う型</param>
+/// <returns>解決済みの型</returns>
+RefType solved(RefType type) {
+    InferenceStats::Probe probe(inferenceStats.solved);
+
+    // 代表元を探索する
+    auto root = type;
+    while (std::holds_alternative<Type::Variable>(root->kind)) {
+        auto& val = std::get<Type::Variable>(root->kind);
+        if (!val.solve) {
+            break;
+        }
+        root = val.solve;
+        probe.add(1);
+    }
+
+    // 解決結果が再適用されないように経路圧縮をしておく
+    while (type != root) {
+        auto& val = std::get<Type::Variable>(type->kind);
+        auto next = val.solve;
+        trail.assign(val.solve, root);
+        type = next;
+    }
+    return root;
+}
+
+/// <summary>
+/// <para>未解決の型変数同士を併合する</para>
+/// <para>ランクの低い方をランクの高い方につなぎ、代表元のスコープの深さは浅い方に合わせる</para>
+/// </summary>
+/// <param name="type1">代表元である型変数1</param>
+/// <param name="type2">代表元である型変数2</param>
+/// <returns>併合結果の代表元</returns>
+RefType unite(RefType type1, RefType type2) {
+    auto& v1 = std::get<Type::Variable>(type1->kind);
+    auto& v2 = std::get<Type::Variable>(type2->kind);
+    auto depth = std::min(v1.depth, v2.depth);
+
+    // ランクが等しい場合は型の循環が起きないように外のスコープのものを代表元とする
+    if (v1.rank > v2.rank || (v1.rank == v2.rank && v1.depth < v2.depth)) {
+        trail.assign(v2.solve, type1);
+        trail.assign(v1.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v1.rank, v1.rank + 1);
+        }
+        return type1;
+    }
+    else {
+        trail.assign(v1.solve, type2);
+        trail.assign(v2.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v2.rank, v2.rank + 1);
+        }
+        return type2;
+    }
+}
+
+/// <summary>
+/// <para>型のアリーナ</para>
+/// <para>型推論のセッション中に生成した型を全て所有し、セッションの終了時に一括で解放する</para>
+/// </summary>
+struct TypeArena {
+    /// <summary>
+    /// <para>生成した型の実体</para>
+    /// <para>チャンク単位で確保されて要素のアドレスが移動しないためstd::dequeで保持する</para>
+    /// </summary>
+    std::deque<Type> types = {};
+
+    /// <summary>
+    /// 関数型を共有するためのキー(引数型と戻り値型の組)
+    /// </summary>
+    using FunctionKey = std::array<const Type*, 2>;
+
+    /// <summary>
+    /// FunctionKeyのハッシュ関数
+    /// </summary>
+    struct FunctionKeyHash {
+        [[nodiscard]] std::size_t operator()(const FunctionKey& key) const noexcept {
+            std::size_t seed = 0;
+            for (auto p : key) {
+                seed ^= std::hash<const Type*>{}(p) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            }
+            return seed;
+        }
+    };
+
+    /// <summary>
+    /// <para>型名から生成済みの基底型への表</para>
+    /// <para>同名の基底型は同一の実体を共有する</para>
+    /// </summary>
+    std::unordered_map<Symbol, RefType> bases = {};
+
+    /// <summary>
+    /// <para>部分型の組から生成済みの型変数を含まない関数型への表</para>
+    /// <para>部分型がすべて共有済みの場合のみ登録するため、部分型のアドレスの比較のみで構造的に等しいかを判定できる</para>
+    /// </summary>
+    std::unordered_map<FunctionKey, RefType, FunctionKeyHash> functions = {};
+
+    /// <summary>
+    /// <para>このアリーナの型から参照する他のアリーナ</para>
+    /// <para>別の型環境で型推論した結果を取り込む際に、取り込んだ型の生成先のアリーナを生存させる</para>
+    /// </summary>
+    std::vector<std::shared_ptr<const TypeArena>> imports = {};
+
+    /// <summary>
+    /// <para>型の生成</para>
+    /// <para>型変数を含まない基底型と関数型は構造的に等しい型が生成済みであればそれを返す(hash-consing)</para>
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        if (std::holds_alternative<Type::Base>(kind)) {
+            // 同名の基底型が生成済みの場合はそれを共有する
+            auto& name = std::get<Type::Base>(kind).name;
+            if (auto itr = this->bases.find(name); itr != this->bases.end()) {
+                return itr->second;
+            }
+            auto type = this->emplace(std::move(kind));
+            this->bases.insert({ std::get<Type::Base>(type->kind).name, type });
+            return type;
+        }
+        else if (std::holds_alternative<Type::Function>(kind)) {
+            auto& x = std::get<Type::Function>(kind);
+            FunctionKey key = { x.paramType, x.returnType };
+            if (std::ranges::all_of(key, [this](const Type* p) { return this->interned(p); })) {
+                // 部分型がすべて共有済みの場合は関数型も共有する
+                auto [itr, inserted] = this->functions.try_emplace(key, nullptr);
+                if (inserted) {
+                    itr->second = this->emplace(std::move(kind));
+                }
+                return itr->second;
+            }
+        }
+        return this->emplace(std::move(kind));
+    }
+
+    /// <summary>
+    /// 型が共有された型であるかの判定
+    /// </summary>
+    /// <param name="type">判定対象の型</param>
+    /// <returns>typeが共有された型である場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool interned(const Type* type) const {
+        if (std::holds_alternative<Type::Base>(type->kind)) {
+            auto itr = this->bases.find(std::get<Type::Base>(type->kind).name);
+            return itr != this->bases.end() && itr->second == type;
+        }
+        else if (std::holds_alternative<Type::Function>(type->kind)) {
+            auto& x = std::get<Type::Function>(type->kind);
+            auto itr = this->functions.find({ x.paramType, x.returnType });
+            return itr != this->functions.end() && itr->second == type;
+        }
+        return false;
+    }
+
+    /// <summary>
+    /// 共有せずに型の実体を生成する
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType emplace(Type::kind_type&& kind) {
+        return std::addressof(this->types.emplace_back(Type{ .kind = std::move(kind) }));
+    }
+};
+
+struct TypeEnvironment;
+
+/// <summary>
+/// <para>識別子の束縛の表</para>
+/// <para>シンボルごとに束縛のスタックをもち、型環境の生成と破棄に合わせて束縛をpush/popすることでスコープの深さによらず識別子を解決する</para>
+/// </summary>
+struct BindingTable {
+    /// <summary>
+    /// 識別子の束縛
+    /// </summary>
+    struct Binding {
+        /// <summary>
+        /// 束縛を行った型環境
+        /// </summary>
+        const TypeEnvironment* env;
+
+        /// <summary>
+        /// 束縛された型
+        /// </summary>
+        std::variant<RefType, Generic> type;
+    };
+
+    /// <summary>
+    /// シンボルの識別番号ごとの束縛のスタック
+    /// </summary>
+    std::vector<std::vector<Binding>> stacks = {};
+
+    /// <summary>
+    /// <para>束縛を行った順のシンボルの列</para>
+    /// <para>型環境の破棄時にその型環境で行った束縛を巻き戻すために利用する</para>
+    /// </summary>
+    std::vector<Symbol> trail = {};
+
+    /// <summary>
+    /// シンボルに対応する束縛のスタックの取得
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する束縛のスタック</returns>
+    [[nodiscard]] std::vector<Binding>& stack(Symbol name) {
+        if (name.id >= this->stacks.size()) {
+            this->stacks.resize(name.id + 1);
+        }
+        return this->stacks[name.id];
+    }
+};
+
+/// <summary>
+/// 型環境
+/// </summary>
+struct TypeEnvironment {
+    /// <summary>
+    /// スコープにおいて1つ上の型環境
+    /// </summary>
+    TypeEnvironment* parent = nullptr;
+
+    /// <summary>
+    /// スコープの深さ
+    /// </summary>
+    std::size_t depth = 1;
+
+    /// <summary>
+    /// <para>型の生成先のアリーナの所有権</para>
+    /// <para>ルートの型環境のみが所有し、子の型環境はnullptrとする</para>
+    /// </summary>
+    std::shared_ptr<TypeArena> storage = std::make_shared<TypeArena>();
+
+    /// <summary>
+    /// <para>型の生成先のアリーナ</para>
+    /// <para>子の型環境は親の型環境と同一のアリーナを参照する(子の型環境は親の型環境より先に破棄されるため所有権はもたない)</para>
+    /// </summary>
+    TypeArena* arena = this->storage.get();
+
+    /// <summary>
+    /// <para>識別子の束縛の表</para>
+    /// <para>子の型環境は親の型環境と同一の表を共有する</para>
+    /// </summary>
+    std::shared_ptr<BindingTable> bindings = std::make_shared<BindingTable>();
+
+    /// <summary>
+    /// 型環境の生成時点での束縛の列の長さ(この型環境で行った束縛の開始位置)
+    /// </summary>
+    std::size_t mark = this->bindings->trail.size();
+
+    TypeEnvironment() = default;
+
+    /// <summary>
+    /// 独自のアリーナと束縛の表をもつ型環境を生成する
+    /// </summary>
+    /// <param name="parent">スコープにおいて1つ上の型環境</param>
+    /// <param name="depth">スコープの深さ</param>
+    TypeEnvironment(TypeEnvironment* parent, std::size_t depth) : parent(parent), depth(depth) {}
+    TypeEnvironment(const TypeEnvironment&) = delete;
+    TypeEnvironment(TypeEnvironment&&) = delete;
+    TypeEnvironment& operator=(const TypeEnvironment&) = delete;
+    TypeEnvironment& operator=(TypeEnvironment&&) = delete;
+    ~TypeEnvironment() {
+        // この型環境で行った束縛を巻き戻す
+        auto& trail = this->bindings->trail;
+        while (trail.size() > this->mark) {
+            this->bindings->stacks[trail.back().id].pop_back();
+            trail.pop_back();
+        }
+    }
+
+    /// <summary>
+    /// 子の型環境を生成する
+    /// </summary>
+    /// <param name="depth">子の型環境のスコープの深さ</param>
+    /// <returns>この型環境とアリーナと束縛の表を共有し、アリーナの所有権をもたない型環境</returns>
+    [[nodiscard]] TypeEnvironment child(std::size_t depth) {
+        return TypeEnvironment(this, depth, this->arena, this->bindings);
+    }
+
+    /// <summary>
+    /// <para>識別子に型を束縛する</para>
+    /// <para>この型環境で既に束縛済みの場合は上書きする</para>
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <param name="type">束縛する型</param>
+    void bind(Symbol name, std::variant<RefType, Generic> type) {
+        auto& stack = this->bindings->stack(name);
+        if (!stack.empty() && stack.back().env == this) {
+            stack.back().type = std::move(type);
+        }
+        else {
+            stack.push_back({ .env = this, .type = std::move(type) });
+            this->bindings->trail.push_back(name);
+        }
+    }
+
+    /// <summary>
+    /// 識別子がこの型環境で束縛されているかを判定する
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>この型環境で束縛されている場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool contains(Symbol name) const {
+        auto& stacks = this->bindings->stacks;
+        return name.id < stacks.size() && !stacks[name.id].empty() && stacks[name.id].back().env == this;
+    }
+
+    /// <summary>
+    /// 識別子のシンボルから型を取り出す
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する型</returns>
+    [[nodiscard]] std::optional<const std::variant<RefType, Generic>*> lookup(Symbol name) const {
+        InferenceStats::Probe probe(inferenceStats.lookup);
+        if (name.id < this->bindings->stacks.size()) {
+            auto& stack = this->bindings->stacks[name.id];
+            for (auto itr = stack.rbegin(); itr != stack.rend(); ++itr) {
+                probe.add(1);
+                // 生存中の子の型環境の束縛は参照しない
+                if (itr->env->depth <= this->depth) {
+                    // std::optionalは参照型は返せないのでポインタを返す
+                    return std::addressof(itr->type);
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// <summary>
+    /// 型の生成
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        return this->arena->newType(std::move(kind));
+    }
+
+    /// <summary>
+    /// 自由な型変数について型をgeneralizeする
+    /// </summary>
+    /// <param name="type">複製対象の型</param>
+    /// <param name="env">型環境</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type);
+
+    /// <summary>
+    /// ジェネリック型の型変数についてinstantiateする
+    /// </summary>
+    /// <param name="type">複製対象の型</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] RefType instantiate(const Generic& type);
+
+private:
+    /// <summary>
+    /// 子の型環境を生成する
+    /// </summary>
+    /// <param name="parent">スコープにおいて1つ上の型環境</param>
+    /// <param name="depth">スコープの深さ</param>
+    /// <param name="arena">親の型環境のアリーナ</param>
+    /// <param name="bindings">親の型環境の束縛の表</param>
+    TypeEnvironment(TypeEnvironment* parent, std::size_t depth, TypeArena* arena, std::shared_ptr<BindingTable> bindings)
+        : parent(parent), depth(depth), storage(nullptr), arena(arena), bindings(std::move(bindings)) {}
+};
+
+/// <summary>
+/// <para>型の走査の作業領域</para>
+/// <para>出現検査やgeneralizeごとにヒープを確保しないようにスレッドごとに使い回し、走査済みの型の集合は世代番号を進めることで全要素をO(1)で削除する</para>
+/// </summary>
+struct OccursBuffer {
+    /// <summary>
+    /// 走査済みの型の集合の要素
+    /// </summary>
+    struct Slot {
+        /// <summary>
+        /// 走査済みの型
+        /// </summary>
+        const Type* type = nullptr;
+        /// <summary>
+        /// 登録した世代番号(現在の世代番号と異なる場合は空とみなす)
+        /// </summary>
+        std::uint32_t epoch = 0;
+    };
+
+    /// <summary>
+    /// <para>走査済みの型の集合(開番地法のハッシュ表)</para>
+    /// <para>要素数は常に2の冪で、使用中の要素が半分を超えないように拡張する</para>
+    /// </summary>
+    std::vector<Slot> slots = {};
+
+    /// <summary>
+    /// 現在の世代番号
+    /// </summary>
+    std::uint32_t epoch = 0;
+
+    /// <summary>
+    /// 現在の世代の要素数
+    /// </summary>
+    std::size_t size = 0;
+
+    /// <summary>
+    /// 検査対象の型のスタック
+    /// </summary>
+    std::vector<RefType> stack = {};
+
+    /// <summary>
+    /// 走査済みの型の集合と検査対象の型のスタックを空にする
+    /// </summary>
+    void clear() {
+        this->stack.clear();
+        this->size = 0;
+        if (++this->epoch == 0) {
+            // 世代番号が一周した場合は古い世代の要素と区別できないため実際に削除する
+            std::ranges::fill(this->slots, Slot{});
+            this->epoch = 1;
+        }
+    }
+
+    /// <summary>
+    /// 走査済みの型を登録する
+    /// </summary>
+    /// <param name="type">登録する型</param>
+    /// <returns>新たに登録した場合はtrue、登録済みの場合はfalse</returns>
+    [[nodiscard]] bool insert(const Type* type) {
+        if ((this->size + 1) * 2 > this->slots.size()) {
+            // 現在の世代の要素のみを2倍の大きさの表に移す
+            std::vector<Slot> slots(std::max<std::size_t>(this->slots.size() * 2, 64));
+            std::swap(slots, this->slots);
+            for (const auto& slot : slots) {
+                if (slot.epoch == this->epoch) {
+                    *this->find(slot.type) = slot;
+                }
+            }
+        }
+        auto slot = this->find(type);
+        if (slot->epoch == this->epoch) {
+            return false;
+        }
+        *slot = { .type = type, .epoch = this->epoch };
+        ++this->size;
+        return true;
+    }
+
+private:
+    /// <summary>
+    /// 型が登録済みの要素もしくは登録先の空の要素を探索する
+    /// </summary>
+    /// <param name="type">探索する型</param>
+    /// <returns>探索結果の要素</returns>
+    [[nodiscard]] Slot* find(const Type* type) {
+        auto mask = this->slots.size() - 1;
+        // 型のアドレスは整列されていて下位のビットが偏るため乗算で攪拌する
+        auto hash = static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(type) >> 4) * 0x9e3779b97f4a7c15ull);
+        for (auto i = (hash ^ (hash >> 29)) & mask; ; i = (i + 1) & mask) {
+            auto& slot = this->slots[i];
+            if (slot.epoch != this->epoch || slot.type == type) {
+                return std::addressof(slot);
+            }
+        }
+    }
+};
+/// <summary>
+/// スレッドごとの出現検査の作業領域
+/// </summary>
+constinit thread_local OccursBuffer occursBuffer = {};
+/// <summary>
+/// スレッドごとのgeneralizeの作業領域
+/// </summary>
+constinit thread_local OccursBuffer generalizeBuffer = {};
+
+/// <summary>
+/// 自由な型変数について型をgeneralizeする
+/// </summary>
+/// <param name="type">複製対象の型</param>
+/// <param name="env">型環境</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type) {
+    InferenceStats::Probe probe(inferenceStats.generalize);
+    InferenceTrace::Span span("generalize", "generalize");
+    generalizeBuffer.clear();
+
+    // generalizeした対象の型変数のリスト
+    std::vector<RefType> vals;
+    std::unordered_map<RefType, typename std::vector<RefType>::size_type> map;
+
+    struct fn {
+        RefType& t;
+        TypeEnvironment& e;
+        std::vector<RefType>& v;
+        std::unordered_map<RefType, typename std::vector<RefType>::size_type>& m;
+        std::vector<RefType*>& s;
+        const RefType* r;
+
+        /// <summary>
+        /// <para>走査中の型の参照先を書き換える</para>
+        /// <para>型の節点の書き換えは巻き戻せるようにTrailに記録する(generalizeの対象の型自身は局所変数のため記録しない)</para>
+        /// </summary>
+        /// <param name="value">書き換え後の型</param>
+        void assign(RefType value) {
+            if (std::addressof(this->t) == this->r) {
+                this->t = value;
+            }
+            else {
+                trail.assign(this->t, value);
+            }
+        }
+
+        void operator()([[maybe_unused]] Type::Base& x) {
+            // generalizeしない
+        }
+        void operator()(Type::Function& x) {
+            if (this->e.arena->interned(this->t)) {
+                // 共有された関数型は型変数を含まないためgeneralizeしない
+                // 部分型の共有を木として展開して走査することになるため部分型も積まない
+                return;
+            }
+            if (!generalizeBuffer.insert(this->t)) {
+                // 走査済みの関数型は部分型の書き換えも済んでいるため再び走査しない
+                return;
+            }
+            // 引数型と戻り値型をgeneralizeする
+            // 引数型の型変数から順に番号を振るため戻り値型から積む
+            this->s.push_back(std::addressof(x.returnType));
+            this->s.push_back(std::addressof(x.paramType));
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
+                // この際にGeneric型から完全に型変数を除去するために簡約
+                this->assign(solved(x.solve));
+                this->s.push_back(std::addressof(this->t));
+                return;
+            }
+
+            if (this->e.depth < x.depth) {
+                // 自由な型変数のためgeneralizeする
+                if (auto itr = this->m.find(this->t); itr != this->m.end()) {
+                    this->assign(this->v[itr->second]);
+                }
+                else {
+                    this->m.insert({ this->t, this->v.size() });
+                    this->v.push_back(this->e.newType(Type::Param{ .index = this->v.size() }));
+                    this->assign(this->v.back());
+                }
+            }
+            // 束縛された型変数のためgeneralizeしない
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {
+            // 外のスコープから与えられた型変数のためgeneralizeしない
+            // 現状の実装ではこのシチュエーションは(おそらく)生じない
+        }
+    };
+
+    // generalizeの対象の型の参照先のスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<RefType*> stack = { std::addressof(type) };
+    while (!stack.empty()) {
+        auto& t = *stack.back();
+        stack.pop_back();
+        probe.add(1);
+        std::visit(fn{ .t = t, .e = *this, .v = vals, .m = map, .s = stack, .r = std::addressof(type) }, t->kind);
+    }
+
+    if (vals.size() > 0) {
+        return Generic{ .vals = std::move(vals), .type = std::move(type) };
+    }
+    else {
+        return type;
+    }
+}
+
+/// <summary>
+/// ジェネリック型の型変数についてinstantiateする
+/// </summary>
+/// <param name="type">複製対象の型</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] RefType TypeEnvironment::instantiate(const Generic& type) {
+    InferenceStats::Probe probe(inferenceStats.instantiate);
+
+    if (!type.spine) {
+        type.spine = GenericTemplate::build(type);
+    }
+
+    // instantiateした対象の型変数のリスト
+    std::vector<RefType> vals(type.vals.size());
+    // instantiateした骨格の節点のリスト
+    std::vector<RefType> nodes(type.spine->nodes.size());
+
+    auto get = [&](const GenericTemplate::Operand& operand) {
+        switch (operand.kind) {
+        case GenericTemplate::Operand::Kind::VAL:
+            if (!vals[operand.index]) {
+                // 型変数を割り当てていない場合は割り当てる
+                vals[operand.index] = this->newType(Type::Variable{ .depth = this->depth });
+            }
+            return vals[operand.index];
+        case GenericTemplate::Operand::Kind::NODE:
+            return nodes[operand.index];
+        default:
+            return operand.type;
+        }
+    };
+
+    // 後行順に並んでいるため子は常に生成済み
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        auto& node = type.spine->nodes[i];
+        nodes[i] = this->newType(Type::Function{ .paramType = get(node.paramType), .returnType = get(node.returnType) });
+    }
+    probe.add(nodes.size());
+    return get(type.spine->root);
+}
+
+/// <summary>
+/// <para>型変数targetがtypeに出現するかの判定(出現検査)</para>
+/// <para>検査と同時にtypeに出現する自由な型変数のスコープの深さをtargetの深さまで引き下げる</para>
+/// <para>共有された部分型は1度の検査につき1度のみ走査する</para>
+/// </summary>
+/// <param name="type">検査対象の型</param>
+/// <param name="target">出現を検査する型変数</param>
+/// <returns>typeにtargetが出現する場合にtrue、出現しない場合にfalse</returns>
+[[nodiscard]] bool occurs(RefType type, RefType target) {
+    InferenceStats::Probe probe(inferenceStats.occurs);
+
+    // 走査済みの型と検査対象の型のスタックはスレッドごとに使い回す
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    auto& visited = occursBuffer;
+    auto& stack = occursBuffer.stack;
+    visited.clear();
+    stack.push_back(type);
+
+    struct fn {
+        const std::size_t depth;
+        std::vector<RefType>& stack;
+
+        void operator()([[maybe_unused]] Type::Base& x) {}
+        void operator()(Type::Function& x) {
+            // 引数型から先に検査するため戻り値型から積む
+            this->stack.push_back(x.returnType);
+            this->stack.push_back(x.paramType);
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                this->stack.push_back(solved(x.solve));
+                return;
+            }
+            // targetより深いスコープでgeneralizeされないようにスコープの深さを引き下げる
+            trail.assign(x.depth, std::min(x.depth, this->depth));
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {}
+    };
+
+    const auto depth = std::get<Type::Variable>(target->kind).depth;
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (t == target) {
+            return true;
+        }
+        if (!visited.insert(t)) {
+            // 走査済みの部分型は再度検査しない
+            continue;
+        }
+        probe.add(1);
+        std::visit(fn{ .depth = depth, .stack = stack }, t->kind);
+    }
+    return false;
+}
+
+
+/// <summary>
+/// 副作用付きの2つの型の単一化
+/// </summary>
+/// <param name="type1">単一化の対象の型1</param>
+/// <param name="type2">単一化の対象の型2</param>
+void unify(RefType type1, RefType type2) {
+    InferenceStats::Probe probe(inferenceStats.unify);
+    InferenceTrace::Span span("unify", "unify");
+
+    // 単一化の対象の型のペアのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<std::pair<RefType, RefType>> stack = { { type1, type2 } };
+
+    while (!stack.empty()) {
+        // 解決済みの型変数が存在すればそれを適用してから単一化を行う
+        auto t1 = solved(stack.back().first);
+        auto t2 = solved(stack.back().second);
+        stack.pop_back();
+        probe.add(1);
+
+        if (t1 != t2) {
+            if (std::holds_alternative<Type::Variable>(t1->kind)) {
+                auto& t1v = std::get<Type::Variable>(t1->kind);
+
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    // 型変数同士の場合は併合する
+                    unite(t1, t2);
+                }
+                else {
+                    if (occurs(t2, t1)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    trail.assign(t1v.solve, t2);
+                }
+            }
+            else {
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    auto& t2v = std::get<Type::Variable>(t2->kind);
+                    if (occurs(t1, t2)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    trail.assign(t2v.solve, t1);
+                }
+                else {
+                    // 型が一致する場合に部分型について単一化
+                    // 制約付きの場合は「C ⊨ type1 ∼ type2」のような同値の条件によりキャストを行うが未実装
+                    if (t1->kind.index() == t2->kind.index()) {
+                        if (std::holds_alternative<Type::Function>(t1->kind)) {
+                            auto& k1 = std::get<Type::Function>(t1->kind);
+                            auto& k2 = std::get<Type::Function>(t2->kind);
+                            // 引数型から先に単一化するため戻り値型から積む
+                            stack.push_back({ k1.returnType, k2.returnType });
+                            stack.push_back({ k1.paramType, k2.paramType });
+                        }
+                        else {
+                            // 部分型をもたないため型は一致しない
+                            throw std::runtime_error("型の不一致");
+                        }
+                    }
+                    else {
+                        // 型の種類が一致しない
+                        throw std::runtime_error("型の不一致");
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// <para>2つの型が構造的に等しいか判定する</para>
+/// <para>解決済みの型変数は解決結果で、ジェネリック型の型変数はインデックスで、未解決の型変数は同一性で比較する</para>
+/// </summary>
+/// <param name="type1">判定対象の型1</param>
+/// <param name="type2">判定対象の型2</param>
+/// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+[[nodiscard]] bool equivalent(RefType type1, RefType type2) {
+    std::vector<std::pair<RefType, RefType>> stack = { { type1, type2 } };
+    // 共有された部分型は同じ組み合わせでは1度のみ比較する
+    std::unordered_map<const Type*, const Type*> visited;
+    while (!stack.empty()) {
+        auto t1 = solved(stack.back().first);
+        auto t2 = solved(stack.back().second);
+        stack.pop_back();
+        if (t1 == t2) {
+            continue;
+        }
+        if (auto [itr, inserted] = visited.insert({ t1, t2 }); !inserted && itr->second == t2) {
+            continue;
+        }
+        if (t1->kind.index() != t2->kind.index()) {
+            return false;
+        }
+        if (std::holds_alternative<Type::Base>(t1->kind)) {
+            if (std::get<Type::Base>(t1->kind).name != std::get<Type::Base>(t2->kind).name) {
+                return false;
+            }
+        }
+        else if (std::holds_alternative<Type::Function>(t1->kind)) {
+            auto& k1 = std::get<Type::Function>(t1->kind);
+            auto& k2 = std::get<Type::Function>(t2->kind);
+            stack.push_back({ k1.returnType, k2.returnType });
+            stack.push_back({ k1.paramType, k2.paramType });
+        }
+        else if (std::holds_alternative<Type::Param>(t1->kind)) {
+            if (std::get<Type::Param>(t1->kind).index != std::get<Type::Param>(t2->kind).index) {
+                return false;
+            }
+        }
+        else {
+            // 異なる未解決の型変数
+            return false;
+        }
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>型の構造のハッシュ値</para>
+/// <para>equivalentで等しい型は等しいハッシュ値となる(未解決の型変数は区別しない)</para>
+/// </summary>
+/// <param name="type">対象の型</param>
+/// <returns>ハッシュ値</returns>
+[[nodiscard]] std::size_t structuralHash(RefType type) {
+    auto combine = [](std::size_t seed, std::size_t value) {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    };
+    // 計算済みの部分型のハッシュ値(共有された部分型は1度のみ計算する)
+    std::unordered_map<const Type*, std::size_t> memo;
+
+    // 対象の部分型と部分型を展開済みであるかのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+    std::vector<std::pair<RefType, bool>> stack = { { solved(type), false } };
+    while (!stack.empty()) {
+        auto [t, expanded] = stack.back();
+        if (memo.contains(t)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!expanded) {
+            stack.back().second = true;
+            if (std::holds_alternative<Type::Function>(t->kind)) {
+                auto& x = std::get<Type::Function>(t->kind);
+                stack.push_back({ solved(x.returnType), false });
+                stack.push_back({ solved(x.paramType), false });
+            }
+            continue;
+        }
+        stack.pop_back();
+        std::size_t hash = combine(0, t->kind.index());
+        if (std::holds_alternative<Type::Base>(t->kind)) {
+            hash = combine(hash, std::hash<Symbol>{}(std::get<Type::Base>(t->kind).name));
+        }
+        else if (std::holds_alternative<Type::Function>(t->kind)) {
+            auto& x = std::get<Type::Function>(t->kind);
+            hash = combine(combine(hash, memo.at(solved(x.paramType))), memo.at(solved(x.returnType)));
+        }
+        else if (std::holds_alternative<Type::Param>(t->kind)) {
+            hash = combine(hash, std::get<Type::Param>(t->kind).index);
+        }
+        memo.insert({ t, hash });
+    }
+    return memo.at(solved(type));
+}
+
+struct Expression;
+
+/// <summary>
+/// <para>識別子への束縛</para>
+/// <para>モジュールのトップレベルの束縛とlet束縛の連鎖の各束縛を示す</para>
+/// </summary>
+struct Definition {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+    /// <summary>
+    /// <para>Letrec束縛であるか</para>
+    /// <para>Let束縛の場合はeに出現するxは外側の束縛を参照する</para>
+    /// </summary>
+    bool recursive = false;
+};
+
+/// <summary>
+/// 式を示す構文木
+/// </summary>
+struct Expression {
+    virtual ~Expression() {};
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    virtual RefType J(TypeEnvironment& env) = 0;
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    virtual void M(TypeEnvironment& env, RefType rho) = 0;
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    virtual void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const = 0;
+
+    /// <summary>
+    /// <para>構文木の構造のハッシュ値</para>
+    /// <para>識別子は名前で、定数は型の構造で区別する</para>
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] virtual std::size_t hash() const = 0;
+
+    /// <summary>
+    /// <para>構文木が構造的に等しいか判定する</para>
+    /// <para>hashと同じく識別子は名前で、定数は型の構造で区別する</para>
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] virtual bool equals(const Expression& other) const = 0;
+
+    /// <summary>
+    /// let束縛であれば束縛とxを利用する式に分解する
+    /// </summary>
+    /// <param name="def">束縛の出力先</param>
+    /// <returns>xを利用する式(let束縛でない場合はnullptr)</returns>
+    [[nodiscard]] virtual std::shared_ptr<Expression> unfold([[maybe_unused]] Definition& def) const {
+        return nullptr;
+    }
+
+    /// <summary>
+    /// ハッシュ値を合成する
+    /// </summary>
+    /// <param name="seed">合成先のハッシュ値</param>
+    /// <param name="value">合成するハッシュ値</param>
+    /// <returns>合成結果のハッシュ値</returns>
+    [[nodiscard]] static std::size_t combine(std::size_t seed, std::size_t value) {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+};
+
+/// <summary>
+/// 定数を示す構文木(簡単のために値はもたない)
+/// </summary>
+struct Constant : Expression {
+    /// <summary>
+    /// 定数の型
+    /// </summary>
+    RefType b;
+
+    Constant(RefType b) : b(b) {}
+    ~Constant() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefType J([[maybe_unused]] TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Constant");
+
+        return this->b;
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Constant");
+
+        unify(rho, this->b);
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables([[maybe_unused]] std::vector<Symbol>& bound, [[maybe_unused]] std::vector<Symbol>& out) const override {}
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(1, structuralHash(this->b));
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Constant*>(std::addressof(other));
+        return x && equivalent(this->b, x->b);
+    }
+};
+
+/// <summary>
+/// 識別子を示す構文木
+/// </summary>
+struct Identifier : Expression {
+    /// <summary>
+    /// 識別子名
+    /// </summary>
+    Symbol x;
+
+    Identifier(std::string_view x) : x(x) {}
+    ~Identifier() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefType J(TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Identifier", this->x);
+
+        struct fn {
+            TypeEnvironment& e;
+
+            RefType operator()(const RefType& x) {
+                return x;
+            }
+            RefType operator()(const Generic& x) {
+                // 多相のためにinstantiateする(単相の場合は不要)
+                return this->e.instantiate(x);
+            }
+        };
+
+        // 型環境から型を取り出す
+        auto tau = env.lookup(this->x);
+        if (tau) {
+            return std::visit(fn{ .e = env }, *tau.value());
+        }
+        throw std::runtime_error(std::format("不明な識別子：{}", this->x.name()));
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Identifier", this->x);
+
+        struct fn {
+            TypeEnvironment& e;
+
+            RefType operator()(const RefType& x) {
+                return x;
+            }
+            RefType operator()(const Generic& x) {
+                // 多相のためにinstantiateする(単相の場合は不要)
+                return this->e.instantiate(x);
+            }
+        };
+
+        // 型環境から型を取り出す
+        auto tau = env.lookup(this->x);
+
+        if (tau) {
+            unify(rho, std::visit(fn{ .e = env }, *tau.value()));
+        }
+        else {
+            throw std::runtime_error(std::format("不明な識別子：{}", this->x.name()));
+        }
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const override {
+        if (std::find(bound.rbegin(), bound.rend(), this->x) == bound.rend()) {
+            out.push_back(this->x);
+        }
+    }
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(2, std::hash<Symbol>{}(this->x));
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Identifier*>(std::addressof(other));
+        return x && this->x == x->x;
+    }
+};
+
+/// <summary>
+/// ラムダ抽象を示す構文木
+/// </summary>
+struct Lambda : Expression {
+    /// <summary>
+    /// 引数名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 関数本体の式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+
+    Lambda(std::string_view x, std::shared_ptr<Expression> e) : x(x), e(e) {}
+    ~Lambda() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefType J(TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Lambda", this->x);
+
+        // 型環境を新しく構成
+        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
+        TypeEnvironment newEnv = env.child(env.depth + 1);
+
+        // 型環境にxを登録してeを評価
+        auto t = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
+        newEnv.bind(this->x, t);
+        auto tau = this->e->J(newEnv);
+
+        return env.newType(Type::Function{ .paramType = t, .returnType = tau });
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Lambda", this->x);
+
+        // 型環境を新しく構成
+        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
+        TypeEnvironment newEnv = env.child(env.depth + 1);
+
+        auto t1 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
+        auto t2 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
+        unify(rho, env.newType(Type::Function{ .paramType = t1, .returnType = t2 }));
+
+        // 型環境にxを登録してeを評価
+        newEnv.bind(this->x, t1);
+        this->e->M(newEnv, t2);
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const override {
+        bound.push_back(this->x);
+        this->e->freeVariables(bound, out);
+        bound.pop_back();
+    }
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(Expression::combine(3, std::hash<Symbol>{}(this->x)), this->e->hash());
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Lambda*>(std::addressof(other));
+        return x && this->x == x->x && this->e->equals(*x->e);
+    }
+};
+
+/// <summary>
+/// 関数適用を示す構文木
+/// </summary>
+struct Apply : Expression {
+    /// <summary>
+    /// 関数を示す式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// 引数の式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), e2(e2) {}
+    ~Apply() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefType J(TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Apply");
+
+        auto tau1 = this->e1->J(env);
+        auto tau2 = this->e2->J(env);
+        auto t = env.newType(Type::Variable{ .depth = env.depth });
+
+        // 制約付きの場合は適用可能かの検査等を行うが未実装
+        unify(tau1, env.newType(Type::Function{ .paramType = tau2, .returnType = t }));
+
+        return t;
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Apply");
+
+        auto t = env.newType(Type::Variable{ .depth = env.depth });
+
+        this->e1->M(env, env.newType(Type::Function{ .paramType = t, .returnType = rho }));
+        this->e2->M(env, t);
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const override {
+        this->e1->freeVariables(bound, out);
+        this->e2->freeVariables(bound, out);
+    }
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(Expression::combine(4, this->e1->hash()), this->e2->hash());
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Apply*>(std::addressof(other));
+        return x && this->e1->equals(*x->e1) && this->e2->equals(*x->e2);
+    }
+};
+
+/// <summary>
+/// Let束縛を示す構文木
+/// </summary>
+struct Let : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    ~Let() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefType J(TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Let", this->x);
+
+        auto tau1 = this->e1->J(env);
+        // xが定義済みであっても型環境の改装を無視して上書きする
+        // グローバルな型環境の場合は異常にする等があるかもしれない
+        env.bind(this->x, env.generalize(tau1));
+
+        return this->e2->J(env);
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Let", this->x);
+
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t = env.newType(Type::Variable{ .depth = env.depth + 1 });
+
+        this->e1->M(env, t);
+
+        // xが定義済みであっても型環境の改装を無視して上書きする
+        // グローバルな型環境の場合は異常にする等があるかもしれない
+        env.bind(this->x, env.generalize(t));
+        this->e2->M(env, rho);
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const override {
+        this->e1->freeVariables(bound, out);
+        bound.push_back(this->x);
+        this->e2->freeVariables(bound, out);
+        bound.pop_back();
+    }
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(Expression::combine(Expression::combine(5, std::hash<Symbol>{}(this->x)), this->e1->hash()), this->e2->hash());
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Let*>(std::addressof(other));
+        return x && this->x == x->x && this->e1->equals(*x->e1) && this->e2->equals(*x->e2);
+    }
+
+    /// <summary>
+    /// let束縛であれば束縛とxを利用する式に分解する
+    /// </summary>
+    /// <param name="def">束縛の出力先</param>
+    /// <returns>xを利用する式</returns>
+    [[nodiscard]] std::shared_ptr<Expression> unfold(Definition& def) const override {
+        def = Definition{ .x = this->x, .e = this->e1, .recursive = false };
+        return this->e2;
+    }
+};
+
+/// <summary>
+/// Letrec束縛を示す構文木
+/// </summary>
+struct Letrec : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    ~Letrec() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
     /// <returns>評価結果の型</returns>
     RefType J(TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Letrec", this->x);
+
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t = env.newType(Type::Variable{ .depth = env.depth + 1 });
+        // xが定義済みであっても型環境の改装を無視して上書きする
+        // グローバルな型環境の場合は異常にする等があるかもしれない
+        env.bind(this->x, t);
+
         auto tau1 = this->e1->J(env);
+        unify(tau1, t);
+
+        env.bind(this->x, env.generalize(tau1));
+
+        return this->e2->J(env);
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, RefType rho) override {
+        InferenceTrace::Span span("M", "Letrec", this->x);
+
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t1 = env.newType(Type::Variable{ .depth = env.depth + 1 });
+        auto t2 = env.newType(Type::Variable{ .depth = env.depth + 1 });
         // xが定義済みであっても型環境の改装を無視して上書きする
         // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, env.generalize(tau1));
+        env.bind(this->x, t1);
+
+        this->e1->M(env, t2);
+        unify(t1, t2);
+
+        env.bind(this->x, env.generalize(t1));
+        this->e2->M(env, rho);
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(std::vector<Symbol>& bound, std::vector<Symbol>& out) const override {
+        bound.push_back(this->x);
+        this->e1->freeVariables(bound, out);
+        this->e2->freeVariables(bound, out);
+        bound.pop_back();
+    }
+
+    /// <summary>
+    /// 構文木の構造のハッシュ値
+    /// </summary>
+    /// <returns>ハッシュ値</returns>
+    [[nodiscard]] std::size_t hash() const override {
+        return Expression::combine(Expression::combine(Expression::combine(6, std::hash<Symbol>{}(this->x)), this->e1->hash()), this->e2->hash());
+    }
+
+    /// <summary>
+    /// 構文木が構造的に等しいか判定する
+    /// </summary>
+    /// <param name="other">比較対象の構文木</param>
+    /// <returns>構造的に等しい場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] bool equals(const Expression& other) const override {
+        auto x = dynamic_cast<const Letrec*>(std::addressof(other));
+        return x && this->x == x->x && this->e1->equals(*x->e1) && this->e2->equals(*x->e2);
+    }
+
+    /// <summary>
+    /// let束縛であれば束縛とxを利用する式に分解する
+    /// </summary>
+    /// <param name="def">束縛の出力先</param>
+    /// <returns>xを利用する式</returns>
+    [[nodiscard]] std::shared_ptr<Expression> unfold(Definition& def) const override {
+        def = Definition{ .x = this->x, .e = this->e1, .recursive = true };
+        return this->e2;
+    }
+};
+
+/// <summary>
+/// RefTypeの標準出力
+/// </summary>
+/// <param name="os">出力ストリーム</param>
+/// <param name="type">出力対象の型</param>
+/// <returns></returns>
+std::ostream& operator<<(std::ostream& os, RefType type) {
+    struct fn {
+        std::ostream& o;
+        char varCnt = 'a';
+        std::unordered_map<const Type::Variable*, char> varmap = {};
+
+        void operator()(const Type::Base& x) {
+            this->o << x.name.name();
+        }
+        void operator()(const Type::Function& x) {
+            // 括弧付きで出力するかを判定
+            bool isSimple = std::holds_alternative<Type::Base>(x.paramType->kind) ||
+                std::holds_alternative<Type::Variable>(x.paramType->kind) ||
+                std::holds_alternative<Type::Param>(x.paramType->kind);
+            if (isSimple) {
+                std::visit(*this, x.paramType->kind);
+            }
+            else {
+                this->o << "(";
+                std::visit(*this, x.paramType->kind);
+                this->o << ")";
+            }
+            this->o << " -> ";
+            std::visit(*this, x.returnType->kind);
+        }
+        void operator()(const Type::Variable& x) {
+            if (x.solve) {
+                // 解決済みの型変数の場合は解決結果の型に対して出力
+                std::visit(*this, solved(x.solve)->kind);
+            }
+            else {
+                // 雑に[a, z]の範囲で型変数を出力
+                // zを超えたら全て「_」で出力
+                if (auto itr = this->varmap.find(std::addressof(x)); itr != this->varmap.end()) {
+                    this->o << '?' << itr->second;
+                }
+                else {
+                    this->varmap.insert({ std::addressof(x), this->varCnt });
+                    this->o << '?' << this->varCnt;
+                    switch (this->varCnt) {
+                    case 'z':
+                        this->varCnt = '_';
+                        break;
+                    case '_':
+                        break;
+                    default:
+                        ++this->varCnt;
+                        break;
+                    }
+                }
+            }
+        }
+        void operator()(const Type::Param& x) {
+            // 雑に[a, z]の範囲で型変数を出力
+            // zを超えたら全て「_」で出力
+            std::size_t c = 'a' + x.index;
+            this->o << '\'' << static_cast<char>(c <= 'z' ? c : '_');
+        }
+    };
+    std::visit(fn{ .o = os }, type->kind);
 
-        return this->e2->J(env);
+    return os;
+}
+
+// 雑に型を短く書くための関数
+RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = Symbol(name) }); }
+RefType var(TypeEnvironment& env) { return env.newType(Type::Variable{ .depth = env.depth + 1 }); }
+RefType fun(TypeEnvironment& env, RefType paramType, RefType returnType) { return env.newType(Type::Function{ .paramType = paramType, .returnType = returnType }); }
+
+// 雑に構文を短く書くための関数
+std::shared_ptr<Expression> c(RefType type) { return std::shared_ptr<Expression>(new Constant(type)); }
+std::shared_ptr<Expression> id(const std::string& name) { return std::shared_ptr<Expression>(new Identifier(name)); }
+std::shared_ptr<Expression> lambda(const std::string& name, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, expr)); }
+std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Apply(expr1, expr2)); }
+template <class Head, class... Tail>
+std::shared_ptr<Expression> apply(Head&& head1, Head&& head2, Tail&&... tail) { return apply(std::shared_ptr<Expression>(new Apply(head1, head2)), std::forward<Tail>(tail)...); }
+std::shared_ptr<Expression> let(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, expr1, expr2)); }
+std::shared_ptr<Expression> letrec(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, expr1, expr2)); }
+
+/// <summary>
+/// <para>トップレベルの束縛の列からなるモジュール</para>
+/// <para>束縛間の依存関係の強連結成分ごとに型推論し、互いに独立な強連結成分は並列に型推論する</para>
+/// <para>束縛の順序は問わず、モジュール内の識別子は重複しないものとする</para>
+/// <para>各強連結成分はLetrec束縛と同じく1段深いスコープで型推論して強連結成分内で生成した型変数を全てgeneralizeするため、let束縛の連鎖とは異なり関数適用の結果の型変数もgeneralizeする</para>
+/// <para>例えばf = id idはlet束縛の連鎖では単相な型となり後続の束縛が型変数を解決するが、モジュールでは'a -> 'aとなる(並列に型推論する強連結成分間で未解決の型変数を共有しないため)</para>
+/// </summary>
+struct Module {
+    /// <summary>
+    /// トップレベルの束縛のリスト
+    /// </summary>
+    std::vector<Definition> definitions = {};
+
+    /// <summary>
+    /// 束縛ごとに参照する識別子を求める
+    /// </summary>
+    /// <returns>束縛ごとの自由な識別子のリスト(重複なし)</returns>
+    [[nodiscard]] std::vector<std::vector<Symbol>> freeVariables() const {
+        std::vector<std::vector<Symbol>> result(this->definitions.size());
+        std::vector<Symbol> bound;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            auto& def = this->definitions[i];
+            if (def.recursive) {
+                bound.push_back(def.x);
+            }
+            def.e->freeVariables(bound, result[i]);
+            bound.clear();
+            std::sort(result[i].begin(), result[i].end(), [](Symbol a, Symbol b) { return a.id < b.id; });
+            result[i].erase(std::unique(result[i].begin(), result[i].end()), result[i].end());
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// <para>有向グラフの強連結成分を求める(Tarjanのアルゴリズム)</para>
+    /// <para>深いグラフでもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで走査する</para>
+    /// </summary>
+    /// <param name="graph">頂点ごとの辺の行き先のリスト</param>
+    /// <returns>強連結成分のリスト(辺の行き先の成分が先に並ぶ順序)</returns>
+    [[nodiscard]] static std::vector<std::vector<std::size_t>> components(const std::vector<std::vector<std::size_t>>& graph) {
+        constexpr auto unvisited = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> order(graph.size(), unvisited);
+        std::vector<std::size_t> low(graph.size(), 0);
+        std::vector<bool> onStack(graph.size(), false);
+        std::vector<std::size_t> stack;
+        std::vector<std::vector<std::size_t>> result;
+        std::size_t counter = 0;
+
+        // 走査中の頂点と次に辿る辺の番号の組のスタック
+        std::vector<std::pair<std::size_t, std::size_t>> frames;
+        for (std::size_t root = 0; root < graph.size(); ++root) {
+            if (order[root] != unvisited) {
+                continue;
+            }
+            frames.push_back({ root, 0 });
+            while (!frames.empty()) {
+                auto& [v, edge] = frames.back();
+                if (edge == 0) {
+                    order[v] = low[v] = counter++;
+                    stack.push_back(v);
+                    onStack[v] = true;
+                }
+                if (edge < graph[v].size()) {
+                    auto w = graph[v][edge++];
+                    if (order[w] == unvisited) {
+                        frames.push_back({ w, 0 });
+                    }
+                    else if (onStack[w]) {
+                        low[v] = std::min(low[v], order[w]);
+                    }
+                    continue;
+                }
+
+                // vを根とする強連結成分を取り出す
+                if (low[v] == order[v]) {
+                    auto& component = result.emplace_back();
+                    std::size_t w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        onStack[w] = false;
+                        component.push_back(w);
+                    } while (w != v);
+                }
+                auto done = v;
+                frames.pop_back();
+                if (!frames.empty()) {
+                    auto parent = frames.back().first;
+                    low[parent] = std::min(low[parent], low[done]);
+                }
+            }
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// <para>モジュールの外の束縛の型を型変数を含まない型としてアリーナへ取り込む</para>
+    /// <para>解決済みの型変数を経由する部分型のみを解決結果で置き換えて複製し、型変数を含まない部分型は書き換えられないためそのまま共有する</para>
+    /// <para>取り込んだ型は書き換えられる型変数を含まないため、複数のスレッドの型推論からロックなしで参照できる</para>
+    /// </summary>
+    /// <param name="arena">複製先のアリーナ</param>
+    /// <param name="binding">複製対象の束縛の型</param>
+    /// <returns>複製結果(未解決の型変数を含む場合はstd::nullopt)</returns>
+    [[nodiscard]] static std::optional<std::variant<RefType, Generic>> isolate(TypeArena& arena, const std::variant<RefType, Generic>& binding) {
+        auto generic = std::get_if<Generic>(std::addressof(binding));
+        auto type = generic ? generic->type : std::get<RefType>(binding);
+        // 複製済みの部分型(共有された部分型は1度のみ複製する)
+        std::unordered_map<const Type*, RefType> memo;
+
+        struct fn {
+            RefType t;
+            TypeArena& a;
+            std::unordered_map<const Type*, RefType>& m;
+
+            RefType operator()([[maybe_unused]] const Type::Base& x) {
+                // 基底型は同名で同一の実体を共有するため複製しない
+                return this->t;
+            }
+            RefType operator()(const Type::Function& x) {
+                auto paramType = this->m.at(x.paramType);
+                auto returnType = this->m.at(x.returnType);
+                if (paramType == x.paramType && returnType == x.returnType) {
+                    // 型変数を経由しない場合は書き換えられないため共有する
+                    return this->t;
+                }
+                return this->a.newType(Type::Function{ .paramType = paramType, .returnType = returnType });
+            }
+            RefType operator()(const Type::Variable& x) {
+                // 解決済みの型変数は解決結果に置き換える
+                return this->m.at(x.solve);
+            }
+            RefType operator()([[maybe_unused]] const Type::Param& x) {
+                return this->t;
+            }
+        };
+
+        // 複製対象の部分型と部分型を展開済みであるかのスタック
+        // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+        std::vector<std::pair<RefType, bool>> stack = { { type, false } };
+        while (!stack.empty()) {
+            auto [t, expanded] = stack.back();
+            if (memo.contains(t)) {
+                stack.pop_back();
+                continue;
+            }
+            if (!expanded) {
+                stack.back().second = true;
+                if (auto x = std::get_if<Type::Function>(std::addressof(t->kind))) {
+                    stack.push_back({ x->returnType, false });
+                    stack.push_back({ x->paramType, false });
+                }
+                else if (auto x = std::get_if<Type::Variable>(std::addressof(t->kind))) {
+                    if (!x->solve) {
+                        // 未解決の型変数は他の型推論と解決結果を共有する必要があるため複製できない
+                        return std::nullopt;
+                    }
+                    stack.push_back({ x->solve, false });
+                }
+                continue;
+            }
+            stack.pop_back();
+            memo.insert({ t, std::visit(fn{ .t = t, .a = arena, .m = memo }, t->kind) });
+        }
+
+        if (!generic) {
+            return memo.at(type);
+        }
+        Generic result = { .vals = generic->vals, .type = memo.at(type), .spine = nullptr };
+        // 他のスレッドから並行してinstantiateされるため雛形は事前に構築しておく
+        result.spine = GenericTemplate::build(result);
+        return result;
+    }
+
+    /// <summary>
+    /// <para>モジュールの型推論</para>
+    /// <para>強連結成分ごとに独自の型環境とアリーナを用意して型推論し、結果をトポロジカル順にenvへ束縛する</para>
+    /// <para>強連結成分内の束縛は相互再帰として扱い、強連結成分内で生成した型変数は全てgeneralizeする</para>
+    /// </summary>
+    /// <param name="env">モジュールの外の束縛をもつ型環境</param>
+    /// <param name="concurrency">並列に型推論するスレッド数</param>
+    void infer(TypeEnvironment& env, std::size_t concurrency = std::thread::hardware_concurrency()) const {
+        // 束縛間の依存グラフを構築して強連結成分に分解する
+        std::unordered_map<Symbol, std::size_t> index;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            if (!index.insert({ this->definitions[i].x, i }).second) {
+                throw std::runtime_error(std::format("モジュール内での再定義：{}", this->definitions[i].x.name()));
+            }
+        }
+        auto fvs = this->freeVariables();
+        std::vector<std::vector<std::size_t>> graph(this->definitions.size());
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            for (auto x : fvs[i]) {
+                if (auto itr = index.find(x); itr != index.end() && (itr->second != i || this->definitions[i].recursive)) {
+                    graph[i].push_back(itr->second);
+                }
+            }
+        }
+        auto components = Module::components(graph);
+
+        // 強連結成分間の依存関係
+        std::vector<std::size_t> componentOf(this->definitions.size());
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            for (auto i : components[c]) {
+                componentOf[i] = c;
+            }
+        }
+        std::vector<std::size_t> pending(components.size(), 0);
+        std::vector<std::vector<std::size_t>> dependents(components.size());
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            std::unordered_set<std::size_t> dependencies;
+            for (auto i : components[c]) {
+                for (auto j : graph[i]) {
+                    if (componentOf[j] != c && dependencies.insert(componentOf[j]).second) {
+                        dependents[componentOf[j]].push_back(c);
+                        ++pending[c];
+                    }
+                }
+            }
+        }
+
+        // 強連結成分ごとの型推論の結果
+        std::vector<std::variant<RefType, Generic>> results(this->definitions.size());
+        std::vector<std::shared_ptr<TypeArena>> arenas(components.size());
+
+        // 参照するモジュールの外の束縛
+        std::unordered_map<Symbol, std::variant<RefType, Generic>> imports;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            for (auto x : fvs[i]) {
+                auto itr = index.find(x);
+                if ((itr == index.end() || (itr->second == i && !this->definitions[i].recursive)) && !imports.contains(x)) {
+                    if (auto tau = env.lookup(x)) {
+                        imports.insert({ x, *tau.value() });
+                    }
+                }
+            }
+        }
+
+        // 強連結成分の型推論
+        // 他の強連結成分の結果は読み取りのみ行い、型の生成と束縛は独自のアリーナと型環境でのみ行う
+        auto inferComponent = [&](std::size_t c) {
+            auto& component = components[c];
+            TypeEnvironment root(std::addressof(env), env.depth);
+
+            // 参照する識別子をモジュール内の結果もしくはenvから束縛する
+            for (auto i : component) {
+                for (auto x : fvs[i]) {
+                    if (root.contains(x)) {
+                        continue;
+                    }
+                    if (auto itr = index.find(x); itr != index.end() && componentOf[itr->second] != c) {
+                        root.bind(x, results[itr->second]);
+                    }
+                    else if (auto found = imports.find(x); found != imports.end() && (itr == index.end() || itr->second == i)) {
+                        root.bind(x, found->second);
+                    }
+                }
+            }
+
+            // 強連結成分内の束縛は1段深いスコープで型推論してrootでgeneralizeする
+            // 関数適用の結果の型変数もscopeの深さとなるため、非再帰の束縛であってもLet::Jと異なりgeneralizeされる
+            TypeEnvironment scope = root.child(root.depth + 1);
+            auto recursive = component.size() > 1 || this->definitions[component.front()].recursive;
+            std::vector<RefType> types;
+            for (auto i : component) {
+                types.push_back(scope.newType(Type::Variable{ .depth = scope.depth }));
+                if (recursive) {
+                    scope.bind(this->definitions[i].x, types.back());
+                }
+            }
+            for (std::size_t k = 0; k < component.size(); ++k) {
+                unify(this->definitions[component[k]].e->J(scope), types[k]);
+            }
+            for (std::size_t k = 0; k < component.size(); ++k) {
+                auto& result = results[component[k]];
+                result = root.generalize(types[k]);
+                if (std::holds_alternative<Generic>(result)) {
+                    // 他のスレッドから並行してinstantiateされるため雛形は事前に構築しておく
+                    auto& generic = std::get<Generic>(result);
+                    generic.spine = GenericTemplate::build(generic);
+                }
+            }
+            arenas[c] = root.storage;
+        };
+
+        // モジュールの外の型はenvのアリーナの型を書き換えないように複製を参照する
+        // 未解決の型変数を含む束縛がある場合はその解決をスレッド間で共有することになるため並列化しない
+        auto imported = std::make_shared<TypeArena>();
+        if (concurrency > 1) {
+            for (auto& [x, tau] : imports) {
+                auto copy = Module::isolate(*imported, tau);
+                if (!copy) {
+                    concurrency = 1;
+                    break;
+                }
+                tau = std::move(copy.value());
+            }
+        }
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::size_t> ready;
+        std::size_t done = 0;
+        std::exception_ptr error = nullptr;
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            if (pending[c] == 0) {
+                ready.push_back(c);
+            }
+        }
+
+        // 依存する強連結成分が全て型推論済みのものから順に取り出して型推論する
+        auto work = [&]() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                cv.wait(lock, [&]() { return !ready.empty() || done == components.size() || error; });
+                if (error || ready.empty()) {
+                    return;
+                }
+                auto c = ready.front();
+                ready.pop_front();
+
+                lock.unlock();
+                try {
+                    inferComponent(c);
+                }
+                catch (...) {
+                    lock.lock();
+                    error = std::current_exception();
+                    cv.notify_all();
+                    return;
+                }
+                lock.lock();
+
+                ++done;
+                for (auto d : dependents[c]) {
+                    if (--pending[d] == 0) {
+                        ready.push_back(d);
+                    }
+                }
+                cv.notify_all();
+            }
+        };
+
+        auto threads = std::min(std::max<std::size_t>(concurrency, 1), components.size());
+        if (threads <= 1) {
+            work();
+        }
+        else {
+            std::vector<std::thread> workers;
+#ifdef INFERENCE_STATS
+            auto& stats = inferenceStats;
+#endif
+            for (std::size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&]() {
+                    work();
+#ifdef INFERENCE_STATS
+                    stats.merge(inferenceStats);
+#endif
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        // トポロジカル順にenvへ束縛する
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            for (auto i : components[c]) {
+                env.bind(this->definitions[i].x, results[i]);
+            }
+            env.arena->imports.push_back(arenas[c]);
+        }
+        env.arena->imports.push_back(imported);
+    }
+};
+
+/// <summary>
+/// <para>let束縛の連鎖の差分型推論</para>
+/// <para>束縛ごとに束縛する式とそのハッシュ値、参照した束縛の版、generalizeした型を記録し、再推論では入力が変化した束縛のみを型推論する</para>
+/// <para>入力が変化していない束縛は記録した型を再利用し、型推論しても型が変化しなかった束縛は版を引き継いで参照元の再推論を省く</para>
+/// <para>未解決の型変数を含む単相な束縛の型は参照元の型推論で解決されうるため、記録を再利用せずに常に新たな版として型推論する</para>
+/// <para>連鎖の外の束縛は変化しないものとする</para>
+/// </summary>
+struct IncrementalInference {
+    /// <summary>
+    /// 束縛ごとの記録
+    /// </summary>
+    struct Entry {
+        /// <summary>
+        /// 束縛先の識別子名
+        /// </summary>
+        Symbol x;
+        /// <summary>
+        /// Letrec束縛であるか
+        /// </summary>
+        bool recursive = false;
+        /// <summary>
+        /// 束縛する式のハッシュ値
+        /// </summary>
+        std::size_t hash = 0;
+        /// <summary>
+        /// <para>束縛する式</para>
+        /// <para>ハッシュ値の衝突で別の式の記録を再利用しないように、ハッシュ値が一致した場合は構造を比較する</para>
+        /// </summary>
+        std::shared_ptr<Expression> e = nullptr;
+        /// <summary>
+        /// <para>参照した識別子と参照先の束縛の版の組のリスト</para>
+        /// <para>連鎖の外の束縛を参照した場合の版は0とする</para>
+        /// </summary>
+        std::vector<std::pair<Symbol, std::size_t>> reads = {};
+        /// <summary>
+        /// generalizeした型
+        /// </summary>
+        std::variant<RefType, Generic> scheme = {};
+        /// <summary>
+        /// schemeを所有するアリーナ
+        /// </summary>
+        std::shared_ptr<TypeArena> arena = nullptr;
+        /// <summary>
+        /// 型推論の直後のschemeが未解決の型変数を含まないか
+        /// </summary>
+        bool closed = true;
+        /// <summary>
+        /// <para>束縛の版</para>
+        /// <para>型推論するごとに採番し、再利用した場合は引き継ぐ</para>
+        /// </summary>
+        std::size_t version = 0;
+    };
+
+    /// <summary>
+    /// 連鎖の外の束縛をもつ型環境
+    /// </summary>
+    TypeEnvironment& env;
+
+    /// <summary>
+    /// 束縛とxを利用する式の型推論に用いるアルゴリズム('J'もしくは'M')
+    /// </summary>
+    char algorithm = 'J';
+
+    /// <summary>
+    /// 直前の型推論における連鎖の順の束縛ごとの記録
+    /// </summary>
+    std::vector<Entry> entries = {};
+
+    /// <summary>
+    /// 直前の型推論の結果の型を所有するアリーナ
+    /// </summary>
+    std::shared_ptr<TypeArena> arena = nullptr;
+
+    /// <summary>
+    /// 採番済みの版の最大値
+    /// </summary>
+    std::size_t versions = 0;
+
+    /// <summary>
+    /// 直前の型推論で記録を再利用した束縛の数
+    /// </summary>
+    std::size_t reused = 0;
+
+    /// <summary>
+    /// 直前の型推論で型推論した束縛の数
+    /// </summary>
+    std::size_t inferred = 0;
+
+    /// <summary>
+    /// <para>let束縛の連鎖の型推論</para>
+    /// <para>束縛する式の構造と参照した束縛の版が一致する記録があれば再利用し、なければ型推論する</para>
+    /// <para>xを利用する式は常に型推論し、型推論に失敗した場合は記録を更新しない</para>
+    /// </summary>
+    /// <param name="expr">let束縛の連鎖</param>
+    /// <returns>評価結果の型(次の型推論まで有効)</returns>
+    [[nodiscard]] RefType infer(std::shared_ptr<Expression> expr) {
+        // 連鎖を束縛とxを利用する式に分解する
+        std::vector<Definition> definitions;
+        Definition binding;
+        while (auto e2 = expr->unfold(binding)) {
+            definitions.push_back(binding);
+            expr = e2;
+        }
+
+        // 直前の記録を束縛先の識別子名で引けるようにする
+        std::unordered_multimap<Symbol, std::size_t> previous;
+        for (std::size_t i = 0; i < this->entries.size(); ++i) {
+            previous.insert({ this->entries[i].x, i });
+        }
+        std::vector<bool> used(this->entries.size(), false);
+
+        std::vector<Entry> next;
+        // 識別子名から参照先の束縛の記録への索引
+        std::unordered_map<Symbol, std::size_t> visible;
+        std::size_t hits = 0;
+        std::vector<Symbol> bound;
+        for (auto& def : definitions) {
+            // 参照する識別子と参照先の束縛の版を求める
+            std::vector<Symbol> fvs;
+            if (def.recursive) {
+                bound.push_back(def.x);
+            }
+            def.e->freeVariables(bound, fvs);
+            bound.clear();
+            std::sort(fvs.begin(), fvs.end(), [](Symbol a, Symbol b) { return a.id < b.id; });
+            fvs.erase(std::unique(fvs.begin(), fvs.end()), fvs.end());
+            std::vector<std::pair<Symbol, std::size_t>> reads;
+            for (auto x : fvs) {
+                auto itr = visible.find(x);
+                reads.push_back({ x, itr != visible.end() ? next[itr->second].version : 0 });
+            }
+            auto hash = def.e->hash();
+
+            // 入力が一致する直前の記録があれば再利用する
+            std::optional<std::size_t> match = std::nullopt;
+            auto [first, last] = previous.equal_range(def.x);
+            for (auto itr = first; itr != last && !match; ++itr) {
+                auto& entry = this->entries[itr->second];
+                if (!used[itr->second] && entry.closed && entry.recursive == def.recursive && entry.hash == hash && entry.reads == reads && (entry.e == def.e || entry.e->equals(*def.e))) {
+                    match = itr->second;
+                }
+            }
+            if (match) {
+                used[match.value()] = true;
+                next.push_back(this->entries[match.value()]);
+                ++hits;
+            }
+            else {
+                auto entry = this->inferDefinition(def, hash, std::move(reads), next, visible);
+                // 型が変化していなければ直前の記録の版を引き継ぐ
+                for (auto itr = first; itr != last && entry.closed; ++itr) {
+                    auto& old = this->entries[itr->second];
+                    if (!used[itr->second] && old.closed && old.recursive == def.recursive && IncrementalInference::equivalent(old.scheme, entry.scheme)) {
+                        used[itr->second] = true;
+                        entry.version = old.version;
+                        break;
+                    }
+                }
+                next.push_back(std::move(entry));
+            }
+            visible[def.x] = next.size() - 1;
+        }
+
+        // xを利用する式は参照する束縛のみを束縛した型環境で型推論する
+        TypeEnvironment root(std::addressof(this->env), this->env.depth);
+        std::vector<Symbol> fvs;
+        expr->freeVariables(bound, fvs);
+        for (auto x : fvs) {
+            this->bind(root, x, next, visible);
+        }
+        RefType t;
+        if (this->algorithm == 'J') {
+            t = expr->J(root);
+        }
+        else {
+            t = root.newType(Type::Variable{ .depth = root.depth - 1 });
+            expr->M(root, t);
+        }
+
+        this->entries = std::move(next);
+        this->arena = root.storage;
+        this->reused = hits;
+        this->inferred = definitions.size() - hits;
+        return t;
+    }
+
+    /// <summary>
+    /// <para>2つの束縛の型が同一の型を示すか判定する</para>
+    /// <para>ジェネリック型の型変数はインデックスで、未解決の型変数は同一性で比較する</para>
+    /// </summary>
+    /// <param name="scheme1">判定対象の型1</param>
+    /// <param name="scheme2">判定対象の型2</param>
+    /// <returns>同一の型を示す場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] static bool equivalent(const std::variant<RefType, Generic>& scheme1, const std::variant<RefType, Generic>& scheme2) {
+        if (scheme1.index() != scheme2.index()) {
+            return false;
+        }
+        if (std::holds_alternative<Generic>(scheme1)) {
+            auto& g1 = std::get<Generic>(scheme1);
+            auto& g2 = std::get<Generic>(scheme2);
+            return g1.vals.size() == g2.vals.size() && ::equivalent(g1.type, g2.type);
+        }
+        return ::equivalent(std::get<RefType>(scheme1), std::get<RefType>(scheme2));
+    }
+
+    /// <summary>
+    /// 束縛の型が未解決の型変数を含まないか判定する
+    /// </summary>
+    /// <param name="scheme">判定対象の型</param>
+    /// <returns>未解決の型変数を含まない場合はtrue、そうでない場合はfalse</returns>
+    [[nodiscard]] static bool closed(const std::variant<RefType, Generic>& scheme) {
+        std::vector<RefType> stack = { std::holds_alternative<Generic>(scheme) ? std::get<Generic>(scheme).type : std::get<RefType>(scheme) };
+        // 共有された部分型は1度のみ調べる
+        std::unordered_set<const Type*> visited;
+        while (!stack.empty()) {
+            auto t = solved(stack.back());
+            stack.pop_back();
+            if (!visited.insert(t).second) {
+                continue;
+            }
+            if (std::holds_alternative<Type::Variable>(t->kind)) {
+                return false;
+            }
+            if (std::holds_alternative<Type::Function>(t->kind)) {
+                auto& x = std::get<Type::Function>(t->kind);
+                stack.push_back(x.returnType);
+                stack.push_back(x.paramType);
+            }
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// 識別子を連鎖の束縛もしくは連鎖の外の束縛から型環境に束縛する
+    /// </summary>
+    /// <param name="root">束縛先の型環境</param>
+    /// <param name="x">束縛する識別子</param>
+    /// <param name="entries">連鎖の束縛の記録</param>
+    /// <param name="visible">識別子名から参照先の束縛の記録への索引</param>
+    void bind(TypeEnvironment& root, Symbol x, const std::vector<Entry>& entries, const std::unordered_map<Symbol, std::size_t>& visible) const {
+        if (root.contains(x)) {
+            return;
+        }
+        if (auto itr = visible.find(x); itr != visible.end()) {
+            auto& entry = entries[itr->second];
+            root.bind(x, entry.scheme);
+            root.arena->imports.push_back(entry.arena);
+        }
+        else if (auto tau = this->env.lookup(x)) {
+            root.bind(x, *tau.value());
+        }
+    }
+
+    /// <summary>
+    /// <para>束縛の型推論</para>
+    /// <para>束縛ごとに独自の型環境とアリーナを用意して型推論し、参照した束縛のアリーナは取り込んで延命する</para>
+    /// <para>全体の型推論と結果が一致するように、Let::JおよびLet::Mと同じく束縛する式はrootのスコープで型推論する</para>
+    /// </summary>
+    /// <param name="def">束縛</param>
+    /// <param name="hash">束縛する式のハッシュ値</param>
+    /// <param name="reads">参照する識別子と参照先の束縛の版の組のリスト</param>
+    /// <param name="entries">先行する束縛の記録</param>
+    /// <param name="visible">識別子名から参照先の束縛の記録への索引</param>
+    /// <returns>束縛の記録</returns>
+    [[nodiscard]] Entry inferDefinition(const Definition& def, std::size_t hash, std::vector<std::pair<Symbol, std::size_t>> reads, const std::vector<Entry>& entries, const std::unordered_map<Symbol, std::size_t>& visible) {
+        TypeEnvironment root(std::addressof(this->env), this->env.depth);
+        // Letrec束縛のxはreadsに含まれずscopeで束縛する
+        for (auto& [x, version] : reads) {
+            this->bind(root, x, entries, visible);
+        }
+
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        // 関数適用の結果の型変数はrootのスコープの深さとなりgeneralizeされない
+        auto t = root.newType(Type::Variable{ .depth = root.depth + 1 });
+        if (def.recursive) {
+            root.bind(def.x, t);
+        }
+        if (this->algorithm == 'J') {
+            unify(def.e->J(root), t);
+        }
+        else {
+            def.e->M(root, t);
+        }
+        auto scheme = root.generalize(t);
+        auto closed = IncrementalInference::closed(scheme);
+
+        return Entry{
+            .x = def.x,
+            .recursive = def.recursive,
+            .hash = hash,
+            .e = def.e,
+            .reads = std::move(reads),
+            .scheme = std::move(scheme),
+            .arena = root.storage,
+            .closed = closed,
+            .version = ++this->versions
+        };
+    }
+};
+
+#ifdef BENCHMARK
+/// <summary>
+/// ベンチマーク用のヒープの使用状況
+/// </summary>
+struct HeapStats {
+    /// <summary>
+    /// 確保の回数
+    /// </summary>
+    std::size_t allocations = 0;
+    /// <summary>
+    /// 確保中のバイト数
+    /// </summary>
+    std::size_t bytes = 0;
+    /// <summary>
+    /// 確保中のバイト数の最大値
+    /// </summary>
+    std::size_t peak = 0;
+};
+// モジュールの並列な型推論ではワーカースレッドも確保するため、計測はスレッドごとに行い計測対象のスレッドの分のみを参照する
+constinit thread_local HeapStats heapStats = {};
+
+// 確保の回数と確保中のバイト数を計測する
+// 解放されたバイト数はサイズ付きのdeleteでのみ得られるため、サイズなしのdeleteの分は確保中のままとして扱う
+// GCCはインライン展開後にoperator newの結果をfreeで解放していると誤検知するため警告を抑制する
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    auto p = std::malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
     }
+    ++heapStats.allocations;
+    heapStats.bytes += size;
+    heapStats.peak = std::max(heapStats.peak, heapStats.bytes);
+    return p;
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
+/// <summary>
+/// 組込みの型と識別子を定義した型推論の環境
+/// </summary>
+struct Fixture {
     /// <summary>
-    /// Algorithm Mの適用
+    /// 型環境
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-
-        this->e1->M(env, t);
-
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, env.generalize(t));
-        this->e2->M(env, rho);
+    TypeEnvironment env = {};
+    /// <summary>
+    /// 数値型
+    /// </summary>
+    RefType numberT = base(this->env, "number");
+    /// <summary>
+    /// Boolean型
+    /// </summary>
+    RefType booleanT = base(this->env, "boolean");
+
+    Fixture() {
+        auto ifvalT = var(this->env);
+        this->env.bind(Symbol("if"), this->env.generalize(fun(this->env, this->booleanT, fun(this->env, ifvalT, fun(this->env, ifvalT, ifvalT)))));
+        this->env.bind(Symbol("-"), fun(this->env, this->numberT, fun(this->env, this->numberT, this->numberT)));
+        this->env.bind(Symbol("+"), fun(this->env, this->numberT, fun(this->env, this->numberT, this->numberT)));
+        this->env.bind(Symbol("<"), fun(this->env, this->numberT, fun(this->env, this->numberT, this->booleanT)));
+        this->env.bind(Symbol("true"), this->booleanT);
+        this->env.bind(Symbol("false"), this->booleanT);
     }
 };
 
 /// <summary>
-/// Letrec束縛を示す構文木
+/// ベンチマーク用に生成したプログラム
 /// </summary>
-struct Letrec : Expression {
+struct Program {
     /// <summary>
-    /// 束縛先の識別子名
-    /// </summary>
-    std::string x;
-    /// <summary>
-    /// 束縛する式
+    /// プログラムの構文木
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    std::shared_ptr<Expression> expr = nullptr;
     /// <summary>
-    /// xを利用する式
+    /// 構文木のノード数
     /// </summary>
-    std::shared_ptr<Expression> e2;
-
-    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    ~Letrec() override {}
+    std::size_t nodes = 0;
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 構文木のノードを数える
     /// </summary>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeEnvironment& env) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, t);
-
-        auto tau1 = this->e1->J(env);
-        unify(tau1, t);
+    /// <param name="e">生成したノード</param>
+    /// <returns>e</returns>
+    std::shared_ptr<Expression> operator()(std::shared_ptr<Expression> e) {
+        ++this->nodes;
+        return e;
+    }
+};
 
-        env.map.insert_or_assign(this->x, env.generalize(tau1));
+/// <summary>
+/// <para>深いlet束縛の入れ子</para>
+/// <para>let x0 = n -> n in let x1 = n -> x0 n in ... in xn</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+Program deepLet([[maybe_unused]] Fixture& fixture, std::size_t n) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(n)));
+    for (auto i = n; i > 0; --i) {
+        e = p(let(x(i), p(lambda("n", p(apply(p(id(x(i - 1))), p(id("n")))))), e));
+    }
+    p.expr = p(let(x(0), p(lambda("n", p(id("n")))), e));
+    return p;
+}
 
-        return this->e2->J(env);
+/// <summary>
+/// <para>多相な束縛の多数の利用</para>
+/// <para>let id = x -> x in let k = a -> b -> b in k (id 1) (k (id true) (... (id 1)))</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">idの利用回数</param>
+/// <returns>生成したプログラム</returns>
+Program widePolymorphism(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto arg = [&](std::size_t i) { return i % 2 == 0 ? p(c(fixture.numberT)) : p(id("true")); };
+    auto e = p(apply(p(id("id")), arg(0)));
+    for (std::size_t i = 1; i < n; ++i) {
+        e = p(apply(p(apply(p(id("k")), p(apply(p(id("id")), arg(i))))), e));
     }
+    p.expr = p(let("id", p(lambda("x", p(id("x")))), p(let("k", p(lambda("a", p(lambda("b", p(id("b")))))), e))));
+    return p;
+}
 
-    /// <summary>
-    /// Algorithm Mの適用
-    /// </summary>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeEnvironment& env, RefType rho) override {
-        auto t1 = env.newType(Type::Variable{ .depth = env.depth });
-        auto t2 = env.newType(Type::Variable{ .depth = env.depth });
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, t1);
+/// <summary>
+/// <para>長いカリー化された関数適用</para>
+/// <para>let f = x0 -> x1 -> ... -> xn -> x0 in f 1 1 ... 1</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">引数の数</param>
+/// <returns>生成したプログラム</returns>
+Program longApply(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto f = p(id(x(0)));
+    for (auto i = n; i-- > 0;) {
+        f = p(lambda(x(i), f));
+    }
+    auto e = p(id("f"));
+    for (std::size_t i = 0; i < n; ++i) {
+        e = p(apply(e, p(c(fixture.numberT))));
+    }
+    p.expr = p(let("f", f, e));
+    return p;
+}
 
-        this->e1->M(env, t2);
-        unify(t1, t2);
+/// <summary>
+/// <para>プログラムの生成と型推論を繰り返して計測結果を出力する</para>
+/// <para>生成は計測に含めず、ノードあたりの時間、確保回数、確保中のバイト数の最大値を出力する</para>
+/// </summary>
+/// <param name="name">プログラム名</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="n">生成器に与える大きさ</param>
+/// <param name="repeat">繰り返し回数</param>
+void benchmark(const std::string& name, Program(*generate)(Fixture&, std::size_t), std::size_t n, std::size_t repeat) {
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::size_t nodes = 0;
+        std::size_t allocations = 0;
+        std::size_t peak = 0;
+        std::chrono::steady_clock::duration elapsed = {};
+
+        for (std::size_t i = 0; i < repeat; ++i) {
+            auto program = generate(fixture, n);
+            nodes = program.nodes;
+
+            auto before = heapStats;
+            heapStats.peak = heapStats.bytes;
+            auto start = std::chrono::steady_clock::now();
+            if (algorithm == 'J') {
+                (void)program.expr->J(fixture.env);
+            }
+            else {
+                auto t = fixture.env.newType(Type::Variable{ .depth = fixture.env.depth - 1 });
+                program.expr->M(fixture.env, t);
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            allocations += heapStats.allocations - before.allocations;
+            peak = std::max(peak, heapStats.peak - before.bytes);
+        }
 
-        env.map.insert_or_assign(this->x, env.generalize(t1));
-        this->e2->M(env, rho);
+        auto count = static_cast<double>(nodes * repeat);
+        std::cout << std::format(
+            "{:<20} {} {:>8} {:>12.1f} {:>12.2f} {:>16.1f}",
+            name,
+            algorithm,
+            nodes,
+            std::chrono::duration<double, std::nano>(elapsed).count() / count,
+            allocations / count,
+            static_cast<double>(peak) / nodes
+        ) << std::endl;
     }
-};
+}
 
 /// <summary>
-/// RefTypeの標準出力
+/// 型のグラフとしてのノード数を数える(共有された部分型は1度のみ数える)
 /// </summary>
-/// <param name="os">出力ストリーム</param>
-/// <param name="type">出力対象の型</param>
-/// <returns></returns>
-std::ostream& operator<<(std::ostream& os, RefType type) {
+/// <param name="type">数える対象の型</param>
+/// <returns>typeから到達可能な型のノード数</returns>
+std::size_t countTypeNodes(RefType type) {
     struct fn {
-        std::ostream& o;
-        char varCnt = 'a';
-        std::unordered_map<const Type::Variable*, char> varmap = {};
+        std::vector<RefType>& stack;
 
-        void operator()(const Type::Base& x) {
-            this->o << x.name;
-        }
+        void operator()([[maybe_unused]] const Type::Base& x) {}
         void operator()(const Type::Function& x) {
-            // 括弧付きで出力するかを判定
-            bool isSimple = std::holds_alternative<Type::Base>(x.paramType->kind) ||
-                std::holds_alternative<Type::Variable>(x.paramType->kind) ||
-                std::holds_alternative<Type::Param>(x.paramType->kind);
-            if (isSimple) {
-                std::visit(*this, x.paramType->kind);
-            }
-            else {
-                this->o << "(";
-                std::visit(*this, x.paramType->kind);
-                this->o << ")";
-            }
-            this->o << " -> ";
-            std::visit(*this, x.returnType->kind);
+            this->stack.push_back(x.paramType);
+            this->stack.push_back(x.returnType);
         }
         void operator()(const Type::Variable& x) {
             if (x.solve) {
-                // 解決済みの型変数の場合は解決結果の型に対して出力
-                std::visit(*this, x.solve.value()->kind);
+                this->stack.push_back(x.solve);
+            }
+        }
+        void operator()([[maybe_unused]] const Type::Param& x) {}
+    };
+
+    std::unordered_set<const Type*> visited;
+    std::vector<RefType> stack = { type };
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (visited.insert(t).second) {
+            std::visit(fn{ .stack = stack }, t->kind);
+        }
+    }
+    return visited.size();
+}
+
+/// <summary>
+/// <para>組を入れ子にするlet束縛の連鎖</para>
+/// <para>let pair = a -> b -> f -> f a b in let x0 = 1 in let x1 = pair x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">連鎖の長さ</param>
+/// <returns>生成したプログラム</returns>
+Program pairChain(Fixture& fixture, std::size_t k) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(k)));
+    for (auto i = k; i > 0; --i) {
+        e = p(let(x(i), p(apply(p(apply(p(id("pair")), p(id(x(i - 1))))), p(id(x(i - 1))))), e));
+    }
+    auto pair = p(lambda("a", p(lambda("b", p(lambda("f", p(apply(p(apply(p(id("f")), p(id("a")))), p(id("b"))))))))));
+    p.expr = p(let("pair", pair, p(let(x(0), p(c(fixture.numberT)), e))));
+    return p;
+}
+
+/// <summary>
+/// <para>多相な束縛を2回ずつ利用する入れ子</para>
+/// <para>let x0 = n -> n in let x1 = y -> y x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+Program polymorphicNest([[maybe_unused]] Fixture& fixture, std::size_t k) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(k)));
+    for (auto i = k; i > 0; --i) {
+        e = p(let(x(i), p(lambda("y", p(apply(p(apply(p(id("y")), p(id(x(i - 1))))), p(id(x(i - 1))))))), e));
+    }
+    p.expr = p(let(x(0), p(lambda("n", p(id("n")))), e));
+    return p;
+}
+
+/// <summary>
+/// <para>型変数を含まない大きな型を返す多相な関数の多数の利用</para>
+/// <para>Tk = Tk-1 -> Tk-1とする、let g = y -> (_: Tk) in let k = a -> b -> b in k (g 1) (k (g 1) (... (g 1)))</para>
+/// <para>Tkは木としては2^k個のノードをもつが、instantiateでTkを共有する限り生成する型の数はkに依存しない</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">Tkの深さ</param>
+/// <returns>生成したプログラム</returns>
+Program groundSharing(Fixture& fixture, std::size_t k) {
+    Program p;
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < k; ++i) {
+        t = fun(fixture.env, t, t);
+    }
+    auto use = [&] { return p(apply(p(id("g")), p(c(fixture.numberT)))); };
+    auto e = use();
+    for (std::size_t i = 1; i < 64; ++i) {
+        e = p(apply(p(apply(p(id("k")), use())), e));
+    }
+    p.expr = p(let("g", p(lambda("y", p(c(t)))), p(let("k", p(lambda("a", p(lambda("b", p(id("b")))))), e))));
+    return p;
+}
+
+/// <summary>
+/// <para>instantiateが型変数を含まない部分型を共有しているかの検査</para>
+/// <para>a -> Tkをgeneralizeしてinstantiateした結果の戻り値型がTkそのものであり、雛形がTkを展開していないことを確認する</para>
+/// </summary>
+/// <returns>共有している場合はtrue、そうでない場合はfalse</returns>
+bool checkSharing() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < 16; ++i) {
+        t = fun(env, t, t);
+    }
+    auto g = env.generalize(fun(env, var(env), t));
+    auto& generic = std::get<Generic>(g);
+    auto f = env.instantiate(generic);
+
+    if (std::get<Type::Function>(f->kind).returnType != t || generic.spine->nodes.size() != 1) {
+        std::cout << std::format("instantiate: 型変数を含まない部分型が共有されていない(雛形の節点数：{})", generic.spine->nodes.size()) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>投機的な単一化の巻き戻しの検査</para>
+/// <para>'a -> 'aとnumber -> booleanの単一化は'aを束縛した後に失敗するため、巻き戻して'aが未解決に戻り別の型と単一化できることを確認する</para>
+/// <para>let束縛を含む型推論を巻き戻した場合にgeneralizeによる型の書き換えも巻き戻されることを確認する</para>
+/// <para>型推論の異常以外の例外で中断した場合も巻き戻されてチェックポイントが閉じられることを確認する</para>
+/// </summary>
+/// <returns>巻き戻せている場合はtrue、そうでない場合はfalse</returns>
+bool checkRollback() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto a = var(env);
+    auto t = fun(env, a, a);
+    auto print = [&] {
+        std::ostringstream os;
+        os << t;
+        return os.str();
+    };
+    auto before = print();
+
+    auto numberToBoolean = fun(env, fixture.numberT, fixture.booleanT);
+    if (trail.speculate([&] { unify(t, numberToBoolean); })) {
+        std::cout << "rollback: 単一化が失敗していない" << std::endl;
+        return false;
+    }
+    if (print() != before || std::get<Type::Variable>(a->kind).solve) {
+        std::cout << std::format("rollback: 巻き戻し後の型が一致しない({} -> {})", before, print()) << std::endl;
+        return false;
+    }
+
+    auto booleanToBoolean = fun(env, fixture.booleanT, fixture.booleanT);
+    if (!trail.speculate([&] { unify(t, booleanToBoolean); }) || solved(a) != fixture.booleanT) {
+        std::cout << "rollback: 巻き戻し後の単一化に失敗した" << std::endl;
+        return false;
+    }
+
+    // let g = (u -> f) (k x) in 1 1
+    // f : 'b -> number、x : 'b、k : boolean -> numberとし、'bはlet束縛の型推論中にfの型を経由せずに解決される
+    // gのgeneralizeがfの型の引数型を解決結果に書き換えてから型推論が失敗する
+    auto b = env.newType(Type::Variable{ .depth = env.depth });
+    auto h = fun(env, b, fixture.numberT);
+    env.bind(Symbol("f"), h);
+    env.bind(Symbol("x"), b);
+    env.bind(Symbol("k"), fun(env, fixture.booleanT, fixture.numberT));
+    auto expr = let("g", apply(lambda("u", id("f")), apply(id("k"), id("x"))), apply(c(fixture.numberT), c(fixture.numberT)));
+    if (trail.speculate([&] { expr->J(env); })) {
+        std::cout << "rollback: let束縛を含む型推論が失敗していない" << std::endl;
+        return false;
+    }
+    if (std::get<Type::Function>(h->kind).paramType != b || std::get<Type::Variable>(b->kind).solve) {
+        std::cout << "rollback: let束縛のgeneralizeによる書き換えが巻き戻されていない" << std::endl;
+        return false;
+    }
+
+    // 型推論の異常以外の例外でも書き換えを巻き戻し、チェックポイントを閉じてから再送出する
+    auto u = var(env);
+    try {
+        (void)trail.speculate([&] {
+            unify(u, fixture.numberT);
+            throw std::out_of_range("speculate");
+        });
+        std::cout << "rollback: 型推論の異常以外の例外が再送出されていない" << std::endl;
+        return false;
+    }
+    catch (const std::out_of_range&) {}
+    if (trail.open != 0 || std::get<Type::Variable>(u->kind).solve) {
+        std::cout << "rollback: 型推論の異常以外の例外で巻き戻されていない" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>大きさを変えながらプログラムの族について型推論を行い、計測結果を出力する</para>
+/// <para>型推論中に生成した型の数と、結果の型のグラフとしてのノード数を出力する</para>
+/// </summary>
+/// <param name="name">プログラムの族の名前</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="sizes">生成器に与える大きさのリスト(昇順)</param>
+/// <param name="shared">生成する型の数が大きさに依存しないことを検査する場合はtrue</param>
+/// <param name="linear">生成する型の数と結果の型のノード数が大きさに比例し、束縛1つあたりに走査する型の数が高々大きさに比例することを検査する場合はtrue(走査する型の数はINFERENCE_STATSを定義した場合のみ検査する)</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool stress(const std::string& name, Program(*generate)(Fixture&, std::size_t), std::initializer_list<std::size_t> sizes, bool shared = false, bool linear = false) {
+    auto ok = true;
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::optional<std::size_t> first = std::nullopt;
+        // 最初の大きさでの計測結果(大きさ、生成した型の数、結果の型のノード数、走査した型の数)
+        std::optional<std::tuple<std::size_t, std::size_t, std::size_t, std::size_t>> base = std::nullopt;
+
+        for (auto k : sizes) {
+            auto program = generate(fixture, k);
+
+            auto types = fixture.env.arena->types.size();
+            auto traversed = inferenceStats.traversed();
+            auto start = std::chrono::steady_clock::now();
+            RefType t = nullptr;
+            if (algorithm == 'J') {
+                t = program.expr->J(fixture.env);
             }
             else {
-                // 雑に[a, z]の範囲で型変数を出力
-                // zを超えたら全て「_」で出力
-                if (auto itr = this->varmap.find(std::addressof(x)); itr != this->varmap.end()) {
-                    this->o << '?' << itr->second;
+                t = fixture.env.newType(Type::Variable{ .depth = fixture.env.depth - 1 });
+                program.expr->M(fixture.env, t);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            auto created = fixture.env.arena->types.size() - types;
+            auto us = std::chrono::duration<double, std::micro>(elapsed).count();
+            auto nodes = countTypeNodes(t);
+            auto visits = inferenceStats.traversed() - traversed;
+
+            std::cout << std::format(
+                "{:<20} {} {:>4} {:>8} {:>12.1f} {:>12} {:>12}",
+                name,
+                algorithm,
+                k,
+                program.nodes,
+                us,
+                created,
+                nodes
+            ) << std::endl;
+
+            // 型変数を含まない部分型を共有している限り、生成する型の数は大きさに依存しない
+            if (shared && first && created > first.value()) {
+                std::cout << std::format("{}: 型変数を含まない部分型が共有されていない({} -> {})", name, first.value(), created) << std::endl;
+                ok = false;
+            }
+            first = first.value_or(created);
+
+            if (linear && base) {
+                auto [k0, created0, nodes0, visits0] = base.value();
+                auto ratio = static_cast<double>(k) / k0;
+                // 計測の誤差を含む時間ではなく決定的な型の数で検査する
+                // 定数項は大きさによらないため、型の数は余裕をもたせずに大きさに比例する上限で検査できる
+                if (created > created0 * ratio || nodes > nodes0 * ratio) {
+                    std::cout << std::format("{}: 型の数が大きさに比例しない({} -> {}, {} -> {})", name, created0, created, nodes0, nodes) << std::endl;
+                    ok = false;
+                    break;
                 }
-                else {
-                    this->varmap.insert({ std::addressof(x), this->varCnt });
-                    this->o << '?' << this->varCnt;
-                    switch (this->varCnt) {
-                    case 'z':
-                        this->varCnt = '_';
-                        break;
-                    case '_':
-                        break;
-                    default:
-                        ++this->varCnt;
-                        break;
-                    }
+                // 束縛ごとに出現検査とgeneralizeがその時点の型を1回ずつ走査するため、束縛1つあたりに走査する型の数は大きさに比例してよい
+                if (visits > visits0 * ratio * ratio) {
+                    std::cout << std::format("{}: 束縛1つあたりに走査する型の数が大きさに比例しない({:.1f} -> {:.1f})", name, static_cast<double>(visits0) / k0, static_cast<double>(visits) / k) << std::endl;
+                    ok = false;
+                    // 指数的に増加する場合に続く大きさの計測が終わらないため打ち切る
+                    break;
                 }
             }
+            else if (linear) {
+                base = std::tuple(k, created, nodes, visits);
+            }
         }
-        void operator()(const Type::Param& x) {
-            // 雑に[a, z]の範囲で型変数を出力
-            // zを超えたら全て「_」で出力
-            std::size_t c = 'a' + x.index;
-            this->o << '\'' << static_cast<char>(c <= 'z' ? c : '_');
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>互いにほぼ独立な束縛からなるモジュール</para>
+/// <para>f0 = wide-polymorphism, f1 = wide-polymorphism, ... とし、8個に1個の束縛は直前の束縛を参照する</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">束縛の数</param>
+/// <param name="m">束縛ごとのwide-polymorphismの大きさ</param>
+/// <returns>生成したモジュール</returns>
+Module wideModule(Fixture& fixture, std::size_t n, std::size_t m) {
+    Module module;
+    auto f = [](std::size_t i) { return std::format("f{}", i); };
+    for (std::size_t i = 0; i < n; ++i) {
+        auto e = widePolymorphism(fixture, m).expr;
+        if (i % 8 == 7) {
+            e = apply(lambda("u", e), id(f(i - 1)));
+        }
+        module.definitions.push_back({ .x = Symbol(f(i)), .e = e });
+    }
+    return module;
+}
+
+/// <summary>
+/// <para>スレッド数を変えながらモジュールの型推論を行い、計測結果を出力する</para>
+/// <para>スレッド数によらず推論結果の型が一致することを検査する</para>
+/// </summary>
+/// <param name="n">束縛の数</param>
+/// <param name="m">束縛ごとのwide-polymorphismの大きさ</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool moduleScaling(std::size_t n, std::size_t m) {
+    auto ok = true;
+    std::optional<double> sequential = std::nullopt;
+    std::vector<std::string> expected;
+    // 実行環境のコア数によらず並列な型推論の経路を通すため2スレッド以上で比較する
+    for (std::size_t threads : { std::size_t(1), std::max<std::size_t>(std::thread::hardware_concurrency(), 2) }) {
+        Fixture fixture;
+        auto module = wideModule(fixture, n, m);
+
+        auto start = std::chrono::steady_clock::now();
+        module.infer(fixture.env, threads);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sequential = sequential.value_or(elapsed);
+
+        std::vector<std::string> actual;
+        for (auto& def : module.definitions) {
+            auto tau = fixture.env.lookup(def.x).value();
+            std::ostringstream os;
+            os << (std::holds_alternative<Generic>(*tau) ? std::get<Generic>(*tau).type : std::get<RefType>(*tau));
+            actual.push_back(os.str());
         }
+        if (expected.empty()) {
+            expected = std::move(actual);
+        }
+        else if (actual != expected) {
+            std::cout << std::format("module: スレッド数{}で推論結果が一致しない", threads) << std::endl;
+            ok = false;
+        }
+
+        std::cout << std::format("{:<20} {:>8} {:>8} {:>12.1f} {:>8.2f}", "wide-module", threads, n, elapsed, sequential.value() / elapsed) << std::endl;
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>モジュールの外の束縛を参照する並列な型推論の検査</para>
+/// <para>型変数を含まない束縛は複製を参照してenvの型を書き換えず、未解決の型変数を含む束縛がある場合は逐次の型推論と同じくその型変数を解決することを確認する</para>
+/// </summary>
+/// <returns>推論結果が正しい場合はtrue、そうでない場合はfalse</returns>
+bool checkModuleImports() {
+    auto print = [](const std::variant<RefType, Generic>& tau) {
+        std::ostringstream os;
+        os << (std::holds_alternative<Generic>(tau) ? std::get<Generic>(tau).type : std::get<RefType>(tau));
+        return os.str();
     };
-    std::visit(fn{ .o = os }, type->kind);
 
-    return os;
+    // g0 = if true 1 1, g1 = + g0 g0, g2 = + g1 g0, ...
+    Fixture closed;
+    Module module;
+    module.definitions.push_back({ .x = Symbol("g0"), .e = apply(id("if"), id("true"), c(closed.numberT), c(closed.numberT)) });
+    for (std::size_t i = 1; i < 8; ++i) {
+        module.definitions.push_back({ .x = Symbol(std::format("g{}", i)), .e = apply(id("+"), id(std::format("g{}", i - 1)), id("g0")) });
+    }
+    module.infer(closed.env, 2);
+    if (auto tau = print(*closed.env.lookup(Symbol("g7")).value()); tau != "number") {
+        std::cout << std::format("module: 外の束縛を参照した推論結果が一致しない({})", tau) << std::endl;
+        return false;
+    }
+
+    // wはgeneralizeされない未解決の型変数に束縛し、h1 = + hでnumberに解決する
+    Fixture open;
+    open.env.bind(Symbol("w"), open.env.newType(Type::Variable{ .depth = open.env.depth }));
+    Module dependent;
+    dependent.definitions.push_back({ .x = Symbol("h"), .e = apply(id("if"), id("true"), id("w"), id("w")) });
+    dependent.definitions.push_back({ .x = Symbol("h1"), .e = apply(id("+"), id("h")) });
+    dependent.infer(open.env, 2);
+    if (auto tau = print(*open.env.lookup(Symbol("w")).value()); tau != "number") {
+        std::cout << std::format("module: 外の束縛の型変数が解決されない({})", tau) << std::endl;
+        return false;
+    }
+    return true;
 }
 
-// 雑に型を短く書くための関数
-RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = name }); }
-RefType var(TypeEnvironment& env) { return env.newType(Type::Variable{ .depth = env.depth + 1 }); }
-RefType fun(TypeEnvironment& env, RefType paramType, RefType returnType) { return env.newType(Type::Function{ .paramType = paramType, .returnType = returnType }); }
+/// <summary>
+/// <para>モジュールのトップレベルの束縛のgeneralizeの検査</para>
+/// <para>let束縛の連鎖では単相な型となる関数適用の結果が、モジュールでは強連結成分内で生成した型変数としてgeneralizeされることを確認する</para>
+/// </summary>
+/// <returns>推論結果が意図した型付けである場合はtrue、そうでない場合はfalse</returns>
+bool checkModuleGeneralization() {
+    auto print = [](const std::variant<RefType, Generic>& tau) {
+        std::ostringstream os;
+        os << (std::holds_alternative<Generic>(tau) ? std::get<Generic>(tau).type : std::get<RefType>(tau));
+        return os.str();
+    };
 
-// 雑に構文を短く書くための関数
-std::shared_ptr<Expression> c(RefType type) { return std::shared_ptr<Expression>(new Constant(type)); }
-std::shared_ptr<Expression> id(const std::string& name) { return std::shared_ptr<Expression>(new Identifier(name)); }
-std::shared_ptr<Expression> lambda(const std::string& name, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, expr)); }
-std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Apply(expr1, expr2)); }
-template <class Head, class... Tail>
-std::shared_ptr<Expression> apply(Head&& head1, Head&& head2, Tail&&... tail) { return apply(std::shared_ptr<Expression>(new Apply(head1, head2)), std::forward<Tail>(tail)...); }
-std::shared_ptr<Expression> let(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, expr1, expr2)); }
-std::shared_ptr<Expression> letrec(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, expr1, expr2)); }
+    // id = n -> n, f = id id, a = f 1, b = f true
+    Fixture fixture;
+    Module module;
+    module.definitions.push_back({ .x = Symbol("id"), .e = lambda("n", id("n")) });
+    module.definitions.push_back({ .x = Symbol("f"), .e = apply(id("id"), id("id")) });
+    module.definitions.push_back({ .x = Symbol("a"), .e = apply(id("f"), c(fixture.numberT)) });
+    module.definitions.push_back({ .x = Symbol("b"), .e = apply(id("f"), c(fixture.booleanT)) });
+    module.infer(fixture.env, 2);
+    auto f = *fixture.env.lookup(Symbol("f")).value();
+    auto a = print(*fixture.env.lookup(Symbol("a")).value());
+    auto b = print(*fixture.env.lookup(Symbol("b")).value());
+    if (!std::holds_alternative<Generic>(f) || a != "number" || b != "boolean") {
+        std::cout << std::format("module: 関数適用の結果がgeneralizeされていない(f : {}, a : {}, b : {})", print(f), a, b) << std::endl;
+        return false;
+    }
+
+    // let id = n -> n in let f = id id in let a = f 1 in f trueではfは単相な型となり型の不一致となる
+    TypeEnvironment env = fixture.env.child(fixture.env.depth);
+    auto chain = let("id", lambda("n", id("n")), let("f", apply(id("id"), id("id")), let("a", apply(id("f"), c(fixture.numberT)), apply(id("f"), c(fixture.booleanT)))));
+    try {
+        auto t = chain->J(env);
+        std::cout << std::format("module: let束縛の連鎖で関数適用の結果がgeneralizeされた({})", print(t)) << std::endl;
+        return false;
+    }
+    catch (const std::runtime_error&) {
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>編集したlet束縛の連鎖の差分型推論を計測する</para>
+/// <para>let x0 = n -> n in let x1 = n -> x0 n in ... in xnについて、全体の型推論、初回、無編集、中央の束縛を型が変化しないように編集した後の差分型推論の時間を出力する</para>
+/// <para>差分型推論の結果の型が全体の型推論の結果の型と一致することを検査する</para>
+/// <para>単相な束縛の型変数を後続の束縛が解決する連鎖についても、差分型推論の結果が全体の型推論の結果(型の不一致を含む)と一致することを検査する</para>
+/// </summary>
+/// <param name="n">最後の束縛の添字(束縛の数はn + 1)</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool incrementalEdit(std::size_t n) {
+    Fixture fixture;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto chain = [&](std::size_t edited) {
+        auto e = id(x(n));
+        for (auto i = n; i > 0; --i) {
+            auto body = apply(id(x(i - 1)), id("n"));
+            if (i == edited) {
+                // 型が変化しない編集
+                body = apply(lambda("m", id("m")), body);
+            }
+            e = let(x(i), lambda("n", body), e);
+        }
+        return let(x(0), lambda("n", id("n")), e);
+    };
+    auto print = [](RefType t) {
+        std::ostringstream os;
+        os << t;
+        return os.str();
+    };
+
+    // 連鎖の束縛はx0からxnまでのn + 1個
+    auto defs = n + 1;
+    auto ok = true;
+    for (auto algorithm : { 'J', 'M' }) {
+        auto start = std::chrono::steady_clock::now();
+        RefType full;
+        if (algorithm == 'J') {
+            full = chain(n / 2)->J(fixture.env);
+        }
+        else {
+            full = fixture.env.newType(Type::Variable{ .depth = fixture.env.depth - 1 });
+            chain(n / 2)->M(fixture.env, full);
+        }
+        auto expected = print(full);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{:<20} {} {:>8} {:>8} {:>8} {:>12.3f}", "full", algorithm, defs, 0, defs, elapsed) << std::endl;
+
+        auto session = IncrementalInference{ .env = fixture.env, .algorithm = algorithm };
+        for (auto [name, edited] : { std::pair{ "initial", std::size_t(0) }, std::pair{ "unchanged", std::size_t(0) }, std::pair{ "edit-same-type", n / 2 } }) {
+            auto program = chain(edited);
+            start = std::chrono::steady_clock::now();
+            auto actual = print(session.infer(program));
+            elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (actual != expected) {
+                std::cout << std::format("incremental: {}の型が全体の型推論と一致しない({} -> {})", name, expected, actual) << std::endl;
+                ok = false;
+            }
+            std::cout << std::format("{:<20} {} {:>8} {:>8} {:>8} {:>12.3f}", name, algorithm, defs, session.reused, session.inferred, elapsed) << std::endl;
+        }
+    }
+
+    // let id = n -> n in let f = id id in let a = f arg1 in f arg2
+    // fの型変数はaの束縛で解決されるため、arg1とarg2の型が異なる場合は型の不一致となる
+    auto monomorphic = [&](RefType arg1, RefType arg2) {
+        return let("id", lambda("n", id("n")), let("f", apply(id("id"), id("id")), let("a", apply(id("f"), c(arg1)), apply(id("f"), c(arg2)))));
+    };
+    auto result = [&](auto&& infer) {
+        try {
+            return print(infer());
+        }
+        catch (const std::runtime_error& e) {
+            return std::string(e.what());
+        }
+    };
+    for (auto algorithm : { 'J', 'M' }) {
+        auto session = IncrementalInference{ .env = fixture.env, .algorithm = algorithm };
+        // fの記録に前回の型推論で解決された型変数が残っていると編集後の結果が全体の型推論と一致しない
+        auto edits = {
+            std::tuple{ "mono-boolean", fixture.booleanT, fixture.booleanT },
+            std::tuple{ "mono-number", fixture.numberT, fixture.numberT },
+            std::tuple{ "mono-mismatch", fixture.numberT, fixture.booleanT },
+            std::tuple{ "mono-unchanged", fixture.numberT, fixture.booleanT }
+        };
+        for (auto [name, arg1, arg2] : edits) {
+            auto expected = std::vector<std::string>();
+            for (auto full : { 'J', 'M' }) {
+                expected.push_back(result([&] {
+                    TypeEnvironment env = fixture.env.child(fixture.env.depth);
+                    if (full == 'J') {
+                        return monomorphic(arg1, arg2)->J(env);
+                    }
+                    auto t = env.newType(Type::Variable{ .depth = env.depth - 1 });
+                    monomorphic(arg1, arg2)->M(env, t);
+                    return t;
+                }));
+            }
+            auto actual = result([&] { return session.infer(monomorphic(arg1, arg2)); });
+            if (actual != expected[0] || actual != expected[1]) {
+                std::cout << std::format("incremental: {}({})の型が全体の型推論と一致しない(J: {}, M: {} -> {})", name, algorithm, expected[0], expected[1], actual) << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
 
 int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
+    std::cout << std::format("{:<20} {} {:>8} {:>12} {:>12} {:>16}", "program", "A", "nodes", "ns/node", "allocs/node", "peak bytes/node") << std::endl;
+    benchmark("deep-let", deepLet, 1000, 20);
+    benchmark("wide-polymorphism", widePolymorphism, 1000, 20);
+    benchmark("long-apply", longApply, 1000, 20);
+
+    // 型が指数的に大きくなりうるプログラムの族
+    std::cout << std::endl << std::format("{:<20} {} {:>4} {:>8} {:>12} {:>12} {:>12}", "family", "A", "k", "nodes", "us", "new types", "type nodes") << std::endl;
+    auto ok = checkSharing();
+    ok = checkRollback() && ok;
+    ok = stress("pair-chain", pairChain, { 8, 16, 32, 64, 128, 256 }, false, true) && ok;
+    ok = stress("polymorphic-nest", polymorphicNest, { 2, 4, 6, 8, 10, 12 }) && ok;
+    ok = stress("ground-sharing", groundSharing, { 4, 8, 16, 32, 64 }, true) && ok;
+
+    // 互いに独立な束縛の並列な型推論
+    std::cout << std::endl << std::format("{:<20} {:>8} {:>8} {:>12} {:>8}", "module", "threads", "defs", "ms", "speedup") << std::endl;
+    ok = moduleScaling(4000, 64) && ok;
+    ok = checkModuleImports() && ok;
+    ok = checkModuleGeneralization() && ok;
+
+    // 編集したlet束縛の連鎖の差分型推論
+    std::cout << std::endl << std::format("{:<20} {} {:>8} {:>8} {:>8} {:>12}", "incremental", "A", "defs", "reused", "inferred", "ms") << std::endl;
+    ok = incrementalEdit(1000) && ok;
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
     // 型環境
     auto env = TypeEnvironment();
 
@@ -838,13 +3901,13 @@ int main() {
 
     // 型環境に式を定義
     auto ifvalT = var(env);
-    env.map.insert({ "if", env.generalize(fun(env, booleanT, fun(env, ifvalT, fun(env, ifvalT, ifvalT)))) });
-    env.map.insert({ "-", fun(env, numberT, fun(env, numberT, numberT)) });
-    env.map.insert({ "+", fun(env, numberT, fun(env, numberT, numberT)) });
-    env.map.insert({ "<", fun(env, numberT, fun(env, numberT, booleanT)) });
+    env.bind(Symbol("if"), env.generalize(fun(env, booleanT, fun(env, ifvalT, fun(env, ifvalT, ifvalT)))));
+    env.bind(Symbol("-"), fun(env, numberT, fun(env, numberT, numberT)));
+    env.bind(Symbol("+"), fun(env, numberT, fun(env, numberT, numberT)));
+    env.bind(Symbol("<"), fun(env, numberT, fun(env, numberT, booleanT)));
     // 雑に定数も登録
-    env.map.insert({ "true", booleanT });
-    env.map.insert({ "false", booleanT });
+    env.bind(Symbol("true"), booleanT);
+    env.bind(Symbol("false"), booleanT);
 
     // 定数のつもりの構文を宣言しておく
     auto _1 = c(numberT);
@@ -870,9 +3933,62 @@ int main() {
     {
         // 型環境を使いまわして型推論をすると実質的にlet束縛で式を連結したことになってしまうが
         // 今回はシャドウも型環境の上書き禁止もないため許容する
+        // INFERENCE_STATSを定義した場合はアルゴリズムごとに計測結果を出力する
+#ifdef INFERENCE_STATS
+        inferenceStats.reset();
+#endif
         std::cout << "Algorithm J: " << expr->J(env) << std::endl;
+#ifdef INFERENCE_STATS
+        inferenceStats.dump(std::cout);
+        inferenceStats.reset();
+#endif
         auto t = env.newType(Type::Variable{ .depth = env.depth - 1 });
         expr->M(env, t);
         std::cout << "Algorithm M: " << t << std::endl;
+#ifdef INFERENCE_STATS
+        inferenceStats.dump(std::cout);
+        inferenceStats.reset();
+#endif
+    }
+
+    // トップレベルの束縛をモジュールとしてまとめて型推論する
+    // 束縛の順序は問わず、互いに独立な束縛は並列に型推論し、相互再帰するisEvenとisOddは1つの強連結成分として型推論する
+    auto module = Module{
+        .definitions = {
+            { .x = Symbol("result"), .e = apply(id("twice"), lambda("n", apply(id("+"), id("n"), _1))) },
+            { .x = Symbol("twice"), .e = lambda("f", lambda("x", apply(id("f"), apply(id("f"), id("x"))))) },
+            { .x = Symbol("isEven"), .e = lambda("n", apply(id("if"), apply(id("<"), id("n"), _1), id("true"), apply(id("isOdd"), apply(id("-"), id("n"), _1)))), .recursive = true },
+            { .x = Symbol("isOdd"), .e = lambda("n", apply(id("if"), apply(id("<"), id("n"), _1), id("false"), apply(id("isEven"), apply(id("-"), id("n"), _1)))), .recursive = true }
+        }
+    };
+    module.infer(env);
+    for (auto& def : module.definitions) {
+        auto tau = env.lookup(def.x).value();
+        std::cout << "Module: " << def.x.name() << " : " << (std::holds_alternative<Generic>(*tau) ? std::get<Generic>(*tau).type : std::get<RefType>(*tau)) << std::endl;
+    }
+
+    // let束縛の連鎖を編集しながら差分型推論する
+    // kの定義を変更した場合はkとkを参照するresultのみを型推論し、変更がなければresult以外の束縛の記録を再利用する
+    // resultの型は未解決の型変数を含む単相な型のため常に型推論する
+    auto session = IncrementalInference{ .env = env };
+    auto chain = [&](std::shared_ptr<Expression> k) {
+        return let("id", lambda("n", id("n")),
+            let("k", k,
+                letrec("loop", lambda("n", apply(id("loop"), id("n"))),
+                    let("result", apply(id("k"), apply(id("id"), _1)), id("result")))));
+    };
+    for (auto& k : {
+        lambda("a", lambda("b", id("a"))),
+        lambda("a", lambda("b", id("b"))),
+        lambda("a", lambda("b", id("b"))),
+        lambda("a", lambda("b", apply(id("id"), id("b"))))
+        })
+    {
+        auto t = session.infer(chain(k));
+        std::cout << std::format("Incremental: reused {}, inferred {} : ", session.reused, session.inferred) << t << std::endl;
     }
-}
\ No newline at end of file
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
+}
+#endif
\ No newline at end of file
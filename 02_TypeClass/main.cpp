@@ -1,1558 +1,5040 @@
 ﻿#include <string>
+#include <string_view>
 #include <vector>
+#include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <format>
 #include <memory>
 #include <variant>
 #include <type_traits>
 #include <optional>
+#include <deque>
+#include <utility>
+#include <cstdint>
+#include <bit>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#if defined(INFERENCE_STATS) || defined(INFERENCE_TRACE)
+#include <chrono>
+#endif
+#ifdef INFERENCE_TRACE
+#include <fstream>
+#endif
+#ifdef BENCHMARK
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#endif
 
 #include <iostream>
 
-struct Type;
-
-/// <summary>
-/// 型への参照
-/// </summary>
-using RefType = std::shared_ptr<Type>;
-
-
-struct TypeClass;
-
 /// <summary>
-/// 型クラスへの参照
-/// </summary>
-using RefTypeClass = std::shared_ptr<TypeClass>;
-
-struct TypeMap;
-
-/// <summary>
-/// 型クラスの集合としての型制約
+/// <para>追記のみ可能なリスト</para>
+/// <para>要素数を倍々に増やしたセグメントに格納するため要素のアドレスは移動せず、追記と並行してロックなしで追記済みの要素を読み取れる</para>
+/// <para>追記同士の排他は呼び出し側で行う</para>
 /// </summary>
-struct Constraints {
-    /// <summary>
-    /// 実装対象の型クラスのリスト
-    /// </summary>
-    std::vector<RefTypeClass> list = {};
-
+template <class T>
+struct AppendOnlyList {
     /// <summary>
-    /// <para>型制約をマージする</para>
-    /// <para>型クラスの継承関係により縮約を適用行いながらマージを行うため縮約を行わない場合は直接constraintsを操作する</para>
+    /// 先頭のセグメントの要素数
     /// </summary>
-    /// <param name="constraints">マージ対象の型クラス</param>
-    void merge(const std::vector<RefTypeClass>& constraints);
+    static constexpr std::size_t FIRST = 64;
 
     /// <summary>
-    /// 制約を持つか検査
+    /// <para>セグメントの先頭のポインタ</para>
+    /// <para>k番目のセグメントはFIRST * 2^k個の要素を格納する</para>
     /// </summary>
-    /// <param name="typeClass">制約を持つか検査する型クラス</param>
-    [[nodiscard]] bool has(RefTypeClass typeClass) const;
+    std::array<std::atomic<T*>, 48> segments = {};
 
     /// <summary>
-    /// 指定されたクラスメソッドを抽出する
+    /// 要素数
     /// </summary>
-    /// <param name="name">クラスメソッド名</param>
-    /// <returns>
-    /// <para>指定されたクラスメソッドを実装した型クラスとconstraintsのインデックスのペア</para>
-    /// <para>constraintsに存在しないが基底から型クラスを取得した場合はconstraintsのサイズがインデックスとなる</para>
-    /// </returns>
-    [[nodiscard]] std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> getClassMethod(std::string& name) const;
-};
-
-/// <summary>
-/// 型の表現
-/// </summary>
-struct Type {
+    std::atomic<std::size_t> count = 0;
+
+    AppendOnlyList() = default;
+    AppendOnlyList(const AppendOnlyList&) = delete;
+    AppendOnlyList& operator=(const AppendOnlyList&) = delete;
+    ~AppendOnlyList() {
+        for (auto& segment : this->segments) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
+    }
 
     /// <summary>
-    /// 基底型
+    /// インデックスからセグメントとセグメント内の位置を求める
     /// </summary>
-    struct Base {
-        /// <summary>
-        /// 型名
-        /// </summary>
-        const std::string name;
-    };
+    /// <param name="i">インデックス</param>
+    /// <returns>セグメントの番号とセグメント内の位置の組</returns>
+    [[nodiscard]] static std::pair<std::size_t, std::size_t> locate(std::size_t i) {
+        auto k = static_cast<std::size_t>(std::bit_width(i / FIRST + 1) - 1);
+        return { k, i - FIRST * ((std::size_t(1) << k) - 1) };
+    }
 
     /// <summary>
-    /// 関数型
+    /// 追記済みの要素を取得する
     /// </summary>
-    struct Function {
-        /// <summary>
-        /// 基底型としての意味を示す型
-        /// </summary>
-        RefType base;
-
-        /// <summary>
-        /// 引数型
-        /// </summary>
-        RefType paramType;
-
-        /// <summary>
-        /// 戻り値型
-        /// </summary>
-        RefType returnType;
-    };
+    /// <param name="i">インデックス</param>
+    /// <returns>要素</returns>
+    [[nodiscard]] const T& operator[](std::size_t i) const {
+        auto [k, offset] = AppendOnlyList::locate(i);
+        return this->segments[k].load(std::memory_order_acquire)[offset];
+    }
 
     /// <summary>
-    /// 型変数
+    /// 要素数を取得する
     /// </summary>
-    struct Variable {
-        /// <summary>
-        /// 型制約
-        /// </summary>
-        Constraints constraints = {};
-
-        /// <summary>
-        /// 型変数の解決結果の型
-        /// </summary>
-        std::optional<RefType> solve = std::nullopt;
-
-        /// <summary>
-        /// スコープの深さ
-        /// </summary>
-        const std::size_t depth = 1;
-    };
+    [[nodiscard]] std::size_t size() const {
+        return this->count.load(std::memory_order_acquire);
+    }
 
     /// <summary>
-    /// ジェネリック型に出現する型変数
+    /// 末尾に要素を追記する
     /// </summary>
-    struct Param {
-        /// <summary>
-        /// 型制約
-        /// </summary>
-        Constraints constraints = {};
-
-        /// <summary>
-        /// ジェネリック型の型変数のインデックス
-        /// </summary>
-        const std::size_t index = 0;
-    };
+    /// <param name="value">追記する要素</param>
+    /// <returns>追記した要素</returns>
+    const T& push_back(T value) {
+        auto i = this->count.load(std::memory_order_relaxed);
+        auto [k, offset] = AppendOnlyList::locate(i);
+        auto segment = this->segments[k].load(std::memory_order_relaxed);
+        if (!segment) {
+            segment = new T[FIRST << k];
+            this->segments[k].store(segment, std::memory_order_release);
+        }
+        segment[offset] = std::move(value);
+        this->count.store(i + 1, std::memory_order_release);
+        return segment[offset];
+    }
+};
 
+/// <summary>
+/// <para>識別子名とシンボルの識別番号の対応表</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し識別子名の取得はロックなしで行う</para>
+/// </summary>
+struct SymbolTable {
     /// <summary>
-    /// 型としての型クラス
+    /// <para>識別番号から識別子名への表</para>
+    /// <para>識別子名への参照をキーとして保持するため要素のアドレスが移動しないAppendOnlyListで保持する</para>
     /// </summary>
-    struct TypeClass {
-        /// <summary>
-        /// 型として扱う型クラス
-        /// </summary>
-        Constraints typeClasses = {};
-    };
-
-    // 本来はこの他にタプルやリスト、エイリアスなどの組み込み機能を定義する
-
+    AppendOnlyList<std::string> names = {};
 
     /// <summary>
-    /// 型の固有情報を示す型
+    /// 識別子名から識別番号への表
     /// </summary>
-    using kind_type = std::variant<Base, Function, Variable, Param, TypeClass>;
+    std::unordered_map<std::string_view, std::uint32_t> ids = {};
 
     /// <summary>
-    /// 型の固有情報
+    /// 登録の排他制御
     /// </summary>
-    kind_type kind;
+    std::mutex mutex = {};
 
     /// <summary>
-    /// 型名の取得
+    /// 識別子名の登録
     /// </summary>
-    /// <returns>トップレベルで型が一意な場合にのみ型名を返す</returns>
-    [[nodiscard]] std::optional<const std::string*> getTypeName() const {
-        if (std::holds_alternative<Type::Base>(this->kind)) {
-            return std::addressof(std::get<Type::Base>(this->kind).name);
-        }
-        else if (std::holds_alternative<Type::Function>(this->kind)) {
-            return std::get<Type::Function>(this->kind).base->getTypeName();
+    /// <param name="name">識別子名</param>
+    /// <returns>nameに対応する識別番号</returns>
+    [[nodiscard]] std::uint32_t intern(std::string_view name) {
+        std::lock_guard lock(this->mutex);
+        if (auto itr = this->ids.find(name); itr != this->ids.end()) {
+            return itr->second;
         }
-        return std::nullopt;
+        auto id = static_cast<std::uint32_t>(this->names.size());
+        this->ids.insert({ this->names.push_back(std::string(name)), id });
+        return id;
     }
 
     /// <summary>
-    /// 型に紐づく型クラスのリストの取得
+    /// 全体で共有するシンボル表の取得
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <returns>型に紐づく型クラスのリスト</returns>
-    [[nodiscard]] const Constraints& getTypeClassList(TypeMap& typeMap) const;
+    /// <returns>シンボル表</returns>
+    [[nodiscard]] static SymbolTable& instance() {
+        static SymbolTable table;
+        return table;
+    }
 };
 
 /// <summary>
-/// ジェネリック型
+/// <para>識別子のシンボル</para>
+/// <para>識別子名は構文木の構築時にシンボル表へ登録し、型環境では32bitの識別番号をキーとして扱う</para>
 /// </summary>
-struct Generic {
+struct Symbol {
     /// <summary>
-    /// 型変数のリスト
+    /// シンボル表における識別番号
     /// </summary>
-    std::vector<RefType> vals;
+    std::uint32_t id = 0;
+
+    Symbol() = default;
+    explicit Symbol(std::string_view name) : id(SymbolTable::instance().intern(name)) {}
 
     /// <summary>
-    /// 型変数valsを内部で持つ型
+    /// 識別子名の取得
     /// </summary>
-    RefType type;
+    /// <returns>シンボルに対応する識別子名</returns>
+    [[nodiscard]] const std::string& name() const {
+        return SymbolTable::instance().names[this->id];
+    }
+
+    [[nodiscard]] bool operator==(const Symbol&) const = default;
 };
 
 /// <summary>
-/// 解決済みの型を取得する
+/// Symbolのハッシュ関数
 /// </summary>
-/// <param name="type">チェックを行う型</param>
-/// <returns>解決済みの型</returns>
-RefType solved(RefType type) {
-    if (std::holds_alternative<Type::Variable>(type->kind)) {
-        auto& val = std::get<Type::Variable>(type->kind);
-        if (val.solve) {
-            // 解決結果が再適用されないように適用しておく
-            return val.solve.emplace(solved(val.solve.value()));
-        }
+template<>
+struct std::hash<Symbol> {
+    [[nodiscard]] std::size_t operator()(const Symbol& symbol) const noexcept {
+        return symbol.id;
     }
-    return type;
-}
+};
+
+struct Type;
 
 /// <summary>
-/// 型環境
+/// <para>型への参照</para>
+/// <para>型の実体はTypeArenaが所有するため参照カウントはもたない</para>
 /// </summary>
-struct TypeEnvironment {
+using RefType = Type*;
+
+
+struct TypeClass;
+
+/// <summary>
+/// 型クラスへの参照
+/// </summary>
+using RefTypeClass = std::shared_ptr<TypeClass>;
+
+struct TypeMap;
+struct TypeData;
+
+/// <summary>
+/// <para>型クラスの通し番号の集合</para>
+/// <para>通し番号をビットの位置とするビット集合で先頭の64個はヒープを確保せずに保持する</para>
+/// </summary>
+struct TypeClassSet {
     /// <summary>
-    /// スコープにおいて1つ上の型環境
+    /// ヒープを確保せずに保持する通し番号の個数
     /// </summary>
-    TypeEnvironment* parent = nullptr;
+    static constexpr std::size_t INLINE_BITS = 64;
 
     /// <summary>
-    /// スコープの深さ
+    /// 通し番号が0から63のビット
     /// </summary>
-    std::size_t depth = 1;
+    std::uint64_t head = 0;
 
     /// <summary>
-    /// 型環境についての識別子と型のペアの表
+    /// 通し番号が64以上のビット(大規模なプログラムでのみ確保する)
     /// </summary>
-    std::unordered_map<std::string, std::variant<RefType, Generic>> map = {};
+    std::vector<std::uint64_t> overflow = {};
 
     /// <summary>
-    /// 識別子の名称から型を取り出す
+    /// 通し番号を追加する
     /// </summary>
-    /// <param name="name">識別子の名称</param>
-    /// <returns>nameに対応する型</returns>
-    [[nodiscard]] std::optional<const std::variant<RefType, Generic>*> lookup(const std::string& name) const {
-        if (auto itr = this->map.find(name); itr != this->map.end()) {
-            // std::optionalは参照型は返せないのでポインタを返す
-            return std::addressof(itr->second);
+    /// <param name="id">追加する通し番号</param>
+    void insert(std::size_t id) {
+        if (id < INLINE_BITS) {
+            this->head |= std::uint64_t(1) << id;
+            return;
         }
-        else if (this->depth != 0 && this->parent) {
-            // 見つからないかつ1つ上の型環境が存在するならそこから取得
-            return this->parent->lookup(name);
+        auto word = id / INLINE_BITS - 1;
+        if (this->overflow.size() <= word) {
+            this->overflow.resize(word + 1, 0);
         }
-        return std::nullopt;
+        this->overflow[word] |= std::uint64_t(1) << (id % INLINE_BITS);
     }
 
     /// <summary>
-    /// 型の生成
+    /// 通し番号を含むか判定
     /// </summary>
-    /// <param name="kind">型の固有情報</param>
-    /// <returns>生成した型</returns>
-    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
-        return RefType(new Type({ .kind = std::move(kind) }));
+    /// <param name="id">判定する通し番号</param>
+    /// <returns>含む場合はtrue、含まない場合はfalse</returns>
+    [[nodiscard]] bool contains(std::size_t id) const {
+        if (id < INLINE_BITS) {
+            return (this->head >> id) & 1;
+        }
+        auto word = id / INLINE_BITS - 1;
+        return word < this->overflow.size() && ((this->overflow[word] >> (id % INLINE_BITS)) & 1);
     }
 
     /// <summary>
-    /// 自由な型変数について型をgeneralizeする
+    /// 和集合を取る
     /// </summary>
-    /// <param name="type">複製対象の型</param>
-    /// <param name="env">型環境</param>
-    /// <param name="vals">generalize対象の型変数のリスト</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type, std::vector<RefType> vals = std::vector<RefType>());
+    /// <param name="other">和集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator|=(const TypeClassSet& other) {
+        this->head |= other.head;
+        if (this->overflow.size() < other.overflow.size()) {
+            this->overflow.resize(other.overflow.size(), 0);
+        }
+        for (std::size_t i = 0; i < other.overflow.size(); ++i) {
+            this->overflow[i] |= other.overflow[i];
+        }
+        return *this;
+    }
 
     /// <summary>
-    /// ジェネリック型の型変数についてinstantiateする
+    /// 積集合を取る
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="type">複製対象の型</param>
-    /// <param name="vals">型変数へ適用対象の型</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] RefType instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals = std::vector<RefType>());
-};
-
-/// <summary>
-/// 自由な型変数について型をgeneralizeする
-/// </summary>
-/// <param name="type">複製対象の型</param>
-/// <param name="env">型環境</param>
-/// <param name="vals">generalize対象の型変数のリスト</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type, std::vector<RefType> vals) {
-    std::unordered_map<RefType, typename std::vector<RefType>::size_type> map;
-
-    struct fn {
-        RefType& t;
-        TypeEnvironment& e;
-        std::vector<RefType>& v;
-        std::unordered_map<RefType, typename std::vector<RefType>::size_type>& m;
-
-        RefType operator()([[maybe_unused]] Type::Base& x) {
-            // generalizeしない
-            return this->t;
+    /// <param name="other">積集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator&=(const TypeClassSet& other) {
+        this->head &= other.head;
+        if (this->overflow.size() > other.overflow.size()) {
+            this->overflow.resize(other.overflow.size());
         }
-        RefType operator()(Type::Function& x) {
-            // 引数型と戻り値型をgeneralizeする
-            auto genParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .m = this->m }, x.paramType->kind);
-            if (x.paramType != genParamType) {
-                x.paramType = genParamType;
-            }
-            auto genReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .m = this->m }, x.returnType->kind);
-            if (x.returnType != genReturnType) {
-                x.returnType = genReturnType;
-            }
-            return this->t;
+        for (std::size_t i = 0; i < this->overflow.size(); ++i) {
+            this->overflow[i] &= other.overflow[i];
         }
-        RefType operator()(Type::Variable& x) {
-            if (x.solve) {
-                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
-                // この際にGeneric型から完全に型変数を除去するために簡約
-                this->t = solved(x.solve.value());
-                return std::visit(fn{ .t = this->t, .e = this->e, .v = this->v, .m = this->m }, this->t->kind);
-            }
+        return *this;
+    }
 
-            if (this->e.depth < x.depth) {
-                // 自由な型変数のためgeneralizeする
-                if (auto itr = this->m.find(this->t); itr != this->m.end()) {
-                    return this->v[itr->second];
-                }
-                else {
-                    this->m.insert({ this->t, this->v.size() });
-                    // 導出した型変数に対する型制約は継承する
-                    this->v.push_back(this->e.newType(Type::Param{ .constraints = std::move(x.constraints), .index = this->v.size() }));
-                    return this->v.back();
-                }
-            }
-            else {
-                // 束縛された型変数のためgeneralizeしない
-                return this->t;
-            }
-        }
-        RefType operator()([[maybe_unused]] Type::Param& x) {
-            // 外のスコープから与えられた型変数のためgeneralizeしない
-            // 現状の実装ではこのシチュエーションは(おそらく)生じない
-            return this->t;
+    /// <summary>
+    /// 通し番号を除去する
+    /// </summary>
+    /// <param name="id">除去する通し番号</param>
+    void erase(std::size_t id) {
+        if (id < INLINE_BITS) {
+            this->head &= ~(std::uint64_t(1) << id);
+            return;
         }
-        RefType operator()([[maybe_unused]] Type::TypeClass& x) {
-            // 型としての型クラスは型変数に依存しないためgeneralizeしない
-            return this->t;
+        auto word = id / INLINE_BITS - 1;
+        if (word < this->overflow.size()) {
+            this->overflow[word] &= ~(std::uint64_t(1) << (id % INLINE_BITS));
         }
-    };
-
-    auto t = std::visit(fn{ .t = type, .e = *this, .v = vals, .m = map }, type->kind);
-    if (vals.size() > 0) {
-        return Generic{ .vals = std::move(vals), .type = std::move(t) };
     }
-    else {
-        return t;
-    }
-}
 
-/// <summary>
-/// <para>型クラス</para>
-/// <para>型クラスごとに一意のインスタンスを持つ</para>
-/// </summary>
-struct TypeClass {
     /// <summary>
-    /// 型クラス名
+    /// 差集合を取る
     /// </summary>
-    const std::string name;
+    /// <param name="other">差集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator-=(const TypeClassSet& other) {
+        this->head &= ~other.head;
+        for (std::size_t i = 0; i < std::min(this->overflow.size(), other.overflow.size()); ++i) {
+            this->overflow[i] &= ~other.overflow[i];
+        }
+        return *this;
+    }
 
     /// <summary>
-    /// <para>基底</para>
-    /// <para>基底のtypeはthisのtypeと一致する</para>
+    /// otherを部分集合として含むか判定
     /// </summary>
-    Constraints bases = {};
+    /// <param name="other">判定する集合</param>
+    /// <returns>含む場合はtrue、含まない場合はfalse</returns>
+    [[nodiscard]] bool includes(const TypeClassSet& other) const {
+        if ((other.head & ~this->head) != 0) {
+            return false;
+        }
+        for (std::size_t i = 0; i < other.overflow.size(); ++i) {
+            auto word = i < this->overflow.size() ? this->overflow[i] : 0;
+            if ((other.overflow[i] & ~word) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
 
     /// <summary>
-    /// <para>型クラスを実装する対象の型を示す型変数</para>
-    /// <para>制約なしの空なType::Paramである必要がある</para>
+    /// 空集合であるか判定
     /// </summary>
-    RefType type;
+    /// <returns>空集合の場合はtrue、それ以外の場合はfalse</returns>
+    [[nodiscard]] bool empty() const {
+        return this->head == 0 && std::ranges::all_of(this->overflow, [](auto word) { return word == 0; });
+    }
 
     /// <summary>
-    /// <para>クラスメソッド</para>
-    /// <para>第一引数はtype(self)固定</para>
+    /// 要素数を取得する
     /// </summary>
-    std::unordered_map<std::string, std::variant<RefType, Generic>> methods = {};
+    /// <returns>要素数</returns>
+    [[nodiscard]] std::size_t size() const {
+        std::size_t size = std::popcount(this->head);
+        for (auto word : this->overflow) {
+            size += std::popcount(word);
+        }
+        return size;
+    }
 
     /// <summary>
-    /// thisが指定された型クラスを継承しているか判定
+    /// 通し番号の昇順に要素を走査する
     /// </summary>
-    /// <param name="typeClass">継承しているか判定する対象の型クラス</param>
-    /// <returns>継承している場合はtrue、継承していない場合はfalse</returns>
-    [[nodiscard]] bool derived(RefTypeClass typeClass) const {
-        // 型クラス/インスタンスの一意性に基づき評価する
-        if (this == typeClass.get()) {
-            return true;
+    /// <param name="f">各通し番号に対して呼び出す関数</param>
+    template <class F>
+    void forEach(F&& f) const {
+        for (auto word = this->head; word != 0; word &= word - 1) {
+            f(static_cast<std::size_t>(std::countr_zero(word)));
         }
-        for (const auto& e : this->bases.list) {
-            if (e->derived(typeClass)) {
-                return true;
+        for (std::size_t i = 0; i < this->overflow.size(); ++i) {
+            for (auto word = this->overflow[i]; word != 0; word &= word - 1) {
+                f((i + 1) * INLINE_BITS + std::countr_zero(word));
             }
         }
-        return false;
+    }
+
+    /// <summary>
+    /// 集合が等しいか判定
+    /// </summary>
+    /// <param name="other">比較対象の集合</param>
+    /// <returns>等しい場合はtrue、等しくない場合はfalse</returns>
+    [[nodiscard]] bool operator==(const TypeClassSet& other) const {
+        return this->includes(other) && other.includes(*this);
     }
 };
 
 /// <summary>
-/// <para>型制約をマージする</para>
-/// <para>型クラスの継承関係により縮約を適用行いながらマージを行うため縮約を行わない場合は直接constraintsを操作する</para>
+/// TypeClassSetのハッシュ関数
 /// </summary>
-/// <param name="constraints">マージ対象の型クラス</param>
-void Constraints::merge(const std::vector<RefTypeClass>& constraints) {
-    if (constraints.empty()) {
-        return;
-    }
-
-    if (this->list.empty()) {
-        // もともと制約がない場合は単純コピーをする
-        this->list = constraints;
-    }
-    else {
-        auto size = this->list.size();
-        // 全ての型制約を検査してより制約が強いものに置き換える
-        for (auto& constraint : constraints) {
-            for (decltype(size) i = 0; i < size; ++i) {
-                // constraintもしくはconstraintの部分型クラスである場合はスキップする
-                if (constraint != this->list[i] || this->list[i]->derived(constraint)) {
-                    continue;
-                }
-
-                if (constraint->derived(this->list[i])) {
-                    if (constraint != this->list[i]) {
-                        this->list[i] = constraint;
-                    }
-                }
-                else {
-                    // 存在しない制約の場合はその制約を追加する
-                    this->list.push_back(constraint);
-                }
+template<>
+struct std::hash<TypeClassSet> {
+    [[nodiscard]] std::size_t operator()(const TypeClassSet& set) const noexcept {
+        std::size_t seed = std::hash<std::uint64_t>{}(set.head);
+        // 末尾の0のワードの有無によらず等しい集合が同じハッシュ値となるように0のワードは読み飛ばす
+        for (std::size_t i = 0; i < set.overflow.size(); ++i) {
+            if (set.overflow[i] != 0) {
+                seed ^= std::hash<std::uint64_t>{}(set.overflow[i] ^ i) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
             }
         }
+        return seed;
     }
-}
+};
 
 /// <summary>
-/// 制約を持つか検査
+/// <para>型クラスの通し番号と型クラスの対応表</para>
+/// <para>型クラスの通し番号は全ての型表で共通とするため1つのインスタンスのみ持つ</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し型クラスの取得はロックなしで行う</para>
 /// </summary>
-/// <param name="typeClass">制約を持つか検査する型クラス</param>
-[[nodiscard]] bool Constraints::has(RefTypeClass typeClass) const {
-    // 全てのtypeが実装している型クラスについて検査する
-    for (const auto& typeClass2 : this->list) {
-        if (typeClass2->derived(typeClass)) {
-            return true;
-        }
-    }
-    return false;
-}
+struct TypeClassTable {
+    /// <summary>
+    /// <para>登録済みの型クラスのリスト</para>
+    /// <para>型クラスの通し番号をインデックスとする</para>
+    /// </summary>
+    AppendOnlyList<RefTypeClass> typeClasses = {};
 
-/// <summary>
-/// 指定されたクラスメソッドを抽出する
-/// </summary>
-/// <param name="name">クラスメソッド名</param>
-/// <returns>
-/// <para>指定されたクラスメソッドを実装した型クラスとconstraintsのインデックスのペア</para>
-/// <para>constraintsに存在しないが基底から型クラスを取得した場合はconstraintsのサイズがインデックスとなる</para>
-/// </returns>
-[[nodiscard]] std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> Constraints::getClassMethod(std::string& name) const {
-    for (decltype(this->list.size()) i = 0; i < this->list.size(); ++i) {
-        // constraints[i]がnameをクラスメソッドとして定義しているか取得
-        auto [typeClass, index] = ([&]() -> std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> {
-            if (auto itr = this->list[i]->methods.find(name); itr != this->list[i]->methods.end()) {
-                return { this->list[i], i };
-            }
-            else {
-                // 基底に存在するかを探索
-                return { this->list[i]->bases.getClassMethod(name).first, this->list.size() };
-            }
-        })();
+    /// <summary>
+    /// 登録の排他制御
+    /// </summary>
+    std::mutex mutex = {};
 
-        if (typeClass) {
-            // 1つ目のnameという名称のクラスメソッドが見つかった場合は2つ目以降が存在するか確認する
-            for (decltype(this->list.size()) j = i + 1; j < this->list.size(); ++j) {
-                // nameというクラスメソッドを定義している型クラスが存在する場合は返却するインデックスを更新する
-                if (typeClass.value() == this->list[j]) {
-                    index = j;
-                    continue;
-                }
+    /// <summary>
+    /// <para>型クラスを登録して通し番号を採番する</para>
+    /// <para>採番した通し番号は型クラスへ記録し、基底の通し番号の集合に自身を加える</para>
+    /// </summary>
+    /// <param name="typeClass">登録する型クラス</param>
+    /// <param name="ancestors">基底の通し番号の集合</param>
+    void add(const RefTypeClass& typeClass, TypeClassSet ancestors);
 
-                // nameというクラスメソッドを定義している型クラスの基底はnameというクラスメソッドを定義していても無視する
-                // 要は基底よりも派生の方をクラスメソッドの探索対象として優先する
-                if (!typeClass.value()->derived(this->list[j]) && this->list[j]->methods.contains(name)) {
-                    if (this->list[j]->derived(typeClass.value())) {
-                        return { this->list[j], j };
-                    }
-                    throw std::runtime_error(std::format("クラスメソッドが一意に特定できない：{}", name));
-                }
-            }
-            return { typeClass, index };
-        }
+    /// <summary>
+    /// 対応表のインスタンスを取得する
+    /// </summary>
+    /// <returns>対応表</returns>
+    static TypeClassTable& instance() {
+        static TypeClassTable table;
+        return table;
     }
-    return { std::nullopt, this->list.size() };
-}
+};
 
 /// <summary>
-/// 型に関するデータ
+/// 型クラスの集合としての型制約
 /// </summary>
-struct TypeData {
+struct Constraints {
     /// <summary>
-    /// 型の表現
+    /// <para>実装対象の型クラスの通し番号の集合</para>
+    /// <para>継承関係にある型クラス同士は最も派生した型クラスのみに縮約して保持する</para>
     /// </summary>
-    std::variant<RefType, Generic> type;
+    TypeClassSet set = {};
 
     /// <summary>
-    /// 実装している型クラス(制約)
+    /// <para>setの型クラスが継承している型クラス(自身を含む)の通し番号の集合</para>
+    /// <para>制約を持つかの検査に用いる</para>
     /// </summary>
-    Constraints typeclasses = {};
-};
+    TypeClassSet closure = {};
+
+    Constraints() = default;
+    Constraints(std::initializer_list<RefTypeClass> typeClasses);
 
-/// <summary>
-/// 型表
-/// </summary>
-struct TypeMap {
     /// <summary>
-    /// 型の表
+    /// 型制約を追加する
     /// </summary>
-    std::unordered_map<std::string, TypeData> typeMap = {};
+    /// <param name="typeClass">追加する型クラス(登録済みである必要がある)</param>
+    void insert(const RefTypeClass& typeClass);
 
     /// <summary>
-    /// 型クラスの表
+    /// <para>型制約をマージする</para>
+    /// <para>型クラスの継承関係により縮約を適用しながらマージを行う</para>
     /// </summary>
-    std::unordered_map<std::string, RefTypeClass> typeClassMap = {};
+    /// <param name="constraints">マージ対象の型クラス</param>
+    void merge(const Constraints& constraints);
 
     /// <summary>
-    /// <para>組込み型の定義</para>
-    /// <para>型の生成時は必ずこれを経由する</para>
+    /// 制約を持つか検査
     /// </summary>
-    struct {
-        /// <summary>
-        /// 関数型
-        /// </summary>
-        Generic fn;
-    } builtin;
+    /// <param name="typeClass">制約を持つか検査する型クラス</param>
+    [[nodiscard]] bool has(const RefTypeClass& typeClass) const;
 
     /// <summary>
-    /// 型定義の追加
+    /// 全ての制約を持つか検査
     /// </summary>
-    /// <param name="type">追加する型</param>
-    /// <returns>追加した型</returns>
-    auto& addType(RefType type) {
-        // 型から型名を取り出して登録する
-        auto typeName = type->getTypeName();
-        assert(!!typeName);
-        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type }});
-        if (!ret) {
-            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
-        }
-        return *itr;
+    /// <param name="constraints">制約を持つか検査する型制約</param>
+    [[nodiscard]] bool includes(const Constraints& constraints) const {
+        return this->closure.includes(constraints.set);
     }
 
     /// <summary>
-    /// 型定義の追加
+    /// 型制約が空であるか判定
     /// </summary>
-    /// <param name="type">追加する型</param>
-    /// <returns>追加した型</returns>
-    auto& addType(const Generic& type) {
-        // 型から型名を取り出して登録する
-        auto typeName = type.type->getTypeName();
-        assert(!!typeName);
-        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type } });
-        if (!ret) {
-            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
-        }
-        return *itr;
+    [[nodiscard]] bool empty() const {
+        return this->set.empty();
     }
 
     /// <summary>
-    /// 型クラスの定義の追加
+    /// 縮約された型クラスの個数を取得する
     /// </summary>
-    /// <param name="typeClass">追加する型クラス</param>
-    /// <returns>追加した型クラス</returns>
-    auto& addTypeClass(RefTypeClass typeClass) {
-        auto [itr, ret] = this->typeClassMap.insert({ typeClass->name, typeClass });
-        if (!ret) {
-            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
-        }
-        return *itr;
+    [[nodiscard]] std::size_t size() const {
+        return this->set.size();
     }
 
     /// <summary>
-    /// 型に制約としての型クラスを適用する
+    /// 縮約された型クラスが一致するか判定
     /// </summary>
-    /// <param name="type">適用対象の型</param>
-    /// <param name="typeClass">適用対象の型クラス</param>
-    void applyConstraint(RefType type, const std::vector<RefTypeClass>& typeClasses) {
-
-        // 解決済みの型変数が存在すればそれを適用してから制約の適用を行う
-        auto t = solved(type);
-
-        if (std::holds_alternative<Type::Variable>(t->kind)) {
-            // 通常の型変数に対しては後からでも自由に型制約を追加可能
-
-            // 型制約にtypeClassesを追加
-            std::get<Type::Variable>(t->kind).constraints.merge(typeClasses);
-        }
-        else {
-            // トップレベルが型変数ではない通常の型の場合は後から型制約の追加は禁止
-            // 型がtypeClassesを実装しているか検査する
-
-            auto& constraints = t->getTypeClassList(*this);
+    /// <param name="other">比較対象の型制約</param>
+    [[nodiscard]] bool operator==(const Constraints& other) const {
+        return this->set == other.set;
+    }
 
-            for (auto& typeClass : typeClasses) {
-                // typeがtypeClassを実装しているか検査する
-                // 実装していない型クラスが見つかった場合は異常とする
-                if (!constraints.has(typeClass)) {
-                    // typeClassMapから型クラス名の逆引きを試みる
-                    if (auto itr = std::ranges::find_if(this->typeClassMap, [&typeClass](auto& p) { return p.second == typeClass; }); itr != this->typeClassMap.end()) {
-                        if (std::holds_alternative<Type::Param>(t->kind)) {
-                            throw std::runtime_error(std::format("ジェネリック型における型変数は事前に制約{}の宣言が必要", itr->first));
-                        }
-                        throw std::runtime_error(std::format("型クラス{}を実装していない", itr->first));
-                    }
-                    else {
-                        // 匿名の型クラス（未実装）を制約として課そうとしたときの異常のため
-                        // ここに到達することは論理エラーとする
-                        assert(false);
-                    }
-                }
-            }
-        }
+    /// <summary>
+    /// 縮約された型クラスを通し番号の昇順に走査する
+    /// </summary>
+    /// <param name="f">各型クラスに対して呼び出す関数</param>
+    template <class F>
+    void forEach(F&& f) const {
+        auto& table = TypeClassTable::instance();
+        this->set.forEach([&](std::size_t id) { f(table.typeClasses[id]); });
     }
+
+private:
+    /// <summary>
+    /// 他の型クラスの基底となっている型クラスをsetから除去する
+    /// </summary>
+    void reduce();
 };
 
 /// <summary>
-/// 型に紐づく型クラスのリストの取得
+/// <para>型制約の共有表</para>
+/// <para>縮約された型クラスの集合が等しい型制約は1つの実体を共有し、型には識別番号のみを持たせる</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し型制約の取得と登録済みの型制約の検索はロックなしで行う</para>
 /// </summary>
-/// <param name="typeMap">型表</param>
-/// <returns>型に紐づく型クラスのリスト</returns>
-const Constraints& Type::getTypeClassList(TypeMap& typeMap) const {
-    // 型変数の場合は型制約としての型クラスのリストを返す
-    if (std::holds_alternative<Type::Variable>(this->kind)) {
-        return std::get<Type::Variable>(this->kind).constraints;
-    }
-    else if (std::holds_alternative<Type::Param>(this->kind)) {
-        return std::get<Type::Param>(this->kind).constraints;
-    }
-    else if (std::holds_alternative<Type::TypeClass>(this->kind)) {
-        // 型としての型クラスはそのまま保持している型クラスのリストを返す
-        return std::get<Type::TypeClass>(this->kind).typeClasses;
-    }
+struct ConstraintsTable {
+    /// <summary>
+    /// <para>縮約された型クラスの集合から識別番号への索引(開番地法のハッシュ表)</para>
+    /// <para>スロットは識別番号 + 1を保持し(0は空き)、登録済みのスロットは書き換えない</para>
+    /// </summary>
+    struct Index {
+        /// <summary>
+        /// スロットの列(要素数は2の冪)
+        /// </summary>
+        std::unique_ptr<std::atomic<std::uint32_t>[]> slots;
 
-    // それ以外の型(明示的に型名を持つ型)は型表にアクセスして取得する
-    auto name = this->getTypeName();
-    assert(!!name);
-    assert(typeMap.typeMap.contains(*name.value()));
+        /// <summary>
+        /// スロットの数から1を引いたもの
+        /// </summary>
+        std::size_t mask;
 
-    return typeMap.typeMap.at(*name.value()).typeclasses;
-}
+        explicit Index(std::size_t capacity) : slots(new std::atomic<std::uint32_t>[capacity]()), mask(capacity - 1) {}
+    };
 
-/// <summary>
-/// ジェネリック型の型変数についてinstantiateする
-/// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="type">複製対象の型</param>
-/// <param name="vals">型変数へ適用対象の型</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] RefType TypeEnvironment::instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals) {
-    // instantiateした対象の型変数のリスト
-    vals.resize(type.vals.size());
+    /// <summary>
+    /// <para>識別番号から型制約への表(識別番号0は空の型制約)</para>
+    /// <para>要素への参照を返すため要素のアドレスが移動しないAppendOnlyListで保持する</para>
+    /// </summary>
+    AppendOnlyList<Constraints> values = {};
 
-    // デフォルトでvalsが要素をもつときは型制約を適用・検査する
-    for (decltype(type.vals.size()) i = 0; i < type.vals.size(); ++i) {
-        auto& param = std::get<Type::Param>(type.vals[i]->kind);
-        if (!vals[i]) {
-            // 型が割当たっていない場合は型変数を割り当てる
-            // 型変数に課された制約を継承する
-            vals[i] = this->newType(Type::Variable{ .constraints = param.constraints, .depth = this->depth });
+    /// <summary>
+    /// <para>検索に用いる最新の索引</para>
+    /// <para>拡張時は新たな索引を構築してから差し替えるため、検索中の索引は書き換わらない</para>
+    /// </summary>
+    std::atomic<Index*> index = nullptr;
+
+    /// <summary>
+    /// <para>構築した索引</para>
+    /// <para>差し替え前の索引を検索中のスレッドがありうるため共有表の破棄まで保持する</para>
+    /// </summary>
+    std::vector<std::unique_ptr<Index>> indexes = {};
+
+    /// <summary>
+    /// 登録の排他制御
+    /// </summary>
+    std::mutex mutex = {};
+
+    ConstraintsTable() {
+        std::lock_guard lock(this->mutex);
+        this->insert(Constraints{});
+    }
+
+    /// <summary>
+    /// 型制約を登録して識別番号を取得する
+    /// </summary>
+    /// <param name="constraints">登録する型制約</param>
+    /// <returns>型制約の識別番号</returns>
+    [[nodiscard]] std::uint32_t intern(const Constraints& constraints) {
+        auto hash = std::hash<TypeClassSet>{}(constraints.set);
+        // 登録済みの型制約はロックせずに取得する
+        if (auto id = this->find(constraints.set, hash)) {
+            return id.value();
         }
-        else {
-            typeMap.applyConstraint(vals[i], param.constraints.list);
+        std::lock_guard lock(this->mutex);
+        if (auto id = this->find(constraints.set, hash)) {
+            return id.value();
         }
+        return this->insert(constraints);
     }
 
-    struct fn {
-        RefType t;
-        TypeEnvironment& e;
-        const std::vector<RefType>& v;
-        const std::vector<RefType>& p;
-
-        RefType operator()([[maybe_unused]] const Type::Base& x) {
-            // instantiateしない
-            return this->t;
+    /// <summary>
+    /// 登録済みの型制約を検索する
+    /// </summary>
+    /// <param name="set">縮約された型クラスの集合</param>
+    /// <param name="hash">setのハッシュ値</param>
+    /// <returns>型制約の識別番号(未登録の場合はstd::nullopt)</returns>
+    [[nodiscard]] std::optional<std::uint32_t> find(const TypeClassSet& set, std::size_t hash) const {
+        auto index = this->index.load(std::memory_order_acquire);
+        if (!index) {
+            return std::nullopt;
         }
-        RefType operator()(const Type::Function& x) {
-            // 引数型と戻り値型をinstantiateする
-            auto instParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .p = this->p }, x.paramType->kind);
-            auto instReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .p = this->p }, x.returnType->kind);
-
-            if (x.paramType == instParamType && x.returnType == instReturnType) {
-                // instantiateされなかった場合は新規にインスタンスを生成しない
-                return this->t;
+        for (auto i = ConstraintsTable::spread(hash) & index->mask; ; i = (i + 1) & index->mask) {
+            auto slot = index->slots[i].load(std::memory_order_acquire);
+            if (slot == 0) {
+                return std::nullopt;
             }
-            else {
-                // instantiateが生じた場合は新規にインスタンスを生成する
-                // 組込み型である関数型なので基底を継承する
-                return this->e.newType(Type::Function{ .base = x.base, .paramType = std::move(instParamType), .returnType = std::move(instReturnType) });
+            if (this->values[slot - 1].set == set) {
+                return slot - 1;
             }
         }
-        RefType operator()([[maybe_unused]] const Type::Variable& x) {
-            // 外のスコープから与えられた型変数のためinstantiateしない
-            return this->t;
-        }
-        RefType operator()(const Type::Param& x) {
-            // ジェネリック型の型変数と等しい場合はinstantiateする
-            if (x.index < this->p.size() && this->p[x.index] == this->t) {
-                return this->v[x.index];
-            }
-            else {
-                return this->t;
+    }
+
+    /// <summary>
+    /// 型制約を登録する(呼び出し側で排他する)
+    /// </summary>
+    /// <param name="constraints">未登録の型制約</param>
+    /// <returns>採番した識別番号</returns>
+    std::uint32_t insert(const Constraints& constraints) {
+        auto id = static_cast<std::uint32_t>(this->values.size());
+        this->values.push_back(constraints);
+
+        // 使用率が1/2を超える場合は2倍の索引を構築して差し替える
+        auto index = this->index.load(std::memory_order_relaxed);
+        if (!index || (static_cast<std::size_t>(id) + 1) * 2 > index->mask + 1) {
+            auto& next = this->indexes.emplace_back(std::make_unique<Index>(index ? (index->mask + 1) * 2 : 64));
+            for (std::uint32_t i = 0; i < id; ++i) {
+                ConstraintsTable::place(*next, i, std::hash<TypeClassSet>{}(this->values[i].set));
             }
+            index = next.get();
+            this->index.store(index, std::memory_order_release);
         }
-        RefType operator()([[maybe_unused]] const Type::TypeClass& x) {
-            // 型としての型クラスは型変数に依存しないためinstantiateしない
-            return this->t;
+        ConstraintsTable::place(*index, id, std::hash<TypeClassSet>{}(constraints.set));
+        return id;
+    }
+
+    /// <summary>
+    /// <para>ハッシュ値の全てのビットを下位のビットへ拡散させる</para>
+    /// <para>整数のハッシュ関数は恒等関数となりうるため、下位のビットのみで索引を引くと上位のビットのみが異なる集合が衝突する</para>
+    /// </summary>
+    /// <param name="hash">ハッシュ値</param>
+    /// <returns>拡散したハッシュ値</returns>
+    [[nodiscard]] static std::size_t spread(std::size_t hash) {
+        std::uint64_t x = hash;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return static_cast<std::size_t>(x);
+    }
+
+    /// <summary>
+    /// 索引の空きスロットに識別番号を書き込む
+    /// </summary>
+    /// <param name="index">書き込み先の索引</param>
+    /// <param name="id">識別番号</param>
+    /// <param name="hash">識別番号に対応する型制約のハッシュ値</param>
+    static void place(Index& index, std::uint32_t id, std::size_t hash) {
+        auto i = ConstraintsTable::spread(hash) & index.mask;
+        while (index.slots[i].load(std::memory_order_relaxed) != 0) {
+            i = (i + 1) & index.mask;
         }
-    };
+        index.slots[i].store(id + 1, std::memory_order_release);
+    }
 
-    return std::visit(fn{ .t = type.type, .e = *this, .v = vals, .p = type.vals }, type.type->kind);
-}
+    /// <summary>
+    /// 共有表のインスタンスを取得する
+    /// </summary>
+    /// <returns>共有表</returns>
+    static ConstraintsTable& instance() {
+        static ConstraintsTable table;
+        return table;
+    }
+};
 
 /// <summary>
-/// typeがtargetに依存しているかの判定(参照先の型が一致するかを判定する)
+/// <para>共有された型制約への参照</para>
+/// <para>型を小さく保つためにConstraintsTableにおける識別番号のみを保持する</para>
 /// </summary>
-/// <param name="type">検査対象の型1</param>
-/// <param name="target">検査対象の型2</param>
-/// <returns>typeがtargetに依存している場合にtrue、依存していない場合にfalse</returns>
-[[nodiscard]] bool depend(const RefType& type, const RefType& target) {
-    struct fn {
-        const RefType& t;
+struct RefConstraints {
+    /// <summary>
+    /// 型制約の識別番号
+    /// </summary>
+    std::uint32_t id = 0;
 
-        bool operator()([[maybe_unused]] const Type::Base& x) {
-            return false;
-        }
-        bool operator()(const Type::Function& x) {
-            return x.paramType == this->t || x.returnType == this->t || depend(x.paramType, this->t) || depend(x.returnType, this->t);
-        }
-        bool operator()([[maybe_unused]] const Type::Variable& x) {
-            return x.solve ? depend(x.solve.value(), this->t) : false;
-        }
-        bool operator()([[maybe_unused]] const Type::Param& x) {
-            return false;
-        }
-        bool operator()([[maybe_unused]] const Type::TypeClass& x) {
-            return false;
-        }
-    };
+    RefConstraints() = default;
+    RefConstraints(const Constraints& constraints) : id(ConstraintsTable::instance().intern(constraints)) {}
+    RefConstraints(std::initializer_list<RefTypeClass> typeClasses) : RefConstraints(Constraints(typeClasses)) {}
 
-    return type == target || std::visit(fn{ .t = target }, type->kind);
-}
+    [[nodiscard]] const Constraints& operator*() const {
+        return ConstraintsTable::instance().values[this->id];
+    }
+    [[nodiscard]] const Constraints* operator->() const {
+        return std::addressof(**this);
+    }
 
-/// <summary>
-/// <para>副作用付きの2つの型の単一化</para>
-/// <para>暗黙の型変換はtype1 <- type2の方向で行われる</para>
-/// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="type1">単一化の対象の型1</param>
-/// <param name="type2">単一化の対象の型2</param>
-void unify(TypeMap& typeMap, RefType type1, RefType type2) {
-
-    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
-    auto t1 = solved(type1);
-    auto t2 = solved(type2);
-
-    if (t1 != t2) {
-        if (std::holds_alternative<Type::Variable>(t1->kind)) {
-            auto& t1v = std::get<Type::Variable>(t1->kind);
-
-            if (std::holds_alternative<Type::Variable>(t2->kind)) {
-                // 型変数同士の場合は型の循環が起きないように外のスコープのものを設定
-                auto& t2v = std::get<Type::Variable>(t2->kind);
-                if (t1v.depth < t2v.depth) {
-                    // 型制約をマージする
-                    t1v.constraints.merge(t2v.constraints.list);
-                    t2v.solve = t1;
-                }
-                else {
-                    // 型制約をマージする
-                    t2v.constraints.merge(t1v.constraints.list);
-                    t1v.solve = t2;
-                }
-            }
-            else {
-                if (depend(t1, t2)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                // t2がt1の制約を満たすかを検証する
-                typeMap.applyConstraint(t2, t1v.constraints.list);
-                t1v.solve = t2;
-            }
-        }
-        else {
-            if (std::holds_alternative<Type::Variable>(t2->kind)) {
-                auto& t2v = std::get<Type::Variable>(t2->kind);
-                if (depend(t2, t1)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                // t1がt2の制約を満たすかを検証する
-                typeMap.applyConstraint(t1, t2v.constraints.list);
-                t2v.solve = t1;
-            }
-            else if (std::holds_alternative<Type::TypeClass>(t1->kind)) {
-                // type1 <- type2な暗黙の型変換の検証
-                // type2はType::Variableでないためtype1に課された型クラスがtype2で実装されているか検証となる
-                typeMap.applyConstraint(t2, std::get<Type::TypeClass>(t1->kind).typeClasses.list);
-
-                // キャストが生じた場合の対処は型推論の域を逸脱するため未実装
-                // 実装する場合は明示的なキャストの構文を構文木に挿入する
-            }
-            else {
-                // 型が一致する場合に部分型について再帰的に単一化
-                // 制約付きの場合は「C ⊨ type1 ∼ type2」のような同値の条件によりキャストを行うが未実装
-                if (t1->kind.index() == t2->kind.index()) {
-                    if (std::holds_alternative<Type::Function>(t1->kind)) {
-                        auto& k1 = std::get<Type::Function>(t1->kind);
-                        auto& k2 = std::get<Type::Function>(t2->kind);
-                        unify(typeMap, k1.paramType, k2.paramType);
-                        unify(typeMap, k1.returnType, k2.returnType);
-                    }
-                    else {
-                        // 部分型をもたないため型は一致しない
-                        throw std::runtime_error("型の不一致");
-                    }
-                }
-                else {
-                    // 型の種類が一致しない
-                    throw std::runtime_error("型の不一致");
-                }
-            }
+    /// <summary>
+    /// <para>型制約をマージする</para>
+    /// <para>共有された型制約は変更せずにマージ結果の型制約を参照するようにする</para>
+    /// </summary>
+    /// <param name="constraints">マージ対象の型クラス</param>
+    void merge(const Constraints& constraints) {
+        if (constraints.empty() || (*this)->includes(constraints)) {
+            return;
         }
+        auto merged = **this;
+        merged.merge(constraints);
+        *this = merged;
     }
-}
+
+    /// <summary>
+    /// 縮約された型クラスが一致するか判定(共有されているため識別番号の比較となる)
+    /// </summary>
+    [[nodiscard]] bool operator==(const RefConstraints&) const = default;
+};
 
 /// <summary>
-/// 式を示す構文木
+/// 型の表現
 /// </summary>
-struct Expression {
-    virtual ~Expression() {};
+struct Type {
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 基底型
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    virtual RefType J(TypeMap& typeMap, TypeEnvironment& env) = 0;
+    struct Base {
+        /// <summary>
+        /// <para>型名</para>
+        /// <para>型の節点を小さく保つためにシンボルとして保持する</para>
+        /// </summary>
+        const Symbol name;
 
-    /// <summary>
-    /// Algorithm Mの適用
-    /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    virtual void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) = 0;
-};
+        /// <summary>
+        /// <para>型表に登録された型に関するデータ</para>
+        /// <para>型名による型表の探索を避けるためにTypeMap::freezeで凍結した型表に登録された型についてのみ記録する</para>
+        /// <para>型推論中は複数の型推論から共有されるため書き込まない</para>
+        /// </summary>
+        const TypeData* data = nullptr;
+
+        /// <summary>
+        /// dataを記録した凍結した型表
+        /// </summary>
+        const TypeMap* owner = nullptr;
+    };
 
-/// <summary>
-/// 定数を示す構文木(簡単のために値はもたない)
-/// </summary>
-struct Constant : Expression {
     /// <summary>
-    /// 定数の型
+    /// 関数型
     /// </summary>
-    RefType b;
+    struct Function {
+        /// <summary>
+        /// 基底型としての意味を示す型
+        /// </summary>
+        RefType base;
 
-    Constant(RefType b) : b(b) {}
-    ~Constant() override {}
+        /// <summary>
+        /// 引数型
+        /// </summary>
+        RefType paramType;
+
+        /// <summary>
+        /// 戻り値型
+        /// </summary>
+        RefType returnType;
+    };
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 型変数
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J([[maybe_unused]] TypeMap& typeMap, [[maybe_unused]] TypeEnvironment& env) override {
-        return this->b;
-    }
+    struct Variable {
+        /// <summary>
+        /// 型制約
+        /// </summary>
+        RefConstraints constraints = {};
+
+        /// <summary>
+        /// <para>型変数の解決結果の型</para>
+        /// <para>未解決の場合はnullptr</para>
+        /// </summary>
+        RefType solve = nullptr;
+
+        /// <summary>
+        /// <para>スコープの深さ</para>
+        /// <para>代表元の場合は併合された型変数のうち最も浅いスコープの深さを保持する</para>
+        /// </summary>
+        std::size_t depth = 1;
+
+        /// <summary>
+        /// 型変数同士の併合における木の高さの上界(ランク)
+        /// </summary>
+        std::size_t rank = 0;
+    };
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// ジェネリック型に出現する型変数
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, [[maybe_unused]] TypeEnvironment& env, RefType rho) override {
-        unify(typeMap, rho, this->b);
-    }
-};
+    struct Param {
+        /// <summary>
+        /// 型制約
+        /// </summary>
+        RefConstraints constraints = {};
+
+        /// <summary>
+        /// ジェネリック型の型変数のインデックス
+        /// </summary>
+        const std::size_t index = 0;
+    };
 
-/// <summary>
-/// 識別子を示す構文木
-/// </summary>
-struct Identifier : Expression {
     /// <summary>
-    /// 識別子名
+    /// 型としての型クラス
     /// </summary>
-    std::string x;
+    struct TypeClass {
+        /// <summary>
+        /// 型として扱う型クラス
+        /// </summary>
+        RefConstraints typeClasses = {};
+    };
+
+    // 本来はこの他にタプルやリスト、エイリアスなどの組み込み機能を定義する
 
-    Identifier(std::string_view x) : x(x) {}
-    ~Identifier() override {}
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 型の固有情報を示す型
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        struct fn {
-            TypeMap& m;
-            TypeEnvironment& e;
+    using kind_type = std::variant<Base, Function, Variable, Param, TypeClass>;
 
-            RefType operator()(const RefType& x) {
-                return x;
-            }
-            RefType operator()(const Generic& x) {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                return this->e.instantiate(this->m, x);
-            }
-        };
+    /// <summary>
+    /// 型の固有情報
+    /// </summary>
+    kind_type kind;
 
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
-        if (tau) {
-            return std::visit(fn{ .m = typeMap, .e = env }, *tau.value());
+    /// <summary>
+    /// 型名の取得
+    /// </summary>
+    /// <returns>トップレベルで型が一意な場合にのみ型名を返す</returns>
+    [[nodiscard]] std::optional<const std::string*> getTypeName() const {
+        if (std::holds_alternative<Type::Base>(this->kind)) {
+            return std::addressof(std::get<Type::Base>(this->kind).name.name());
+        }
+        else if (std::holds_alternative<Type::Function>(this->kind)) {
+            return std::get<Type::Function>(this->kind).base->getTypeName();
         }
-        throw std::runtime_error(std::format("不明な識別子：{}", this->x));
+        return std::nullopt;
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 型に紐づく型クラスのリストの取得
     /// </summary>
     /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        struct fn {
-            TypeMap& m;
-            TypeEnvironment& e;
-
-            RefType operator()(const RefType& x) {
-                return x;
-            }
-            RefType operator()(const Generic& x) {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                return this->e.instantiate(this->m, x);
-            }
-        };
+    /// <returns>型に紐づく型クラスのリスト</returns>
+    [[nodiscard]] const Constraints& getTypeClassList(TypeMap& typeMap) const;
 
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
+    /// <summary>
+    /// 明示的に型名を持つ型について型表に登録された型に関するデータを取得する
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <returns>型に関するデータ</returns>
+    [[nodiscard]] const TypeData& getTypeData(const TypeMap& typeMap) const;
 
-        if (tau) {
-            unify(typeMap, rho, std::visit(fn{ .m = typeMap, .e = env }, *tau.value()));
-        }
-        else {
-            throw std::runtime_error(std::format("不明な識別子：{}", this->x));
+    /// <summary>
+    /// 関数型などについて基底型としての意味を示す型を取得する
+    /// </summary>
+    /// <param name="type">取得対象の型(明示的に型名を持つ型)</param>
+    /// <returns>基底型</returns>
+    template <class T>
+    [[nodiscard]] static T* getBaseType(T* type) {
+        if (std::holds_alternative<Type::Function>(type->kind)) {
+            type = std::get<Type::Function>(type->kind).base;
         }
+        assert(std::holds_alternative<Type::Base>(type->kind));
+        return type;
     }
 };
 
+struct Generic;
+
 /// <summary>
-/// ラムダ抽象を示す構文木
+/// <para>ジェネリック型のinstantiateの雛形</para>
+/// <para>型変数を含む部分型(骨格)のみを後行順に並べたもので、型変数を含まない部分型はinstantiate結果で共有する</para>
 /// </summary>
-struct Lambda : Expression {
-    /// <summary>
-    /// 引数名
-    /// </summary>
-    std::string x;
-    /// <summary>
-    /// xの型制約
-    /// </summary>
-    std::optional<RefType> constraint = std::nullopt;
+struct GenericTemplate {
     /// <summary>
-    /// 関数本体の式
+    /// 雛形における部分型の参照
     /// </summary>
-    std::shared_ptr<Expression> e;
+    struct Operand {
+        /// <summary>
+        /// 参照先の種類
+        /// </summary>
+        enum struct Kind {
+            /// <summary>
+            /// 型変数を含まないため共有する型
+            /// </summary>
+            SHARED,
+            /// <summary>
+            /// ジェネリック型の型変数のインデックス
+            /// </summary>
+            VAL,
+            /// <summary>
+            /// 骨格の節点のインデックス
+            /// </summary>
+            NODE
+        } kind = Kind::SHARED;
 
-    Lambda(std::string_view x, std::shared_ptr<Expression> e) : x(x), e(e) {}
-    Lambda(std::string_view x, RefType constraint, std::shared_ptr<Expression> e) : x(x), constraint(constraint), e(e) {}
-    ~Lambda() override {}
+        /// <summary>
+        /// kindがSHAREDの場合の共有する型
+        /// </summary>
+        RefType type = nullptr;
+
+        /// <summary>
+        /// kindがVALまたはNODEの場合のインデックス
+        /// </summary>
+        std::size_t index = 0;
+    };
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 骨格の節点(関数型)
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
+    struct Node {
+        /// <summary>
+        /// 基底型としての意味を示す型
+        /// </summary>
+        RefType base;
 
-        // 型環境にxを登録してeを評価
-        auto t = this->constraint ? this->constraint.value() : newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        newEnv.map.insert({ this->x, t });
-        auto tau = this->e->J(typeMap, newEnv);
+        /// <summary>
+        /// 引数型
+        /// </summary>
+        Operand paramType;
 
-        return env.instantiate(typeMap, typeMap.builtin.fn, { t, tau });
-    }
+        /// <summary>
+        /// 戻り値型
+        /// </summary>
+        Operand returnType;
+    };
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 後行順に並べた骨格の節点のリスト
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
+    std::vector<Node> nodes = {};
 
-        auto t1 = this->constraint ? this->constraint.value() : newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        auto t2 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
-        unify(typeMap, rho, env.instantiate(typeMap, typeMap.builtin.fn, { t1, t2 }));
+    /// <summary>
+    /// ジェネリック型の本体の型
+    /// </summary>
+    Operand root;
 
-        // 型環境にxを登録してeを評価
-        newEnv.map.insert({ this->x, t1 });
-        this->e->M(typeMap, newEnv, t2);
-    }
+    /// <summary>
+    /// ジェネリック型から雛形を構築する
+    /// </summary>
+    /// <param name="generic">雛形の構築対象のジェネリック型</param>
+    /// <returns>構築した雛形</returns>
+    [[nodiscard]] static std::shared_ptr<const GenericTemplate> build(const Generic& generic);
 };
 
 /// <summary>
-/// 関数適用を示す構文木
+/// ジェネリック型
 /// </summary>
-struct Apply : Expression {
+struct Generic {
     /// <summary>
-    /// 関数を示す式
+    /// 型変数のリスト
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    std::vector<RefType> vals;
+
     /// <summary>
-    /// 引数の式
+    /// 型変数valsを内部で持つ型
     /// </summary>
-    std::shared_ptr<Expression> e2;
-
-    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), e2(e2) {}
-    ~Apply() override {}
+    RefType type;
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// <para>instantiateの雛形</para>
+    /// <para>初回のinstantiate時に構築して以降のinstantiateで再利用する</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau1 = this->e1->J(typeMap, env);
-        auto tau2 = this->e2->J(typeMap, env);
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
+    mutable std::shared_ptr<const GenericTemplate> spine = nullptr;
+};
 
-        unify(typeMap, tau1, env.instantiate(typeMap, typeMap.builtin.fn, { tau2, t }));
+/// <summary>
+/// ジェネリック型から雛形を構築する
+/// </summary>
+/// <param name="generic">雛形の構築対象のジェネリック型</param>
+/// <returns>構築した雛形</returns>
+[[nodiscard]] std::shared_ptr<const GenericTemplate> GenericTemplate::build(const Generic& generic) {
+    auto spine = std::make_shared<GenericTemplate>();
+    // 構築済みの部分型の参照(共有された部分型は1度のみ構築する)
+    std::unordered_map<const Type*, Operand> memo;
 
-        return t;
-    }
+    struct fn {
+        RefType t;
+        GenericTemplate& s;
+        std::unordered_map<const Type*, Operand>& m;
+        const std::vector<RefType>& p;
 
-    /// <summary>
-    /// Algorithm Mの適用
-    /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
+        Operand operator()([[maybe_unused]] const Type::Base& x) {
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
+        }
+        Operand operator()(const Type::Function& x) {
+            auto paramType = this->m.at(x.paramType);
+            auto returnType = this->m.at(x.returnType);
+            if (paramType.kind == Operand::Kind::SHARED && returnType.kind == Operand::Kind::SHARED) {
+                // 型変数を含まない場合は共有する
+                return { .kind = Operand::Kind::SHARED, .type = this->t };
+            }
+            this->s.nodes.push_back({ .base = x.base, .paramType = paramType, .returnType = returnType });
+            return { .kind = Operand::Kind::NODE, .index = this->s.nodes.size() - 1 };
+        }
+        Operand operator()([[maybe_unused]] const Type::Variable& x) {
+            // 外のスコープから与えられた型変数のため共有する
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
+        }
+        Operand operator()(const Type::Param& x) {
+            // ジェネリック型の型変数と等しい場合はinstantiateの対象とする
+            if (x.index < this->p.size() && this->p[x.index] == this->t) {
+                return { .kind = Operand::Kind::VAL, .index = x.index };
+            }
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
+        }
+        Operand operator()([[maybe_unused]] const Type::TypeClass& x) {
+            // 型としての型クラスは型変数に依存しないため共有する
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
+        }
+    };
 
-        this->e1->M(typeMap, env, env.instantiate(typeMap, typeMap.builtin.fn, { t, rho }));
-        this->e2->M(typeMap, env, t);
+    // 構築対象の部分型と部分型を展開済みであるかのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+    std::vector<std::pair<RefType, bool>> stack = { { generic.type, false } };
+    while (!stack.empty()) {
+        auto [t, expanded] = stack.back();
+        if (memo.contains(t)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!expanded) {
+            // 部分型を先に構築する
+            stack.back().second = true;
+            if (std::holds_alternative<Type::Function>(t->kind)) {
+                // 引数型の部分型から順に構築するため戻り値型から積む
+                auto& x = std::get<Type::Function>(t->kind);
+                stack.push_back({ x.returnType, false });
+                stack.push_back({ x.paramType, false });
+            }
+            continue;
+        }
+        stack.pop_back();
+        memo.insert({ t, std::visit(fn{ .t = t, .s = *spine, .m = memo, .p = generic.vals }, t->kind) });
     }
-};
+
+    spine->root = memo.at(generic.type);
+    return spine;
+}
 
 /// <summary>
-/// Let束縛を示す構文木
+/// <para>型推論の処理ごとの呼び出し回数と処理時間の計測結果</para>
+/// <para>INFERENCE_STATSを定義した場合のみ計測し、定義しない場合はProbeが空の型となり計測処理はコンパイル時に除去される</para>
+/// <para>スレッドごとに計測し、並列に型推論したスレッドの計測結果は終了時に呼び出し元のスレッドの計測結果へ加算する</para>
 /// </summary>
-struct Let : Expression {
+struct InferenceStats {
     /// <summary>
-    /// 束縛先の識別子名
+    /// 1つの処理の計測結果
     /// </summary>
-    std::string x;
+    struct Counter {
+        /// <summary>
+        /// 処理名
+        /// </summary>
+        const char* name = "";
+        /// <summary>
+        /// <para>処理時間を計測するか</para>
+        /// <para>呼び出し回数が多く処理が軽いものは計測自体が支配的になるため計測しない</para>
+        /// </summary>
+        bool timed = false;
+        /// <summary>
+        /// 呼び出し回数
+        /// </summary>
+        std::size_t calls = 0;
+        /// <summary>
+        /// 処理した要素数の合計
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 1回の呼び出しで処理した要素数の最大値
+        /// </summary>
+        std::size_t maxItems = 0;
+        /// <summary>
+        /// 処理時間の合計[ns]
+        /// </summary>
+        std::int64_t nanoseconds = 0;
+        /// <summary>
+        /// <para>実行中の呼び出しの数</para>
+        /// <para>再帰的な呼び出しの処理時間を重複して計上しないために最も外側の呼び出しのみ計測する</para>
+        /// </summary>
+        std::size_t active = 0;
+    };
+
     /// <summary>
-    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// 計測中の1回の呼び出し
     /// </summary>
-    std::vector<RefType> params = {};
+    struct Probe {
+#ifdef INFERENCE_STATS
+        /// <summary>
+        /// 計上先
+        /// </summary>
+        Counter& counter;
+        /// <summary>
+        /// この呼び出しで処理した要素数
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 最も外側の呼び出しであるか
+        /// </summary>
+        bool outermost = false;
+        /// <summary>
+        /// 開始時刻
+        /// </summary>
+        std::chrono::steady_clock::time_point start = {};
+
+        explicit Probe(Counter& counter) : counter(counter) {
+            ++this->counter.calls;
+            this->outermost = this->counter.active++ == 0;
+            if (this->counter.timed && this->outermost) {
+                this->start = std::chrono::steady_clock::now();
+            }
+        }
+        ~Probe() {
+            if (this->counter.timed && this->outermost) {
+                this->counter.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count();
+            }
+            --this->counter.active;
+            this->counter.items += this->items;
+            this->counter.maxItems = std::max(this->counter.maxItems, this->items);
+        }
+#else
+        explicit Probe([[maybe_unused]] Counter& counter) {}
+#endif
+        Probe(const Probe&) = delete;
+        Probe& operator=(const Probe&) = delete;
+
+        /// <summary>
+        /// 処理した要素数を計上する
+        /// </summary>
+        /// <param name="n">処理した要素数</param>
+        void add([[maybe_unused]] std::size_t n) {
+#ifdef INFERENCE_STATS
+            this->items += n;
+#endif
+        }
+    };
+
     /// <summary>
-    /// 束縛する式
+    /// 単一化(要素数は単一化した型のペアの数)
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    Counter unify = { .name = "unify", .timed = true };
     /// <summary>
-    /// xを利用する式
+    /// 解決済みの型の取得(要素数は辿った型変数の解決結果の数)
     /// </summary>
-    std::shared_ptr<Expression> e2;
-
-    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    Let(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
-    ~Let() override {}
-
+    Counter solved = { .name = "solved" };
     /// <summary>
-    /// Algorithm Jの適用
+    /// 出現検査(要素数は走査した型の数)
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau1 = this->e1->J(typeMap, env);
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, env.generalize(tau1, this->params));
+    Counter occurs = { .name = "occurs", .timed = true };
+    /// <summary>
+    /// generalize(要素数は走査した型の数)
+    /// </summary>
+    Counter generalize = { .name = "generalize", .timed = true };
+    /// <summary>
+    /// instantiate(要素数は骨格から生成した型の数)
+    /// </summary>
+    Counter instantiate = { .name = "instantiate", .timed = true };
+    /// <summary>
+    /// 型制約の適用(要素数は型クラスの実装を検査した型の数)
+    /// </summary>
+    Counter applyConstraint = { .name = "applyConstraint", .timed = true };
+    /// <summary>
+    /// 識別子の型の取り出し(要素数は辿った束縛の数)
+    /// </summary>
+    Counter lookup = { .name = "lookup" };
 
-        return this->e2->J(typeMap, env);
+    /// <summary>
+    /// 計測結果を初期化する
+    /// </summary>
+    void reset() {
+        *this = InferenceStats{};
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// <para>他のスレッドの計測結果を加算する</para>
+    /// <para>複数のスレッドから並行して加算されるため排他する</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
+    /// <param name="other">加算する計測結果</param>
+    void merge(const InferenceStats& other) {
+        static std::mutex mutex;
+        std::lock_guard lock(mutex);
+        for (auto counter : { &InferenceStats::unify, &InferenceStats::solved, &InferenceStats::occurs, &InferenceStats::generalize, &InferenceStats::instantiate, &InferenceStats::applyConstraint, &InferenceStats::lookup }) {
+            auto& to = this->*counter;
+            auto& from = other.*counter;
+            to.calls += from.calls;
+            to.items += from.items;
+            to.maxItems = std::max(to.maxItems, from.maxItems);
+            to.nanoseconds += from.nanoseconds;
+        }
+    }
 
-        this->e1->M(typeMap, env, t);
+    /// <summary>
+    /// <para>出現検査とgeneralizeで走査した型の数</para>
+    /// <para>INFERENCE_STATSを定義しない場合は計上されないため常に0</para>
+    /// </summary>
+    /// <returns>走査した型の数</returns>
+    [[nodiscard]] std::size_t traversed() const {
+        return this->occurs.items + this->generalize.items;
+    }
 
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, env.generalize(t, this->params));
-        this->e2->M(typeMap, env, rho);
+    /// <summary>
+    /// 計測結果を出力する
+    /// </summary>
+    /// <param name="os">出力先</param>
+    void dump(std::ostream& os) const {
+        os << std::format("  {:<16} {:>8} {:>10} {:>8} {:>12}", "phase", "calls", "items", "max", "time[us]") << std::endl;
+        for (auto counter : { &this->unify, &this->solved, &this->occurs, &this->generalize, &this->instantiate, &this->applyConstraint, &this->lookup }) {
+            os << std::format(
+                "  {:<16} {:>8} {:>10} {:>8} {:>12}",
+                counter->name,
+                counter->calls,
+                counter->items,
+                counter->maxItems,
+                counter->timed ? std::format("{:.1f}", counter->nanoseconds / 1000.0) : std::string("-")
+            ) << std::endl;
+        }
     }
 };
+constinit thread_local InferenceStats inferenceStats = {};
 
 /// <summary>
-/// Letrec束縛を示す構文木
+/// <para>型推論のイベントトレース</para>
+/// <para>INFERENCE_TRACEを定義した場合のみ、区間をChromeのtrace_event形式(JSON)でファイルへ逐次書き出す</para>
+/// <para>区間の開始と終了をその場で書き出すため、巨大な入力でもイベントをメモリに溜めない</para>
+/// <para>複数のスレッドのイベントは排他して書き出し、スレッドごとに別のtidを割り当てる</para>
 /// </summary>
-struct Letrec : Expression {
+struct InferenceTrace {
+#ifdef INFERENCE_TRACE
     /// <summary>
-    /// 束縛先の識別子名
+    /// 出力先
     /// </summary>
-    std::string x;
+    std::ofstream os = {};
     /// <summary>
-    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// タイムスタンプの基準時刻
     /// </summary>
-    std::vector<RefType> params = {};
+    std::chrono::steady_clock::time_point origin = {};
     /// <summary>
-    /// 束縛する式
+    /// 最初のイベントであるか
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    bool first = true;
     /// <summary>
-    /// xを利用する式
+    /// 書き出しの排他制御
     /// </summary>
-    std::shared_ptr<Expression> e2;
-
-    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    Letrec(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
-    ~Letrec() override {}
-
+    std::mutex mutex = {};
     /// <summary>
-    /// Algorithm Jの適用
+    /// tidを割り当てたスレッドの数
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, t);
-
-        auto tau1 = this->e1->J(typeMap, env);
-        unify(typeMap, tau1, t);
+    std::size_t threads = 0;
+#endif
 
-        env.map.insert_or_assign(this->x, env.generalize(tau1, this->params));
+    /// <summary>
+    /// 計測中の区間
+    /// </summary>
+    struct Span {
+#ifdef INFERENCE_TRACE
+        explicit Span(std::string_view category, std::string_view name, const std::string& id);
+        explicit Span(std::string_view category, std::string_view name, std::optional<Symbol> x = std::nullopt);
+        ~Span();
+#else
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] const std::string& id) {}
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] std::optional<Symbol> x = std::nullopt) {}
+#endif
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
 
-        return this->e2->J(typeMap, env);
+#ifdef INFERENCE_TRACE
+    /// <summary>
+    /// トレースの出力を開始する
+    /// </summary>
+    /// <param name="path">出力先のファイル名</param>
+    void open(const std::string& path) {
+        std::lock_guard lock(this->mutex);
+        this->os.open(path);
+        if (!this->os) {
+            throw std::runtime_error(std::format("トレースの出力先{}を開けない", path));
+        }
+        this->os << "[\n";
+        this->origin = std::chrono::steady_clock::now();
+        this->first = true;
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// トレースの出力を終了する
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        auto t1 = env.newType(Type::Variable{ .depth = env.depth });
-        auto t2 = env.newType(Type::Variable{ .depth = env.depth });
-        // xが定義済みであっても型環境の改装を無視して上書きする
-        // グローバルな型環境の場合は異常にする等があるかもしれない
-        env.map.insert_or_assign(this->x, t1);
+    void close() {
+        std::lock_guard lock(this->mutex);
+        if (this->os.is_open()) {
+            this->os << "\n]\n";
+            this->os.close();
+        }
+    }
 
-        this->e1->M(typeMap, env, t2);
-        unify(typeMap, t1, t2);
+    /// <summary>
+    /// <para>イベントを書き出す</para>
+    /// <para>出力を開始していない場合は何もしない</para>
+    /// </summary>
+    /// <param name="phase">イベントの種類(B：区間の開始、E：区間の終了)</param>
+    /// <param name="category">イベントの分類</param>
+    /// <param name="name">イベント名</param>
+    /// <param name="id">識別子名</param>
+    void event(char phase, std::string_view category, std::string_view name, std::string_view id) {
+        std::lock_guard lock(this->mutex);
+        if (!this->os.is_open()) {
+            return;
+        }
+        thread_local auto tid = ++this->threads;
+        auto ts = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->origin).count();
+        this->os << (std::exchange(this->first, false) ? "" : ",\n");
+        this->os << R"({"ph":")" << phase << R"(","ts":)" << std::format("{:.3f}", ts) << R"(,"pid":1,"tid":)" << tid;
+        if (phase == 'B') {
+            this->os << R"(,"cat":")";
+            this->escape(category);
+            this->os << R"(","name":")";
+            this->escape(name);
+            this->os << '"';
+            if (!id.empty()) {
+                this->os << R"(,"args":{"id":")";
+                this->escape(id);
+                this->os << R"("})";
+            }
+        }
+        this->os << '}';
+    }
 
-        env.map.insert_or_assign(this->x, env.generalize(t1, this->params));
-        this->e2->M(typeMap, env, rho);
+    /// <summary>
+    /// JSONの文字列としてエスケープして書き出す
+    /// </summary>
+    /// <param name="s">書き出す文字列</param>
+    void escape(std::string_view s) {
+        for (auto c : s) {
+            if (c == '"' || c == '\\') {
+                this->os << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                this->os << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+            }
+            else {
+                this->os << c;
+            }
+        }
     }
+#endif
 };
+InferenceTrace inferenceTrace = {};
+
+#ifdef INFERENCE_TRACE
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, const std::string& id) {
+    inferenceTrace.event('B', category, name, id);
+}
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, std::optional<Symbol> x) {
+    inferenceTrace.event('B', category, name, x ? std::string_view(x->name()) : std::string_view());
+}
+InferenceTrace::Span::~Span() {
+    inferenceTrace.event('E', {}, {}, {});
+}
+#endif
 
 /// <summary>
-/// クラスメソッドへのアクセスを示す構文木
+/// <para>単一化による書き換えの記録(トレイル)</para>
+/// <para>チェックポイントを開いている間のみ書き換え前の値を記録し、書き換えの数に比例する時間で巻き戻す</para>
+/// <para>記録の対象は単一化(solved, unite, occurs, unify, applyConstraint)とgeneralizeによる書き換えのみ</para>
 /// </summary>
-struct AccessToClassMethod : Expression {
+struct Trail {
     /// <summary>
-    /// 式
+    /// 書き換え前の値
     /// </summary>
-    std::shared_ptr<Expression> e;
+    template <class T>
+    struct Entry {
+        /// <summary>
+        /// 書き換えた場所
+        /// </summary>
+        T* slot;
+        /// <summary>
+        /// 書き換え前の値
+        /// </summary>
+        T value;
+    };
 
     /// <summary>
-    /// クラスメソッド名
+    /// 書き換え前の値の記録
     /// </summary>
-    std::string x;
+    using Record = std::variant<Entry<RefType>, Entry<RefConstraints>, Entry<std::size_t>>;
 
-    AccessToClassMethod(std::shared_ptr<Expression> e, std::string_view x) : e(e), x(x) {}
-    ~AccessToClassMethod() override {}
+    /// <summary>
+    /// 記録を書き戻す
+    /// </summary>
+    struct fn {
+        template <class T>
+        void operator()(Entry<T>& entry) const {
+            *entry.slot = std::move(entry.value);
+        }
+    };
 
     /// <summary>
-    /// 指定された型からクラスメソッドを抽出する
+    /// チェックポイント
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="type">クラスメソッドを実装した型</param>
-    /// <returns>クラスメソッドを示す型</returns>
-    RefType getClassMethod(TypeMap& typeMap, TypeEnvironment& env, RefType type) {
-        // typeがxをクラスメソッドとしてただ1つもつか検査
-        // 型クラスを実装しているかだけを見るため、クラスメソッドの実装方式などは見ない
-        auto& typeClassList = solved(type)->getTypeClassList(typeMap);
-        auto [typeClass, index] = typeClassList.getClassMethod(this->x);
+    struct Checkpoint {
+        /// <summary>
+        /// チェックポイントを取得した時点の記録の数
+        /// </summary>
+        std::size_t size;
+    };
 
-        if (typeClass) {
-            // クラスメソッドがジェネリック型ならinstantiateする
-            // 型クラスを実装する対象の型についてもinstantiateする
-            auto& method = typeClass.value()->methods.at(this->x);
-            auto f = env.instantiate(typeMap, Generic{
-                .vals = { typeClass.value()->type },
-                .type = (
-                    std::holds_alternative<Generic>(method) ?
-                    env.instantiate(typeMap, std::get<Generic>(method)) :
-                    std::get<RefType>(method)
-                )
-                });
-            return std::get<Type::Function>(f->kind).returnType;
+    /// <summary>
+    /// 書き換え前の値の記録のリスト
+    /// </summary>
+    std::vector<Record> records = {};
+
+    /// <summary>
+    /// 開いているチェックポイントの数
+    /// </summary>
+    std::size_t open = 0;
+
+    /// <summary>
+    /// チェックポイントを開いていれば書き換える前の値を記録する
+    /// </summary>
+    /// <param name="slot">書き換える場所</param>
+    template <class T>
+    void save(T& slot) {
+        if (this->open > 0) {
+            this->records.push_back(Entry<T>{ .slot = std::addressof(slot), .value = slot });
         }
-        else {
-            throw std::runtime_error(std::format("クラスメソッドが実装されていない：{}", this->x));
+    }
+
+    /// <summary>
+    /// 書き換え前の値を記録して書き換える
+    /// </summary>
+    /// <param name="slot">書き換える場所</param>
+    /// <param name="value">書き換え後の値</param>
+    template <class T>
+    void assign(T& slot, T value) {
+        if (slot != value) {
+            this->save(slot);
+            slot = std::move(value);
         }
     }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// チェックポイントを開く
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau = this->e->J(typeMap, env);
+    /// <returns>チェックポイント</returns>
+    [[nodiscard]] Checkpoint checkpoint() {
+        ++this->open;
+        return Checkpoint{ .size = this->records.size() };
+    }
 
-        // クラスメソッドを取得して部分適用結果の型を取得する
-        return this->getClassMethod(typeMap, env, tau);
+    /// <summary>
+    /// チェックポイント以降の書き換えを巻き戻してチェックポイントを閉じる
+    /// </summary>
+    /// <param name="checkpoint">巻き戻し先のチェックポイント</param>
+    void rollback(Checkpoint checkpoint) {
+        while (this->records.size() > checkpoint.size) {
+            std::visit(fn{}, this->records.back());
+            this->records.pop_back();
+        }
+        this->close();
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// <para>チェックポイント以降の書き換えを確定してチェックポイントを閉じる</para>
+    /// <para>外側のチェックポイントが開いている場合は外側で巻き戻せるように記録を残す</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-        this->e->M(typeMap, env, t);
+    /// <param name="checkpoint">確定するチェックポイント</param>
+    void commit([[maybe_unused]] Checkpoint checkpoint) {
+        this->close();
+    }
+
+    /// <summary>
+    /// <para>処理を投機的に実行する</para>
+    /// <para>型推論の異常で失敗した場合は処理による書き換えを巻き戻す</para>
+    /// <para>それ以外の例外でもチェックポイントを開いたままにしないように巻き戻してから再送出する</para>
+    /// </summary>
+    /// <param name="f">実行する処理</param>
+    /// <returns>成功した場合はtrue、失敗して巻き戻した場合はfalse</returns>
+    template <class F>
+    bool speculate(F&& f) {
+        auto checkpoint = this->checkpoint();
+        try {
+            std::forward<F>(f)();
+        }
+        catch (const std::runtime_error&) {
+            this->rollback(checkpoint);
+            return false;
+        }
+        catch (...) {
+            this->rollback(checkpoint);
+            throw;
+        }
+        this->commit(checkpoint);
+        return true;
+    }
 
-        // クラスメソッドを取得して部分適用結果の型を取得する
-        unify(typeMap, this->getClassMethod(typeMap, env, t), rho);
+    /// <summary>
+    /// チェックポイントを閉じ、全て閉じた場合は記録を破棄する
+    /// </summary>
+    void close() {
+        assert(this->open > 0);
+        if (--this->open == 0) {
+            this->records.clear();
+        }
     }
 };
+/// <summary>
+/// スレッドごとの単一化による書き換えの記録
+/// </summary>
+constinit thread_local Trail trail = {};
 
 /// <summary>
-/// 二項演算を示す構文木
+/// <para>解決済みの型を取得する</para>
+/// <para>型変数の解決結果を代表元として辿り、経路上の型変数を全て代表元へ直接つなぎ替える</para>
 /// </summary>
-struct BinaryExpression : Expression {
+/// <param name="type">チェックを行う型</param>
+/// <returns>解決済みの型</returns>
+RefType solved(RefType type) {
+    InferenceStats::Probe probe(inferenceStats.solved);
+
+    // 代表元を探索する
+    auto root = type;
+    while (std::holds_alternative<Type::Variable>(root->kind)) {
+        auto& val = std::get<Type::Variable>(root->kind);
+        if (!val.solve) {
+            break;
+        }
+        root = val.solve;
+        probe.add(1);
+    }
+
+    // 解決結果が再適用されないように経路圧縮をしておく
+    while (type != root) {
+        auto& val = std::get<Type::Variable>(type->kind);
+        auto next = val.solve;
+        trail.assign(val.solve, root);
+        type = next;
+    }
+    return root;
+}
+
+/// <summary>
+/// <para>未解決の型変数同士を併合する</para>
+/// <para>ランクの低い方をランクの高い方につなぎ、代表元のスコープの深さは浅い方に合わせる</para>
+/// </summary>
+/// <param name="type1">代表元である型変数1</param>
+/// <param name="type2">代表元である型変数2</param>
+/// <returns>併合結果の代表元</returns>
+RefType unite(RefType type1, RefType type2) {
+    auto& v1 = std::get<Type::Variable>(type1->kind);
+    auto& v2 = std::get<Type::Variable>(type2->kind);
+    auto depth = std::min(v1.depth, v2.depth);
+
+    // ランクが等しい場合は型の循環が起きないように外のスコープのものを代表元とする
+    if (v1.rank > v2.rank || (v1.rank == v2.rank && v1.depth < v2.depth)) {
+        // 型制約をマージする
+        trail.save(v1.constraints);
+        v1.constraints.merge(*v2.constraints);
+        trail.assign(v2.solve, type1);
+        trail.assign(v1.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v1.rank, v1.rank + 1);
+        }
+        return type1;
+    }
+    else {
+        // 型制約をマージする
+        trail.save(v2.constraints);
+        v2.constraints.merge(*v1.constraints);
+        trail.assign(v1.solve, type2);
+        trail.assign(v2.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v2.rank, v2.rank + 1);
+        }
+        return type2;
+    }
+}
+
+/// <summary>
+/// <para>型のアリーナ</para>
+/// <para>型推論のセッション中に生成した型を全て所有し、セッションの終了時に一括で解放する</para>
+/// </summary>
+struct TypeArena {
     /// <summary>
-    /// 左項
+    /// <para>生成した型の実体</para>
+    /// <para>チャンク単位で確保されて要素のアドレスが移動しないためstd::dequeで保持する</para>
     /// </summary>
-    std::shared_ptr<Expression> lhs;
+    std::deque<Type> types = {};
+
     /// <summary>
-    /// 右項
+    /// 関数型を共有するためのキー(基底型としての意味を示す型と引数型と戻り値型の組)
     /// </summary>
-    std::shared_ptr<Expression> rhs;
+    using FunctionKey = std::array<const Type*, 3>;
 
-    BinaryExpression(std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : lhs(lhs), rhs(rhs) {}
-    ~BinaryExpression() override {}
+    /// <summary>
+    /// FunctionKeyのハッシュ関数
+    /// </summary>
+    struct FunctionKeyHash {
+        [[nodiscard]] std::size_t operator()(const FunctionKey& key) const noexcept {
+            std::size_t seed = 0;
+            for (auto p : key) {
+                seed ^= std::hash<const Type*>{}(p) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            }
+            return seed;
+        }
+    };
 
     /// <summary>
-    /// クラスメソッドを抽出する
+    /// <para>型名から生成済みの基底型への表</para>
+    /// <para>同名の基底型は同一の実体を共有する</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
+    std::unordered_map<Symbol, RefType> bases = {};
+
+    /// <summary>
+    /// <para>部分型の組から生成済みの型変数を含まない関数型への表</para>
+    /// <para>部分型がすべて共有済みの場合のみ登録するため、部分型のアドレスの比較のみで構造的に等しいかを判定できる</para>
+    /// </summary>
+    std::unordered_map<FunctionKey, RefType, FunctionKeyHash> functions = {};
+
+    /// <summary>
+    /// <para>このアリーナの型から参照する他のアリーナ</para>
+    /// <para>別の型環境で型推論した結果を取り込む際に、取り込んだ型の生成先のアリーナを生存させる</para>
+    /// </summary>
+    std::vector<std::shared_ptr<const TypeArena>> imports = {};
+
+    /// <summary>
+    /// <para>型の生成</para>
+    /// <para>型変数を含まない基底型と関数型は構造的に等しい型が生成済みであればそれを返す(hash-consing)</para>
+    /// <para>参照型はリージョンが単一化により書き換えられるため共有しない</para>
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        if (std::holds_alternative<Type::Base>(kind)) {
+            // 同名の基底型が生成済みの場合はそれを共有する
+            auto& name = std::get<Type::Base>(kind).name;
+            if (auto itr = this->bases.find(name); itr != this->bases.end()) {
+                return itr->second;
+            }
+            auto type = this->emplace(std::move(kind));
+            this->bases.insert({ std::get<Type::Base>(type->kind).name, type });
+            return type;
+        }
+        else if (std::holds_alternative<Type::Function>(kind)) {
+            auto& x = std::get<Type::Function>(kind);
+            FunctionKey key = { x.base, x.paramType, x.returnType };
+            if (std::ranges::all_of(key, [this](const Type* p) { return this->interned(p); })) {
+                // 部分型がすべて共有済みの場合は関数型も共有する
+                auto [itr, inserted] = this->functions.try_emplace(key, nullptr);
+                if (inserted) {
+                    itr->second = this->emplace(std::move(kind));
+                }
+                return itr->second;
+            }
+        }
+        return this->emplace(std::move(kind));
+    }
+
+    /// <summary>
+    /// 型が共有された型であるかの判定
+    /// </summary>
+    /// <param name="type">判定対象の型</param>
+    /// <returns>typeが共有された型である場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool interned(const Type* type) const {
+        if (std::holds_alternative<Type::Base>(type->kind)) {
+            auto itr = this->bases.find(std::get<Type::Base>(type->kind).name);
+            return itr != this->bases.end() && itr->second == type;
+        }
+        else if (std::holds_alternative<Type::Function>(type->kind)) {
+            auto& x = std::get<Type::Function>(type->kind);
+            auto itr = this->functions.find({ x.base, x.paramType, x.returnType });
+            return itr != this->functions.end() && itr->second == type;
+        }
+        return false;
+    }
+
+    /// <summary>
+    /// 共有せずに型の実体を生成する
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType emplace(Type::kind_type&& kind) {
+        return std::addressof(this->types.emplace_back(Type{ .kind = std::move(kind) }));
+    }
+};
+
+struct TypeEnvironment;
+
+/// <summary>
+/// <para>識別子の束縛の表</para>
+/// <para>シンボルごとに束縛のスタックをもち、型環境の生成と破棄に合わせて束縛をpush/popすることでスコープの深さによらず識別子を解決する</para>
+/// </summary>
+struct BindingTable {
+    /// <summary>
+    /// 識別子の束縛
+    /// </summary>
+    struct Binding {
+        /// <summary>
+        /// 束縛を行った型環境
+        /// </summary>
+        const TypeEnvironment* env;
+
+        /// <summary>
+        /// 束縛された型
+        /// </summary>
+        std::variant<RefType, Generic> type;
+    };
+
+    /// <summary>
+    /// シンボルの識別番号ごとの束縛のスタック
+    /// </summary>
+    std::vector<std::vector<Binding>> stacks = {};
+
+    /// <summary>
+    /// <para>束縛を行った順のシンボルの列</para>
+    /// <para>型環境の破棄時にその型環境で行った束縛を巻き戻すために利用する</para>
+    /// </summary>
+    std::vector<Symbol> trail = {};
+
+    /// <summary>
+    /// シンボルに対応する束縛のスタックの取得
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する束縛のスタック</returns>
+    [[nodiscard]] std::vector<Binding>& stack(Symbol name) {
+        if (name.id >= this->stacks.size()) {
+            this->stacks.resize(name.id + 1);
+        }
+        return this->stacks[name.id];
+    }
+};
+
+/// <summary>
+/// 型環境
+/// </summary>
+struct TypeEnvironment {
+    /// <summary>
+    /// スコープにおいて1つ上の型環境
+    /// </summary>
+    TypeEnvironment* parent = nullptr;
+
+    /// <summary>
+    /// スコープの深さ
+    /// </summary>
+    std::size_t depth = 1;
+
+    /// <summary>
+    /// <para>型の生成先のアリーナの所有権</para>
+    /// <para>ルートの型環境のみが所有し、子の型環境はnullptrとする</para>
+    /// </summary>
+    std::shared_ptr<TypeArena> storage = std::make_shared<TypeArena>();
+
+    /// <summary>
+    /// <para>型の生成先のアリーナ</para>
+    /// <para>子の型環境は親の型環境と同一のアリーナを参照する(子の型環境は親の型環境より先に破棄されるため所有権はもたない)</para>
+    /// </summary>
+    TypeArena* arena = this->storage.get();
+
+    /// <summary>
+    /// <para>識別子の束縛の表</para>
+    /// <para>子の型環境は親の型環境と同一の表を共有する</para>
+    /// </summary>
+    std::shared_ptr<BindingTable> bindings = std::make_shared<BindingTable>();
+
+    /// <summary>
+    /// 型環境の生成時点での束縛の列の長さ(この型環境で行った束縛の開始位置)
+    /// </summary>
+    std::size_t mark = this->bindings->trail.size();
+
+    TypeEnvironment() = default;
+
+    /// <summary>
+    /// 独自のアリーナと束縛の表をもつ型環境を生成する
+    /// </summary>
+    /// <param name="parent">スコープにおいて1つ上の型環境</param>
+    /// <param name="depth">スコープの深さ</param>
+    TypeEnvironment(TypeEnvironment* parent, std::size_t depth) : parent(parent), depth(depth) {}
+    TypeEnvironment(const TypeEnvironment&) = delete;
+    TypeEnvironment(TypeEnvironment&&) = delete;
+    TypeEnvironment& operator=(const TypeEnvironment&) = delete;
+    TypeEnvironment& operator=(TypeEnvironment&&) = delete;
+    ~TypeEnvironment() {
+        // この型環境で行った束縛を巻き戻す
+        auto& trail = this->bindings->trail;
+        while (trail.size() > this->mark) {
+            this->bindings->stacks[trail.back().id].pop_back();
+            trail.pop_back();
+        }
+    }
+
+    /// <summary>
+    /// 子の型環境を生成する
+    /// </summary>
+    /// <param name="depth">子の型環境のスコープの深さ</param>
+    /// <returns>この型環境とアリーナと束縛の表を共有し、アリーナの所有権をもたない型環境</returns>
+    [[nodiscard]] TypeEnvironment child(std::size_t depth) {
+        return TypeEnvironment(this, depth, this->arena, this->bindings);
+    }
+
+    /// <summary>
+    /// <para>識別子に型を束縛する</para>
+    /// <para>この型環境で既に束縛済みの場合は上書きする</para>
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <param name="type">束縛する型</param>
+    void bind(Symbol name, std::variant<RefType, Generic> type) {
+        auto& stack = this->bindings->stack(name);
+        if (!stack.empty() && stack.back().env == this) {
+            stack.back().type = std::move(type);
+        }
+        else {
+            stack.push_back({ .env = this, .type = std::move(type) });
+            this->bindings->trail.push_back(name);
+        }
+    }
+
+    /// <summary>
+    /// 識別子がこの型環境で束縛されているかを判定する
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>この型環境で束縛されている場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool contains(Symbol name) const {
+        auto& stacks = this->bindings->stacks;
+        return name.id < stacks.size() && !stacks[name.id].empty() && stacks[name.id].back().env == this;
+    }
+
+    /// <summary>
+    /// 識別子のシンボルから型を取り出す
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する型</returns>
+    [[nodiscard]] std::optional<const std::variant<RefType, Generic>*> lookup(Symbol name) const {
+        InferenceStats::Probe probe(inferenceStats.lookup);
+        if (name.id < this->bindings->stacks.size()) {
+            auto& stack = this->bindings->stacks[name.id];
+            for (auto itr = stack.rbegin(); itr != stack.rend(); ++itr) {
+                probe.add(1);
+                // 生存中の子の型環境の束縛は参照しない
+                if (itr->env->depth <= this->depth) {
+                    // std::optionalは参照型は返せないのでポインタを返す
+                    return std::addressof(itr->type);
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// <summary>
+    /// 型の生成
+    /// </summary>
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        return this->arena->newType(std::move(kind));
+    }
+
+    /// <summary>
+    /// 自由な型変数について型をgeneralizeする
+    /// </summary>
+    /// <param name="type">複製対象の型</param>
     /// <param name="env">型環境</param>
-    /// <returns>クラスメソッドを示す型</returns>
-    RefType getClassMethod(TypeMap& typeMap, TypeEnvironment& env) {
-        auto& typeClass = this->getTypeClass();
-        auto& methodName = this->getMethodName();
-        // クラスメソッドがないのは論理エラーとする
-        assert(typeClass->methods.contains(methodName));
+    /// <param name="vals">generalize対象の型変数のリスト</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type, std::vector<RefType> vals = std::vector<RefType>());
+
+    /// <summary>
+    /// ジェネリック型の型変数についてinstantiateする
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="type">複製対象の型</param>
+    /// <param name="vals">型変数へ適用対象の型</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] RefType instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals = std::vector<RefType>());
+
+    /// <summary>
+    /// <para>組込みの関数型の生成</para>
+    /// <para>typeMap.builtin.fnのinstantiateと同一の型を汎用のinstantiateを経由せずに生成する</para>
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="paramType">引数型</param>
+    /// <param name="returnType">戻り値型</param>
+    /// <returns>生成した関数型</returns>
+    [[nodiscard]] RefType newFunction(TypeMap& typeMap, RefType paramType, RefType returnType);
+
+private:
+    /// <summary>
+    /// 子の型環境を生成する
+    /// </summary>
+    /// <param name="parent">スコープにおいて1つ上の型環境</param>
+    /// <param name="depth">スコープの深さ</param>
+    /// <param name="arena">親の型環境のアリーナ</param>
+    /// <param name="bindings">親の型環境の束縛の表</param>
+    TypeEnvironment(TypeEnvironment* parent, std::size_t depth, TypeArena* arena, std::shared_ptr<BindingTable> bindings)
+        : parent(parent), depth(depth), storage(nullptr), arena(arena), bindings(std::move(bindings)) {}
+};
+
+/// <summary>
+/// <para>型の走査の作業領域</para>
+/// <para>出現検査やgeneralizeごとにヒープを確保しないようにスレッドごとに使い回し、走査済みの型の集合は世代番号を進めることで全要素をO(1)で削除する</para>
+/// </summary>
+struct OccursBuffer {
+    /// <summary>
+    /// 走査済みの型の集合の要素
+    /// </summary>
+    struct Slot {
+        /// <summary>
+        /// 走査済みの型
+        /// </summary>
+        const Type* type = nullptr;
+        /// <summary>
+        /// 登録した世代番号(現在の世代番号と異なる場合は空とみなす)
+        /// </summary>
+        std::uint32_t epoch = 0;
+    };
+
+    /// <summary>
+    /// <para>走査済みの型の集合(開番地法のハッシュ表)</para>
+    /// <para>要素数は常に2の冪で、使用中の要素が半分を超えないように拡張する</para>
+    /// </summary>
+    std::vector<Slot> slots = {};
+
+    /// <summary>
+    /// 現在の世代番号
+    /// </summary>
+    std::uint32_t epoch = 0;
+
+    /// <summary>
+    /// 現在の世代の要素数
+    /// </summary>
+    std::size_t size = 0;
+
+    /// <summary>
+    /// 検査対象の型のスタック
+    /// </summary>
+    std::vector<RefType> stack = {};
+
+    /// <summary>
+    /// 走査済みの型の集合と検査対象の型のスタックを空にする
+    /// </summary>
+    void clear() {
+        this->stack.clear();
+        this->size = 0;
+        if (++this->epoch == 0) {
+            // 世代番号が一周した場合は古い世代の要素と区別できないため実際に削除する
+            std::ranges::fill(this->slots, Slot{});
+            this->epoch = 1;
+        }
+    }
+
+    /// <summary>
+    /// 走査済みの型を登録する
+    /// </summary>
+    /// <param name="type">登録する型</param>
+    /// <returns>新たに登録した場合はtrue、登録済みの場合はfalse</returns>
+    [[nodiscard]] bool insert(const Type* type) {
+        if ((this->size + 1) * 2 > this->slots.size()) {
+            // 現在の世代の要素のみを2倍の大きさの表に移す
+            std::vector<Slot> slots(std::max<std::size_t>(this->slots.size() * 2, 64));
+            std::swap(slots, this->slots);
+            for (const auto& slot : slots) {
+                if (slot.epoch == this->epoch) {
+                    *this->find(slot.type) = slot;
+                }
+            }
+        }
+        auto slot = this->find(type);
+        if (slot->epoch == this->epoch) {
+            return false;
+        }
+        *slot = { .type = type, .epoch = this->epoch };
+        ++this->size;
+        return true;
+    }
+
+private:
+    /// <summary>
+    /// 型が登録済みの要素もしくは登録先の空の要素を探索する
+    /// </summary>
+    /// <param name="type">探索する型</param>
+    /// <returns>探索結果の要素</returns>
+    [[nodiscard]] Slot* find(const Type* type) {
+        auto mask = this->slots.size() - 1;
+        // 型のアドレスは整列されていて下位のビットが偏るため乗算で攪拌する
+        auto hash = static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(type) >> 4) * 0x9e3779b97f4a7c15ull);
+        for (auto i = (hash ^ (hash >> 29)) & mask; ; i = (i + 1) & mask) {
+            auto& slot = this->slots[i];
+            if (slot.epoch != this->epoch || slot.type == type) {
+                return std::addressof(slot);
+            }
+        }
+    }
+};
+/// <summary>
+/// スレッドごとの出現検査の作業領域
+/// </summary>
+constinit thread_local OccursBuffer occursBuffer = {};
+/// <summary>
+/// スレッドごとのgeneralizeの作業領域
+/// </summary>
+constinit thread_local OccursBuffer generalizeBuffer = {};
+
+/// <summary>
+/// 自由な型変数について型をgeneralizeする
+/// </summary>
+/// <param name="type">複製対象の型</param>
+/// <param name="env">型環境</param>
+/// <param name="vals">generalize対象の型変数のリスト</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type, std::vector<RefType> vals) {
+    InferenceStats::Probe probe(inferenceStats.generalize);
+    InferenceTrace::Span span("generalize", "generalize");
+    generalizeBuffer.clear();
+
+    std::unordered_map<RefType, typename std::vector<RefType>::size_type> map;
+
+    struct fn {
+        RefType& t;
+        TypeEnvironment& e;
+        std::vector<RefType>& v;
+        std::unordered_map<RefType, typename std::vector<RefType>::size_type>& m;
+        std::vector<RefType*>& s;
+        const RefType* r;
+
+        /// <summary>
+        /// <para>走査中の型の参照先を書き換える</para>
+        /// <para>型の節点の書き換えは巻き戻せるようにTrailに記録する(generalizeの対象の型自身は局所変数のため記録しない)</para>
+        /// </summary>
+        /// <param name="value">書き換え後の型</param>
+        void assign(RefType value) {
+            if (std::addressof(this->t) == this->r) {
+                this->t = value;
+            }
+            else {
+                trail.assign(this->t, value);
+            }
+        }
+
+        void operator()([[maybe_unused]] Type::Base& x) {
+            // generalizeしない
+        }
+        void operator()(Type::Function& x) {
+            if (this->e.arena->interned(this->t)) {
+                // 共有された関数型は型変数を含まないためgeneralizeしない
+                // 部分型の共有を木として展開して走査することになるため部分型も積まない
+                return;
+            }
+            if (!generalizeBuffer.insert(this->t)) {
+                // 走査済みの関数型は部分型の書き換えも済んでいるため再び走査しない
+                return;
+            }
+            // 引数型と戻り値型をgeneralizeする
+            // 引数型の型変数から順に番号を振るため戻り値型から積む
+            this->s.push_back(std::addressof(x.returnType));
+            this->s.push_back(std::addressof(x.paramType));
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
+                // この際にGeneric型から完全に型変数を除去するために簡約
+                this->assign(solved(x.solve));
+                this->s.push_back(std::addressof(this->t));
+                return;
+            }
+
+            if (this->e.depth < x.depth) {
+                // 自由な型変数のためgeneralizeする
+                if (auto itr = this->m.find(this->t); itr != this->m.end()) {
+                    this->assign(this->v[itr->second]);
+                }
+                else {
+                    this->m.insert({ this->t, this->v.size() });
+                    // 導出した型変数に対する型制約は継承する
+                    this->v.push_back(this->e.newType(Type::Param{ .constraints = std::move(x.constraints), .index = this->v.size() }));
+                    this->assign(this->v.back());
+                }
+            }
+            // 束縛された型変数のためgeneralizeしない
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {
+            // 外のスコープから与えられた型変数のためgeneralizeしない
+            // 現状の実装ではこのシチュエーションは(おそらく)生じない
+        }
+        void operator()([[maybe_unused]] Type::TypeClass& x) {
+            // 型としての型クラスは型変数に依存しないためgeneralizeしない
+        }
+    };
+
+    // generalizeの対象の型の参照先のスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<RefType*> stack = { std::addressof(type) };
+    while (!stack.empty()) {
+        auto& t = *stack.back();
+        stack.pop_back();
+        probe.add(1);
+        std::visit(fn{ .t = t, .e = *this, .v = vals, .m = map, .s = stack, .r = std::addressof(type) }, t->kind);
+    }
+
+    if (vals.size() > 0) {
+        return Generic{ .vals = std::move(vals), .type = std::move(type) };
+    }
+    else {
+        return type;
+    }
+}
+
+/// <summary>
+/// <para>型クラス</para>
+/// <para>型クラスごとに一意のインスタンスを持つ</para>
+/// </summary>
+struct TypeClass {
+    /// <summary>
+    /// 型クラス名
+    /// </summary>
+    const std::string name;
+
+    /// <summary>
+    /// <para>基底</para>
+    /// <para>基底のtypeはthisのtypeと一致する</para>
+    /// </summary>
+    Constraints bases = {};
+
+    /// <summary>
+    /// <para>型クラスを実装する対象の型を示す型変数</para>
+    /// <para>制約なしの空なType::Paramである必要がある</para>
+    /// </summary>
+    RefType type;
+
+    /// <summary>
+    /// <para>クラスメソッド</para>
+    /// <para>第一引数はtype(self)固定</para>
+    /// </summary>
+    std::unordered_map<std::string, std::variant<RefType, Generic>> methods = {};
+
+    /// <summary>
+    /// <para>型クラスの通し番号</para>
+    /// <para>TypeMap::addTypeClassで登録した際に採番する</para>
+    /// </summary>
+    std::optional<std::size_t> id = std::nullopt;
+
+    /// <summary>
+    /// <para>自身を含む継承している型クラスの通し番号の集合</para>
+    /// <para>TypeMap::addTypeClassで登録した際に基底の推移閉包として事前計算する</para>
+    /// </summary>
+    TypeClassSet ancestors = {};
+
+    /// <summary>
+    /// thisが指定された型クラスを継承しているか判定
+    /// </summary>
+    /// <param name="typeClass">継承しているか判定する対象の型クラス</param>
+    /// <returns>継承している場合はtrue、継承していない場合はfalse</returns>
+    [[nodiscard]] bool derived(RefTypeClass typeClass) const {
+        if (this->id) {
+            // 登録済みの型クラスの基底は全て登録済みのため事前計算した集合で判定する
+            return typeClass->id && this->ancestors.contains(typeClass->id.value());
+        }
+
+        // 未登録の型クラスは基底を辿って判定する
+        // 型クラス/インスタンスの一意性に基づき評価する
+        if (this == typeClass.get()) {
+            return true;
+        }
+        return this->bases.has(typeClass);
+    }
+};
+
+/// <summary>
+/// 型クラスを登録して通し番号を採番する
+/// </summary>
+/// <param name="typeClass">登録する型クラス</param>
+/// <param name="ancestors">基底が継承している型クラスの通し番号の集合</param>
+void TypeClassTable::add(const RefTypeClass& typeClass, TypeClassSet ancestors) {
+    std::lock_guard lock(this->mutex);
+    typeClass->id = this->typeClasses.size();
+    ancestors.insert(typeClass->id.value());
+    typeClass->ancestors = std::move(ancestors);
+    this->typeClasses.push_back(typeClass);
+}
+
+/// <summary>
+/// 型クラスのリストから型制約を構築する
+/// </summary>
+/// <param name="typeClasses">型制約とする型クラス</param>
+
+Constraints::Constraints(std::initializer_list<RefTypeClass> typeClasses) {
+    for (const auto& typeClass : typeClasses) {
+        this->insert(typeClass);
+    }
+}
+
+/// <summary>
+/// 型制約を追加する
+/// </summary>
+/// <param name="typeClass">追加する型クラス(登録済みである必要がある)</param>
+void Constraints::insert(const RefTypeClass& typeClass) {
+    if (!typeClass->id) {
+        throw std::runtime_error(std::format("型クラス{}は事前に定義が必要", typeClass->name));
+    }
+    if (this->closure.contains(typeClass->id.value())) {
+        // 既に同じ型クラスもしくは派生の型クラスが存在する
+        return;
+    }
+    this->set.insert(typeClass->id.value());
+    this->closure |= typeClass->ancestors;
+    this->reduce();
+}
+
+/// <summary>
+/// <para>型制約をマージする</para>
+/// <para>型クラスの継承関係により縮約を適用しながらマージを行う</para>
+/// </summary>
+/// <param name="constraints">マージ対象の型クラス</param>
+void Constraints::merge(const Constraints& constraints) {
+    if (constraints.empty() || this->includes(constraints)) {
+        return;
+    }
+
+    if (this->empty()) {
+        // もともと制約がない場合は単純コピーをする
+        *this = constraints;
+    }
+    else {
+        // 和集合を取ってからより制約が強いものに縮約する
+        this->set |= constraints.set;
+        this->closure |= constraints.closure;
+        this->reduce();
+    }
+}
+
+/// <summary>
+/// 他の型クラスの基底となっている型クラスをsetから除去する
+/// </summary>
+void Constraints::reduce() {
+    auto& table = TypeClassTable::instance();
+    // setの型クラスの真の基底の集合
+    TypeClassSet bases;
+    this->set.forEach([&](std::size_t id) {
+        auto ancestors = table.typeClasses[id]->ancestors;
+        ancestors.erase(id);
+        bases |= ancestors;
+    });
+    this->set -= bases;
+}
+
+/// <summary>
+/// 制約を持つか検査
+/// </summary>
+/// <param name="typeClass">制約を持つか検査する型クラス</param>
+[[nodiscard]] bool Constraints::has(const RefTypeClass& typeClass) const {
+    // 全てのtypeが実装している型クラスの継承関係を事前に集約しているため1度の判定で済む
+    return typeClass->id && this->closure.contains(typeClass->id.value());
+}
+
+/// <summary>
+/// 型に関するデータ
+/// </summary>
+struct TypeData {
+    /// <summary>
+    /// 型の表現
+    /// </summary>
+    std::variant<RefType, Generic> type;
+
+    /// <summary>
+    /// 実装している型クラス(制約)
+    /// </summary>
+    Constraints typeclasses = {};
+};
+
+/// <summary>
+/// <para>型表</para>
+/// <para>freezeで凍結した型表は変更されないため、任意の数の型推論から同時に参照できる</para>
+/// <para>型推論ごとの追加はoverlayで凍結した型表の上に重ねた型表に対して行う</para>
+/// </summary>
+struct TypeMap {
+    /// <summary>
+    /// <para>下層の凍結した型表</para>
+    /// <para>自身に登録されていない型と型クラスは下層から探索する</para>
+    /// </summary>
+    const TypeMap* prelude = nullptr;
+
+    /// <summary>
+    /// 凍結済みか
+    /// </summary>
+    bool frozen = false;
+
+    /// <summary>
+    /// 型の表
+    /// </summary>
+    std::unordered_map<std::string, TypeData> typeMap = {};
+
+    /// <summary>
+    /// 型クラスの表
+    /// </summary>
+    std::unordered_map<std::string, RefTypeClass> typeClassMap = {};
+
+    /// <summary>
+    /// <para>クラスメソッド名からクラスメソッドを定義している型クラスの通し番号の集合への索引</para>
+    /// <para>基底から継承したクラスメソッドは含まない</para>
+    /// </summary>
+    std::unordered_map<Symbol, TypeClassSet> methodIndex = {};
+
+    /// <summary>
+    /// クラスメソッドの解決結果のキャッシュのキー(縮約された型制約とクラスメソッド名の組)
+    /// </summary>
+    struct MethodKey {
+        /// <summary>
+        /// 縮約された型制約
+        /// </summary>
+        TypeClassSet set;
+        /// <summary>
+        /// クラスメソッド名
+        /// </summary>
+        Symbol name;
+
+        [[nodiscard]] bool operator==(const MethodKey&) const = default;
+    };
+
+    /// <summary>
+    /// MethodKeyのハッシュ関数
+    /// </summary>
+    struct MethodKeyHash {
+        [[nodiscard]] std::size_t operator()(const MethodKey& key) const noexcept {
+            std::size_t seed = std::hash<TypeClassSet>{}(key.set);
+            seed ^= std::hash<Symbol>{}(key.name) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            return seed;
+        }
+    };
+
+    /// <summary>
+    /// <para>クラスメソッドの解決結果のキャッシュ</para>
+    /// <para>型クラスの追加では既存の型制約の継承関係は変化しないため無効化は不要</para>
+    /// <para>凍結後は更新しない</para>
+    /// </summary>
+    std::unordered_map<MethodKey, std::optional<RefTypeClass>, MethodKeyHash> methodCache = {};
+
+    /// <summary>
+    /// <para>組込み型の定義</para>
+    /// <para>型の生成時は必ずこれを経由する</para>
+    /// </summary>
+    struct {
+        /// <summary>
+        /// 関数型
+        /// </summary>
+        Generic fn;
+    } builtin;
+
+    /// <summary>
+    /// 型名から型に関するデータを探索する
+    /// </summary>
+    /// <param name="name">型名</param>
+    /// <returns>型に関するデータ(存在しない場合はnullptr)</returns>
+    [[nodiscard]] const TypeData* findType(const std::string& name) const {
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->typeMap.find(name); itr != typeMap->typeMap.end()) {
+                return std::addressof(itr->second);
+            }
+        }
+        return nullptr;
+    }
+
+    /// <summary>
+    /// 型クラス名から型クラスを探索する
+    /// </summary>
+    /// <param name="name">型クラス名</param>
+    /// <returns>型クラス(存在しない場合はnullptr)</returns>
+    [[nodiscard]] RefTypeClass findTypeClass(const std::string& name) const {
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->typeClassMap.find(name); itr != typeMap->typeClassMap.end()) {
+                return itr->second;
+            }
+        }
+        return nullptr;
+    }
+
+    /// <summary>
+    /// 型クラス名から型クラスを取得する
+    /// </summary>
+    /// <param name="name">型クラス名</param>
+    /// <returns>型クラス</returns>
+    [[nodiscard]] RefTypeClass getTypeClass(const std::string& name) const {
+        auto typeClass = this->findTypeClass(name);
+        if (!typeClass) {
+            throw std::runtime_error(std::format("型クラス{}が定義されていない", name));
+        }
+        return typeClass;
+    }
+
+    /// <summary>
+    /// <para>型表を凍結する</para>
+    /// <para>型推論中に遅延して構築するinstantiateの雛形を事前に構築し、以降の変更を禁止する</para>
+    /// </summary>
+    void freeze() {
+        auto build = [](const Generic& generic) {
+            if (!generic.spine) {
+                generic.spine = GenericTemplate::build(generic);
+            }
+        };
+        build(this->builtin.fn);
+        for (const auto& [name, data] : this->typeMap) {
+            if (std::holds_alternative<Generic>(data.type)) {
+                build(std::get<Generic>(data.type));
+            }
+            // 型名による探索を避けるために基底型へ型に関するデータを記録する
+            // 凍結後は変更しないため型推論中は読み取りのみとなる
+            auto type = std::holds_alternative<Generic>(data.type) ? std::get<Generic>(data.type).type : std::get<RefType>(data.type);
+            auto& x = std::get<Type::Base>(Type::getBaseType(type)->kind);
+            x.data = std::addressof(data);
+            x.owner = this;
+        }
+        for (const auto& [name, typeClass] : this->typeClassMap) {
+            for (const auto& [methodName, method] : typeClass->methods) {
+                if (std::holds_alternative<Generic>(method)) {
+                    build(std::get<Generic>(method));
+                }
+            }
+        }
+        this->frozen = true;
+    }
+
+    /// <summary>
+    /// <para>凍結した型表の上に型推論ごとの型表を重ねる</para>
+    /// <para>重ねた型表への追加は凍結した型表に影響しない</para>
+    /// </summary>
+    /// <returns>重ねた型表</returns>
+    [[nodiscard]] TypeMap overlay() const {
+        if (!this->frozen) {
+            throw std::runtime_error("凍結していない型表には重ねられない");
+        }
+        TypeMap typeMap;
+        typeMap.prelude = this;
+        typeMap.builtin = this->builtin;
+        return typeMap;
+    }
+
+    /// <summary>
+    /// 型定義の追加
+    /// </summary>
+    /// <param name="type">追加する型</param>
+    /// <returns>追加した型</returns>
+    auto& addType(RefType type) {
+        // 型から型名を取り出して登録する
+        auto typeName = type->getTypeName();
+        assert(!!typeName);
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型{}は追加できない", *typeName.value()));
+        }
+        if (this->prelude && this->prelude->findType(*typeName.value())) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type }});
+        if (!ret) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        return *itr;
+    }
+
+    /// <summary>
+    /// 型定義の追加
+    /// </summary>
+    /// <param name="type">追加する型</param>
+    /// <returns>追加した型</returns>
+    auto& addType(const Generic& type) {
+        // 型から型名を取り出して登録する
+        auto typeName = type.type->getTypeName();
+        assert(!!typeName);
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型{}は追加できない", *typeName.value()));
+        }
+        if (this->prelude && this->prelude->findType(*typeName.value())) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type } });
+        if (!ret) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        return *itr;
+    }
+
+    /// <summary>
+    /// 型クラスの定義の追加
+    /// </summary>
+    /// <param name="typeClass">追加する型クラス</param>
+    /// <returns>追加した型クラス</returns>
+    auto& addTypeClass(RefTypeClass typeClass) {
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型クラス{}は追加できない", typeClass->name));
+        }
+        if (typeClass->id || (this->prelude && this->prelude->findTypeClass(typeClass->name))) {
+            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
+        }
+        // 基底の継承関係は登録済みのため基底の集合の和として継承関係を構成する
+        TypeClassSet ancestors;
+        typeClass->bases.forEach([&](const RefTypeClass& base) {
+            ancestors |= base->ancestors;
+        });
+
+        auto [itr, ret] = this->typeClassMap.insert({ typeClass->name, typeClass });
+        if (!ret) {
+            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
+        }
+        // 通し番号を採番する
+        TypeClassTable::instance().add(typeClass, std::move(ancestors));
+
+        // クラスメソッドの索引に登録する
+        for (const auto& method : typeClass->methods) {
+            this->methodIndex[Symbol(method.first)].insert(typeClass->id.value());
+        }
+        return *itr;
+    }
+
+    /// <summary>
+    /// <para>型制約から指定されたクラスメソッドを定義している型クラスを解決する</para>
+    /// <para>基底よりも派生の型クラスを優先して探索し、解決結果は型制約とクラスメソッド名の組ごとにキャッシュする</para>
+    /// <para>下層の型表のキャッシュも参照するが、更新するのは凍結していない自身のキャッシュのみ</para>
+    /// </summary>
+    /// <param name="constraints">クラスメソッドを探索する型制約</param>
+    /// <param name="name">クラスメソッド名</param>
+    /// <returns>クラスメソッドを定義している型クラス(存在しない場合はstd::nullopt)</returns>
+    [[nodiscard]] std::optional<RefTypeClass> getClassMethod(const Constraints& constraints, Symbol name) {
+        auto key = MethodKey{ .set = constraints.set, .name = name };
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->methodCache.find(key); itr != typeMap->methodCache.end()) {
+                return itr->second;
+            }
+        }
+
+        // 型制約が継承している型クラスのうちnameを定義している型クラスを抽出する
+        TypeClassSet defined;
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->methodIndex.find(name); itr != typeMap->methodIndex.end()) {
+                defined |= itr->second;
+            }
+        }
+        auto candidates = constraints.closure;
+        candidates &= defined;
+
+        // nameを定義している型クラスの基底はnameを定義していても無視する
+        // 要は基底よりも派生の方をクラスメソッドの探索対象として優先する
+        auto& table = TypeClassTable::instance();
+        Constraints resolved;
+        candidates.forEach([&](std::size_t id) { resolved.insert(table.typeClasses[id]); });
+        if (resolved.size() > 1) {
+            throw std::runtime_error(std::format("クラスメソッドが一意に特定できない：{}", name.name()));
+        }
+
+        std::optional<RefTypeClass> typeClass = std::nullopt;
+        resolved.forEach([&typeClass](const RefTypeClass& t) { typeClass = t; });
+        if (!this->frozen) {
+            this->methodCache.insert({ std::move(key), typeClass });
+        }
+        return typeClass;
+    }
+
+    /// <summary>
+    /// 型に制約としての型クラスを適用する
+    /// </summary>
+    /// <param name="type">適用対象の型</param>
+    /// <param name="typeClass">適用対象の型クラス</param>
+    void applyConstraint(RefType type, const Constraints& typeClasses) {
+        InferenceStats::Probe probe(inferenceStats.applyConstraint);
+
+        // 解決済みの型変数が存在すればそれを適用してから制約の適用を行う
+        auto t = solved(type);
+
+        if (std::holds_alternative<Type::Variable>(t->kind)) {
+            // 通常の型変数に対しては後からでも自由に型制約を追加可能
+
+            // 型制約にtypeClassesを追加
+            auto& constraints = std::get<Type::Variable>(t->kind).constraints;
+            trail.save(constraints);
+            constraints.merge(typeClasses);
+        }
+        else {
+            // トップレベルが型変数ではない通常の型の場合は後から型制約の追加は禁止
+            // 型がtypeClassesを実装しているか検査する
+            probe.add(1);
+
+            auto& constraints = t->getTypeClassList(*this);
+            if (constraints.includes(typeClasses)) {
+                return;
+            }
+
+            typeClasses.forEach([&](const RefTypeClass& typeClass) {
+                // typeがtypeClassを実装しているか検査する
+                // 実装していない型クラスが見つかった場合は異常とする
+                if (!constraints.has(typeClass)) {
+                    // 登録済みの型クラスは登録された型クラス名をそのまま保持している
+                    if (typeClass->id) {
+                        if (std::holds_alternative<Type::Param>(t->kind)) {
+                            throw std::runtime_error(std::format("ジェネリック型における型変数は事前に制約{}の宣言が必要", typeClass->name));
+                        }
+                        throw std::runtime_error(std::format("型クラス{}を実装していない", typeClass->name));
+                    }
+                    else {
+                        // 匿名の型クラス（未実装）を制約として課そうとしたときの異常のため
+                        // ここに到達することは論理エラーとする
+                        assert(false);
+                    }
+                }
+            });
+        }
+    }
+};
+
+/// <summary>
+/// 型に紐づく型クラスのリストの取得
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <returns>型に紐づく型クラスのリスト</returns>
+const Constraints& Type::getTypeClassList(TypeMap& typeMap) const {
+    // 型変数の場合は型制約としての型クラスのリストを返す
+    if (std::holds_alternative<Type::Variable>(this->kind)) {
+        return *std::get<Type::Variable>(this->kind).constraints;
+    }
+    else if (std::holds_alternative<Type::Param>(this->kind)) {
+        return *std::get<Type::Param>(this->kind).constraints;
+    }
+    else if (std::holds_alternative<Type::TypeClass>(this->kind)) {
+        // 型としての型クラスはそのまま保持している型クラスのリストを返す
+        return *std::get<Type::TypeClass>(this->kind).typeClasses;
+    }
+
+    // それ以外の型(明示的に型名を持つ型)は型表に登録された型に関するデータから取得する
+    return this->getTypeData(typeMap).typeclasses;
+}
+
+/// <summary>
+/// 明示的に型名を持つ型について型表に登録された型に関するデータを取得する
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <returns>型に関するデータ</returns>
+const TypeData& Type::getTypeData(const TypeMap& typeMap) const {
+    auto& x = std::get<Type::Base>(Type::getBaseType(this)->kind);
+
+    // 凍結時に記録した型表がtypeMapの下層にある場合のみ記録を利用する
+    if (x.data) {
+        for (const TypeMap* map = std::addressof(typeMap); map; map = map->prelude) {
+            if (map == x.owner) {
+                return *x.data;
+            }
+        }
+    }
+
+    // 記録がない型推論ごとの型は型名で型表を探索する
+    auto data = typeMap.findType(x.name.name());
+    assert(data);
+    return *data;
+}
+
+/// <summary>
+/// <para>組込みの関数型の生成</para>
+/// <para>typeMap.builtin.fnのinstantiateと同一の型を汎用のinstantiateを経由せずに生成する</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="paramType">引数型</param>
+/// <param name="returnType">戻り値型</param>
+/// <returns>生成した関数型</returns>
+[[nodiscard]] RefType TypeEnvironment::newFunction(TypeMap& typeMap, RefType paramType, RefType returnType) {
+    // 組込みの関数型の型変数は型制約をもたないため制約の検査は不要
+    return this->newType(Type::Function{
+        .base = std::get<Type::Function>(typeMap.builtin.fn.type->kind).base,
+        .paramType = paramType,
+        .returnType = returnType
+    });
+}
+
+/// <summary>
+/// ジェネリック型の型変数についてinstantiateする
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="type">複製対象の型</param>
+/// <param name="vals">型変数へ適用対象の型</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] RefType TypeEnvironment::instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals) {
+    InferenceStats::Probe probe(inferenceStats.instantiate);
+
+    // instantiateした対象の型変数のリスト
+    vals.resize(type.vals.size());
+
+    // デフォルトでvalsが要素をもつときは型制約を適用・検査する
+    for (decltype(type.vals.size()) i = 0; i < type.vals.size(); ++i) {
+        auto& param = std::get<Type::Param>(type.vals[i]->kind);
+        if (!vals[i]) {
+            // 型が割当たっていない場合は型変数を割り当てる
+            // 型変数に課された制約を継承する
+            vals[i] = this->newType(Type::Variable{ .constraints = param.constraints, .depth = this->depth });
+        }
+        else {
+            typeMap.applyConstraint(vals[i], *param.constraints);
+        }
+    }
+
+    if (!type.spine) {
+        type.spine = GenericTemplate::build(type);
+    }
+
+    // instantiateした骨格の節点のリスト
+    std::vector<RefType> nodes(type.spine->nodes.size());
+
+    auto get = [&](const GenericTemplate::Operand& operand) {
+        switch (operand.kind) {
+        case GenericTemplate::Operand::Kind::VAL:
+            return vals[operand.index];
+        case GenericTemplate::Operand::Kind::NODE:
+            return nodes[operand.index];
+        default:
+            return operand.type;
+        }
+    };
+
+    // 後行順に並んでいるため子は常に生成済み
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        auto& node = type.spine->nodes[i];
+        // 組込み型である関数型なので基底を継承する
+        nodes[i] = this->newType(Type::Function{ .base = node.base, .paramType = get(node.paramType), .returnType = get(node.returnType) });
+    }
+    probe.add(nodes.size());
+    return get(type.spine->root);
+}
+
+/// <summary>
+/// <para>型変数targetがtypeに出現するかの判定(出現検査)</para>
+/// <para>検査と同時にtypeに出現する自由な型変数のスコープの深さをtargetの深さまで引き下げる</para>
+/// <para>共有された部分型は1度の検査につき1度のみ走査する</para>
+/// </summary>
+/// <param name="type">検査対象の型</param>
+/// <param name="target">出現を検査する型変数</param>
+/// <returns>typeにtargetが出現する場合にtrue、出現しない場合にfalse</returns>
+[[nodiscard]] bool occurs(RefType type, RefType target) {
+    InferenceStats::Probe probe(inferenceStats.occurs);
+
+    // 走査済みの型と検査対象の型のスタックはスレッドごとに使い回す
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    auto& visited = occursBuffer;
+    auto& stack = occursBuffer.stack;
+    visited.clear();
+    stack.push_back(type);
+
+    struct fn {
+        const std::size_t depth;
+        std::vector<RefType>& stack;
+
+        void operator()([[maybe_unused]] Type::Base& x) {}
+        void operator()(Type::Function& x) {
+            // 引数型から先に検査するため戻り値型から積む
+            this->stack.push_back(x.returnType);
+            this->stack.push_back(x.paramType);
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                this->stack.push_back(solved(x.solve));
+                return;
+            }
+            // targetより深いスコープでgeneralizeされないようにスコープの深さを引き下げる
+            trail.assign(x.depth, std::min(x.depth, this->depth));
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {}
+        void operator()([[maybe_unused]] Type::TypeClass& x) {}
+    };
+
+    const auto depth = std::get<Type::Variable>(target->kind).depth;
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (t == target) {
+            return true;
+        }
+        if (!visited.insert(t)) {
+            // 走査済みの部分型は再度検査しない
+            continue;
+        }
+        probe.add(1);
+        std::visit(fn{ .depth = depth, .stack = stack }, t->kind);
+    }
+    return false;
+}
+
+
+/// <summary>
+/// <para>副作用付きの2つの型の単一化</para>
+/// <para>暗黙の型変換はtype1 <- type2の方向で行われる</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="type1">単一化の対象の型1</param>
+/// <param name="type2">単一化の対象の型2</param>
+void unify(TypeMap& typeMap, RefType type1, RefType type2) {
+    InferenceStats::Probe probe(inferenceStats.unify);
+    InferenceTrace::Span span("unify", "unify");
+
+    // 単一化の対象の型のペアのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<std::pair<RefType, RefType>> stack = { { type1, type2 } };
+
+    while (!stack.empty()) {
+        // 解決済みの型変数が存在すればそれを適用してから単一化を行う
+        auto t1 = solved(stack.back().first);
+        auto t2 = solved(stack.back().second);
+        stack.pop_back();
+        probe.add(1);
+
+        if (t1 != t2) {
+            if (std::holds_alternative<Type::Variable>(t1->kind)) {
+                auto& t1v = std::get<Type::Variable>(t1->kind);
+
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    // 型変数同士の場合は併合する
+                    unite(t1, t2);
+                }
+                else {
+                    if (occurs(t2, t1)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    // t2がt1の制約を満たすかを検証する
+                    typeMap.applyConstraint(t2, *t1v.constraints);
+                    trail.assign(t1v.solve, t2);
+                }
+            }
+            else {
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    auto& t2v = std::get<Type::Variable>(t2->kind);
+                    if (occurs(t1, t2)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    // t1がt2の制約を満たすかを検証する
+                    typeMap.applyConstraint(t1, *t2v.constraints);
+                    trail.assign(t2v.solve, t1);
+                }
+                else if (std::holds_alternative<Type::TypeClass>(t1->kind)) {
+                    // type1 <- type2な暗黙の型変換の検証
+                    // type2はType::Variableでないためtype1に課された型クラスがtype2で実装されているか検証となる
+                    typeMap.applyConstraint(t2, *std::get<Type::TypeClass>(t1->kind).typeClasses);
+
+                    // キャストが生じた場合の対処は型推論の域を逸脱するため未実装
+                    // 実装する場合は明示的なキャストの構文を構文木に挿入する
+                }
+                else {
+                    // 型が一致する場合に部分型について単一化
+                    // 制約付きの場合は「C ⊨ type1 ∼ type2」のような同値の条件によりキャストを行うが未実装
+                    if (t1->kind.index() == t2->kind.index()) {
+                        if (std::holds_alternative<Type::Function>(t1->kind)) {
+                            auto& k1 = std::get<Type::Function>(t1->kind);
+                            auto& k2 = std::get<Type::Function>(t2->kind);
+                            // 引数型から先に単一化するため戻り値型から積む
+                            stack.push_back({ k1.returnType, k2.returnType });
+                            stack.push_back({ k1.paramType, k2.paramType });
+                        }
+                        else {
+                            // 部分型をもたないため型は一致しない
+                            throw std::runtime_error("型の不一致");
+                        }
+                    }
+                    else {
+                        // 型の種類が一致しない
+                        throw std::runtime_error("型の不一致");
+                    }
+                }
+            }
+        }
+    }
+}
+/// <summary>
+/// <para>連続した配列上に平坦化された構文木</para>
+/// <para>各ノードは種別タグと子ノードのインデックスの範囲のみをもち、引数や型といった可変長の情報は種類ごとの配列に格納する</para>
+/// </summary>
+struct Ast {
+    /// <summary>
+    /// 各配列におけるインデックス
+    /// </summary>
+    using Index = std::uint32_t;
+
+    /// <summary>
+    /// ノードの種別
+    /// </summary>
+    enum struct Tag : std::uint8_t {
+        Constant,
+        Identifier,
+        Lambda,
+        Apply,
+        Let,
+        Letrec,
+        AccessToClassMethod,
+        BinaryExpression
+    };
+
+    /// <summary>
+    /// 配列上の半開区間[begin, end)
+    /// </summary>
+    struct Range {
+        Index begin = 0;
+        Index end = 0;
+
+        [[nodiscard]] Index size() const {
+            return this->end - this->begin;
+        }
+    };
+
+    /// <summary>
+    /// ラムダ抽象の引数
+    /// </summary>
+    struct Parameter {
+        /// <summary>
+        /// 引数名
+        /// </summary>
+        Symbol x;
+        /// <summary>
+        /// xの型制約
+        /// </summary>
+        std::optional<RefType> constraint = std::nullopt;
+    };
+
+    /// <summary>
+    /// <para>構文木のノード</para>
+    /// <para>operandsの参照先はtagにより異なる</para>
+    /// <para>Constant、Let、Letrec：types、Lambda：params、BinaryExpression：typeClasses</para>
+    /// </summary>
+    struct Node {
+        /// <summary>
+        /// ノードの種別
+        /// </summary>
+        Tag tag;
+        /// <summary>
+        /// 識別子名、束縛先の識別子名またはクラスメソッド名
+        /// </summary>
+        Symbol x = {};
+        /// <summary>
+        /// childrenにおける子ノードのインデックスの範囲
+        /// </summary>
+        Range children = {};
+        /// <summary>
+        /// 可変長の情報の範囲
+        /// </summary>
+        Range operands = {};
+    };
+
+    /// <summary>
+    /// ノードの配列
+    /// </summary>
+    std::vector<Node> nodes = {};
+    /// <summary>
+    /// 子ノードのインデックスの配列
+    /// </summary>
+    std::vector<Index> children = {};
+    /// <summary>
+    /// ラムダ抽象の引数の配列
+    /// </summary>
+    std::vector<Parameter> params = {};
+    /// <summary>
+    /// 定数の型と明示的に宣言されたジェネリック型に出現する型変数の配列
+    /// </summary>
+    std::vector<RefType> types = {};
+    /// <summary>
+    /// 二項演算を示す型クラスの配列
+    /// </summary>
+    std::vector<RefTypeClass> typeClasses = {};
+
+    /// <summary>
+    /// 配列の末尾に要素を追加する
+    /// </summary>
+    /// <param name="v">追加先の配列</param>
+    /// <param name="items">追加する要素</param>
+    /// <returns>追加した要素の範囲</returns>
+    template <class T, class Items>
+    static Range append(std::vector<T>& v, const Items& items) {
+        auto begin = static_cast<Index>(v.size());
+        v.insert(v.end(), std::begin(items), std::end(items));
+        return Range{ .begin = begin, .end = static_cast<Index>(v.size()) };
+    }
+
+    /// <summary>
+    /// ノードを追加する
+    /// </summary>
+    /// <param name="node">追加するノード</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Index push(const Node& node) {
+        this->nodes.push_back(node);
+        return static_cast<Index>(this->nodes.size() - 1);
+    }
+
+    /// <summary>
+    /// ノードの子ノードを取得する
+    /// </summary>
+    /// <param name="node">ノード</param>
+    /// <param name="i">子ノードの番号</param>
+    /// <returns>子ノードのインデックス</returns>
+    [[nodiscard]] Index child(const Node& node, Index i) const {
+        assert(i < node.children.size());
+        return this->children[node.children.begin + i];
+    }
+
+    /// <summary>
+    /// 自由な識別子の列挙
+    /// </summary>
+    /// <param name="index">列挙対象のノードのインデックス</param>
+    /// <param name="bound">束縛済みの識別子のスタック</param>
+    /// <param name="out">自由な識別子の出力先(重複を含む)</param>
+    void freeVariables(Index index, std::vector<Symbol>& bound, std::vector<Symbol>& out) const {
+        auto& node = this->nodes[index];
+        switch (node.tag) {
+        case Tag::Identifier:
+            if (std::find(bound.rbegin(), bound.rend(), node.x) == bound.rend()) {
+                out.push_back(node.x);
+            }
+            return;
+        case Tag::Lambda:
+            for (auto i = node.operands.begin; i < node.operands.end; ++i) {
+                bound.push_back(this->params[i].x);
+            }
+            this->freeVariables(this->child(node, 0), bound, out);
+            bound.resize(bound.size() - node.operands.size());
+            return;
+        case Tag::Let:
+            // 束縛する式に出現するxは外側の束縛を参照する
+            this->freeVariables(this->child(node, 0), bound, out);
+            bound.push_back(node.x);
+            this->freeVariables(this->child(node, 1), bound, out);
+            bound.pop_back();
+            return;
+        case Tag::Letrec:
+            bound.push_back(node.x);
+            this->freeVariables(this->child(node, 0), bound, out);
+            this->freeVariables(this->child(node, 1), bound, out);
+            bound.pop_back();
+            return;
+        default:
+            // AccessToClassMethodとBinaryExpressionのクラスメソッド名は識別子ではないため列挙しない
+            for (Index i = 0; i < node.children.size(); ++i) {
+                this->freeVariables(this->child(node, i), bound, out);
+            }
+            return;
+        }
+    }
+
+    /// <summary>
+    /// ノードの種別名の取得
+    /// </summary>
+    /// <param name="tag">ノードの種別</param>
+    /// <returns>種別名</returns>
+    [[nodiscard]] static const char* tagName(Tag tag) {
+        switch (tag) {
+        case Tag::Constant:
+            return "Constant";
+        case Tag::Identifier:
+            return "Identifier";
+        case Tag::Lambda:
+            return "Lambda";
+        case Tag::Apply:
+            return "Apply";
+        case Tag::Let:
+            return "Let";
+        case Tag::Letrec:
+            return "Letrec";
+        case Tag::AccessToClassMethod:
+            return "AccessToClassMethod";
+        default:
+            return "BinaryExpression";
+        }
+    }
+};
+
+/// <summary>
+/// <para>式を示す構文木</para>
+/// <para>構築のためのフロントエンドであり、型推論はAstへ平坦化した結果に対して行う</para>
+/// </summary>
+struct Expression {
+    virtual ~Expression() {};
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    virtual Ast::Index flatten(Ast& ast) const = 0;
+};
+
+/// <summary>
+/// 定数を示す構文木(簡単のために値はもたない)
+/// </summary>
+struct Constant : Expression {
+    /// <summary>
+    /// 定数の型
+    /// </summary>
+    RefType b;
+
+    Constant(RefType b) : b(b) {}
+    ~Constant() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        return ast.push({ .tag = Ast::Tag::Constant, .operands = Ast::append(ast.types, std::array{ this->b }) });
+    }
+};
+
+/// <summary>
+/// 識別子を示す構文木
+/// </summary>
+struct Identifier : Expression {
+    /// <summary>
+    /// 識別子名
+    /// </summary>
+    Symbol x;
+
+    Identifier(std::string_view x) : x(x) {}
+    ~Identifier() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        return ast.push({ .tag = Ast::Tag::Identifier, .x = this->x });
+    }
+};
+
+/// <summary>
+/// <para>ラムダ抽象を示す構文木</para>
+/// <para>複数の引数はカリー化された関数として扱い、1つの型環境ですべての引数を束縛する</para>
+/// </summary>
+struct Lambda : Expression {
+    /// <summary>
+    /// 引数
+    /// </summary>
+    using Parameter = Ast::Parameter;
+
+    /// <summary>
+    /// 引数のリスト
+    /// </summary>
+    std::vector<Parameter> params;
+    /// <summary>
+    /// 関数本体の式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+
+    Lambda(std::string_view x, std::shared_ptr<Expression> e) : params{ Parameter{ .x = Symbol(x) } }, e(e) {}
+    Lambda(std::string_view x, RefType constraint, std::shared_ptr<Expression> e) : params{ Parameter{ .x = Symbol(x), .constraint = constraint } }, e(e) {}
+    Lambda(std::vector<Parameter> params, std::shared_ptr<Expression> e) : params(std::move(params)), e(e) {
+        assert(!this->params.empty());
+    }
+    ~Lambda() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        auto e = this->e->flatten(ast);
+        return ast.push({
+            .tag = Ast::Tag::Lambda,
+            .children = Ast::append(ast.children, std::array{ e }),
+            .operands = Ast::append(ast.params, this->params)
+            });
+    }
+};
+
+/// <summary>
+/// <para>関数適用を示す構文木</para>
+/// <para>複数の引数は先頭から順に1つずつ適用する</para>
+/// </summary>
+struct Apply : Expression {
+    /// <summary>
+    /// 関数を示す式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// 引数の式のリスト
+    /// </summary>
+    std::vector<std::shared_ptr<Expression>> args;
+
+    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), args{ e2 } {}
+    Apply(std::shared_ptr<Expression> e1, std::vector<std::shared_ptr<Expression>> args) : e1(e1), args(std::move(args)) {}
+    ~Apply() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        // 子ノードは連続して配置する必要があるため、先にすべて平坦化してからまとめて追加する
+        std::vector<Ast::Index> es;
+        es.reserve(this->args.size() + 1);
+        es.push_back(this->e1->flatten(ast));
+        for (auto& e2 : this->args) {
+            es.push_back(e2->flatten(ast));
+        }
+        return ast.push({ .tag = Ast::Tag::Apply, .children = Ast::append(ast.children, es) });
+    }
+};
+
+/// <summary>
+/// Let束縛を示す構文木
+/// </summary>
+struct Let : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// </summary>
+    std::vector<RefType> params = {};
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    Let(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
+    ~Let() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        auto e1 = this->e1->flatten(ast);
+        auto e2 = this->e2->flatten(ast);
+        return ast.push({
+            .tag = Ast::Tag::Let,
+            .x = this->x,
+            .children = Ast::append(ast.children, std::array{ e1, e2 }),
+            .operands = Ast::append(ast.types, this->params)
+            });
+    }
+};
+
+/// <summary>
+/// Letrec束縛を示す構文木
+/// </summary>
+struct Letrec : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// </summary>
+    std::vector<RefType> params = {};
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    Letrec(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
+    ~Letrec() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        auto e1 = this->e1->flatten(ast);
+        auto e2 = this->e2->flatten(ast);
+        return ast.push({
+            .tag = Ast::Tag::Letrec,
+            .x = this->x,
+            .children = Ast::append(ast.children, std::array{ e1, e2 }),
+            .operands = Ast::append(ast.types, this->params)
+            });
+    }
+};
+
+/// <summary>
+/// クラスメソッドへのアクセスを示す構文木
+/// </summary>
+struct AccessToClassMethod : Expression {
+    /// <summary>
+    /// 式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+
+    /// <summary>
+    /// クラスメソッド名
+    /// </summary>
+    Symbol x;
+
+    AccessToClassMethod(std::shared_ptr<Expression> e, std::string_view x) : e(e), x(Symbol(x)) {}
+    ~AccessToClassMethod() override {}
+
+    /// <summary>
+    /// 構文木を平坦化してastに追加する
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        auto e = this->e->flatten(ast);
+        return ast.push({ .tag = Ast::Tag::AccessToClassMethod, .x = this->x, .children = Ast::append(ast.children, std::array{ e }) });
+    }
+};
+
+/// <summary>
+/// 二項演算を示す構文木
+/// </summary>
+struct BinaryExpression : Expression {
+    /// <summary>
+    /// 左項
+    /// </summary>
+    std::shared_ptr<Expression> lhs;
+    /// <summary>
+    /// 右項
+    /// </summary>
+    std::shared_ptr<Expression> rhs;
+
+    BinaryExpression(std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : lhs(lhs), rhs(rhs) {}
+    ~BinaryExpression() override {}
+
+    /// <summary>
+    /// 二項演算を示す型クラスを取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    virtual const RefTypeClass& getTypeClass() const = 0;
+
+    /// <summary>
+    /// 二項演算をクラスメソッド名を取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    virtual const std::string& getMethodName() const = 0;
+
+    /// <summary>
+    /// <para>構文木を平坦化してastに追加する</para>
+    /// <para>二項演算の種類は型クラスとクラスメソッド名としてノードに保持する</para>
+    /// </summary>
+    /// <param name="ast">追加先の構文木</param>
+    /// <returns>追加したノードのインデックス</returns>
+    Ast::Index flatten(Ast& ast) const override {
+        auto lhs = this->lhs->flatten(ast);
+        auto rhs = this->rhs->flatten(ast);
+        return ast.push({
+            .tag = Ast::Tag::BinaryExpression,
+            .x = Symbol(this->getMethodName()),
+            .children = Ast::append(ast.children, std::array{ lhs, rhs }),
+            .operands = Ast::append(ast.typeClasses, std::array{ this->getTypeClass() })
+            });
+    }
+};
+
+/// <summary>
+/// 加算を示す構文木
+/// </summary>
+struct Add : BinaryExpression {
+    /// <summary>
+    /// <para>加算の定義についての型クラス</para>
+    /// <para>型表ごとに異なり得るため構文木の構築時に型表から取得して保持する</para>
+    /// </summary>
+    RefTypeClass typeClass;
+    /// <summary>
+    /// 加算の定義についてのクラスメソッド名
+    /// </summary>
+    static inline const std::string methodName = "add";
+
+    Add(RefTypeClass typeClass, std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : BinaryExpression(lhs, rhs), typeClass(typeClass) {}
+    ~Add() override {}
+
+    /// <summary>
+    /// 二項演算を示す型クラスを取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    const RefTypeClass& getTypeClass() const override {
+        return this->typeClass;
+    }
+
+    /// <summary>
+    /// 二項演算をクラスメソッド名を取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    const std::string& getMethodName() const override {
+        return Add::methodName;
+    }
+};
+
+/// <summary>
+/// <para>平坦化された構文木に対する型推論</para>
+/// <para>ノードの種別タグによる分岐で各構文の規則を適用する</para>
+/// </summary>
+struct Inference {
+    /// <summary>
+    /// 型表
+    /// </summary>
+    TypeMap& typeMap;
+    /// <summary>
+    /// 型推論の対象の構文木
+    /// </summary>
+    const Ast& ast;
+
+    /// <summary>
+    /// 識別子の型を型環境から取り出す
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="x">識別子名</param>
+    /// <returns>識別子の型</returns>
+    RefType lookup(TypeEnvironment& env, Symbol x) {
+        struct fn {
+            TypeMap& m;
+            TypeEnvironment& e;
+
+            RefType operator()(const RefType& x) {
+                return x;
+            }
+            RefType operator()(const Generic& x) {
+                // 多相のためにinstantiateする(単相の場合は不要)
+                return this->e.instantiate(this->m, x);
+            }
+        };
+
+        // 型環境から型を取り出す
+        auto tau = env.lookup(x);
+        if (tau) {
+            return std::visit(fn{ .m = this->typeMap, .e = env }, *tau.value());
+        }
+        throw std::runtime_error(std::format("不明な識別子：{}", x.name()));
+    }
+
+    /// <summary>
+    /// ラムダ抽象の引数を型環境に登録する
+    /// </summary>
+    /// <param name="env">ラムダ抽象のために構成された型環境</param>
+    /// <param name="params">paramsにおける引数の範囲</param>
+    /// <returns>引数型のリスト</returns>
+    std::vector<RefType> bindParams(TypeEnvironment& env, Ast::Range params) {
+        std::vector<RefType> types;
+        types.reserve(params.size());
+        for (auto i = params.begin; i < params.end; ++i) {
+            auto& p = this->ast.params[i];
+            auto t = p.constraint ? p.constraint.value() : env.newType(Type::Variable{ .depth = env.depth });
+            env.bind(p.x, t);
+            types.push_back(t);
+        }
+        return types;
+    }
+
+    /// <summary>
+    /// 明示的に宣言されたジェネリック型に出現する型変数を取得する
+    /// </summary>
+    /// <param name="params">typesにおける型変数の範囲</param>
+    /// <returns>型変数のリスト</returns>
+    std::vector<RefType> genericParams(Ast::Range params) {
+        return std::vector<RefType>(this->ast.types.begin() + params.begin, this->ast.types.begin() + params.end);
+    }
+
+    /// <summary>
+    /// 型クラスからクラスメソッドを抽出する
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="typeClass">型クラス</param>
+    /// <param name="x">クラスメソッド名</param>
+    /// <returns>クラスメソッドを部分適用した結果を示す型</returns>
+    RefType instantiateClassMethod(TypeEnvironment& env, const RefTypeClass& typeClass, Symbol x) {
+        // クラスメソッドがジェネリック型ならinstantiateする
+        // 型クラスを実装する対象の型についてもinstantiateする
+        auto& method = typeClass->methods.at(x.name());
+        auto f = env.instantiate(this->typeMap, Generic{
+            .vals = { typeClass->type },
+            .type = (
+                std::holds_alternative<Generic>(method) ?
+                env.instantiate(this->typeMap, std::get<Generic>(method)) :
+                std::get<RefType>(method)
+            )
+            });
+        return std::get<Type::Function>(f->kind).returnType;
+    }
+
+    /// <summary>
+    /// 指定された型からクラスメソッドを抽出する
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="type">クラスメソッドを実装した型</param>
+    /// <param name="x">クラスメソッド名</param>
+    /// <returns>クラスメソッドを示す型</returns>
+    RefType getClassMethod(TypeEnvironment& env, RefType type, Symbol x) {
+        // typeがxをクラスメソッドとしてただ1つもつか検査
+        // 型クラスを実装しているかだけを見るため、クラスメソッドの実装方式などは見ない
+        auto& typeClassList = solved(type)->getTypeClassList(this->typeMap);
+        auto typeClass = this->typeMap.getClassMethod(typeClassList, x);
+
+        if (typeClass) {
+            return this->instantiateClassMethod(env, typeClass.value(), x);
+        }
+        else {
+            throw std::runtime_error(std::format("クラスメソッドが実装されていない：{}", x.name()));
+        }
+    }
+
+    /// <summary>
+    /// <para>トレースに出力するノードの識別子名の取得</para>
+    /// <para>ラムダ抽象は先頭の引数名とする</para>
+    /// </summary>
+    /// <param name="node">ノード</param>
+    /// <returns>識別子名、識別子をもたないノードの場合はstd::nullopt</returns>
+    [[nodiscard]] std::optional<Symbol> traceSymbol(const Ast::Node& node) const {
+        switch (node.tag) {
+        case Ast::Tag::Constant:
+        case Ast::Tag::Apply:
+            return std::nullopt;
+        case Ast::Tag::Lambda:
+            return node.operands.size() > 0 ? std::optional(this->ast.params[node.operands.begin].x) : std::nullopt;
+        default:
+            return node.x;
+        }
+    }
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="index">ノードのインデックス</param>
+    /// <returns>評価結果の型</returns>
+    RefType J(TypeEnvironment& env, Ast::Index index) {
+        auto& node = this->ast.nodes[index];
+        InferenceTrace::Span span("J", Ast::tagName(node.tag), this->traceSymbol(node));
+        switch (node.tag) {
+        case Ast::Tag::Constant:
+            return this->ast.types[node.operands.begin];
+        case Ast::Tag::Identifier:
+            return this->lookup(env, node.x);
+        case Ast::Tag::Lambda: {
+            // 型環境を新しく構成
+            TypeEnvironment newEnv = env.child(env.depth + 1);
+
+            // 型環境に引数を登録してeを評価
+            auto ts = this->bindParams(newEnv, node.operands);
+            auto tau = this->J(newEnv, this->ast.child(node, 0));
+
+            // 末尾の引数から順に関数型を構成する
+            for (auto itr = ts.rbegin(); itr != ts.rend(); ++itr) {
+                tau = env.newFunction(this->typeMap, *itr, tau);
+            }
+            return tau;
+        }
+        case Ast::Tag::Apply: {
+            auto tau1 = this->J(env, this->ast.child(node, 0));
+            auto size = node.children.size() - 1;
+            std::vector<RefType> ts(size);
+            for (Ast::Index i = 0; i < size; ++i) {
+                ts[i] = this->J(env, this->ast.child(node, i + 1));
+            }
+
+            // 引数ごとに単一化すると途中の戻り値型に対する出現検査で残りの関数型を繰り返し走査するため
+            // Mと同様に末尾の引数から関数型を1度だけ構成して関数の型と単一化する
+            auto t = env.newType(Type::Variable{ .depth = env.depth });
+            auto f = t;
+            for (auto i = size; i-- > 0;) {
+                f = env.newFunction(this->typeMap, ts[i], f);
+            }
+            unify(this->typeMap, tau1, f);
+
+            return t;
+        }
+        case Ast::Tag::Let: {
+            auto tau1 = this->J(env, this->ast.child(node, 0));
+            // xが定義済みであっても型環境の改装を無視して上書きする
+            // グローバルな型環境の場合は異常にする等があるかもしれない
+            env.bind(node.x, env.generalize(tau1, this->genericParams(node.operands)));
+
+            return this->J(env, this->ast.child(node, 1));
+        }
+        case Ast::Tag::Letrec: {
+            // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+            auto t = env.newType(Type::Variable{ .depth = env.depth + 1 });
+            // xが定義済みであっても型環境の改装を無視して上書きする
+            // グローバルな型環境の場合は異常にする等があるかもしれない
+            env.bind(node.x, t);
+
+            auto tau1 = this->J(env, this->ast.child(node, 0));
+            unify(this->typeMap, tau1, t);
+
+            env.bind(node.x, env.generalize(tau1, this->genericParams(node.operands)));
+
+            return this->J(env, this->ast.child(node, 1));
+        }
+        case Ast::Tag::AccessToClassMethod: {
+            auto tau = this->J(env, this->ast.child(node, 0));
+
+            // クラスメソッドを取得して部分適用結果の型を取得する
+            return this->getClassMethod(env, tau, node.x);
+        }
+        case Ast::Tag::BinaryExpression: {
+            auto& typeClass = this->ast.typeClasses[node.operands.begin];
+            // クラスメソッドがないのは論理エラーとする
+            assert(typeClass->methods.contains(node.x.name()));
+
+            // 左項については型制約の適用・検査
+            auto tau1 = this->J(env, this->ast.child(node, 0));
+            this->typeMap.applyConstraint(tau1, { typeClass });
+            auto tau2 = this->J(env, this->ast.child(node, 1));
+
+            // クラスメソッドに対して単一化を行って二項演算の結果型を得る
+            auto t = env.newType(Type::Variable{ .depth = env.depth });
+            unify(this->typeMap, this->instantiateClassMethod(env, typeClass, node.x), env.newFunction(this->typeMap, tau2, t));
+
+            return t;
+        }
+        }
+        throw std::runtime_error(std::format("不明な構文木の種別：{}", static_cast<int>(node.tag)));
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="env">型環境</param>
+    /// <param name="index">ノードのインデックス</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeEnvironment& env, Ast::Index index, RefType rho) {
+        auto& node = this->ast.nodes[index];
+        InferenceTrace::Span span("M", Ast::tagName(node.tag), this->traceSymbol(node));
+        switch (node.tag) {
+        case Ast::Tag::Constant:
+            unify(this->typeMap, rho, this->ast.types[node.operands.begin]);
+            return;
+        case Ast::Tag::Identifier:
+            unify(this->typeMap, rho, this->lookup(env, node.x));
+            return;
+        case Ast::Tag::Lambda: {
+            // 型環境を新しく構成
+            TypeEnvironment newEnv = env.child(env.depth + 1);
+
+            // 型環境に引数を登録する
+            auto ts = this->bindParams(newEnv, node.operands);
+            auto t2 = newEnv.newType(Type::Variable{ .depth = newEnv.depth });
+            auto t = t2;
+            for (auto itr = ts.rbegin(); itr != ts.rend(); ++itr) {
+                t = env.newFunction(this->typeMap, *itr, t);
+            }
+            unify(this->typeMap, rho, t);
+
+            // eを評価
+            this->M(newEnv, this->ast.child(node, 0), t2);
+            return;
+        }
+        case Ast::Tag::Apply: {
+            auto size = node.children.size() - 1;
+            std::vector<RefType> ts(size);
+            auto t = rho;
+            for (auto i = size; i-- > 0;) {
+                ts[i] = env.newType(Type::Variable{ .depth = env.depth });
+                t = env.newFunction(this->typeMap, ts[i], t);
+            }
+
+            this->M(env, this->ast.child(node, 0), t);
+            for (Ast::Index i = 0; i < size; ++i) {
+                this->M(env, this->ast.child(node, i + 1), ts[i]);
+            }
+            return;
+        }
+        case Ast::Tag::Let: {
+            // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+            auto t = env.newType(Type::Variable{ .depth = env.depth + 1 });
+
+            this->M(env, this->ast.child(node, 0), t);
+
+            // xが定義済みであっても型環境の改装を無視して上書きする
+            // グローバルな型環境の場合は異常にする等があるかもしれない
+            env.bind(node.x, env.generalize(t, this->genericParams(node.operands)));
+            this->M(env, this->ast.child(node, 1), rho);
+            return;
+        }
+        case Ast::Tag::Letrec: {
+            // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+            auto t1 = env.newType(Type::Variable{ .depth = env.depth + 1 });
+            auto t2 = env.newType(Type::Variable{ .depth = env.depth + 1 });
+            // xが定義済みであっても型環境の改装を無視して上書きする
+            // グローバルな型環境の場合は異常にする等があるかもしれない
+            env.bind(node.x, t1);
+
+            this->M(env, this->ast.child(node, 0), t2);
+            unify(this->typeMap, t1, t2);
+
+            env.bind(node.x, env.generalize(t1, this->genericParams(node.operands)));
+            this->M(env, this->ast.child(node, 1), rho);
+            return;
+        }
+        case Ast::Tag::AccessToClassMethod: {
+            auto t = env.newType(Type::Variable{ .depth = env.depth });
+            this->M(env, this->ast.child(node, 0), t);
+
+            // クラスメソッドを取得して部分適用結果の型を取得する
+            unify(this->typeMap, this->getClassMethod(env, t, node.x), rho);
+            return;
+        }
+        case Ast::Tag::BinaryExpression: {
+            auto& typeClass = this->ast.typeClasses[node.operands.begin];
+            // クラスメソッドがないのは論理エラーとする
+            assert(typeClass->methods.contains(node.x.name()));
+
+            auto t1 = env.newType(Type::Variable{ .depth = env.depth });
+            // 左項については型制約の適用・検査
+            this->M(env, this->ast.child(node, 0), t1);
+            this->typeMap.applyConstraint(t1, { typeClass });
+
+            // クラスメソッドに対して単一化を行って二項演算の結果型を得る
+            auto t2 = env.newType(Type::Variable{ .depth = env.depth });
+            unify(this->typeMap, this->instantiateClassMethod(env, typeClass, node.x), env.newFunction(this->typeMap, t2, rho));
+
+            this->M(env, this->ast.child(node, 1), t2);
+            return;
+        }
+        }
+        throw std::runtime_error(std::format("不明な構文木の種別：{}", static_cast<int>(node.tag)));
+    }
+};
+
+/// <summary>
+/// RefTypeの標準出力
+/// </summary>
+/// <param name="os">出力ストリーム</param>
+/// <param name="type">出力対象の型</param>
+/// <returns></returns>
+std::ostream& operator<<(std::ostream& os, RefType type) {
+    struct fn {
+        std::ostream& o;
+        char varCnt = 'a';
+        std::unordered_map<const Type::Variable*, char> varmap = {};
+
+        void operator()(const Type::Base& x) {
+            this->o << x.name.name();
+        }
+        void operator()(const Type::Function& x) {
+            // 括弧付きで出力するかを判定
+            bool isSimple = std::holds_alternative<Type::Base>(x.paramType->kind) ||
+                std::holds_alternative<Type::Variable>(x.paramType->kind) ||
+                std::holds_alternative<Type::Param>(x.paramType->kind) ||
+                std::holds_alternative<Type::TypeClass>(x.paramType->kind);
+            if (isSimple) {
+                std::visit(*this, x.paramType->kind);
+            }
+            else {
+                this->o << "(";
+                std::visit(*this, x.paramType->kind);
+                this->o << ")";
+            }
+            this->o << " -> ";
+            std::visit(*this, x.returnType->kind);
+        }
+        void operator()(const Type::Variable& x) {
+            if (x.solve) {
+                // 解決済みの型変数の場合は解決結果の型に対して出力
+                std::visit(*this, solved(x.solve)->kind);
+            }
+            else {
+                // 雑に[a, z]の範囲で型変数を出力
+                // zを超えたら全て「_」で出力
+                if (auto itr = this->varmap.find(std::addressof(x)); itr != this->varmap.end()) {
+                    this->o << '?' << itr->second;
+                }
+                else {
+                    this->varmap.insert({ std::addressof(x), this->varCnt });
+                    this->o << '?' << this->varCnt;
+                    switch (this->varCnt) {
+                    case 'z':
+                        this->varCnt = '_';
+                        break;
+                    case '_':
+                        break;
+                    default:
+                        ++this->varCnt;
+                        break;
+                    }
+                }
+
+                // 型クラスの情報を出力
+                if (x.constraints->size() == 1) {
+                    x.constraints->forEach([this](const RefTypeClass& typeClass) { this->o << ": " << typeClass->name; });
+                }
+                else if (x.constraints->size() > 1) {
+                    auto first = true;
+                    x.constraints->forEach([this, &first](const RefTypeClass& typeClass) {
+                        this->o << (first ? ":(" : " + ") << typeClass->name;
+                        first = false;
+                    });
+                    this->o << ")";
+                }
+            }
+        }
+        void operator()(const Type::Param& x) {
+            // 雑に[a, z]の範囲で型変数を出力
+            // zを超えたら全て「_」で出力
+            std::size_t c = 'a' + x.index;
+            this->o << '\'' << static_cast<char>(c <= 'z' ? c : '_');
+
+            // 型クラスの情報を出力
+            if (x.constraints->size() == 1) {
+                x.constraints->forEach([this](const RefTypeClass& typeClass) { this->o << ": " << typeClass->name; });
+            }
+            else if (x.constraints->size() > 1) {
+                auto first = true;
+                x.constraints->forEach([this, &first](const RefTypeClass& typeClass) {
+                    this->o << (first ? ":(" : " + ") << typeClass->name;
+                    first = false;
+                });
+                this->o << ")";
+            }
+        }
+        void operator()(const Type::TypeClass& x) {
+            auto size = x.typeClasses->size();
+            if (size == 0) {
+                // 空を出力
+                this->o << "()";
+            }
+            else {
+                // 2つ以上の複数の型クラスから成る型の場合は括弧付きで出力
+                if (size > 1) {
+                    this->o << '(';
+                }
+                // 型クラスとわかるようにプレフィックスとして「:」を付けて出力する
+                auto first = true;
+                x.typeClasses->forEach([this, &first](const RefTypeClass& typeClass) {
+                    if (!first) {
+                        this->o << " + ";
+                    }
+                    this->o << ':' << typeClass->name;
+                    first = false;
+                });
+                if (size > 1) {
+                    this->o << ')';
+                }
+            }
+        }
+    };
+    std::visit(fn{ .o = os }, type->kind);
+
+    return os;
+}
+
+// 雑に型を短く書くための関数
+RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = Symbol(name) }); }
+RefType var(TypeEnvironment& env) { return env.newType(Type::Variable{ .depth = env.depth + 1 }); }
+RefType param(TypeEnvironment& env, std::size_t index = 0) { return env.newType(Type::Param{ .index = index }); }
+RefType fun(TypeEnvironment& env, RefType base, RefType paramType, RefType returnType) { return env.newType(Type::Function{ .base = base, .paramType = paramType, .returnType = returnType }); }
+RefType fun(TypeMap& typeMap, TypeEnvironment& env, RefType paramType, RefType returnType) { return env.newFunction(typeMap, paramType, returnType); }
+template <class... Types>
+RefType tc(TypeEnvironment& env, Types&&... args) { return env.newType(Type::TypeClass{ .typeClasses{ std::forward<Types>(args)... } }); }
+
+// 雑に構文を短く書くための関数
+std::shared_ptr<Expression> c(RefType type) { return std::shared_ptr<Expression>(new Constant(type)); }
+std::shared_ptr<Expression> id(const std::string& name) { return std::shared_ptr<Expression>(new Identifier(name)); }
+std::shared_ptr<Expression> lambda(const std::string& name, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, expr)); }
+std::shared_ptr<Expression> lambda(const std::string& name, RefType constraint, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, constraint, expr)); }
+std::shared_ptr<Expression> lambda(std::vector<Lambda::Parameter> params, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(std::move(params), expr)); }
+std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Apply(expr1, expr2)); }
+template <class... Tail>
+std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2, Tail&&... tail) { return std::shared_ptr<Expression>(new Apply(expr1, { expr2, std::forward<Tail>(tail)... })); }
+std::shared_ptr<Expression> let(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, expr1, expr2)); }
+std::shared_ptr<Expression> let(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, params, expr1, expr2)); }
+std::shared_ptr<Expression> letrec(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, expr1, expr2)); }
+std::shared_ptr<Expression> letrec(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, params, expr1, expr2)); }
+std::shared_ptr<Expression> dot(std::shared_ptr<Expression> expr, const std::string& name) { return std::shared_ptr<Expression>(new AccessToClassMethod(expr, name)); }
+std::shared_ptr<Expression> add(const TypeMap& typeMap, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Add(typeMap.getTypeClass("Add"), expr1, expr2)); }
+
+/// <summary>
+/// モジュールのトップレベルの束縛
+/// </summary>
+struct Definition {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+    /// <summary>
+    /// <para>Letrec束縛であるか</para>
+    /// <para>Let束縛の場合はeに出現するxは外側の束縛を参照する</para>
+    /// </summary>
+    bool recursive = false;
+};
+
+/// <summary>
+/// <para>トップレベルの束縛の列からなるモジュール</para>
+/// <para>束縛間の依存関係の強連結成分ごとに型推論し、互いに独立な強連結成分は並列に型推論する</para>
+/// <para>束縛の順序は問わず、モジュール内の識別子は重複しないものとする</para>
+/// <para>各強連結成分はLetrec束縛と同じく1段深いスコープで型推論して強連結成分内で生成した型変数を全てgeneralizeするため、let束縛の連鎖とは異なり関数適用の結果の型変数もgeneralizeする</para>
+/// <para>例えばf = id idはlet束縛の連鎖では単相な型となり後続の束縛が型変数を解決するが、モジュールでは'a -> 'aとなる(並列に型推論する強連結成分間で未解決の型変数を共有しないため)</para>
+/// <para>強連結成分ごとに凍結した型表に重ねた型表で型推論するため、型推論の結果の型表への追加は他の強連結成分から参照できない</para>
+/// </summary>
+struct Module {
+    /// <summary>
+    /// トップレベルの束縛のリスト
+    /// </summary>
+    std::vector<Definition> definitions = {};
+
+    /// <summary>
+    /// 束縛ごとに参照する識別子を求める
+    /// </summary>
+    /// <param name="ast">束縛する式を平坦化した構文木</param>
+    /// <param name="roots">束縛ごとの束縛する式のノードのインデックス</param>
+    /// <returns>束縛ごとの自由な識別子のリスト(重複なし)</returns>
+    [[nodiscard]] std::vector<std::vector<Symbol>> freeVariables(const Ast& ast, const std::vector<Ast::Index>& roots) const {
+        std::vector<std::vector<Symbol>> result(this->definitions.size());
+        std::vector<Symbol> bound;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            auto& def = this->definitions[i];
+            if (def.recursive) {
+                bound.push_back(def.x);
+            }
+            ast.freeVariables(roots[i], bound, result[i]);
+            bound.clear();
+            std::sort(result[i].begin(), result[i].end(), [](Symbol a, Symbol b) { return a.id < b.id; });
+            result[i].erase(std::unique(result[i].begin(), result[i].end()), result[i].end());
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// <para>有向グラフの強連結成分を求める(Tarjanのアルゴリズム)</para>
+    /// <para>深いグラフでもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで走査する</para>
+    /// </summary>
+    /// <param name="graph">頂点ごとの辺の行き先のリスト</param>
+    /// <returns>強連結成分のリスト(辺の行き先の成分が先に並ぶ順序)</returns>
+    [[nodiscard]] static std::vector<std::vector<std::size_t>> components(const std::vector<std::vector<std::size_t>>& graph) {
+        constexpr auto unvisited = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> order(graph.size(), unvisited);
+        std::vector<std::size_t> low(graph.size(), 0);
+        std::vector<bool> onStack(graph.size(), false);
+        std::vector<std::size_t> stack;
+        std::vector<std::vector<std::size_t>> result;
+        std::size_t counter = 0;
+
+        // 走査中の頂点と次に辿る辺の番号の組のスタック
+        std::vector<std::pair<std::size_t, std::size_t>> frames;
+        for (std::size_t root = 0; root < graph.size(); ++root) {
+            if (order[root] != unvisited) {
+                continue;
+            }
+            frames.push_back({ root, 0 });
+            while (!frames.empty()) {
+                auto& [v, edge] = frames.back();
+                if (edge == 0) {
+                    order[v] = low[v] = counter++;
+                    stack.push_back(v);
+                    onStack[v] = true;
+                }
+                if (edge < graph[v].size()) {
+                    auto w = graph[v][edge++];
+                    if (order[w] == unvisited) {
+                        frames.push_back({ w, 0 });
+                    }
+                    else if (onStack[w]) {
+                        low[v] = std::min(low[v], order[w]);
+                    }
+                    continue;
+                }
+
+                // vを根とする強連結成分を取り出す
+                if (low[v] == order[v]) {
+                    auto& component = result.emplace_back();
+                    std::size_t w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        onStack[w] = false;
+                        component.push_back(w);
+                    } while (w != v);
+                }
+                auto done = v;
+                frames.pop_back();
+                if (!frames.empty()) {
+                    auto parent = frames.back().first;
+                    low[parent] = std::min(low[parent], low[done]);
+                }
+            }
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// <para>モジュールの外の束縛の型を型変数を含まない型としてアリーナへ取り込む</para>
+    /// <para>解決済みの型変数を経由する部分型のみを解決結果で置き換えて複製し、型変数を含まない部分型は書き換えられないためそのまま共有する</para>
+    /// <para>取り込んだ型は書き換えられる型変数を含まないため、複数のスレッドの型推論からロックなしで参照できる</para>
+    /// </summary>
+    /// <param name="arena">複製先のアリーナ</param>
+    /// <param name="binding">複製対象の束縛の型</param>
+    /// <returns>複製結果(未解決の型変数を含む場合はstd::nullopt)</returns>
+    [[nodiscard]] static std::optional<std::variant<RefType, Generic>> isolate(TypeArena& arena, const std::variant<RefType, Generic>& binding) {
+        auto generic = std::get_if<Generic>(std::addressof(binding));
+        auto type = generic ? generic->type : std::get<RefType>(binding);
+        // 複製済みの部分型(共有された部分型は1度のみ複製する)
+        std::unordered_map<const Type*, RefType> memo;
+
+        struct fn {
+            RefType t;
+            TypeArena& a;
+            std::unordered_map<const Type*, RefType>& m;
+
+            RefType operator()([[maybe_unused]] const Type::Base& x) {
+                // 基底型は同名で同一の実体を共有するため複製しない
+                return this->t;
+            }
+            RefType operator()(const Type::Function& x) {
+                auto paramType = this->m.at(x.paramType);
+                auto returnType = this->m.at(x.returnType);
+                if (paramType == x.paramType && returnType == x.returnType) {
+                    // 型変数を経由しない場合は書き換えられないため共有する
+                    return this->t;
+                }
+                return this->a.newType(Type::Function{ .base = x.base, .paramType = paramType, .returnType = returnType });
+            }
+            RefType operator()(const Type::Variable& x) {
+                // 解決済みの型変数は解決結果に置き換える
+                return this->m.at(x.solve);
+            }
+            RefType operator()([[maybe_unused]] const Type::Param& x) {
+                return this->t;
+            }
+            RefType operator()([[maybe_unused]] const Type::TypeClass& x) {
+                // 型としての型クラスは型変数に依存しないため複製しない
+                return this->t;
+            }
+        };
+
+        // 複製対象の部分型と部分型を展開済みであるかのスタック
+        // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+        std::vector<std::pair<RefType, bool>> stack = { { type, false } };
+        while (!stack.empty()) {
+            auto [t, expanded] = stack.back();
+            if (memo.contains(t)) {
+                stack.pop_back();
+                continue;
+            }
+            if (!expanded) {
+                stack.back().second = true;
+                if (auto x = std::get_if<Type::Function>(std::addressof(t->kind))) {
+                    stack.push_back({ x->returnType, false });
+                    stack.push_back({ x->paramType, false });
+                }
+                else if (auto x = std::get_if<Type::Variable>(std::addressof(t->kind))) {
+                    if (!x->solve) {
+                        // 未解決の型変数は他の型推論と解決結果を共有する必要があるため複製できない
+                        return std::nullopt;
+                    }
+                    stack.push_back({ x->solve, false });
+                }
+                continue;
+            }
+            stack.pop_back();
+            memo.insert({ t, std::visit(fn{ .t = t, .a = arena, .m = memo }, t->kind) });
+        }
+
+        if (!generic) {
+            return memo.at(type);
+        }
+        Generic result = { .vals = generic->vals, .type = memo.at(type), .spine = nullptr };
+        // 他のスレッドから並行してinstantiateされるため雛形は事前に構築しておく
+        result.spine = GenericTemplate::build(result);
+        return result;
+    }
+
+    /// <summary>
+    /// <para>モジュールの型推論</para>
+    /// <para>強連結成分ごとに独自の型環境とアリーナを用意して型推論し、結果をトポロジカル順にenvへ束縛する</para>
+    /// <para>強連結成分内の束縛は相互再帰として扱い、強連結成分内で生成した型変数は全てgeneralizeする</para>
+    /// </summary>
+    /// <param name="typeMap">凍結した型表</param>
+    /// <param name="env">モジュールの外の束縛をもつ型環境</param>
+    /// <param name="concurrency">並列に型推論するスレッド数</param>
+    void infer(const TypeMap& typeMap, TypeEnvironment& env, std::size_t concurrency = std::thread::hardware_concurrency()) const {
+        // 束縛する式は1つの構文木へ平坦化し、型推論中は全てのスレッドから読み取りのみ行う
+        Ast ast;
+        std::vector<Ast::Index> roots;
+        for (auto& def : this->definitions) {
+            roots.push_back(def.e->flatten(ast));
+        }
+
+        // 束縛間の依存グラフを構築して強連結成分に分解する
+        std::unordered_map<Symbol, std::size_t> index;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            if (!index.insert({ this->definitions[i].x, i }).second) {
+                throw std::runtime_error(std::format("モジュール内での再定義：{}", this->definitions[i].x.name()));
+            }
+        }
+        auto fvs = this->freeVariables(ast, roots);
+        std::vector<std::vector<std::size_t>> graph(this->definitions.size());
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            for (auto x : fvs[i]) {
+                if (auto itr = index.find(x); itr != index.end() && (itr->second != i || this->definitions[i].recursive)) {
+                    graph[i].push_back(itr->second);
+                }
+            }
+        }
+        auto components = Module::components(graph);
+
+        // 強連結成分間の依存関係
+        std::vector<std::size_t> componentOf(this->definitions.size());
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            for (auto i : components[c]) {
+                componentOf[i] = c;
+            }
+        }
+        std::vector<std::size_t> pending(components.size(), 0);
+        std::vector<std::vector<std::size_t>> dependents(components.size());
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            std::unordered_set<std::size_t> dependencies;
+            for (auto i : components[c]) {
+                for (auto j : graph[i]) {
+                    if (componentOf[j] != c && dependencies.insert(componentOf[j]).second) {
+                        dependents[componentOf[j]].push_back(c);
+                        ++pending[c];
+                    }
+                }
+            }
+        }
+
+        // 強連結成分ごとの型推論の結果
+        std::vector<std::variant<RefType, Generic>> results(this->definitions.size());
+        std::vector<std::shared_ptr<TypeArena>> arenas(components.size());
+
+        // 参照するモジュールの外の束縛
+        std::unordered_map<Symbol, std::variant<RefType, Generic>> imports;
+        for (std::size_t i = 0; i < this->definitions.size(); ++i) {
+            for (auto x : fvs[i]) {
+                auto itr = index.find(x);
+                if ((itr == index.end() || (itr->second == i && !this->definitions[i].recursive)) && !imports.contains(x)) {
+                    if (auto tau = env.lookup(x)) {
+                        imports.insert({ x, *tau.value() });
+                    }
+                }
+            }
+        }
+
+        // 強連結成分の型推論
+        // 他の強連結成分の結果は読み取りのみ行い、型の生成と束縛は独自のアリーナと型環境でのみ行う
+        auto inferComponent = [&](std::size_t c) {
+            auto& component = components[c];
+            TypeEnvironment root(std::addressof(env), env.depth);
+            // クラスメソッドの解決結果のキャッシュは強連結成分ごとの型表にのみ追加する
+            auto session = typeMap.overlay();
+            auto inference = Inference{ .typeMap = session, .ast = ast };
+
+            // 参照する識別子をモジュール内の結果もしくはenvから束縛する
+            for (auto i : component) {
+                for (auto x : fvs[i]) {
+                    if (root.contains(x)) {
+                        continue;
+                    }
+                    if (auto itr = index.find(x); itr != index.end() && componentOf[itr->second] != c) {
+                        root.bind(x, results[itr->second]);
+                    }
+                    else if (auto found = imports.find(x); found != imports.end() && (itr == index.end() || itr->second == i)) {
+                        root.bind(x, found->second);
+                    }
+                }
+            }
+
+            // 強連結成分内の束縛は1段深いスコープで型推論してrootでgeneralizeする
+            // 関数適用の結果の型変数もscopeの深さとなるため、非再帰の束縛であってもLet::Jと異なりgeneralizeされる
+            TypeEnvironment scope = root.child(root.depth + 1);
+            auto recursive = component.size() > 1 || this->definitions[component.front()].recursive;
+            std::vector<RefType> types;
+            for (auto i : component) {
+                types.push_back(scope.newType(Type::Variable{ .depth = scope.depth }));
+                if (recursive) {
+                    scope.bind(this->definitions[i].x, types.back());
+                }
+            }
+            for (std::size_t k = 0; k < component.size(); ++k) {
+                unify(session, inference.J(scope, roots[component[k]]), types[k]);
+            }
+            for (std::size_t k = 0; k < component.size(); ++k) {
+                auto& result = results[component[k]];
+                result = root.generalize(types[k]);
+                if (std::holds_alternative<Generic>(result)) {
+                    // 他のスレッドから並行してinstantiateされるため雛形は事前に構築しておく
+                    auto& generic = std::get<Generic>(result);
+                    generic.spine = GenericTemplate::build(generic);
+                }
+            }
+            arenas[c] = root.storage;
+        };
+
+        // モジュールの外の型はenvのアリーナの型を書き換えないように複製を参照する
+        // 未解決の型変数を含む束縛がある場合はその解決をスレッド間で共有することになるため並列化しない
+        auto imported = std::make_shared<TypeArena>();
+        if (concurrency > 1) {
+            for (auto& [x, tau] : imports) {
+                auto copy = Module::isolate(*imported, tau);
+                if (!copy) {
+                    concurrency = 1;
+                    break;
+                }
+                tau = std::move(copy.value());
+            }
+        }
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::size_t> ready;
+        std::size_t done = 0;
+        std::exception_ptr error = nullptr;
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            if (pending[c] == 0) {
+                ready.push_back(c);
+            }
+        }
+
+        // 依存する強連結成分が全て型推論済みのものから順に取り出して型推論する
+        auto work = [&]() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                cv.wait(lock, [&]() { return !ready.empty() || done == components.size() || error; });
+                if (error || ready.empty()) {
+                    return;
+                }
+                auto c = ready.front();
+                ready.pop_front();
+
+                lock.unlock();
+                try {
+                    inferComponent(c);
+                }
+                catch (...) {
+                    lock.lock();
+                    error = std::current_exception();
+                    cv.notify_all();
+                    return;
+                }
+                lock.lock();
+
+                ++done;
+                for (auto d : dependents[c]) {
+                    if (--pending[d] == 0) {
+                        ready.push_back(d);
+                    }
+                }
+                cv.notify_all();
+            }
+        };
+
+        auto threads = std::min(std::max<std::size_t>(concurrency, 1), components.size());
+        if (threads <= 1) {
+            work();
+        }
+        else {
+            std::vector<std::thread> workers;
+#ifdef INFERENCE_STATS
+            auto& stats = inferenceStats;
+#endif
+            for (std::size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&]() {
+                    work();
+#ifdef INFERENCE_STATS
+                    stats.merge(inferenceStats);
+#endif
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        // トポロジカル順にenvへ束縛する
+        for (std::size_t c = 0; c < components.size(); ++c) {
+            for (auto i : components[c]) {
+                env.bind(this->definitions[i].x, results[i]);
+            }
+            env.arena->imports.push_back(arenas[c]);
+        }
+        env.arena->imports.push_back(imported);
+    }
+};
+
+#ifdef BENCHMARK
+/// <summary>
+/// ベンチマーク用のヒープの使用状況
+/// </summary>
+struct HeapStats {
+    /// <summary>
+    /// 確保の回数
+    /// </summary>
+    std::size_t allocations = 0;
+    /// <summary>
+    /// 確保中のバイト数
+    /// </summary>
+    std::size_t bytes = 0;
+    /// <summary>
+    /// 確保中のバイト数の最大値
+    /// </summary>
+    std::size_t peak = 0;
+};
+constinit thread_local HeapStats heapStats = {};
+
+// 確保の回数と確保中のバイト数を計測する
+// 解放されたバイト数はサイズ付きのdeleteでのみ得られるため、サイズなしのdeleteの分は確保中のままとして扱う
+// GCCはインライン展開後にoperator newの結果をfreeで解放していると誤検知するため警告を抑制する
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    auto p = std::malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    ++heapStats.allocations;
+    heapStats.bytes += size;
+    heapStats.peak = std::max(heapStats.peak, heapStats.bytes);
+    return p;
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/// <summary>
+/// 組込みの型と型クラスを定義した型推論の環境
+/// </summary>
+struct Fixture {
+    /// <summary>
+    /// 型環境
+    /// </summary>
+    TypeEnvironment env = {};
+    /// <summary>
+    /// 型表
+    /// </summary>
+    TypeMap typeMap = {};
+    /// <summary>
+    /// 数値型
+    /// </summary>
+    RefType numberT = nullptr;
+    /// <summary>
+    /// Boolean型
+    /// </summary>
+    RefType booleanT = nullptr;
+
+    Fixture() {
+        auto& env = this->env;
+        auto& typeMap = this->typeMap;
+        typeMap.builtin.fn = std::get<Generic>(env.generalize(fun(env, base(env, "fn"), var(env), var(env))));
+        typeMap.addType(typeMap.builtin.fn);
+        this->numberT = std::get<RefType>(typeMap.addType(base(env, "number")).second.type);
+        auto& [booleanN, booleanTD] = typeMap.addType(base(env, "boolean"));
+        this->booleanT = std::get<RefType>(booleanTD.type);
+
+        typeMap.addTypeClass(([&] {
+            auto valT = param(env);
+            return RefTypeClass(new TypeClass({
+                .name = "Add",
+                .type = valT,
+                .methods = {
+                    { Add::methodName, fun(typeMap, env, valT, fun(typeMap, env, valT, valT)) }
+                }
+            }));
+        })());
+        typeMap.addTypeClass(([&] {
+            auto valT = param(env);
+            return RefTypeClass(new TypeClass({
+                .name = "TypeClass",
+                .type = valT,
+                .methods = {
+                    { "method", fun(typeMap, env, valT, fun(typeMap, env, valT, valT)) }
+                }
+            }));
+        })());
+        booleanTD.typeclasses.insert(typeMap.getTypeClass("TypeClass"));
+    }
+};
+
+/// <summary>
+/// <para>深いlet束縛の入れ子</para>
+/// <para>let x0 = n -> n in let x1 = n -> x0 n in ... in xn</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> deepLet([[maybe_unused]] Fixture& fixture, std::size_t n) {
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = id(x(n));
+    for (auto i = n; i > 0; --i) {
+        e = let(x(i), lambda("n", apply(id(x(i - 1)), id("n"))), e);
+    }
+    return let(x(0), lambda("n", id("n")), e);
+}
+
+/// <summary>
+/// <para>多相な束縛の多数の利用</para>
+/// <para>let id = x -> x in let k = a -> b -> b in k (id 1) (k (id true) (... (id 1)))</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">idの利用回数</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> widePolymorphism(Fixture& fixture, std::size_t n) {
+    auto arg = [&](std::size_t i) { return c(i % 2 == 0 ? fixture.numberT : fixture.booleanT); };
+    auto e = apply(id("id"), arg(0));
+    for (std::size_t i = 1; i < n; ++i) {
+        e = apply(id("k"), apply(id("id"), arg(i)), e);
+    }
+    return let("id", lambda("x", id("x")), let("k", lambda({ Lambda::Parameter{ .x = Symbol("a") }, Lambda::Parameter{ .x = Symbol("b") } }, id("b")), e));
+}
+
+/// <summary>
+/// <para>長いカリー化された関数適用</para>
+/// <para>let f = x0 -> x1 -> ... -> xn -> x0 in f 1 1 ... 1</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">引数の数</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> longApply(Fixture& fixture, std::size_t n) {
+    std::vector<Lambda::Parameter> params;
+    std::vector<std::shared_ptr<Expression>> args;
+    for (std::size_t i = 0; i < n; ++i) {
+        params.push_back({ .x = Symbol(std::format("x{}", i)) });
+        args.push_back(c(fixture.numberT));
+    }
+    return let("f", lambda(std::move(params), id("x0")), std::shared_ptr<Expression>(new Apply(id("f"), std::move(args))));
+}
+
+/// <summary>
+/// <para>型制約を多数伴う式</para>
+/// <para>let f = n -> n + n + ... + n in true.method (true.method (... true))</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">加算とクラスメソッドの呼び出しのそれぞれの回数</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> classConstraints(Fixture& fixture, std::size_t n) {
+    auto sum = id("n");
+    for (std::size_t i = 0; i < n; ++i) {
+        sum = add(fixture.typeMap, sum, id("n"));
+    }
+    auto e = c(fixture.booleanT);
+    for (std::size_t i = 0; i < n; ++i) {
+        e = apply(dot(c(fixture.booleanT), "method"), e);
+    }
+    return let("f", lambda("n", sum), e);
+}
+
+/// <summary>
+/// <para>プログラムの生成と型推論を繰り返して計測結果を出力する</para>
+/// <para>生成と平坦化は計測に含めず、ノードあたりの時間、確保回数、確保中のバイト数の最大値を出力する</para>
+/// </summary>
+/// <param name="name">プログラム名</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="n">生成器に与える大きさ</param>
+/// <param name="repeat">繰り返し回数</param>
+void benchmark(const std::string& name, std::shared_ptr<Expression>(*generate)(Fixture&, std::size_t), std::size_t n, std::size_t repeat) {
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::size_t nodes = 0;
+        std::size_t allocations = 0;
+        std::size_t peak = 0;
+        std::chrono::steady_clock::duration elapsed = {};
+
+        for (std::size_t i = 0; i < repeat; ++i) {
+            Ast ast;
+            auto root = generate(fixture, n)->flatten(ast);
+            auto inference = Inference{ .typeMap = fixture.typeMap, .ast = ast };
+            nodes = ast.nodes.size();
+
+            auto before = heapStats;
+            heapStats.peak = heapStats.bytes;
+            auto start = std::chrono::steady_clock::now();
+            if (algorithm == 'J') {
+                (void)inference.J(fixture.env, root);
+            }
+            else {
+                auto t = fixture.env.newType(Type::Variable{ .depth = fixture.env.depth - 1 });
+                inference.M(fixture.env, root, t);
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            allocations += heapStats.allocations - before.allocations;
+            peak = std::max(peak, heapStats.peak - before.bytes);
+        }
 
-        // クラスメソッドがジェネリック型ならinstantiateする
-        // 型クラスを実装する対象の型についてもinstantiateする
-        auto& method = typeClass->methods.at(methodName);
-        auto f = env.instantiate(typeMap, Generic{
-            .vals = { typeClass->type },
-            .type = (
-                std::holds_alternative<Generic>(method) ?
-                env.instantiate(typeMap, std::get<Generic>(method)) :
-                std::get<RefType>(method)
-            )
-            });
-        return std::get<Type::Function>(f->kind).returnType;
+        auto count = static_cast<double>(nodes * repeat);
+        std::cout << std::format(
+            "{:<20} {} {:>8} {:>12.1f} {:>12.2f} {:>16.1f}",
+            name,
+            algorithm,
+            nodes,
+            std::chrono::duration<double, std::nano>(elapsed).count() / count,
+            allocations / count,
+            static_cast<double>(peak) / nodes
+        ) << std::endl;
     }
+}
 
-    /// <summary>
-    /// 二項演算を示す型クラスを取得する
-    /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    virtual const RefTypeClass& getTypeClass() const = 0;
+/// <summary>
+/// 型のグラフとしてのノード数を数える(共有された部分型は1度のみ数える)
+/// </summary>
+/// <param name="type">数える対象の型</param>
+/// <returns>typeから到達可能な型のノード数</returns>
+std::size_t countTypeNodes(RefType type) {
+    struct fn {
+        std::vector<RefType>& stack;
 
-    /// <summary>
-    /// 二項演算をクラスメソッド名を取得する
-    /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    virtual const std::string& getMethodName() const = 0;
+        void operator()([[maybe_unused]] const Type::Base& x) {}
+        void operator()(const Type::Function& x) {
+            this->stack.push_back(x.base);
+            this->stack.push_back(x.paramType);
+            this->stack.push_back(x.returnType);
+        }
+        void operator()(const Type::Variable& x) {
+            if (x.solve) {
+                this->stack.push_back(x.solve);
+            }
+        }
+        void operator()([[maybe_unused]] const Type::Param& x) {}
+        void operator()([[maybe_unused]] const Type::TypeClass& x) {}
+    };
 
-    /// <summary>
-    /// Algorithm Jの適用
-    /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefType J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 左項については型制約の適用・検査
-        auto tau1 = this->lhs->J(typeMap, env);
-        typeMap.applyConstraint(tau1, { this->getTypeClass() });
-        auto tau2 = this->rhs->J(typeMap, env);
+    std::unordered_set<const Type*> visited;
+    std::vector<RefType> stack = { type };
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (visited.insert(t).second) {
+            std::visit(fn{ .stack = stack }, t->kind);
+        }
+    }
+    return visited.size();
+}
 
-        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
-        auto t = env.newType(Type::Variable{ .depth = env.depth });
-        unify(typeMap, this->getClassMethod(typeMap, env), env.instantiate(typeMap, typeMap.builtin.fn, { tau2, t }));
+/// <summary>
+/// <para>組を入れ子にするlet束縛の連鎖</para>
+/// <para>let pair = a -> b -> f -> f a b in let x0 = 1 in let x1 = pair x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">連鎖の長さ</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> pairChain(Fixture& fixture, std::size_t k) {
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = id(x(k));
+    for (auto i = k; i > 0; --i) {
+        e = let(x(i), apply(id("pair"), id(x(i - 1)), id(x(i - 1))), e);
+    }
+    auto params = std::vector<Lambda::Parameter>{ { .x = Symbol("a") }, { .x = Symbol("b") }, { .x = Symbol("f") } };
+    return let("pair", lambda(std::move(params), apply(id("f"), id("a"), id("b"))), let(x(0), c(fixture.numberT), e));
+}
 
-        return t;
+/// <summary>
+/// <para>多相な束縛を2回ずつ利用する入れ子</para>
+/// <para>let x0 = n -> n in let x1 = y -> y x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> polymorphicNest([[maybe_unused]] Fixture& fixture, std::size_t k) {
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = id(x(k));
+    for (auto i = k; i > 0; --i) {
+        e = let(x(i), lambda("y", apply(id("y"), id(x(i - 1)), id(x(i - 1)))), e);
     }
+    return let(x(0), lambda("n", id("n")), e);
+}
 
-    /// <summary>
-    /// Algorithm Mの適用
-    /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefType rho) override {
-        auto t1 = env.newType(Type::Variable{ .depth = env.depth });
-        // 左項については型制約の適用・検査
-        this->lhs->M(typeMap, env, t1);
-        typeMap.applyConstraint(t1, { this->getTypeClass() });
+/// <summary>
+/// <para>型変数を含まない大きな型を返す多相な関数の多数の利用</para>
+/// <para>Tk = Tk-1 -> Tk-1とする、let g = y -> (_: Tk) in let k = a -> b -> b in k (g 1) (k (g 1) (... (g 1)))</para>
+/// <para>Tkは木としては2^k個のノードをもつが、instantiateでTkを共有する限り生成する型の数はkに依存しない</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">Tkの深さ</param>
+/// <returns>生成したプログラム</returns>
+std::shared_ptr<Expression> groundSharing(Fixture& fixture, std::size_t k) {
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < k; ++i) {
+        t = fun(fixture.typeMap, fixture.env, t, t);
+    }
+    auto use = [&] { return apply(id("g"), c(fixture.numberT)); };
+    auto e = use();
+    for (std::size_t i = 1; i < 64; ++i) {
+        e = apply(id("k"), use(), e);
+    }
+    return let("g", lambda("y", c(t)), let("k", lambda({ Lambda::Parameter{ .x = Symbol("a") }, Lambda::Parameter{ .x = Symbol("b") } }, id("b")), e));
+}
 
-        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
-        auto t2 = env.newType(Type::Variable{ .depth = env.depth });
-        unify(typeMap, this->getClassMethod(typeMap, env), env.instantiate(typeMap, typeMap.builtin.fn, { t2, rho }));
+/// <summary>
+/// <para>instantiateが型変数を含まない部分型を共有しているかの検査</para>
+/// <para>a -> Tkをgeneralizeしてinstantiateした結果の戻り値型がTkそのものであり、雛形がTkを展開していないことを確認する</para>
+/// </summary>
+/// <returns>共有している場合はtrue、そうでない場合はfalse</returns>
+bool checkSharing() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < 16; ++i) {
+        t = fun(fixture.typeMap, env, t, t);
+    }
+    auto g = env.generalize(fun(fixture.typeMap, env, var(env), t));
+    auto& generic = std::get<Generic>(g);
+    auto f = env.instantiate(fixture.typeMap, generic);
 
-        this->rhs->M(typeMap, env, t2);
+    if (std::get<Type::Function>(f->kind).returnType != t || generic.spine->nodes.size() != 1) {
+        std::cout << std::format("instantiate: 型変数を含まない部分型が共有されていない(雛形の節点数：{})", generic.spine->nodes.size()) << std::endl;
+        return false;
     }
-};
+    return true;
+}
 
 /// <summary>
-/// 加算を示す構文木
+/// <para>投機的な単一化の巻き戻しの検査</para>
+/// <para>'a -> 'aとnumber -> booleanの単一化は'aを束縛した後に失敗するため、巻き戻して'aが未解決に戻り別の型と単一化できることを確認する</para>
+/// <para>let束縛を含む型推論を巻き戻した場合にgeneralizeによる型の書き換えも巻き戻されることを確認する</para>
+/// <para>型推論の異常以外の例外で中断した場合も巻き戻されてチェックポイントが閉じられることを確認する</para>
 /// </summary>
-struct Add : BinaryExpression {
-    /// <summary>
-    /// 加算の定義についての型クラス
-    /// </summary>
-    static RefTypeClass typeClass;
-    /// <summary>
-    /// 加算尾定義についてのクラスメソッド名
-    /// </summary>
-    static std::string methodName;
+/// <returns>巻き戻せている場合はtrue、そうでない場合はfalse</returns>
+bool checkRollback() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto a = var(env);
+    auto t = fun(fixture.typeMap, env, a, a);
+    auto print = [&] {
+        std::ostringstream os;
+        os << t;
+        return os.str();
+    };
+    auto before = print();
 
-    using BinaryExpression::BinaryExpression;
-    ~Add() override {}
+    auto numberToBoolean = fun(fixture.typeMap, env, fixture.numberT, fixture.booleanT);
+    if (trail.speculate([&] { unify(fixture.typeMap, t, numberToBoolean); })) {
+        std::cout << "rollback: 単一化が失敗していない" << std::endl;
+        return false;
+    }
+    if (print() != before || std::get<Type::Variable>(a->kind).solve) {
+        std::cout << std::format("rollback: 巻き戻し後の型が一致しない({} -> {})", before, print()) << std::endl;
+        return false;
+    }
 
-    /// <summary>
-    /// 二項演算を示す型クラスを取得する
-    /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    const RefTypeClass& getTypeClass() const override {
-        return Add::typeClass;
+    auto booleanToBoolean = fun(fixture.typeMap, env, fixture.booleanT, fixture.booleanT);
+    if (!trail.speculate([&] { unify(fixture.typeMap, t, booleanToBoolean); }) || solved(a) != fixture.booleanT) {
+        std::cout << "rollback: 巻き戻し後の単一化に失敗した" << std::endl;
+        return false;
     }
 
-    /// <summary>
-    /// 二項演算をクラスメソッド名を取得する
-    /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    const std::string& getMethodName() const override {
-        return Add::methodName;
+    // let g = (u -> f) (k x) in 1 1
+    // f : 'b -> number、x : 'b、k : boolean -> numberとし、'bはlet束縛の型推論中にfの型を経由せずに解決される
+    // gのgeneralizeがfの型の引数型を解決結果に書き換えてから型推論が失敗する
+    auto b = env.newType(Type::Variable{ .depth = env.depth });
+    auto h = fun(fixture.typeMap, env, b, fixture.numberT);
+    env.bind(Symbol("f"), h);
+    env.bind(Symbol("x"), b);
+    env.bind(Symbol("k"), fun(fixture.typeMap, env, fixture.booleanT, fixture.numberT));
+    Ast ast;
+    auto root = let("g", apply(lambda("u", id("f")), apply(id("k"), id("x"))), apply(c(fixture.numberT), c(fixture.numberT)))->flatten(ast);
+    auto inference = Inference{ .typeMap = fixture.typeMap, .ast = ast };
+    if (trail.speculate([&] { inference.J(env, root); })) {
+        std::cout << "rollback: let束縛を含む型推論が失敗していない" << std::endl;
+        return false;
     }
-};
-RefTypeClass Add::typeClass = nullptr;
-std::string Add::methodName = "";
+    if (std::get<Type::Function>(h->kind).paramType != b || std::get<Type::Variable>(b->kind).solve) {
+        std::cout << "rollback: let束縛のgeneralizeによる書き換えが巻き戻されていない" << std::endl;
+        return false;
+    }
+
+    // 型推論の異常以外の例外でも書き換えを巻き戻し、チェックポイントを閉じてから再送出する
+    auto u = var(env);
+    try {
+        (void)trail.speculate([&] {
+            unify(fixture.typeMap, u, fixture.numberT);
+            throw std::out_of_range("speculate");
+        });
+        std::cout << "rollback: 型推論の異常以外の例外が再送出されていない" << std::endl;
+        return false;
+    }
+    catch (const std::out_of_range&) {}
+    if (trail.open != 0 || std::get<Type::Variable>(u->kind).solve) {
+        std::cout << "rollback: 型推論の異常以外の例外で巻き戻されていない" << std::endl;
+        return false;
+    }
+    return true;
+}
 
 /// <summary>
-/// RefTypeの標準出力
+/// <para>大きさを変えながらプログラムの族について型推論を行い、計測結果を出力する</para>
+/// <para>型推論中に生成した型の数と、結果の型のグラフとしてのノード数を出力する</para>
 /// </summary>
-/// <param name="os">出力ストリーム</param>
-/// <param name="type">出力対象の型</param>
-/// <returns></returns>
-std::ostream& operator<<(std::ostream& os, RefType type) {
-    struct fn {
-        std::ostream& o;
-        char varCnt = 'a';
-        std::unordered_map<const Type::Variable*, char> varmap = {};
-
-        void operator()(const Type::Base& x) {
-            this->o << x.name;
-        }
-        void operator()(const Type::Function& x) {
-            // 括弧付きで出力するかを判定
-            bool isSimple = std::holds_alternative<Type::Base>(x.paramType->kind) ||
-                std::holds_alternative<Type::Variable>(x.paramType->kind) ||
-                std::holds_alternative<Type::Param>(x.paramType->kind) ||
-                std::holds_alternative<Type::TypeClass>(x.paramType->kind);
-            if (isSimple) {
-                std::visit(*this, x.paramType->kind);
+/// <param name="name">プログラムの族の名前</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="sizes">生成器に与える大きさのリスト(昇順)</param>
+/// <param name="shared">生成する型の数が大きさに依存しないことを検査する場合はtrue</param>
+/// <param name="linear">生成する型の数と結果の型のノード数が大きさに比例し、束縛1つあたりに走査する型の数が高々大きさに比例することを検査する場合はtrue(走査する型の数はINFERENCE_STATSを定義した場合のみ検査する)</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool stress(const std::string& name, std::shared_ptr<Expression>(*generate)(Fixture&, std::size_t), std::initializer_list<std::size_t> sizes, bool shared = false, bool linear = false) {
+    auto ok = true;
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::optional<std::size_t> first = std::nullopt;
+        // 最初の大きさでの計測結果(大きさ、生成した型の数、結果の型のノード数、走査した型の数)
+        std::optional<std::tuple<std::size_t, std::size_t, std::size_t, std::size_t>> base = std::nullopt;
+
+        for (auto k : sizes) {
+            Ast ast;
+            auto root = generate(fixture, k)->flatten(ast);
+            auto inference = Inference{ .typeMap = fixture.typeMap, .ast = ast };
+
+            auto types = fixture.env.arena->types.size();
+            auto traversed = inferenceStats.traversed();
+            auto start = std::chrono::steady_clock::now();
+            RefType t = nullptr;
+            if (algorithm == 'J') {
+                t = inference.J(fixture.env, root);
             }
             else {
-                this->o << "(";
-                std::visit(*this, x.paramType->kind);
-                this->o << ")";
+                t = fixture.env.newType(Type::Variable{ .depth = fixture.env.depth - 1 });
+                inference.M(fixture.env, root, t);
             }
-            this->o << " -> ";
-            std::visit(*this, x.returnType->kind);
-        }
-        void operator()(const Type::Variable& x) {
-            if (x.solve) {
-                // 解決済みの型変数の場合は解決結果の型に対して出力
-                std::visit(*this, x.solve.value()->kind);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            auto created = fixture.env.arena->types.size() - types;
+            auto us = std::chrono::duration<double, std::micro>(elapsed).count();
+            auto nodes = countTypeNodes(t);
+            auto visits = inferenceStats.traversed() - traversed;
+
+            std::cout << std::format(
+                "{:<20} {} {:>4} {:>8} {:>12.1f} {:>12} {:>12}",
+                name,
+                algorithm,
+                k,
+                ast.nodes.size(),
+                us,
+                created,
+                nodes
+            ) << std::endl;
+
+            // 型変数を含まない部分型を共有している限り、生成する型の数は大きさに依存しない
+            if (shared && first && created > first.value()) {
+                std::cout << std::format("{}: 型変数を含まない部分型が共有されていない({} -> {})", name, first.value(), created) << std::endl;
+                ok = false;
             }
-            else {
-                // 雑に[a, z]の範囲で型変数を出力
-                // zを超えたら全て「_」で出力
-                if (auto itr = this->varmap.find(std::addressof(x)); itr != this->varmap.end()) {
-                    this->o << '?' << itr->second;
-                }
-                else {
-                    this->varmap.insert({ std::addressof(x), this->varCnt });
-                    this->o << '?' << this->varCnt;
-                    switch (this->varCnt) {
-                    case 'z':
-                        this->varCnt = '_';
-                        break;
-                    case '_':
-                        break;
-                    default:
-                        ++this->varCnt;
-                        break;
-                    }
-                }
-
-                // 型クラスの情報を出力
-                if (x.constraints.list.size() == 1) {
-                    this->o << ": " << x.constraints.list[0]->name;
+            first = first.value_or(created);
+
+            if (linear && base) {
+                auto [k0, created0, nodes0, visits0] = base.value();
+                auto ratio = static_cast<double>(k) / k0;
+                // 計測の誤差を含む時間ではなく決定的な型の数で検査する
+                // 定数項は大きさによらないため、型の数は余裕をもたせずに大きさに比例する上限で検査できる
+                if (created > created0 * ratio || nodes > nodes0 * ratio) {
+                    std::cout << std::format("{}: 型の数が大きさに比例しない({} -> {}, {} -> {})", name, created0, created, nodes0, nodes) << std::endl;
+                    ok = false;
+                    break;
                 }
-                else if (x.constraints.list.size() > 1) {
-                    this->o << ":(" << x.constraints.list[0]->name;
-                    for (auto itr = x.constraints.list.begin() + 1; itr != x.constraints.list.end(); ++itr) {
-                        this->o << " + " << (*itr)->name;
-                    }
-                    this->o << ")";
+                // 束縛ごとに出現検査とgeneralizeがその時点の型を1回ずつ走査するため、束縛1つあたりに走査する型の数は大きさに比例してよい
+                if (visits > visits0 * ratio * ratio) {
+                    std::cout << std::format("{}: 束縛1つあたりに走査する型の数が大きさに比例しない({:.1f} -> {:.1f})", name, static_cast<double>(visits0) / k0, static_cast<double>(visits) / k) << std::endl;
+                    ok = false;
+                    // 指数的に増加する場合に続く大きさの計測が終わらないため打ち切る
+                    break;
                 }
             }
+            else if (linear) {
+                base = std::tuple(k, created, nodes, visits);
+            }
         }
-        void operator()(const Type::Param& x) {
-            // 雑に[a, z]の範囲で型変数を出力
-            // zを超えたら全て「_」で出力
-            std::size_t c = 'a' + x.index;
-            this->o << '\'' << static_cast<char>(c <= 'z' ? c : '_');
+    }
+    return ok;
+}
 
-            // 型クラスの情報を出力
-            if (x.constraints.list.size() == 1) {
-                this->o << ": " << x.constraints.list[0]->name;
-            }
-            else if (x.constraints.list.size() > 1) {
-                this->o << ":(" << x.constraints.list[0]->name;
-                for (auto itr = x.constraints.list.begin() + 1; itr != x.constraints.list.end(); ++itr) {
-                    this->o << " + " << (*itr)->name;
-                }
-                this->o << ")";
+/// <summary>
+/// <para>凍結した1つの型表を共有した複数の型推論を並行に実行して計測結果を出力する</para>
+/// <para>型推論ごとに型表を重ね、スレッド数によらず推論結果の型が一致することを検査する</para>
+/// </summary>
+/// <param name="n">class-constraintsの大きさ</param>
+/// <param name="sessions">型推論の回数</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool sharedPrelude(std::size_t n, std::size_t sessions) {
+    auto ok = true;
+    Fixture fixture;
+    fixture.typeMap.freeze();
+    auto program = classConstraints(fixture, n);
+
+    std::optional<double> sequential = std::nullopt;
+    std::vector<std::string> expected;
+    // 実行環境のコア数によらず並行な型推論の経路を通すため2スレッド以上で比較する
+    auto concurrency = std::max<std::size_t>(std::thread::hardware_concurrency(), 2);
+    for (auto threads : { std::size_t(1), concurrency }) {
+        std::vector<std::string> actual(sessions);
+        std::atomic<std::size_t> next = 0;
+        auto worker = [&] {
+            for (auto i = next++; i < sessions; i = next++) {
+                auto env = TypeEnvironment();
+                auto typeMap = fixture.typeMap.overlay();
+                Ast ast;
+                auto root = program->flatten(ast);
+                auto inference = Inference{ .typeMap = typeMap, .ast = ast };
+                std::ostringstream os;
+                os << inference.J(env, root);
+                actual[i] = os.str();
             }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+#ifdef INFERENCE_STATS
+        auto& stats = inferenceStats;
+#endif
+        for (std::size_t i = 1; i < threads; ++i) {
+            pool.emplace_back([&] {
+                worker();
+#ifdef INFERENCE_STATS
+                stats.merge(inferenceStats);
+#endif
+            });
         }
-        void operator()(const Type::TypeClass& x) {
-            auto size = x.typeClasses.list.size();
-            if (size == 0) {
-                // 空を出力
-                this->o << "()";
-            }
-            else {
-                // 2つ以上の複数の型クラスから成る型の場合は括弧付きで出力
-                if (size > 1) {
-                    this->o << '(';
-                }
-                // 型クラスとわかるようにプレフィックスとして「:」を付けて出力する
-                for (decltype(x.typeClasses.list.size()) i = 0; i < x.typeClasses.list.size(); ++i) {
-                    auto& l = x.typeClasses.list[i];
-                    if (auto itr = std::ranges::find_if(x.typeClasses.list, [&l](auto& typeClass) { return typeClass == l; }); itr != x.typeClasses.list.end()) {
-                        if (i > 0) {
-                            this->o << " + ";
-                        }
-                        this->o << ':' << (*itr)->name;
-                    }
-                    else {
-                        assert(false);
-                    }
-                }
-                if (size > 1) {
-                    this->o << ')';
-                }
-            }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sequential = sequential.value_or(elapsed);
+
+        if (expected.empty()) {
+            expected = std::move(actual);
+        }
+        else if (actual != expected) {
+            std::cout << std::format("shared-prelude: スレッド数{}で推論結果が一致しない", threads) << std::endl;
+            ok = false;
+        }
+
+        std::cout << std::format("{:<20} {:>8} {:>8} {:>12.1f} {:>8.2f}", "shared-prelude", threads, sessions, elapsed, sequential.value() / elapsed) << std::endl;
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>互いにほぼ独立な束縛からなるモジュール</para>
+/// <para>f0 = wide-polymorphism, f1 = wide-polymorphism, ... とし、8個に1個の束縛は直前の束縛を参照する</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">束縛の数</param>
+/// <param name="m">束縛ごとのwide-polymorphismの大きさ</param>
+/// <returns>生成したモジュール</returns>
+Module wideModule(Fixture& fixture, std::size_t n, std::size_t m) {
+    Module module;
+    auto f = [](std::size_t i) { return std::format("f{}", i); };
+    for (std::size_t i = 0; i < n; ++i) {
+        auto e = widePolymorphism(fixture, m);
+        if (i % 8 == 7) {
+            e = apply(lambda("u", e), id(f(i - 1)));
+        }
+        module.definitions.push_back({ .x = Symbol(f(i)), .e = e });
+    }
+    return module;
+}
+
+/// <summary>
+/// <para>スレッド数を変えながらモジュールの型推論を行い、計測結果を出力する</para>
+/// <para>スレッド数によらず推論結果の型が一致することを検査する</para>
+/// </summary>
+/// <param name="n">束縛の数</param>
+/// <param name="m">束縛ごとのwide-polymorphismの大きさ</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool moduleScaling(std::size_t n, std::size_t m) {
+    auto ok = true;
+    std::optional<double> sequential = std::nullopt;
+    std::vector<std::string> expected;
+    // 実行環境のコア数によらず並列な型推論の経路を通すため2スレッド以上で比較する
+    for (std::size_t threads : { std::size_t(1), std::max<std::size_t>(std::thread::hardware_concurrency(), 2) }) {
+        Fixture fixture;
+        fixture.typeMap.freeze();
+        auto module = wideModule(fixture, n, m);
+
+        auto start = std::chrono::steady_clock::now();
+        module.infer(fixture.typeMap, fixture.env, threads);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sequential = sequential.value_or(elapsed);
+
+        std::vector<std::string> actual;
+        for (auto& def : module.definitions) {
+            auto tau = fixture.env.lookup(def.x).value();
+            std::ostringstream os;
+            os << (std::holds_alternative<Generic>(*tau) ? std::get<Generic>(*tau).type : std::get<RefType>(*tau));
+            actual.push_back(os.str());
         }
+        if (expected.empty()) {
+            expected = std::move(actual);
+        }
+        else if (actual != expected) {
+            std::cout << std::format("module: スレッド数{}で推論結果が一致しない", threads) << std::endl;
+            ok = false;
+        }
+
+        std::cout << std::format("{:<20} {:>8} {:>8} {:>12.1f} {:>8.2f}", "wide-module", threads, n, elapsed, sequential.value() / elapsed) << std::endl;
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>モジュールの外の束縛を参照する並列な型推論の検査</para>
+/// <para>型クラスの制約をもつ束縛を参照した型推論が逐次の型推論と一致し、未解決の型変数を含む束縛がある場合は逐次の型推論と同じくその型変数を解決することを確認する</para>
+/// </summary>
+/// <returns>推論結果が正しい場合はtrue、そうでない場合はfalse</returns>
+bool checkModuleImports() {
+    auto print = [](const std::variant<RefType, Generic>& tau) {
+        std::ostringstream os;
+        os << (std::holds_alternative<Generic>(tau) ? std::get<Generic>(tau).type : std::get<RefType>(tau));
+        return os.str();
     };
-    std::visit(fn{ .o = os }, type->kind);
 
-    return os;
+    // g0 = n -> n + n, g1 = n -> g0 (g0 n), g2 = n -> g1 (g0 n), ...
+    Fixture closed;
+    closed.typeMap.freeze();
+    Module module;
+    module.definitions.push_back({ .x = Symbol("g0"), .e = lambda("n", add(closed.typeMap, id("n"), id("n"))) });
+    for (std::size_t i = 1; i < 8; ++i) {
+        module.definitions.push_back({ .x = Symbol(std::format("g{}", i)), .e = lambda("n", apply(id(std::format("g{}", i - 1)), apply(id("g0"), id("n")))) });
+    }
+    module.infer(closed.typeMap, closed.env, 2);
+    if (auto tau = print(*closed.env.lookup(Symbol("g7")).value()); tau != "'a: Add -> 'a: Add") {
+        std::cout << std::format("module: 外の束縛を参照した推論結果が一致しない({})", tau) << std::endl;
+        return false;
+    }
+
+    // wはgeneralizeされない未解決の型変数に束縛し、h1 = (g -> (u -> g true) (g h)) (x -> x)でbooleanに解決する
+    Fixture open;
+    open.typeMap.freeze();
+    open.env.bind(Symbol("w"), open.env.newType(Type::Variable{ .depth = open.env.depth }));
+    Module dependent;
+    dependent.definitions.push_back({ .x = Symbol("h"), .e = apply(lambda("x", id("x")), id("w")) });
+    dependent.definitions.push_back({ .x = Symbol("h1"), .e = apply(lambda("g", apply(lambda("u", apply(id("g"), c(open.booleanT))), apply(id("g"), id("h")))), lambda("x", id("x"))) });
+    dependent.infer(open.typeMap, open.env, 2);
+    if (auto tau = print(*open.env.lookup(Symbol("w")).value()); tau != "boolean") {
+        std::cout << std::format("module: 外の束縛の型変数が解決されない({})", tau) << std::endl;
+        return false;
+    }
+    return true;
 }
 
-// 雑に型を短く書くための関数
-RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = name }); }
-RefType var(TypeEnvironment& env) { return env.newType(Type::Variable{ .depth = env.depth + 1 }); }
-RefType param(TypeEnvironment& env, std::size_t index = 0) { return env.newType(Type::Param{ .index = index }); }
-RefType fun(TypeEnvironment& env, RefType base, RefType paramType, RefType returnType) { return env.newType(Type::Function{ .base = base, .paramType = paramType, .returnType = returnType }); }
-RefType fun(TypeMap& typeMap, TypeEnvironment& env, RefType paramType, RefType returnType) { return env.instantiate(typeMap, typeMap.builtin.fn, { paramType, returnType }); }
-template <class... Types>
-RefType tc(TypeEnvironment& env, Types&&... args) { return env.newType(Type::TypeClass{ .typeClasses{.list = { std::forward<Types>(args)...}} }); }
+/// <summary>
+/// <para>モジュールのトップレベルの束縛のgeneralizeの検査</para>
+/// <para>let束縛の連鎖では単相な型となる関数適用の結果が、モジュールでは強連結成分内で生成した型変数としてgeneralizeされることを確認する</para>
+/// </summary>
+/// <returns>推論結果が意図した型付けである場合はtrue、そうでない場合はfalse</returns>
+bool checkModuleGeneralization() {
+    auto print = [](const std::variant<RefType, Generic>& tau) {
+        std::ostringstream os;
+        os << (std::holds_alternative<Generic>(tau) ? std::get<Generic>(tau).type : std::get<RefType>(tau));
+        return os.str();
+    };
 
-// 雑に構文を短く書くための関数
-std::shared_ptr<Expression> c(RefType type) { return std::shared_ptr<Expression>(new Constant(type)); }
-std::shared_ptr<Expression> id(const std::string& name) { return std::shared_ptr<Expression>(new Identifier(name)); }
-std::shared_ptr<Expression> lambda(const std::string& name, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, expr)); }
-std::shared_ptr<Expression> lambda(const std::string& name, RefType constraint, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, constraint, expr)); }
-std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Apply(expr1, expr2)); }
-template <class Head, class... Tail>
-std::shared_ptr<Expression> apply(Head&& head1, Head&& head2, Tail&&... tail) { return apply(std::shared_ptr<Expression>(new Apply(head1, head2)), std::forward<Tail>(tail)...); }
-std::shared_ptr<Expression> let(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, expr1, expr2)); }
-std::shared_ptr<Expression> let(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, params, expr1, expr2)); }
-std::shared_ptr<Expression> letrec(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, expr1, expr2)); }
-std::shared_ptr<Expression> letrec(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, params, expr1, expr2)); }
-std::shared_ptr<Expression> dot(std::shared_ptr<Expression> expr, const std::string& name) { return std::shared_ptr<Expression>(new AccessToClassMethod(expr, name)); }
-std::shared_ptr<Expression> add(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Add(expr1, expr2)); }
+    // id = n -> n, f = id id, a = f 1, b = f true
+    Fixture fixture;
+    fixture.typeMap.freeze();
+    Module module;
+    module.definitions.push_back({ .x = Symbol("id"), .e = lambda("n", id("n")) });
+    module.definitions.push_back({ .x = Symbol("f"), .e = apply(id("id"), id("id")) });
+    module.definitions.push_back({ .x = Symbol("a"), .e = apply(id("f"), c(fixture.numberT)) });
+    module.definitions.push_back({ .x = Symbol("b"), .e = apply(id("f"), c(fixture.booleanT)) });
+    module.infer(fixture.typeMap, fixture.env, 2);
+    auto f = *fixture.env.lookup(Symbol("f")).value();
+    auto a = print(*fixture.env.lookup(Symbol("a")).value());
+    auto b = print(*fixture.env.lookup(Symbol("b")).value());
+    if (!std::holds_alternative<Generic>(f) || a != "number" || b != "boolean") {
+        std::cout << std::format("module: 関数適用の結果がgeneralizeされていない(f : {}, a : {}, b : {})", print(f), a, b) << std::endl;
+        return false;
+    }
+
+    // let id = n -> n in let f = id id in let a = f 1 in f trueではfは単相な型となり型の不一致となる
+    TypeEnvironment env = fixture.env.child(fixture.env.depth);
+    auto typeMap = fixture.typeMap.overlay();
+    Ast ast;
+    auto root = let("id", lambda("n", id("n")), let("f", apply(id("id"), id("id")), let("a", apply(id("f"), c(fixture.numberT)), apply(id("f"), c(fixture.booleanT)))))->flatten(ast);
+    auto inference = Inference{ .typeMap = typeMap, .ast = ast };
+    try {
+        auto t = inference.J(env, root);
+        std::cout << std::format("module: let束縛の連鎖で関数適用の結果がgeneralizeされた({})", print(t)) << std::endl;
+        return false;
+    }
+    catch (const std::runtime_error&) {
+    }
+    return true;
+}
 
 int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
+    std::cout << std::format("{:<20} {} {:>8} {:>12} {:>12} {:>16}", "program", "A", "nodes", "ns/node", "allocs/node", "peak bytes/node") << std::endl;
+    benchmark("deep-let", deepLet, 1000, 20);
+    benchmark("wide-polymorphism", widePolymorphism, 1000, 20);
+    benchmark("long-apply", longApply, 1000, 20);
+    benchmark("class-constraints", classConstraints, 1000, 20);
+
+    // 型が指数的に大きくなりうるプログラムの族
+    std::cout << std::endl << std::format("{:<20} {} {:>4} {:>8} {:>12} {:>12} {:>12}", "family", "A", "k", "nodes", "us", "new types", "type nodes") << std::endl;
+    auto ok = checkSharing();
+    ok = checkRollback() && ok;
+    ok = stress("pair-chain", pairChain, { 8, 16, 32, 64, 128, 256 }, false, true) && ok;
+    ok = stress("polymorphic-nest", polymorphicNest, { 2, 4, 6, 8, 10, 12 }) && ok;
+    ok = stress("ground-sharing", groundSharing, { 4, 8, 16, 32, 64 }, true) && ok;
+
+    // 凍結した型表を共有する並行な型推論
+    std::cout << std::endl << std::format("{:<20} {:>8} {:>8} {:>12} {:>8}", "prelude", "threads", "sessions", "ms", "speedup") << std::endl;
+    ok = sharedPrelude(200, 256) && ok;
+
+    // 互いに独立な束縛の並列な型推論
+    std::cout << std::endl << std::format("{:<20} {:>8} {:>8} {:>12} {:>8}", "module", "threads", "defs", "ms", "speedup") << std::endl;
+    ok = moduleScaling(4000, 64) && ok;
+    ok = checkModuleImports() && ok;
+    ok = checkModuleGeneralization() && ok;
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
     // 型環境
     auto env = TypeEnvironment();
     // 型表
@@ -1567,8 +5049,7 @@ int main() {
     auto& booleanT = std::get<RefType>(booleanTD.type);
 
     // 組込みの型クラスを定義する
-    Add::methodName = "add";
-    Add::typeClass = ([&] {
+    typeMap.addTypeClass(([&typeMap, &env] {
         auto valT = param(env);
         return RefTypeClass(new TypeClass({
             .name = "Add",
@@ -1578,8 +5059,7 @@ int main() {
                 { Add::methodName, fun(typeMap, env, valT, fun(typeMap, env, valT, valT)) }
             }
         }));
-    })();
-    typeMap.addTypeClass(Add::typeClass);
+    })());
 
     // 適当に型クラスを定義する
     typeMap.addTypeClass(([&typeMap, &env] {
@@ -1594,7 +5074,10 @@ int main() {
         }));
     })());
     // Boolean型に型クラスTypeClassを実装する
-    booleanTD.typeclasses.list.push_back(typeMap.typeClassMap["TypeClass"]);
+    booleanTD.typeclasses.insert(typeMap.getTypeClass("TypeClass"));
+
+    // 登録を終えた型表は凍結して各式の型推論で共有する
+    typeMap.freeze();
 
     // 定数のつもりの構文を宣言しておく
     auto _true = c(booleanT);
@@ -1603,27 +5086,69 @@ int main() {
         {
             // n -> n + n
             // 型推論で自動的に型クラスが付加される例
-            lambda("n", add(id("n"), id("n"))),
+            lambda("n", add(typeMap, id("n"), id("n"))),
             // true.method true
             // 型クラスを実装した型からクラスメソッドを呼び出す
             apply(dot(_true, "method"), _true),
             // let f = n: (:TypeClass) -> n.method n in f
             // 引数型に型を明示的に指定してクラスメソッドを呼び出す例
-            let("f", lambda("n", tc(env, typeMap.typeClassMap["TypeClass"]), apply(dot(id("n"), "method"), id("n"))), id("f")),
+            let("f", lambda("n", tc(env, typeMap.getTypeClass("TypeClass")), apply(dot(id("n"), "method"), id("n"))), id("f")),
             // let f<'a: TypeClass> = n: 'a -> n.method n in f
             // 引数型に型変数を明示的に指定してクラスメソッドを呼び出す例
             ([&] {
                 auto p0 = param(env, 0);
-                std::get<Type::Param>(p0->kind).constraints.list = { typeMap.typeClassMap["TypeClass"] };
+                std::get<Type::Param>(p0->kind).constraints = { typeMap.getTypeClass("TypeClass") };
                 return let("f", { p0 }, lambda("n", p0, apply(dot(id("n"), "method"), id("n"))), id("f"));
             })()
         })
     {
         // 型環境を使いまわして型推論をすると実質的にlet束縛で式を連結したことになってしまうが
         // 今回はシャドウも型環境の上書き禁止もないため許容する
-        std::cout << "Algorithm J: " << expr->J(typeMap, env) << std::endl;
+        // 構文木は平坦化してから型推論を行う
+        // 型推論は凍結した型表に重ねた型表で行う
+        Ast ast;
+        auto root = expr->flatten(ast);
+        auto session = typeMap.overlay();
+        auto inference = Inference{ .typeMap = session, .ast = ast };
+
+        // INFERENCE_STATSを定義した場合はアルゴリズムごとに計測結果を出力する
+#ifdef INFERENCE_STATS
+        inferenceStats.reset();
+#endif
+        std::cout << "Algorithm J: " << inference.J(env, root) << std::endl;
+#ifdef INFERENCE_STATS
+        inferenceStats.dump(std::cout);
+        inferenceStats.reset();
+#endif
         auto t = env.newType(Type::Variable{ .depth = env.depth - 1 });
-        expr->M(typeMap, env, t);
+        inference.M(env, root, t);
         std::cout << "Algorithm M: " << t << std::endl;
+#ifdef INFERENCE_STATS
+        inferenceStats.dump(std::cout);
+        inferenceStats.reset();
+#endif
+    }
+
+    // トップレベルの束縛をモジュールとしてまとめて型推論する
+    // 束縛の順序は問わず、互いに独立な束縛は並列に型推論し、相互再帰するpingとpongは1つの強連結成分として型推論する
+    auto module = Module{
+        .definitions = {
+            { .x = Symbol("result"), .e = apply(id("twice"), id("self"), _true) },
+            { .x = Symbol("twice"), .e = lambda("f", lambda("x", apply(id("f"), apply(id("f"), id("x"))))) },
+            { .x = Symbol("self"), .e = lambda("n", tc(env, typeMap.getTypeClass("TypeClass")), apply(dot(id("n"), "method"), id("n"))) },
+            { .x = Symbol("double"), .e = lambda("n", add(typeMap, id("n"), id("n"))) },
+            { .x = Symbol("ping"), .e = lambda("n", apply(id("pong"), id("n"))), .recursive = true },
+            { .x = Symbol("pong"), .e = lambda("n", apply(id("ping"), id("n"))), .recursive = true }
+        }
+    };
+    module.infer(typeMap, env);
+    for (auto& def : module.definitions) {
+        auto tau = env.lookup(def.x).value();
+        std::cout << "Module: " << def.x.name() << " : " << (std::holds_alternative<Generic>(*tau) ? std::get<Generic>(*tau).type : std::get<RefType>(*tau)) << std::endl;
     }
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
 }
+
+#endif
\ No newline at end of file
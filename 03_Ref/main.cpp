@@ -1,22 +1,204 @@
 ﻿#include <string>
+#include <string_view>
 #include <vector>
+#include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <format>
 #include <memory>
 #include <variant>
 #include <type_traits>
 #include <optional>
+#include <deque>
+#include <utility>
+#include <cstdint>
+#include <bit>
 #include <cassert>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <cstring>
+#include <fstream>
+#if defined(INFERENCE_STATS) || defined(INFERENCE_TRACE)
+#include <chrono>
+#endif
+#ifdef BENCHMARK
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <filesystem>
+#endif
 
 #include <iostream>
 
+/// <summary>
+/// <para>追記のみ可能なリスト</para>
+/// <para>要素数を倍々に増やしたセグメントに格納するため要素のアドレスは移動せず、追記と並行してロックなしで追記済みの要素を読み取れる</para>
+/// <para>追記同士の排他は呼び出し側で行う</para>
+/// </summary>
+template <class T>
+struct AppendOnlyList {
+    /// <summary>
+    /// 先頭のセグメントの要素数
+    /// </summary>
+    static constexpr std::size_t FIRST = 64;
+
+    /// <summary>
+    /// <para>セグメントの先頭のポインタ</para>
+    /// <para>k番目のセグメントはFIRST * 2^k個の要素を格納する</para>
+    /// </summary>
+    std::array<std::atomic<T*>, 48> segments = {};
+
+    /// <summary>
+    /// 要素数
+    /// </summary>
+    std::atomic<std::size_t> count = 0;
+
+    AppendOnlyList() = default;
+    AppendOnlyList(const AppendOnlyList&) = delete;
+    AppendOnlyList& operator=(const AppendOnlyList&) = delete;
+    ~AppendOnlyList() {
+        for (auto& segment : this->segments) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// インデックスからセグメントとセグメント内の位置を求める
+    /// </summary>
+    /// <param name="i">インデックス</param>
+    /// <returns>セグメントの番号とセグメント内の位置の組</returns>
+    [[nodiscard]] static std::pair<std::size_t, std::size_t> locate(std::size_t i) {
+        auto k = static_cast<std::size_t>(std::bit_width(i / FIRST + 1) - 1);
+        return { k, i - FIRST * ((std::size_t(1) << k) - 1) };
+    }
+
+    /// <summary>
+    /// 追記済みの要素を取得する
+    /// </summary>
+    /// <param name="i">インデックス</param>
+    /// <returns>要素</returns>
+    [[nodiscard]] const T& operator[](std::size_t i) const {
+        auto [k, offset] = AppendOnlyList::locate(i);
+        return this->segments[k].load(std::memory_order_acquire)[offset];
+    }
+
+    /// <summary>
+    /// 要素数を取得する
+    /// </summary>
+    [[nodiscard]] std::size_t size() const {
+        return this->count.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// 末尾に要素を追記する
+    /// </summary>
+    /// <param name="value">追記する要素</param>
+    /// <returns>追記した要素</returns>
+    const T& push_back(T value) {
+        auto i = this->count.load(std::memory_order_relaxed);
+        auto [k, offset] = AppendOnlyList::locate(i);
+        auto segment = this->segments[k].load(std::memory_order_relaxed);
+        if (!segment) {
+            segment = new T[FIRST << k];
+            this->segments[k].store(segment, std::memory_order_release);
+        }
+        segment[offset] = std::move(value);
+        this->count.store(i + 1, std::memory_order_release);
+        return segment[offset];
+    }
+};
+
+/// <summary>
+/// <para>識別子名とシンボルの識別番号の対応表</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し識別子名の取得はロックなしで行う</para>
+/// </summary>
+struct SymbolTable {
+    /// <summary>
+    /// <para>識別番号から識別子名への表</para>
+    /// <para>識別子名への参照をキーとして保持するため要素のアドレスが移動しないAppendOnlyListで保持する</para>
+    /// </summary>
+    AppendOnlyList<std::string> names = {};
+
+    /// <summary>
+    /// 識別子名から識別番号への表
+    /// </summary>
+    std::unordered_map<std::string_view, std::uint32_t> ids = {};
+
+    /// <summary>
+    /// 登録の排他制御
+    /// </summary>
+    std::mutex mutex = {};
+
+    /// <summary>
+    /// 識別子名の登録
+    /// </summary>
+    /// <param name="name">識別子名</param>
+    /// <returns>nameに対応する識別番号</returns>
+    [[nodiscard]] std::uint32_t intern(std::string_view name) {
+        std::lock_guard lock(this->mutex);
+        if (auto itr = this->ids.find(name); itr != this->ids.end()) {
+            return itr->second;
+        }
+        auto id = static_cast<std::uint32_t>(this->names.size());
+        this->ids.insert({ this->names.push_back(std::string(name)), id });
+        return id;
+    }
+
+    /// <summary>
+    /// 全体で共有するシンボル表の取得
+    /// </summary>
+    /// <returns>シンボル表</returns>
+    [[nodiscard]] static SymbolTable& instance() {
+        static SymbolTable table;
+        return table;
+    }
+};
+
+/// <summary>
+/// <para>識別子のシンボル</para>
+/// <para>識別子名は構文木の構築時にシンボル表へ登録し、型環境では32bitの識別番号をキーとして扱う</para>
+/// </summary>
+struct Symbol {
+    /// <summary>
+    /// シンボル表における識別番号
+    /// </summary>
+    std::uint32_t id = 0;
+
+    Symbol() = default;
+    explicit Symbol(std::string_view name) : id(SymbolTable::instance().intern(name)) {}
+
+    /// <summary>
+    /// 識別子名の取得
+    /// </summary>
+    /// <returns>シンボルに対応する識別子名</returns>
+    [[nodiscard]] const std::string& name() const {
+        return SymbolTable::instance().names[this->id];
+    }
+
+    [[nodiscard]] bool operator==(const Symbol&) const = default;
+};
+
+/// <summary>
+/// Symbolのハッシュ関数
+/// </summary>
+template<>
+struct std::hash<Symbol> {
+    [[nodiscard]] std::size_t operator()(const Symbol& symbol) const noexcept {
+        return symbol.id;
+    }
+};
+
 struct Type;
 
 /// <summary>
-/// 型への参照
+/// <para>型への参照</para>
+/// <para>型の実体はTypeArenaが所有するため参照カウントはもたない</para>
 /// </summary>
-using RefType = std::shared_ptr<Type>;
+using RefType = Type*;
 
 
 struct TypeClass;
@@ -27,15 +209,18 @@ struct TypeClass;
 using RefTypeClass = std::shared_ptr<TypeClass>;
 
 struct TypeMap;
+struct TypeData;
 
 
 struct TypeEnvironment;
 struct Region;
+struct TypeInfo;
 
 /// <summary>
-/// リージョン型への参照
+/// <para>リージョン型への参照</para>
+/// <para>リージョン型の実体はTypeArenaが所有するため参照カウントはもたない</para>
 /// </summary>
-using RefRegion = std::shared_ptr<Region>;
+using RefRegion = Region*;
 
 /// <summary>
 /// 識別子に対応付けられたリージョン型
@@ -93,1951 +278,5189 @@ struct Region {
 };
 
 /// <summary>
-/// 型クラスの集合としての型制約
+/// <para>型クラスの通し番号の集合</para>
+/// <para>通し番号をビットの位置とするビット集合で先頭の64個はヒープを確保せずに保持する</para>
 /// </summary>
-struct Constraints {
+struct TypeClassSet {
     /// <summary>
-    /// 実装対象の型クラスのリスト
+    /// ヒープを確保せずに保持する通し番号の個数
     /// </summary>
-    std::vector<RefTypeClass> list = {};
+    static constexpr std::size_t INLINE_BITS = 64;
 
     /// <summary>
-    /// <para>型制約をマージする</para>
-    /// <para>型クラスの継承関係により縮約を適用行いながらマージを行うため縮約を行わない場合は直接constraintsを操作する</para>
+    /// 通し番号が0から63のビット
     /// </summary>
-    /// <param name="constraints">マージ対象の型クラス</param>
-    void merge(const std::vector<RefTypeClass>& constraints);
+    std::uint64_t head = 0;
 
     /// <summary>
-    /// 制約を持つか検査
+    /// 通し番号が64以上のビット(大規模なプログラムでのみ確保する)
     /// </summary>
-    /// <param name="typeClass">制約を持つか検査する型クラス</param>
-    [[nodiscard]] bool has(RefTypeClass typeClass) const;
+    std::vector<std::uint64_t> overflow = {};
 
     /// <summary>
-    /// 指定されたクラスメソッドを抽出する
+    /// 通し番号を追加する
     /// </summary>
-    /// <param name="name">クラスメソッド名</param>
-    /// <returns>
-    /// <para>指定されたクラスメソッドを実装した型クラスとconstraintsのインデックスのペア</para>
-    /// <para>constraintsに存在しないが基底から型クラスを取得した場合はconstraintsのサイズがインデックスとなる</para>
-    /// </returns>
-    [[nodiscard]] std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> getClassMethod(std::string& name) const;
-};
-
-/// <summary>
-/// 型の表現
-/// </summary>
-struct Type {
+    /// <param name="id">追加する通し番号</param>
+    void insert(std::size_t id) {
+        if (id < INLINE_BITS) {
+            this->head |= std::uint64_t(1) << id;
+            return;
+        }
+        auto word = id / INLINE_BITS - 1;
+        if (this->overflow.size() <= word) {
+            this->overflow.resize(word + 1, 0);
+        }
+        this->overflow[word] |= std::uint64_t(1) << (id % INLINE_BITS);
+    }
 
     /// <summary>
-    /// 基底型
+    /// 通し番号を含むか判定
     /// </summary>
-    struct Base {
-        /// <summary>
-        /// 型名
-        /// </summary>
-        const std::string name;
-    };
+    /// <param name="id">判定する通し番号</param>
+    /// <returns>含む場合はtrue、含まない場合はfalse</returns>
+    [[nodiscard]] bool contains(std::size_t id) const {
+        if (id < INLINE_BITS) {
+            return (this->head >> id) & 1;
+        }
+        auto word = id / INLINE_BITS - 1;
+        return word < this->overflow.size() && ((this->overflow[word] >> (id % INLINE_BITS)) & 1);
+    }
 
     /// <summary>
-    /// 関数型
+    /// 和集合を取る
     /// </summary>
-    struct Function {
-        /// <summary>
-        /// 基底型としての意味を示す型
-        /// </summary>
-        RefType base;
-
-        /// <summary>
-        /// 引数型
-        /// </summary>
-        RefType paramType;
-
-        /// <summary>
-        /// 戻り値型
-        /// </summary>
-        RefType returnType;
-    };
+    /// <param name="other">和集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator|=(const TypeClassSet& other) {
+        this->head |= other.head;
+        if (this->overflow.size() < other.overflow.size()) {
+            this->overflow.resize(other.overflow.size(), 0);
+        }
+        for (std::size_t i = 0; i < other.overflow.size(); ++i) {
+            this->overflow[i] |= other.overflow[i];
+        }
+        return *this;
+    }
 
     /// <summary>
-    /// 型変数
+    /// 積集合を取る
     /// </summary>
-    struct Variable {
-        /// <summary>
-        /// 型制約
-        /// </summary>
-        Constraints constraints = {};
-
-        /// <summary>
-        /// 型変数の解決結果の型
-        /// </summary>
-        std::optional<RefType> solve = std::nullopt;
-
-        /// <summary>
-        /// スコープの深さ
-        /// </summary>
-        const std::size_t depth = 1;
-    };
+    /// <param name="other">積集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator&=(const TypeClassSet& other) {
+        this->head &= other.head;
+        if (this->overflow.size() > other.overflow.size()) {
+            this->overflow.resize(other.overflow.size());
+        }
+        for (std::size_t i = 0; i < this->overflow.size(); ++i) {
+            this->overflow[i] &= other.overflow[i];
+        }
+        return *this;
+    }
 
     /// <summary>
-    /// ジェネリック型に出現する型変数
+    /// 通し番号を除去する
     /// </summary>
-    struct Param {
-        /// <summary>
-        /// 型制約
-        /// </summary>
-        Constraints constraints = {};
-
-        /// <summary>
-        /// ジェネリック型の型変数のインデックス
-        /// </summary>
-        const std::size_t index = 0;
-    };
+    /// <param name="id">除去する通し番号</param>
+    void erase(std::size_t id) {
+        if (id < INLINE_BITS) {
+            this->head &= ~(std::uint64_t(1) << id);
+            return;
+        }
+        auto word = id / INLINE_BITS - 1;
+        if (word < this->overflow.size()) {
+            this->overflow[word] &= ~(std::uint64_t(1) << (id % INLINE_BITS));
+        }
+    }
 
     /// <summary>
-    /// <para>型としての型クラス</para>
-    /// <para>振る舞いとしては限定的にサブタイピングを許容した参照型</para>
+    /// 差集合を取る
     /// </summary>
-    struct TypeClass {
-        /// <summary>
-        /// 型として扱う型クラス
-        /// </summary>
-        Constraints typeClasses = {};
-
-        /// <summary>
-        /// 参照先の値型についてのリージョン
-        /// </summary>
-        RefRegion region;
-    };
+    /// <param name="other">差集合を取る対象の集合</param>
+    /// <returns>this</returns>
+    TypeClassSet& operator-=(const TypeClassSet& other) {
+        this->head &= ~other.head;
+        for (std::size_t i = 0; i < std::min(this->overflow.size(), other.overflow.size()); ++i) {
+            this->overflow[i] &= ~other.overflow[i];
+        }
+        return *this;
+    }
 
     /// <summary>
-    /// <para>参照型</para>
-    /// <para>線型論理における指数的結合子に相当する</para>
+    /// otherを部分集合として含むか判定
     /// </summary>
-    struct Ref {
-        /// <summary>
-        /// 基底型としての意味を示す型
-        /// </summary>
-        RefType base;
-
-        /// <summary>
-        /// 参照先の型
-        /// </summary>
-        RefType type;
-
-        /// <summary>
-        /// 参照先の値型についてのリージョン
-        /// </summary>
-        RefRegion region;
-    };
-
-    // 本来はこの他にタプルやリスト、エイリアスなどの組み込み機能を定義する
-
+    /// <param name="other">判定する集合</param>
+    /// <returns>含む場合はtrue、含まない場合はfalse</returns>
+    [[nodiscard]] bool includes(const TypeClassSet& other) const {
+        if ((other.head & ~this->head) != 0) {
+            return false;
+        }
+        for (std::size_t i = 0; i < other.overflow.size(); ++i) {
+            auto word = i < this->overflow.size() ? this->overflow[i] : 0;
+            if ((other.overflow[i] & ~word) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
 
     /// <summary>
-    /// 型の固有情報を示す型
+    /// 空集合であるか判定
     /// </summary>
-    using kind_type = std::variant<Base, Function, Variable, Param, TypeClass, Ref>;
+    /// <returns>空集合の場合はtrue、それ以外の場合はfalse</returns>
+    [[nodiscard]] bool empty() const {
+        return this->head == 0 && std::ranges::all_of(this->overflow, [](auto word) { return word == 0; });
+    }
 
     /// <summary>
-    /// 型の固有情報
+    /// 要素数を取得する
     /// </summary>
-    kind_type kind;
+    /// <returns>要素数</returns>
+    [[nodiscard]] std::size_t size() const {
+        std::size_t size = std::popcount(this->head);
+        for (auto word : this->overflow) {
+            size += std::popcount(word);
+        }
+        return size;
+    }
 
     /// <summary>
-    /// 型名の取得
+    /// 通し番号の昇順に要素を走査する
     /// </summary>
-    /// <returns>トップレベルで型が一意な場合にのみ型名を返す</returns>
-    [[nodiscard]] std::optional<const std::string*> getTypeName() const {
-        if (std::holds_alternative<Type::Base>(this->kind)) {
-            return std::addressof(std::get<Type::Base>(this->kind).name);
-        }
-        else if (std::holds_alternative<Type::Function>(this->kind)) {
-            return std::get<Type::Function>(this->kind).base->getTypeName();
+    /// <param name="f">各通し番号に対して呼び出す関数</param>
+    template <class F>
+    void forEach(F&& f) const {
+        for (auto word = this->head; word != 0; word &= word - 1) {
+            f(static_cast<std::size_t>(std::countr_zero(word)));
         }
-        else if (std::holds_alternative<Type::Ref>(this->kind)) {
-            return std::get<Type::Ref>(this->kind).base->getTypeName();
+        for (std::size_t i = 0; i < this->overflow.size(); ++i) {
+            for (auto word = this->overflow[i]; word != 0; word &= word - 1) {
+                f((i + 1) * INLINE_BITS + std::countr_zero(word));
+            }
         }
-        return std::nullopt;
     }
 
     /// <summary>
-    /// 型に紐づく型クラスのリストの取得
+    /// 集合が等しいか判定
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <returns>型に紐づく型クラスのリスト</returns>
-    [[nodiscard]] const Constraints& getTypeClassList(TypeMap& typeMap) const;
+    /// <param name="other">比較対象の集合</param>
+    /// <returns>等しい場合はtrue、等しくない場合はfalse</returns>
+    [[nodiscard]] bool operator==(const TypeClassSet& other) const {
+        return this->includes(other) && other.includes(*this);
+    }
 };
 
 /// <summary>
-/// ジェネリック型
+/// TypeClassSetのハッシュ関数
 /// </summary>
-struct Generic {
+template<>
+struct std::hash<TypeClassSet> {
+    [[nodiscard]] std::size_t operator()(const TypeClassSet& set) const noexcept {
+        std::size_t seed = std::hash<std::uint64_t>{}(set.head);
+        // 末尾の0のワードの有無によらず等しい集合が同じハッシュ値となるように0のワードは読み飛ばす
+        for (std::size_t i = 0; i < set.overflow.size(); ++i) {
+            if (set.overflow[i] != 0) {
+                seed ^= std::hash<std::uint64_t>{}(set.overflow[i] ^ i) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            }
+        }
+        return seed;
+    }
+};
+
+/// <summary>
+/// <para>型クラスの通し番号と型クラスの対応表</para>
+/// <para>型クラスの通し番号は全ての型表で共通とするため1つのインスタンスのみ持つ</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し型クラスの取得はロックなしで行う</para>
+/// </summary>
+struct TypeClassTable {
     /// <summary>
-    /// 型変数のリスト
+    /// <para>登録済みの型クラスのリスト</para>
+    /// <para>型クラスの通し番号をインデックスとする</para>
     /// </summary>
-    std::vector<RefType> vals;
+    AppendOnlyList<RefTypeClass> typeClasses = {};
 
     /// <summary>
-    /// リージョン型における型変数のリスト
+    /// 登録の排他制御
     /// </summary>
-    std::vector<RefRegion> regionVals;
+    std::mutex mutex = {};
 
     /// <summary>
-    /// 型変数valsおよびregionValsを内部で持つ型
+    /// <para>型クラスを登録して通し番号を採番する</para>
+    /// <para>採番した通し番号は型クラスへ記録し、基底の通し番号の集合に自身を加える</para>
     /// </summary>
-    RefType type;
-};
+    /// <param name="typeClass">登録する型クラス</param>
+    /// <param name="ancestors">基底の通し番号の集合</param>
+    void add(const RefTypeClass& typeClass, TypeClassSet ancestors);
 
-/// <summary>
-/// 解決済みの型を取得する
-/// </summary>
-/// <param name="type">チェックを行う型</param>
-/// <returns>解決済みの型</returns>
-RefType solved(RefType type) {
-    if (std::holds_alternative<Type::Variable>(type->kind)) {
-        auto& val = std::get<Type::Variable>(type->kind);
-        if (val.solve) {
-            // 解決結果が再適用されないように適用しておく
-            return val.solve.emplace(solved(val.solve.value()));
-        }
+    /// <summary>
+    /// 対応表のインスタンスを取得する
+    /// </summary>
+    /// <returns>対応表</returns>
+    static TypeClassTable& instance() {
+        static TypeClassTable table;
+        return table;
     }
-    return type;
-}
+};
 
 /// <summary>
-/// 型から参照型を除去した解決済みの型を取得する
+/// 型クラスの集合としての型制約
 /// </summary>
-/// <param name="type">参照型を除去する対象の型</param>
-/// <returns>参照型を除去した結果の型</returns>
-RefType unwrapRef(RefType type) {
-    auto t = solved(type);
-    while (std::holds_alternative<Type::Ref>(t->kind)) {
-        auto& t2 = std::get<Type::Ref>(t->kind).type;
-        t2 = solved(t2);
-        t = t2;
-    }
-    return t;
-}
-
-/// <summary>
-/// 解決済みの型を取得する
-/// </summary>
-/// <param name="type">チェックを行う型</param>
-/// <returns>解決済みの型</returns>
-RefRegion solved(RefRegion type) {
-    if (std::holds_alternative<Region::Variable>(type->kind)) {
-        auto& val = std::get<Region::Variable>(type->kind);
-        if (val.solve) {
-            // 解決結果が再適用されないように適用しておく
-            return val.solve.emplace(solved(val.solve.value()));
-        }
-    }
-    return type;
-}
-
-/// <summary>
-/// 型環境で管理するコンテキスト情報付きの型情報
-/// </summary>
-struct TypeInfo {
-    /// <summary>
-    /// 型情報本体
-    /// </summary>
-    std::variant<RefType, Generic> type;
+struct Constraints {
+    /// <summary>
+    /// <para>実装対象の型クラスの通し番号の集合</para>
+    /// <para>継承関係にある型クラス同士は最も派生した型クラスのみに縮約して保持する</para>
+    /// </summary>
+    TypeClassSet set = {};
 
     /// <summary>
-    /// 識別子が定義されるリージョン
+    /// <para>setの型クラスが継承している型クラス(自身を含む)の通し番号の集合</para>
+    /// <para>制約を持つかの検査に用いる</para>
     /// </summary>
-    RefRegion region;
-};
+    TypeClassSet closure = {};
 
-/// <summary>
-/// 型環境で管理するコンテキスト情報付きの型情報への参照
-/// </summary>
-using RefTypeInfo = std::shared_ptr<TypeInfo>;
+    Constraints() = default;
+    Constraints(std::initializer_list<RefTypeClass> typeClasses);
 
-/// <summary>
-/// 型環境
-/// </summary>
-struct TypeEnvironment {
     /// <summary>
-    /// スコープにおいて1つ上の型環境
+    /// 型制約を追加する
     /// </summary>
-    TypeEnvironment* parent = nullptr;
+    /// <param name="typeClass">追加する型クラス(登録済みである必要がある)</param>
+    void insert(const RefTypeClass& typeClass);
 
     /// <summary>
-    /// スコープの深さ
+    /// <para>型制約をマージする</para>
+    /// <para>型クラスの継承関係により縮約を適用しながらマージを行う</para>
     /// </summary>
-    std::size_t depth = 1;
+    /// <param name="constraints">マージ対象の型クラス</param>
+    void merge(const Constraints& constraints);
 
     /// <summary>
-    /// 型環境についての識別子と型のペアの表
+    /// 制約を持つか検査
     /// </summary>
-    std::unordered_map<std::string, RefTypeInfo> map = {};
+    /// <param name="typeClass">制約を持つか検査する型クラス</param>
+    [[nodiscard]] bool has(const RefTypeClass& typeClass) const;
 
     /// <summary>
-    /// 識別子の名称から型を取り出す
+    /// 全ての制約を持つか検査
     /// </summary>
-    /// <param name="name">識別子の名称</param>
-    /// <returns>nameに対応する型</returns>
-    [[nodiscard]] std::optional<RefTypeInfo> lookup(const std::string& name) {
-        if (auto itr = this->map.find(name); itr != this->map.end()) {
-            return itr->second;
-        }
-        else if (this->depth != 0 && this->parent) {
-            // 見つからないかつ1つ上の型環境が存在するならそこから取得
-            return this->parent->lookup(name);
-        }
-        return std::nullopt;
+    /// <param name="constraints">制約を持つか検査する型制約</param>
+    [[nodiscard]] bool includes(const Constraints& constraints) const {
+        return this->closure.includes(constraints.set);
     }
 
     /// <summary>
-    /// 型の生成
+    /// 型制約が空であるか判定
     /// </summary>
-    /// <param name="kind">型の固有情報</param>
-    /// <returns>生成した型</returns>
-    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
-        return RefType(new Type({ .kind = std::move(kind) }));
+    [[nodiscard]] bool empty() const {
+        return this->set.empty();
     }
 
     /// <summary>
-    /// コンテキスト情報付きの型の生成
+    /// 縮約された型クラスの個数を取得する
     /// </summary>
-    /// <param name="type">型情報</param>
-    /// <param name="region">型情報が属するリージョン</param>
-    /// <returns>生成した型</returns>
-    [[nodiscard]] RefTypeInfo newTypeInfo(RefType type, RefRegion region) {
-        return RefTypeInfo(new TypeInfo({ .type = type, .region = region }));
+    [[nodiscard]] std::size_t size() const {
+        return this->set.size();
     }
 
     /// <summary>
-    /// コンテキスト情報付きの型の生成
+    /// 縮約された型クラスが一致するか判定
     /// </summary>
-    /// <param name="type">型情報</param>
-    /// <param name="region">型情報が属するリージョン</param>
-    /// <returns>生成した型</returns>
-    [[nodiscard]] RefTypeInfo newTypeInfo(Generic&& type, RefRegion region) {
-        return RefTypeInfo(new TypeInfo({ .type = std::move(type), .region = region }));
+    /// <param name="other">比較対象の型制約</param>
+    [[nodiscard]] bool operator==(const Constraints& other) const {
+        return this->set == other.set;
     }
 
     /// <summary>
-    /// リージョン型の生成
+    /// 縮約された型クラスを通し番号の昇順に走査する
     /// </summary>
-    /// <param name="kind">型の固有情報</param>
-    /// <returns>生成したリージョン型</returns>
-    [[nodiscard]] RefRegion newRegion(Region::kind_type&& kind) {
-        return RefRegion(new Region({ .kind = std::move(kind) }));
+    /// <param name="f">各型クラスに対して呼び出す関数</param>
+    template <class F>
+    void forEach(F&& f) const {
+        auto& table = TypeClassTable::instance();
+        this->set.forEach([&](std::size_t id) { f(table.typeClasses[id]); });
     }
 
+private:
     /// <summary>
-    /// 自由な型変数について型をgeneralizeする
+    /// 他の型クラスの基底となっている型クラスをsetから除去する
     /// </summary>
-    /// <param name="type">複製対象の型</param>
-    /// <param name="env">型環境</param>
-    /// <param name="vals">generalize対象の型変数のリスト</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type, std::vector<RefType> vals = std::vector<RefType>());
+    void reduce();
+};
 
+/// <summary>
+/// <para>型制約の共有表</para>
+/// <para>縮約された型クラスの集合が等しい型制約は1つの実体を共有し、型には識別番号のみを持たせる</para>
+/// <para>複数の型推論のセッションから並行して利用するため、登録は排他し型制約の取得と登録済みの型制約の検索はロックなしで行う</para>
+/// </summary>
+struct ConstraintsTable {
     /// <summary>
-    /// ジェネリック型の型変数についてinstantiateする
+    /// <para>縮約された型クラスの集合から識別番号への索引(開番地法のハッシュ表)</para>
+    /// <para>スロットは識別番号 + 1を保持し(0は空き)、登録済みのスロットは書き換えない</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="type">複製対象の型</param>
-    /// <param name="vals">型変数へ適用対象の型</param>
-    /// <returns>複製結果</returns>
-    [[nodiscard]] RefType instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals = std::vector<RefType>());
+    struct Index {
+        /// <summary>
+        /// スロットの列(要素数は2の冪)
+        /// </summary>
+        std::unique_ptr<std::atomic<std::uint32_t>[]> slots;
+
+        /// <summary>
+        /// スロットの数から1を引いたもの
+        /// </summary>
+        std::size_t mask;
+
+        explicit Index(std::size_t capacity) : slots(new std::atomic<std::uint32_t>[capacity]()), mask(capacity - 1) {}
+    };
 
     /// <summary>
-    /// <para>regionが型環境に含まれるかを判定する</para>
-    /// <para>実装の詳細はconvertを参照</para>
+    /// <para>識別番号から型制約への表(識別番号0は空の型制約)</para>
+    /// <para>要素への参照を返すため要素のアドレスが移動しないAppendOnlyListで保持する</para>
     /// </summary>
-    /// <param name="region">判定対象のリージョン</param>
-    /// <returns>含まれている場合はtrue, 含まれていない場合はfalse</returns>
-    [[nodiscard]] bool include(RefRegion& region) {
-        region = solved(region);
- 
-        if (std::holds_alternative<Region::Temporary>(region->kind)) {
-            return true;
-        }
-        if (std::holds_alternative<Region::Base>(region->kind)) {
-            // regionがthisのスコープに含まれているかを見る
-            auto r1env = std::get<Region::Base>(region->kind).env;
-            auto r2env = this;
-            if (r1env->depth > r2env->depth) {
-                return false;
-            }
-            else {
-                // region2をregion1と同一階層に移動したときに型環境が一致するかを比較する
-                while (r1env->depth != r2env->depth) {
-                    r2env = r2env->parent;
-                }
-                return r1env == r2env;
-            }
-        }
-        else {
-            return false;
-        }
-    }
-};
+    AppendOnlyList<Constraints> values = {};
 
-/// <summary>
-/// 自由な型変数について型をgeneralizeする
-/// </summary>
-/// <param name="type">複製対象の型</param>
-/// <param name="env">型環境</param>
-/// <param name="vals">generalize対象の型変数のリスト</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type, std::vector<RefType> vals) {
-    std::vector<RefRegion> regionVals;
+    /// <summary>
+    /// <para>検索に用いる最新の索引</para>
+    /// <para>拡張時は新たな索引を構築してから差し替えるため、検索中の索引は書き換わらない</para>
+    /// </summary>
+    std::atomic<Index*> index = nullptr;
 
-    struct fn {
-        RefType& t;
-        TypeEnvironment& e;
-        std::vector<RefType>& v;
-        std::vector<RefRegion>& rv;
+    /// <summary>
+    /// <para>構築した索引</para>
+    /// <para>差し替え前の索引を検索中のスレッドがありうるため共有表の破棄まで保持する</para>
+    /// </summary>
+    std::vector<std::unique_ptr<Index>> indexes = {};
 
-        /// <summary>
-        /// 自由なリージョン型の型変数について型をgeneralizeする
-        /// </summary>
-        /// <param name="type">複製対象の型</param>
-        void generalizeRegion(RefRegion& region) {
-            if (std::holds_alternative<Region::Variable>(region->kind)) {
-                // リージョン型に解決済みの別のリージョンが存在するならば解決しておく
-                auto& var = std::get<Region::Variable>(region->kind);
-                if (var.solve) {
-                    region = solved(var.solve.value());
-                }
+    /// <summary>
+    /// 登録の排他制御
+    /// </summary>
+    std::mutex mutex = {};
 
-                // リージョン型の型変数をgeneralizeするか検査
-                if (std::holds_alternative<Region::Variable>(region->kind)) {
-                    auto& var2 = std::get<Region::Variable>(region->kind);
-
-                    if (this->e.depth < var2.depth) {
-                        // 自由な型変数のためgeneralizeする
-                        // 一度generalize済みならばx.solveに解決結果が記録されるため、ここにはgeneralize未の場合のみしか到達しない
-                        auto p = this->e.newRegion(Region::Param{ .index = this->rv.size() });
-                        var2.solve = p;
-                        region = p;
-                        this->rv.push_back(p);
-                    }
-                }
-            }
-        }
+    ConstraintsTable() {
+        std::lock_guard lock(this->mutex);
+        this->insert(Constraints{});
+    }
 
-        RefType operator()([[maybe_unused]] Type::Base& x) {
-            // generalizeしない
-            return this->t;
+    /// <summary>
+    /// 型制約を登録して識別番号を取得する
+    /// </summary>
+    /// <param name="constraints">登録する型制約</param>
+    /// <returns>型制約の識別番号</returns>
+    [[nodiscard]] std::uint32_t intern(const Constraints& constraints) {
+        auto hash = std::hash<TypeClassSet>{}(constraints.set);
+        // 登録済みの型制約はロックせずに取得する
+        if (auto id = this->find(constraints.set, hash)) {
+            return id.value();
         }
-        RefType operator()(Type::Function& x) {
-            // 引数型と戻り値型をgeneralizeする
-            auto genParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .rv = this->rv }, x.paramType->kind);
-            if (x.paramType != genParamType) {
-                x.paramType = genParamType;
-            }
-            auto genReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .rv = this->rv }, x.returnType->kind);
-            if (x.returnType != genReturnType) {
-                x.returnType = genReturnType;
-            }
-            return this->t;
+        std::lock_guard lock(this->mutex);
+        if (auto id = this->find(constraints.set, hash)) {
+            return id.value();
         }
-        RefType operator()(Type::Variable& x) {
-            if (x.solve) {
-                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
-                // この際にGeneric型から完全に型変数を除去するために簡約
-                this->t = solved(x.solve.value());
-                return std::visit(fn{ .t = this->t, .e = this->e, .v = this->v, .rv = this->rv }, this->t->kind);
-            }
+        return this->insert(constraints);
+    }
 
-            if (this->e.depth < x.depth) {
-                // 自由な型変数のためgeneralizeする
-                // 一度generalize済みならばx.solveに解決結果が記録されるため、ここにはgeneralize未の場合のみしか到達しない
-                // 導出した型変数に対する型制約は継承する
-                auto p = this->e.newType(Type::Param{ .constraints = std::move(x.constraints), .index = this->v.size() });
-                x.solve = p;
-                this->v.push_back(p);
-                return p;
+    /// <summary>
+    /// 登録済みの型制約を検索する
+    /// </summary>
+    /// <param name="set">縮約された型クラスの集合</param>
+    /// <param name="hash">setのハッシュ値</param>
+    /// <returns>型制約の識別番号(未登録の場合はstd::nullopt)</returns>
+    [[nodiscard]] std::optional<std::uint32_t> find(const TypeClassSet& set, std::size_t hash) const {
+        auto index = this->index.load(std::memory_order_acquire);
+        if (!index) {
+            return std::nullopt;
+        }
+        for (auto i = ConstraintsTable::spread(hash) & index->mask; ; i = (i + 1) & index->mask) {
+            auto slot = index->slots[i].load(std::memory_order_acquire);
+            if (slot == 0) {
+                return std::nullopt;
             }
-            else {
-                // 束縛された型変数のためgeneralizeしない
-                return this->t;
+            if (this->values[slot - 1].set == set) {
+                return slot - 1;
             }
         }
-        RefType operator()([[maybe_unused]] Type::Param& x) {
-            // 外のスコープから与えられた型変数もしくはgeneralize済みの型変数のためgeneralizeしない
-            return this->t;
-        }
-        RefType operator()([[maybe_unused]] Type::TypeClass& x) {
-            // リージョン型に対してgeneralizeする
-            this->generalizeRegion(x.region);
+    }
 
-            return this->t;
-        }
-        RefType operator()(Type::Ref& x) {
-            // 参照先の型に対してgeneralizeする
-            auto genType = std::visit(fn{ .t = x.type, .e = this->e, .v = this->v, .rv = this->rv }, x.type->kind);
-            if (x.type != genType) {
-                x.type = genType;
+    /// <summary>
+    /// 型制約を登録する(呼び出し側で排他する)
+    /// </summary>
+    /// <param name="constraints">未登録の型制約</param>
+    /// <returns>採番した識別番号</returns>
+    std::uint32_t insert(const Constraints& constraints) {
+        auto id = static_cast<std::uint32_t>(this->values.size());
+        this->values.push_back(constraints);
+
+        // 使用率が1/2を超える場合は2倍の索引を構築して差し替える
+        auto index = this->index.load(std::memory_order_relaxed);
+        if (!index || (static_cast<std::size_t>(id) + 1) * 2 > index->mask + 1) {
+            auto& next = this->indexes.emplace_back(std::make_unique<Index>(index ? (index->mask + 1) * 2 : 64));
+            for (std::uint32_t i = 0; i < id; ++i) {
+                ConstraintsTable::place(*next, i, std::hash<TypeClassSet>{}(this->values[i].set));
             }
-            // リージョン型に対してgeneralizeする
-            this->generalizeRegion(x.region);
-
-            return this->t;
+            index = next.get();
+            this->index.store(index, std::memory_order_release);
         }
-    };
-
-    auto t = std::visit(fn{ .t = type, .e = *this, .v = vals, .rv = regionVals }, type->kind);
-    if (vals.size() > 0 || regionVals.size() > 0) {
-        return Generic{ .vals = std::move(vals), .regionVals = std::move(regionVals), .type = std::move(t)};
-    }
-    else {
-        return t;
+        ConstraintsTable::place(*index, id, std::hash<TypeClassSet>{}(constraints.set));
+        return id;
     }
-}
 
-/// <summary>
-/// <para>型クラス</para>
-/// <para>型クラスごとに一意のインスタンスを持つ</para>
-/// </summary>
-struct TypeClass {
     /// <summary>
-    /// 型クラス名
+    /// <para>ハッシュ値の全てのビットを下位のビットへ拡散させる</para>
+    /// <para>整数のハッシュ関数は恒等関数となりうるため、下位のビットのみで索引を引くと上位のビットのみが異なる集合が衝突する</para>
     /// </summary>
-    const std::string name;
+    /// <param name="hash">ハッシュ値</param>
+    /// <returns>拡散したハッシュ値</returns>
+    [[nodiscard]] static std::size_t spread(std::size_t hash) {
+        std::uint64_t x = hash;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return static_cast<std::size_t>(x);
+    }
 
     /// <summary>
-    /// <para>基底</para>
-    /// <para>基底のtypeはthisのtypeと一致する</para>
+    /// 索引の空きスロットに識別番号を書き込む
     /// </summary>
-    Constraints bases = {};
+    /// <param name="index">書き込み先の索引</param>
+    /// <param name="id">識別番号</param>
+    /// <param name="hash">識別番号に対応する型制約のハッシュ値</param>
+    static void place(Index& index, std::uint32_t id, std::size_t hash) {
+        auto i = ConstraintsTable::spread(hash) & index.mask;
+        while (index.slots[i].load(std::memory_order_relaxed) != 0) {
+            i = (i + 1) & index.mask;
+        }
+        index.slots[i].store(id + 1, std::memory_order_release);
+    }
 
     /// <summary>
-    /// <para>型クラスを実装する対象の型を示す型変数</para>
-    /// <para>制約なしの空なType::Paramである必要がある</para>
+    /// 共有表のインスタンスを取得する
     /// </summary>
-    RefType type;
+    /// <returns>共有表</returns>
+    static ConstraintsTable& instance() {
+        static ConstraintsTable table;
+        return table;
+    }
+};
 
+/// <summary>
+/// <para>共有された型制約への参照</para>
+/// <para>型を小さく保つためにConstraintsTableにおける識別番号のみを保持する</para>
+/// </summary>
+struct RefConstraints {
     /// <summary>
-    /// <para>クラスメソッド</para>
-    /// <para>第一引数はtype(self)固定</para>
+    /// 型制約の識別番号
     /// </summary>
-    std::unordered_map<std::string, std::variant<RefType, Generic>> methods = {};
+    std::uint32_t id = 0;
+
+    RefConstraints() = default;
+    RefConstraints(const Constraints& constraints) : id(ConstraintsTable::instance().intern(constraints)) {}
+    RefConstraints(std::initializer_list<RefTypeClass> typeClasses) : RefConstraints(Constraints(typeClasses)) {}
+
+    [[nodiscard]] const Constraints& operator*() const {
+        return ConstraintsTable::instance().values[this->id];
+    }
+    [[nodiscard]] const Constraints* operator->() const {
+        return std::addressof(**this);
+    }
 
     /// <summary>
-    /// thisが指定された型クラスを継承しているか判定
+    /// <para>型制約をマージする</para>
+    /// <para>共有された型制約は変更せずにマージ結果の型制約を参照するようにする</para>
     /// </summary>
-    /// <param name="typeClass">継承しているか判定する対象の型クラス</param>
-    /// <returns>継承している場合はtrue、継承していない場合はfalse</returns>
-    [[nodiscard]] bool derived(RefTypeClass typeClass) const {
-        // 型クラス/インスタンスの一意性に基づき評価する
-        if (this == typeClass.get()) {
-            return true;
-        }
-        for (const auto& e : this->bases.list) {
-            if (e->derived(typeClass)) {
-                return true;
-            }
+    /// <param name="constraints">マージ対象の型クラス</param>
+    void merge(const Constraints& constraints) {
+        if (constraints.empty() || (*this)->includes(constraints)) {
+            return;
         }
-        return false;
+        auto merged = **this;
+        merged.merge(constraints);
+        *this = merged;
     }
 
     /// <summary>
-    /// インスタンス化されたクラスメソッドを取得する
+    /// 縮約された型クラスが一致するか判定(共有されているため識別番号の比較となる)
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="methodName">クラスメソッド名(存在するかについては呼び出し元で保証する)</param>
-    /// <param name="type">クラスメソッドを呼び出す型</param>
-    /// <returns></returns>
-    [[nodiscard]] RefType getInstantiatedMethod(TypeMap& typeMap, TypeEnvironment& env, const std::string& methodName, RefTypeInfo type);
+    [[nodiscard]] bool operator==(const RefConstraints&) const = default;
 };
 
 /// <summary>
-/// <para>型制約をマージする</para>
-/// <para>型クラスの継承関係により縮約を適用行いながらマージを行うため縮約を行わない場合は直接constraintsを操作する</para>
+/// 型の表現
 /// </summary>
-/// <param name="constraints">マージ対象の型クラス</param>
-void Constraints::merge(const std::vector<RefTypeClass>& constraints) {
-    if (constraints.empty()) {
-        return;
-    }
+struct Type {
 
-    if (this->list.empty()) {
-        // もともと制約がない場合は単純コピーをする
-        this->list = constraints;
-    }
-    else {
-        auto size = this->list.size();
-        // 全ての型制約を検査してより制約が強いものに置き換える
-        for (auto& constraint : constraints) {
-            for (decltype(size) i = 0; i < size; ++i) {
-                // constraintもしくはconstraintの部分型クラスである場合はスキップする
-                if (constraint != this->list[i] || this->list[i]->derived(constraint)) {
-                    continue;
-                }
+    /// <summary>
+    /// 基底型
+    /// </summary>
+    struct Base {
+        /// <summary>
+        /// <para>型名</para>
+        /// <para>型の節点を小さく保つためにシンボルとして保持する</para>
+        /// </summary>
+        const Symbol name;
 
-                if (constraint->derived(this->list[i])) {
-                    if (constraint != this->list[i]) {
-                        this->list[i] = constraint;
-                    }
-                }
-                else {
-                    // 存在しない制約の場合はその制約を追加する
-                    this->list.push_back(constraint);
-                }
-            }
-        }
-    }
-}
+        /// <summary>
+        /// <para>型表に登録された型に関するデータ</para>
+        /// <para>型名による型表の探索を避けるためにTypeMap::freezeで凍結した型表に登録された型についてのみ記録する</para>
+        /// <para>型推論中は複数の型推論から共有されるため書き込まない</para>
+        /// </summary>
+        const TypeData* data = nullptr;
 
-/// <summary>
-/// 制約を持つか検査
-/// </summary>
-/// <param name="typeClass">制約を持つか検査する型クラス</param>
-[[nodiscard]] bool Constraints::has(RefTypeClass typeClass) const {
-    // 全てのtypeが実装している型クラスについて検査する
-    for (const auto& typeClass2 : this->list) {
-        if (typeClass2->derived(typeClass)) {
-            return true;
-        }
-    }
-    return false;
-}
+        /// <summary>
+        /// dataを記録した凍結した型表
+        /// </summary>
+        const TypeMap* owner = nullptr;
+    };
 
-/// <summary>
-/// 指定されたクラスメソッドを抽出する
-/// </summary>
-/// <param name="name">クラスメソッド名</param>
-/// <returns>
-/// <para>指定されたクラスメソッドを実装した型クラスとconstraintsのインデックスのペア</para>
-/// <para>constraintsに存在しないが基底から型クラスを取得した場合はconstraintsのサイズがインデックスとなる</para>
-/// </returns>
-[[nodiscard]] std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> Constraints::getClassMethod(std::string& name) const {
-    for (decltype(this->list.size()) i = 0; i < this->list.size(); ++i) {
-        // constraints[i]がnameをクラスメソッドとして定義しているか取得
-        auto [typeClass, index] = ([&]() -> std::pair<std::optional<RefTypeClass>, typename std::vector<RefTypeClass>::size_type> {
-            if (auto itr = this->list[i]->methods.find(name); itr != this->list[i]->methods.end()) {
-                return { this->list[i], i };
-            }
-            else {
-                // 基底に存在するかを探索
-                return { this->list[i]->bases.getClassMethod(name).first, this->list.size() };
-            }
-        })();
+    /// <summary>
+    /// 関数型
+    /// </summary>
+    struct Function {
+        /// <summary>
+        /// 基底型としての意味を示す型
+        /// </summary>
+        RefType base;
 
-        if (typeClass) {
-            // 1つ目のnameという名称のクラスメソッドが見つかった場合は2つ目以降が存在するか確認する
-            for (decltype(this->list.size()) j = i + 1; j < this->list.size(); ++j) {
-                // nameというクラスメソッドを定義している型クラスが存在する場合は返却するインデックスを更新する
-                if (typeClass.value() == this->list[j]) {
-                    index = j;
-                    continue;
-                }
+        /// <summary>
+        /// 引数型
+        /// </summary>
+        RefType paramType;
 
-                // nameというクラスメソッドを定義している型クラスの基底はnameというクラスメソッドを定義していても無視する
-                // 要は基底よりも派生の方をクラスメソッドの探索対象として優先する
-                if (!typeClass.value()->derived(this->list[j]) && this->list[j]->methods.contains(name)) {
-                    if (this->list[j]->derived(typeClass.value())) {
-                        return { this->list[j], j };
-                    }
-                    throw std::runtime_error(std::format("クラスメソッドが一意に特定できない：{}", name));
-                }
-            }
-            return { typeClass, index };
-        }
-    }
-    return { std::nullopt, this->list.size() };
-}
+        /// <summary>
+        /// 戻り値型
+        /// </summary>
+        RefType returnType;
+    };
 
-/// <summary>
-/// 型に関するデータ
-/// </summary>
-struct TypeData {
     /// <summary>
-    /// 型の表現
+    /// 型変数
     /// </summary>
-    std::variant<RefType, Generic> type;
+    struct Variable {
+        /// <summary>
+        /// 型制約
+        /// </summary>
+        RefConstraints constraints = {};
 
-    /// <summary>
-    /// 実装している型クラス(制約)
-    /// </summary>
-    Constraints typeclasses = {};
-};
+        /// <summary>
+        /// <para>型変数の解決結果の型</para>
+        /// <para>未解決の場合はnullptr</para>
+        /// </summary>
+        RefType solve = nullptr;
+
+        /// <summary>
+        /// <para>スコープの深さ</para>
+        /// <para>代表元の場合は併合された型変数のうち最も浅いスコープの深さを保持する</para>
+        /// </summary>
+        std::size_t depth = 1;
+
+        /// <summary>
+        /// 型変数同士の併合における木の高さの上界(ランク)
+        /// </summary>
+        std::size_t rank = 0;
+    };
 
-/// <summary>
-/// 型表
-/// </summary>
-struct TypeMap {
     /// <summary>
-    /// 型の表
+    /// ジェネリック型に出現する型変数
     /// </summary>
-    std::unordered_map<std::string, TypeData> typeMap = {};
+    struct Param {
+        /// <summary>
+        /// 型制約
+        /// </summary>
+        RefConstraints constraints = {};
+
+        /// <summary>
+        /// ジェネリック型の型変数のインデックス
+        /// </summary>
+        const std::size_t index = 0;
+    };
 
     /// <summary>
-    /// 型クラスの表
+    /// <para>型としての型クラス</para>
+    /// <para>振る舞いとしては限定的にサブタイピングを許容した参照型</para>
     /// </summary>
-    std::unordered_map<std::string, RefTypeClass> typeClassMap = {};
+    struct TypeClass {
+        /// <summary>
+        /// 型として扱う型クラス
+        /// </summary>
+        RefConstraints typeClasses = {};
+
+        /// <summary>
+        /// 参照先の値型についてのリージョン
+        /// </summary>
+        RefRegion region;
+    };
 
     /// <summary>
-    /// <para>組込み型の定義</para>
-    /// <para>型の生成時は必ずこれを経由する</para>
+    /// <para>参照型</para>
+    /// <para>線型論理における指数的結合子に相当する</para>
     /// </summary>
-    struct {
+    struct Ref {
         /// <summary>
-        /// 関数型
+        /// 基底型としての意味を示す型
         /// </summary>
-        Generic fn;
+        RefType base;
+
         /// <summary>
-        /// 参照型
+        /// 参照先の型
         /// </summary>
-        Generic ref;
-    } builtin;
+        RefType type;
+
+        /// <summary>
+        /// 参照先の値型についてのリージョン
+        /// </summary>
+        RefRegion region;
+    };
+
+    // 本来はこの他にタプルやリスト、エイリアスなどの組み込み機能を定義する
+
 
     /// <summary>
-    /// 型定義の追加
+    /// 型の固有情報を示す型
     /// </summary>
-    /// <param name="type">追加する型</param>
-    /// <returns>追加した型</returns>
-    auto& addType(RefType type) {
-        // 型から型名を取り出して登録する
-        auto typeName = type->getTypeName();
-        assert(!!typeName);
-        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type }});
-        if (!ret) {
-            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
-        }
-        return *itr;
-    }
+    using kind_type = std::variant<Base, Function, Variable, Param, TypeClass, Ref>;
 
     /// <summary>
-    /// 型定義の追加
+    /// 型の固有情報
     /// </summary>
-    /// <param name="type">追加する型</param>
-    /// <returns>追加した型</returns>
-    auto& addType(const Generic& type) {
-        // 型から型名を取り出して登録する
-        auto typeName = type.type->getTypeName();
-        assert(!!typeName);
-        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type } });
-        if (!ret) {
-            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
-        }
-        return *itr;
-    }
+    kind_type kind;
 
     /// <summary>
-    /// 型クラスの定義の追加
+    /// 型名の取得
     /// </summary>
-    /// <param name="typeClass">追加する型クラス</param>
-    /// <returns>追加した型クラス</returns>
-    auto& addTypeClass(RefTypeClass typeClass) {
-        auto [itr, ret] = this->typeClassMap.insert({ typeClass->name, typeClass });
-        if (!ret) {
-            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
+    /// <returns>トップレベルで型が一意な場合にのみ型名を返す</returns>
+    [[nodiscard]] std::optional<const std::string*> getTypeName() const {
+        if (std::holds_alternative<Type::Base>(this->kind)) {
+            return std::addressof(std::get<Type::Base>(this->kind).name.name());
         }
-        return *itr;
+        else if (std::holds_alternative<Type::Function>(this->kind)) {
+            return std::get<Type::Function>(this->kind).base->getTypeName();
+        }
+        else if (std::holds_alternative<Type::Ref>(this->kind)) {
+            return std::get<Type::Ref>(this->kind).base->getTypeName();
+        }
+        return std::nullopt;
     }
 
     /// <summary>
-    /// 型に制約としての型クラスを適用する
+    /// 型に紐づく型クラスのリストの取得
     /// </summary>
-    /// <param name="type">適用対象の型</param>
-    /// <param name="typeClass">適用対象の型クラス</param>
-    void applyConstraint(RefType type, const std::vector<RefTypeClass>& typeClasses) {
-
-        // 解決済みの型変数および参照型が存在すればそれを解消してから制約の適用を行う
-        auto t = unwrapRef(type);
+    /// <param name="typeMap">型表</param>
+    /// <returns>型に紐づく型クラスのリスト</returns>
+    [[nodiscard]] const Constraints& getTypeClassList(TypeMap& typeMap) const;
 
-        if (std::holds_alternative<Type::Variable>(t->kind)) {
-            // 通常の型変数に対しては後からでも自由に型制約を追加可能
+    /// <summary>
+    /// 明示的に型名を持つ型について型表に登録された型に関するデータを取得する
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <returns>型に関するデータ</returns>
+    [[nodiscard]] const TypeData& getTypeData(const TypeMap& typeMap) const;
 
-            // 型制約にtypeClassesを追加
-            std::get<Type::Variable>(t->kind).constraints.merge(typeClasses);
+    /// <summary>
+    /// 関数型などについて基底型としての意味を示す型を取得する
+    /// </summary>
+    /// <param name="type">取得対象の型(明示的に型名を持つ型)</param>
+    /// <returns>基底型</returns>
+    template <class T>
+    [[nodiscard]] static T* getBaseType(T* type) {
+        if (std::holds_alternative<Type::Function>(type->kind)) {
+            type = std::get<Type::Function>(type->kind).base;
         }
-        else {
-            // トップレベルが型変数ではない通常の型の場合は後から型制約の追加は禁止
-            // 型がtypeClassesを実装しているか検査する
-
-            auto& constraints = t->getTypeClassList(*this);
-
-            for (auto& typeClass : typeClasses) {
-                // typeがtypeClassを実装しているか検査する
-                // 実装していない型クラスが見つかった場合は異常とする
-                if (!constraints.has(typeClass)) {
-                    // typeClassMapから型クラス名の逆引きを試みる
-                    if (auto itr = std::ranges::find_if(this->typeClassMap, [&typeClass](auto& p) { return p.second == typeClass; }); itr != this->typeClassMap.end()) {
-                        if (std::holds_alternative<Type::Param>(t->kind)) {
-                            throw std::runtime_error(std::format("ジェネリック型における型変数は事前に制約{}の宣言が必要", itr->first));
-                        }
-                        throw std::runtime_error(std::format("型クラス{}を実装していない", itr->first));
-                    }
-                    else {
-                        // 匿名の型クラス（未実装）を制約として課そうとしたときの異常のため
-                        // ここに到達することは論理エラーとする
-                        assert(false);
-                    }
-                }
-            }
+        else if (std::holds_alternative<Type::Ref>(type->kind)) {
+            type = std::get<Type::Ref>(type->kind).base;
         }
+        assert(std::holds_alternative<Type::Base>(type->kind));
+        return type;
     }
 };
 
+struct Generic;
+
 /// <summary>
-/// 型に紐づく型クラスのリストの取得
+/// <para>ジェネリック型のinstantiateの雛形</para>
+/// <para>型変数を含む部分型(骨格)のみを後行順に並べたもので、型変数を含まない部分型はinstantiate結果で共有する</para>
 /// </summary>
-/// <param name="typeMap">型表</param>
-/// <returns>型に紐づく型クラスのリスト</returns>
-const Constraints& Type::getTypeClassList(TypeMap& typeMap) const {
-    // 型変数の場合は型制約としての型クラスのリストを返す
-    if (std::holds_alternative<Type::Variable>(this->kind)) {
-        return std::get<Type::Variable>(this->kind).constraints;
-    }
-    else if (std::holds_alternative<Type::Param>(this->kind)) {
-        return std::get<Type::Param>(this->kind).constraints;
-    }
-    else if (std::holds_alternative<Type::TypeClass>(this->kind)) {
-        // 型としての型クラスはそのまま保持している型クラスのリストを返す
-        return std::get<Type::TypeClass>(this->kind).typeClasses;
-    }
-    else if (std::holds_alternative<Type::Ref>(this->kind)) {
-        // 参照型の場合は参照型を解除してから型クラスのリストを取得する
-        // Type::Variableの場合の動作に合わせるためにsolvedは適用しない
-        return std::get<Type::Ref>(this->kind).type->getTypeClassList(typeMap);
-    }
+struct GenericTemplate {
+    /// <summary>
+    /// 雛形における部分型の参照
+    /// </summary>
+    struct Operand {
+        /// <summary>
+        /// 参照先の種類
+        /// </summary>
+        enum struct Kind {
+            /// <summary>
+            /// 型変数を含まないため共有する型
+            /// </summary>
+            SHARED,
+            /// <summary>
+            /// ジェネリック型の型変数のインデックス
+            /// </summary>
+            VAL,
+            /// <summary>
+            /// 骨格の節点のインデックス
+            /// </summary>
+            NODE
+        } kind = Kind::SHARED;
 
-    // それ以外の型(明示的に型名を持つ型)は型表にアクセスして取得する
-    auto name = this->getTypeName();
-    assert(!!name);
-    assert(typeMap.typeMap.contains(*name.value()));
+        /// <summary>
+        /// kindがSHAREDの場合の共有する型
+        /// </summary>
+        RefType type = nullptr;
 
-    return typeMap.typeMap.at(*name.value()).typeclasses;
-}
+        /// <summary>
+        /// kindがVALまたはNODEの場合のインデックス
+        /// </summary>
+        std::size_t index = 0;
+    };
 
-/// <summary>
-/// ジェネリック型の型変数についてinstantiateする
-/// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="type">複製対象の型</param>
-/// <param name="vals">型変数へ適用対象の型</param>
-/// <returns>複製結果</returns>
-[[nodiscard]] RefType TypeEnvironment::instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals) {
-    // instantiateした対象の型変数のリスト
-    vals.resize(type.vals.size());
-    std::vector<RefRegion> regionVals;
-    regionVals.reserve(type.regionVals.size());
+    /// <summary>
+    /// 雛形におけるリージョン型の参照
+    /// </summary>
+    struct RegionOperand {
+        /// <summary>
+        /// 参照先の種類(SHAREDまたはVAL)
+        /// </summary>
+        Operand::Kind kind = Operand::Kind::SHARED;
 
-    // デフォルトでvalsが要素をもつときは型制約を適用・検査する
-    for (decltype(type.vals.size()) i = 0; i < type.vals.size(); ++i) {
-        auto& param = std::get<Type::Param>(type.vals[i]->kind);
-        if (!vals[i]) {
-            // 型が割当たっていない場合は型変数を割り当てる
-            // 型変数に課された制約を継承する
-            vals[i] = this->newType(Type::Variable{ .constraints = param.constraints, .depth = this->depth });
-        }
-        else {
-            typeMap.applyConstraint(vals[i], param.constraints.list);
-        }
-    }
-    for (decltype(type.regionVals.size()) i = 0; i < type.regionVals.size(); ++i) {
-        regionVals.push_back(this->newRegion(Region::Variable{ .depth = this->depth }));
-    }
+        /// <summary>
+        /// kindがSHAREDの場合の共有するリージョン型
+        /// </summary>
+        RefRegion region = nullptr;
+
+        /// <summary>
+        /// kindがVALの場合のリージョン型の型変数のインデックス
+        /// </summary>
+        std::size_t index = 0;
+    };
+
+    /// <summary>
+    /// 骨格の節点(関数型、参照型、型としての型クラスのいずれか)
+    /// </summary>
+    struct Node {
+        /// <summary>
+        /// 複製元の型
+        /// </summary>
+        RefType source;
+
+        /// <summary>
+        /// 関数型の場合は引数型、参照型の場合は参照先の型
+        /// </summary>
+        Operand first = {};
+
+        /// <summary>
+        /// 関数型の場合の戻り値型
+        /// </summary>
+        Operand second = {};
+
+        /// <summary>
+        /// 参照型と型としての型クラスの場合のリージョン型
+        /// </summary>
+        RegionOperand region = {};
+    };
+
+    /// <summary>
+    /// 後行順に並べた骨格の節点のリスト
+    /// </summary>
+    std::vector<Node> nodes = {};
+
+    /// <summary>
+    /// ジェネリック型の本体の型
+    /// </summary>
+    Operand root;
+
+    /// <summary>
+    /// ジェネリック型から雛形を構築する
+    /// </summary>
+    /// <param name="generic">雛形の構築対象のジェネリック型</param>
+    /// <returns>構築した雛形</returns>
+    [[nodiscard]] static std::shared_ptr<const GenericTemplate> build(const Generic& generic);
+};
+
+/// <summary>
+/// ジェネリック型
+/// </summary>
+struct Generic {
+    /// <summary>
+    /// 型変数のリスト
+    /// </summary>
+    std::vector<RefType> vals;
+
+    /// <summary>
+    /// リージョン型における型変数のリスト
+    /// </summary>
+    std::vector<RefRegion> regionVals;
+
+    /// <summary>
+    /// 型変数valsおよびregionValsを内部で持つ型
+    /// </summary>
+    RefType type;
+
+    /// <summary>
+    /// <para>instantiateの雛形</para>
+    /// <para>初回のinstantiate時に構築して以降のinstantiateで再利用する</para>
+    /// </summary>
+    mutable std::shared_ptr<const GenericTemplate> spine = nullptr;
+};
+
+/// <summary>
+/// ジェネリック型から雛形を構築する
+/// </summary>
+/// <param name="generic">雛形の構築対象のジェネリック型</param>
+/// <returns>構築した雛形</returns>
+[[nodiscard]] std::shared_ptr<const GenericTemplate> GenericTemplate::build(const Generic& generic) {
+    auto spine = std::make_shared<GenericTemplate>();
+    // 構築済みの部分型の参照(共有された部分型は1度のみ構築する)
+    std::unordered_map<const Type*, Operand> memo;
 
     struct fn {
         RefType t;
-        TypeEnvironment& e;
-        const std::vector<RefType>& v;
+        GenericTemplate& s;
+        std::unordered_map<const Type*, Operand>& m;
         const std::vector<RefType>& p;
-        const std::vector<RefRegion>& rv;
         const std::vector<RefRegion>& rp;
 
         /// <summary>
-        /// ジェネリック型のリージョン型の型変数について型をinstantiateする
+        /// リージョン型の参照を構築する
         /// </summary>
-        /// <param name="type">複製対象の型</param>
-        RefRegion instantiateRegion(const RefRegion& region) {
+        /// <param name="region">構築対象のリージョン型</param>
+        RegionOperand region(RefRegion region) {
             if (std::holds_alternative<Region::Param>(region->kind)) {
                 auto& x = std::get<Region::Param>(region->kind);
-                // ジェネリック型の型変数と等しい場合はinstantiateする
+                // ジェネリック型の型変数と等しい場合はinstantiateの対象とする
                 if (x.index < this->rp.size() && this->rp[x.index] == region) {
-                    return this->rv[x.index];
-                }
-                else {
-                    return region;
+                    return { .kind = Operand::Kind::VAL, .index = x.index };
                 }
             }
-            return region;
+            return { .kind = Operand::Kind::SHARED, .region = region };
         }
 
-        RefType operator()([[maybe_unused]] const Type::Base& x) {
-            // instantiateしない
-            return this->t;
+        Operand operator()([[maybe_unused]] const Type::Base& x) {
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
-        RefType operator()(const Type::Function& x) {
-            // 引数型と戻り値型をinstantiateする
-            auto instParamType = std::visit(fn{ .t = x.paramType, .e = this->e, .v = this->v, .p = this->p, .rv = this->rv, .rp = this->rp }, x.paramType->kind);
-            auto instReturnType = std::visit(fn{ .t = x.returnType, .e = this->e, .v = this->v, .p = this->p, .rv = this->rv, .rp = this->rp }, x.returnType->kind);
-
-            if (x.paramType == instParamType && x.returnType == instReturnType) {
-                // instantiateされなかった場合は新規にインスタンスを生成しない
-                return this->t;
-            }
-            else {
-                // instantiateが生じた場合は新規にインスタンスを生成する
-                // 組込み型である関数型なので基底を継承する
-                return this->e.newType(Type::Function{ .base = x.base, .paramType = std::move(instParamType), .returnType = std::move(instReturnType) });
+        Operand operator()(const Type::Function& x) {
+            auto paramType = this->m.at(x.paramType);
+            auto returnType = this->m.at(x.returnType);
+            if (paramType.kind == Operand::Kind::SHARED && returnType.kind == Operand::Kind::SHARED) {
+                // 型変数を含まない場合は共有する
+                return { .kind = Operand::Kind::SHARED, .type = this->t };
             }
+            this->s.nodes.push_back({ .source = this->t, .first = paramType, .second = returnType });
+            return { .kind = Operand::Kind::NODE, .index = this->s.nodes.size() - 1 };
         }
-        RefType operator()([[maybe_unused]] const Type::Variable& x) {
-            // 外のスコープから与えられた型変数のためinstantiateしない
-            return this->t;
+        Operand operator()([[maybe_unused]] const Type::Variable& x) {
+            // 外のスコープから与えられた型変数のため共有する
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
-        RefType operator()(const Type::Param& x) {
-            // ジェネリック型の型変数と等しい場合はinstantiateする
+        Operand operator()(const Type::Param& x) {
+            // ジェネリック型の型変数と等しい場合はinstantiateの対象とする
             if (x.index < this->p.size() && this->p[x.index] == this->t) {
-                return this->v[x.index];
-            }
-            else {
-                return this->t;
+                return { .kind = Operand::Kind::VAL, .index = x.index };
             }
+            return { .kind = Operand::Kind::SHARED, .type = this->t };
         }
-        RefType operator()([[maybe_unused]] const Type::TypeClass& x) {
-            // リージョン型についてのみinstantiateする
-            auto instRegion = this->instantiateRegion(x.region);
-            if (x.region == instRegion) {
-                // instantiateされなかった場合は新規にインスタンスを生成しない
-                return this->t;
+        Operand operator()(const Type::TypeClass& x) {
+            // リージョン型についてのみinstantiateの対象とする
+            auto region = this->region(x.region);
+            if (region.kind == Operand::Kind::SHARED) {
+                return { .kind = Operand::Kind::SHARED, .type = this->t };
             }
-            else {
-                // instantiateが生じた場合は新規にインスタンスを生成する
-                return this->e.newType(Type::TypeClass{ .typeClasses = x.typeClasses, .region = std::move(instRegion) });
+            this->s.nodes.push_back({ .source = this->t, .region = region });
+            return { .kind = Operand::Kind::NODE, .index = this->s.nodes.size() - 1 };
+        }
+        Operand operator()(const Type::Ref& x) {
+            auto type = this->m.at(x.type);
+            auto region = this->region(x.region);
+            if (type.kind == Operand::Kind::SHARED && region.kind == Operand::Kind::SHARED) {
+                // 型変数を含まない場合は共有する
+                return { .kind = Operand::Kind::SHARED, .type = this->t };
             }
+            this->s.nodes.push_back({ .source = this->t, .first = type, .region = region });
+            return { .kind = Operand::Kind::NODE, .index = this->s.nodes.size() - 1 };
+        }
+    };
+
+    // 構築対象の部分型と部分型を展開済みであるかのスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで後行順に走査する
+    std::vector<std::pair<RefType, bool>> stack = { { generic.type, false } };
+    while (!stack.empty()) {
+        auto [t, expanded] = stack.back();
+        if (memo.contains(t)) {
+            stack.pop_back();
+            continue;
         }
-        RefType operator()([[maybe_unused]] const Type::Ref& x) {
-            // 参照先の型をinstantiateする
-            auto instType = std::visit(fn{ .t = x.type, .e = this->e, .v = this->v, .p = this->p, .rv = this->rv, .rp = this->rp }, x.type->kind);
-            auto instRegion = this->instantiateRegion(x.region);
-            if (x.type == instType && x.region == instRegion) {
-                // instantiateされなかった場合は新規にインスタンスを生成しない
-                return this->t;
+        if (!expanded) {
+            // 部分型を先に構築する
+            stack.back().second = true;
+            if (std::holds_alternative<Type::Function>(t->kind)) {
+                // 引数型の部分型から順に構築するため戻り値型から積む
+                auto& x = std::get<Type::Function>(t->kind);
+                stack.push_back({ x.returnType, false });
+                stack.push_back({ x.paramType, false });
             }
-            else {
-                // instantiateが生じた場合は新規にインスタンスを生成する
-                // 組込み型である参照型なので基底を継承する
-                return this->e.newType(Type::Ref{ .base = x.base, .type = std::move(instType), .region = std::move(instRegion) });
+            else if (std::holds_alternative<Type::Ref>(t->kind)) {
+                stack.push_back({ std::get<Type::Ref>(t->kind).type, false });
             }
+            continue;
         }
-    };
+        stack.pop_back();
+        memo.insert({ t, std::visit(fn{ .t = t, .s = *spine, .m = memo, .p = generic.vals, .rp = generic.regionVals }, t->kind) });
+    }
 
-    return std::visit(fn{ .t = type.type, .e = *this, .v = vals, .p = type.vals, .rv = regionVals, .rp = type.regionVals }, type.type->kind);
+    spine->root = memo.at(generic.type);
+    return spine;
 }
 
 /// <summary>
-/// <para>region2からregion1へ暗黙の型変換をする</para>
-/// <para>束でいうならば型変数をtop、Region::Temporaryをbottomとしてregion2≧region1の場合に変換する</para>
+/// <para>型推論の処理ごとの呼び出し回数と処理時間の計測結果</para>
+/// <para>INFERENCE_STATSを定義した場合のみ計測し、定義しない場合はProbeが空の型となり計測処理はコンパイル時に除去される</para>
+/// <para>スレッドごとに計測し、並列に型推論したスレッドの計測結果は終了時に呼び出し元のスレッドの計測結果へ加算する</para>
 /// </summary>
-/// <param name="region1">変換先のリージョン</param>
-/// <param name="region2">変換元のリージョン</param>
-/// <returns>変換を実施した場合はtrue, 変換を実施していない場合はfalse</returns>
-[[nodiscard]] bool convert(RefRegion& region1, RefRegion& region2) {
-    // 型解決のネストを解消する
-    region1 = solved(region1);
-    region2 = solved(region2);
+struct InferenceStats {
+    /// <summary>
+    /// 1つの処理の計測結果
+    /// </summary>
+    struct Counter {
+        /// <summary>
+        /// 処理名
+        /// </summary>
+        const char* name = "";
+        /// <summary>
+        /// <para>処理時間を計測するか</para>
+        /// <para>呼び出し回数が多く処理が軽いものは計測自体が支配的になるため計測しない</para>
+        /// </summary>
+        bool timed = false;
+        /// <summary>
+        /// 呼び出し回数
+        /// </summary>
+        std::size_t calls = 0;
+        /// <summary>
+        /// 処理した要素数の合計
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 1回の呼び出しで処理した要素数の最大値
+        /// </summary>
+        std::size_t maxItems = 0;
+        /// <summary>
+        /// 処理時間の合計[ns]
+        /// </summary>
+        std::int64_t nanoseconds = 0;
+        /// <summary>
+        /// <para>実行中の呼び出しの数</para>
+        /// <para>再帰的な呼び出しの処理時間を重複して計上しないために最も外側の呼び出しのみ計測する</para>
+        /// </summary>
+        std::size_t active = 0;
+    };
 
-    if (std::holds_alternative<Region::Temporary>(region1->kind)) {
-        // 変換先がbottomであるため常に変換可能
-        if (std::holds_alternative<Region::Variable>(region2->kind)) {
-            std::get<Region::Variable>(region2->kind).solve = region1;
-        }
-        region2 = region1;
-        return true;
-    }
-    if (!std::holds_alternative<Region::Temporary>(region2->kind)) {
-        if (std::holds_alternative<Region::Variable>(region2->kind)) {
-            // topのため常に変換可能
-            std::get<Region::Variable>(region2->kind).solve = region1;
-            region2 = region1;
-            return true;
+    /// <summary>
+    /// 計測中の1回の呼び出し
+    /// </summary>
+    struct Probe {
+#ifdef INFERENCE_STATS
+        /// <summary>
+        /// 計上先
+        /// </summary>
+        Counter& counter;
+        /// <summary>
+        /// この呼び出しで処理した要素数
+        /// </summary>
+        std::size_t items = 0;
+        /// <summary>
+        /// 最も外側の呼び出しであるか
+        /// </summary>
+        bool outermost = false;
+        /// <summary>
+        /// 開始時刻
+        /// </summary>
+        std::chrono::steady_clock::time_point start = {};
+
+        explicit Probe(Counter& counter) : counter(counter) {
+            ++this->counter.calls;
+            this->outermost = this->counter.active++ == 0;
+            if (this->counter.timed && this->outermost) {
+                this->start = std::chrono::steady_clock::now();
+            }
         }
-        else if (std::holds_alternative<Region::Variable>(region1->kind)) {
-            // region2がtopならばregion1もtopである必要があるため変換不可
-            return false;
+        ~Probe() {
+            if (this->counter.timed && this->outermost) {
+                this->counter.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count();
+            }
+            --this->counter.active;
+            this->counter.items += this->items;
+            this->counter.maxItems = std::max(this->counter.maxItems, this->items);
         }
-        else if (std::holds_alternative<Region::Param>(region1->kind) || std::holds_alternative<Region::Param>(region2->kind)) {
-            // region1とregion2のどちらかがジェネリック型に出現する型変数の場合は同じリージョンでなければ変換不可
-            return region1 == region2;
+#else
+        explicit Probe([[maybe_unused]] Counter& counter) {}
+#endif
+        Probe(const Probe&) = delete;
+        Probe& operator=(const Probe&) = delete;
+
+        /// <summary>
+        /// 処理した要素数を計上する
+        /// </summary>
+        /// <param name="n">処理した要素数</param>
+        void add([[maybe_unused]] std::size_t n) {
+#ifdef INFERENCE_STATS
+            this->items += n;
+#endif
         }
-        else {
-            auto r1env = std::get<Region::Base>(region2->kind).env;
-            auto r2env = std::get<Region::Base>(region1->kind).env;
-            if (r1env->depth > r2env->depth) {
-                // 深いスコープから浅いスコープへの変換は不可にする
-                // リージョン推論などによりスコープの変換が可能な場合はその限りではない
-                return false;
-            }
-            else {
-                // region2をregion1と同一階層に移動したときに型環境が一致するかを比較する
-                while (r1env->depth != r2env->depth) {
-                    r2env = r2env->parent;
-                }
-                if (r1env == r2env) {
-                    region2 = region1;
-                    return true;
-                }
-                return false;
-            }
+    };
+
+    /// <summary>
+    /// 単一化(要素数は単一化した型のペアの数)
+    /// </summary>
+    Counter unify = { .name = "unifyType", .timed = true };
+    /// <summary>
+    /// 解決済みの型の取得(要素数は辿った型変数の解決結果の数)
+    /// </summary>
+    Counter solved = { .name = "solved" };
+    /// <summary>
+    /// 出現検査(要素数は走査した型の数)
+    /// </summary>
+    Counter occurs = { .name = "occurs", .timed = true };
+    /// <summary>
+    /// generalize(要素数は走査した型の数)
+    /// </summary>
+    Counter generalize = { .name = "generalize", .timed = true };
+    /// <summary>
+    /// instantiate(要素数は骨格から生成した型の数)
+    /// </summary>
+    Counter instantiate = { .name = "instantiate", .timed = true };
+    /// <summary>
+    /// 型制約の適用(要素数は型クラスの実装を検査した型の数)
+    /// </summary>
+    Counter applyConstraint = { .name = "applyConstraint", .timed = true };
+    /// <summary>
+    /// リージョンの変換可能性の検査(要素数は計上しない)
+    /// </summary>
+    Counter convert = { .name = "convert" };
+    /// <summary>
+    /// 識別子の型の取り出し(要素数は辿った束縛の数)
+    /// </summary>
+    Counter lookup = { .name = "lookup" };
+
+    /// <summary>
+    /// 計測結果を初期化する
+    /// </summary>
+    void reset() {
+        *this = InferenceStats{};
+    }
+
+    /// <summary>
+    /// <para>他のスレッドの計測結果を加算する</para>
+    /// <para>複数のスレッドから並行して加算されるため排他する</para>
+    /// </summary>
+    /// <param name="other">加算する計測結果</param>
+    void merge(const InferenceStats& other) {
+        static std::mutex mutex;
+        std::lock_guard lock(mutex);
+        for (auto counter : { &InferenceStats::unify, &InferenceStats::solved, &InferenceStats::occurs, &InferenceStats::generalize, &InferenceStats::instantiate, &InferenceStats::applyConstraint, &InferenceStats::convert, &InferenceStats::lookup }) {
+            auto& to = this->*counter;
+            auto& from = other.*counter;
+            to.calls += from.calls;
+            to.items += from.items;
+            to.maxItems = std::max(to.maxItems, from.maxItems);
+            to.nanoseconds += from.nanoseconds;
         }
     }
-    else {
-        // region1がbottomならばregion2もbottomである必要があるため変換不可
-        return false;
+
+    /// <summary>
+    /// <para>出現検査とgeneralizeで走査した型の数</para>
+    /// <para>INFERENCE_STATSを定義しない場合は計上されないため常に0</para>
+    /// </summary>
+    /// <returns>走査した型の数</returns>
+    [[nodiscard]] std::size_t traversed() const {
+        return this->occurs.items + this->generalize.items;
     }
-}
+
+    /// <summary>
+    /// 計測結果を出力する
+    /// </summary>
+    /// <param name="os">出力先</param>
+    void dump(std::ostream& os) const {
+        os << std::format("  {:<16} {:>8} {:>10} {:>8} {:>12}", "phase", "calls", "items", "max", "time[us]") << std::endl;
+        for (auto counter : { &this->unify, &this->solved, &this->occurs, &this->generalize, &this->instantiate, &this->applyConstraint, &this->convert, &this->lookup }) {
+            os << std::format(
+                "  {:<16} {:>8} {:>10} {:>8} {:>12}",
+                counter->name,
+                counter->calls,
+                counter->items,
+                counter->maxItems,
+                counter->timed ? std::format("{:.1f}", counter->nanoseconds / 1000.0) : std::string("-")
+            ) << std::endl;
+        }
+    }
+};
+constinit thread_local InferenceStats inferenceStats = {};
 
 /// <summary>
-/// typeがtargetに依存しているかの判定(参照先の型が一致するかを判定する)
+/// <para>型推論のイベントトレース</para>
+/// <para>INFERENCE_TRACEを定義した場合のみ、区間をChromeのtrace_event形式(JSON)でファイルへ逐次書き出す</para>
+/// <para>区間の開始と終了をその場で書き出すため、巨大な入力でもイベントをメモリに溜めない</para>
+/// <para>複数のスレッドのイベントは排他して書き出し、スレッドごとに別のtidを割り当てる</para>
 /// </summary>
-/// <param name="type">検査対象の型1</param>
-/// <param name="target">検査対象の型2</param>
-/// <returns>typeがtargetに依存している場合にtrue、依存していない場合にfalse</returns>
-[[nodiscard]] bool depend(const RefType& type, const RefType& target) {
-    struct fn {
-        const RefType& t;
+struct InferenceTrace {
+#ifdef INFERENCE_TRACE
+    /// <summary>
+    /// 出力先
+    /// </summary>
+    std::ofstream os = {};
+    /// <summary>
+    /// タイムスタンプの基準時刻
+    /// </summary>
+    std::chrono::steady_clock::time_point origin = {};
+    /// <summary>
+    /// 最初のイベントであるか
+    /// </summary>
+    bool first = true;
+    /// <summary>
+    /// 書き出しの排他制御
+    /// </summary>
+    std::mutex mutex = {};
+    /// <summary>
+    /// tidを割り当てたスレッドの数
+    /// </summary>
+    std::size_t threads = 0;
+#endif
 
-        bool operator()([[maybe_unused]] const Type::Base& x) {
-            return false;
-        }
-        bool operator()(const Type::Function& x) {
-            return x.paramType == this->t || x.returnType == this->t || depend(x.paramType, this->t) || depend(x.returnType, this->t);
+    /// <summary>
+    /// 計測中の区間
+    /// </summary>
+    struct Span {
+#ifdef INFERENCE_TRACE
+        explicit Span(std::string_view category, std::string_view name, const std::string& id);
+        explicit Span(std::string_view category, std::string_view name, std::optional<Symbol> x = std::nullopt);
+        ~Span();
+#else
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] const std::string& id) {}
+        explicit Span([[maybe_unused]] std::string_view category, [[maybe_unused]] std::string_view name, [[maybe_unused]] std::optional<Symbol> x = std::nullopt) {}
+#endif
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+
+#ifdef INFERENCE_TRACE
+    /// <summary>
+    /// トレースの出力を開始する
+    /// </summary>
+    /// <param name="path">出力先のファイル名</param>
+    void open(const std::string& path) {
+        std::lock_guard lock(this->mutex);
+        this->os.open(path);
+        if (!this->os) {
+            throw std::runtime_error(std::format("トレースの出力先{}を開けない", path));
         }
-        bool operator()([[maybe_unused]] const Type::Variable& x) {
-            return x.solve ? depend(x.solve.value(), this->t) : false;
+        this->os << "[\n";
+        this->origin = std::chrono::steady_clock::now();
+        this->first = true;
+    }
+
+    /// <summary>
+    /// トレースの出力を終了する
+    /// </summary>
+    void close() {
+        std::lock_guard lock(this->mutex);
+        if (this->os.is_open()) {
+            this->os << "\n]\n";
+            this->os.close();
         }
-        bool operator()([[maybe_unused]] const Type::Param& x) {
-            return false;
+    }
+
+    /// <summary>
+    /// <para>イベントを書き出す</para>
+    /// <para>出力を開始していない場合は何もしない</para>
+    /// </summary>
+    /// <param name="phase">イベントの種類(B：区間の開始、E：区間の終了)</param>
+    /// <param name="category">イベントの分類</param>
+    /// <param name="name">イベント名</param>
+    /// <param name="id">識別子名</param>
+    void event(char phase, std::string_view category, std::string_view name, std::string_view id) {
+        std::lock_guard lock(this->mutex);
+        if (!this->os.is_open()) {
+            return;
         }
-        bool operator()([[maybe_unused]] const Type::TypeClass& x) {
-            return false;
+        thread_local auto tid = ++this->threads;
+        auto ts = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->origin).count();
+        this->os << (std::exchange(this->first, false) ? "" : ",\n");
+        this->os << R"({"ph":")" << phase << R"(","ts":)" << std::format("{:.3f}", ts) << R"(,"pid":1,"tid":)" << tid;
+        if (phase == 'B') {
+            this->os << R"(,"cat":")";
+            this->escape(category);
+            this->os << R"(","name":")";
+            this->escape(name);
+            this->os << '"';
+            if (!id.empty()) {
+                this->os << R"(,"args":{"id":")";
+                this->escape(id);
+                this->os << R"("})";
+            }
         }
-        bool operator()(const Type::Ref& x) {
-            return  x.type == this->t || depend(x.type, this->t);
+        this->os << '}';
+    }
+
+    /// <summary>
+    /// JSONの文字列としてエスケープして書き出す
+    /// </summary>
+    /// <param name="s">書き出す文字列</param>
+    void escape(std::string_view s) {
+        for (auto c : s) {
+            if (c == '"' || c == '\\') {
+                this->os << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                this->os << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+            }
+            else {
+                this->os << c;
+            }
         }
-    };
+    }
+#endif
+};
+InferenceTrace inferenceTrace = {};
 
-    return type == target || std::visit(fn{ .t = target }, type->kind);
+#ifdef INFERENCE_TRACE
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, const std::string& id) {
+    inferenceTrace.event('B', category, name, id);
 }
+InferenceTrace::Span::Span(std::string_view category, std::string_view name, std::optional<Symbol> x) {
+    inferenceTrace.event('B', category, name, x ? std::string_view(x->name()) : std::string_view());
+}
+InferenceTrace::Span::~Span() {
+    inferenceTrace.event('E', {}, {}, {});
+}
+#endif
 
 /// <summary>
-/// 暗黙の型変換のパターンの列挙
+/// <para>単一化による書き換えの記録(トレイル)</para>
+/// <para>チェックポイントを開いている間のみ書き換え前の値を記録し、書き換えの数に比例する時間で巻き戻す</para>
+/// <para>記録の対象は単一化(solved, unite, occurs, convert, unifyType, unifyWithRef, unifyFunction, applyConstraint)とgeneralizeによる書き換え、型推論による型情報とリージョン型の書き換えのみ</para>
 /// </summary>
-enum struct ImplicitCastPattern {
+struct Trail {
     /// <summary>
-    /// 参照型への変換
+    /// 書き換え前の値
     /// </summary>
-    REFERENCE,
+    template <class T>
+    struct Entry {
+        /// <summary>
+        /// 書き換えた場所
+        /// </summary>
+        T* slot;
+        /// <summary>
+        /// 書き換え前の値
+        /// </summary>
+        T value;
+    };
+
     /// <summary>
-    /// 型としての型クラスへの変換
+    /// 書き換え前の値の記録
     /// </summary>
-    TYPECLASS,
+    using Record = std::variant<Entry<RefType>, Entry<RefRegion>, Entry<std::optional<RefRegion>>, Entry<RefConstraints>, Entry<std::size_t>, Entry<Region::kind_type>, Entry<std::variant<RefType, Generic>>>;
 
     /// <summary>
-    /// 暗黙の型変換はなし
+    /// 記録を書き戻す
     /// </summary>
-    NONE
-};
+    struct fn {
+        template <class T>
+        void operator()(Entry<T>& entry) const {
+            *entry.slot = std::move(entry.value);
+        }
+        void operator()(Entry<Region::kind_type>& entry) const {
+            // Region::Variableは代入できないため書き換え前の値から構築し直す
+            std::visit([&](auto& value) { entry.slot->template emplace<std::remove_cvref_t<decltype(value)>>(std::move(value)); }, entry.value);
+        }
+    };
 
-/// <summary>
-/// <para>暗黙の型変換付きの副作用付きの2つの型の単一化</para>
-/// <para>暗黙の型変換はtype1 &lt;- type2の方向で行われる</para>
-/// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="type1">単一化の対象の型1</param>
-/// <param name="type2">単一化の対象の型2</param>
-/// <param name="implicitCast">暗黙の型変換が有効であるか</param>
-/// <returns>
-/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
-/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
-/// </returns>
-ImplicitCastPattern unifyType(TypeMap& typeMap, RefType& type1, RefType& type2, bool implicitCast) {
+    /// <summary>
+    /// チェックポイント
+    /// </summary>
+    struct Checkpoint {
+        /// <summary>
+        /// チェックポイントを取得した時点の記録の数
+        /// </summary>
+        std::size_t size;
+    };
 
-    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
-    type1 = solved(type1);
-    type2 = solved(type2);
-
-    if (type1 != type2) {
-        if (std::holds_alternative<Type::Variable>(type1->kind)) {
-            auto& t1v = std::get<Type::Variable>(type1->kind);
-
-            if (std::holds_alternative<Type::Variable>(type2->kind)) {
-                // 型変数同士の場合は型の循環が起きないように外のスコープのものを設定
-                auto& t2v = std::get<Type::Variable>(type2->kind);
-                if (t1v.depth < t2v.depth) {
-                    // 型制約をマージする
-                    t1v.constraints.merge(t2v.constraints.list);
-                    t2v.solve = type1;
-                    type2 = type1;
-                }
-                else {
-                    // 型制約をマージする
-                    t2v.constraints.merge(t1v.constraints.list);
-                    t1v.solve = type2;
-                    type1 = type2;
-                }
-            }
-            else {
-                if (depend(type1, type2)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                // type2がtype1の制約を満たすかを検証する
-                typeMap.applyConstraint(type2, t1v.constraints.list);
-                t1v.solve = type2;
-                type1 = type2;
-            }
-        }
-        else {
-            if (std::holds_alternative<Type::Variable>(type2->kind)) {
-                auto& t2v = std::get<Type::Variable>(type2->kind);
-                if (depend(type2, type1)) {
-                    // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
-                    throw std::runtime_error("再帰的単一化");
-                }
-                // 一方のみが型変数の場合はもう一方と型を一致させる
-                // type1がtype2の制約を満たすかを検証する
-                typeMap.applyConstraint(type1, t2v.constraints.list);
-                t2v.solve = type1;
-                type2 = type1;
-            }
-            else {
-                // 型が一致する場合に部分型について再帰的に単一化
-                if (type1->kind.index() == type2->kind.index()) {
-                    if (std::holds_alternative<Type::Function>(type1->kind)) {
-                        auto& k1 = std::get<Type::Function>(type1->kind);
-                        auto& k2 = std::get<Type::Function>(type2->kind);
-                        // type2 <: type1を仮定すると引数型は反変、戻り値型は共変なサブタイピングが行えるが
-                        // バイナリレベルでの互換性はないため暗黙の型変換は無効
-                        unifyType(typeMap, k1.paramType, k2.paramType, false);
-                        unifyType(typeMap, k1.returnType, k2.returnType, false);
-                        if (k1.paramType == k2.paramType && k1.returnType == k2.returnType) {
-                            type1 = type2;
-                        }
-                    }
-                    else if (implicitCast && std::holds_alternative<Type::TypeClass>(type1->kind)) {
-                        auto& k1 = std::get<Type::TypeClass>(type1->kind);
-                        auto& k2 = std::get<Type::TypeClass>(type2->kind);
-
-                        // 型クラス同士が一致していない場合は暗黙の型変換が実施可能か検証する
-                        std::ranges::sort(k1.typeClasses.list);
-                        std::ranges::sort(k2.typeClasses.list);
-                        bool ret = !std::ranges::equal(k1.typeClasses.list, k2.typeClasses.list);
-                        if (ret) {
-                            // type1に課された型クラスがtype2で実装されているか検証
-                            typeMap.applyConstraint(type2, k1.typeClasses.list);
-                        }
+    /// <summary>
+    /// 書き換え前の値の記録のリスト
+    /// </summary>
+    std::vector<Record> records = {};
 
-                        // 型クラス同士の場合はtype1 <- type2でリージョンも一致させる
-                        if (!convert(k1.region, k2.region)) {
-                            // リージョンに互換性がない
-                            assert(false);
-                        }
-                        if (!ret) {
-                            type1 = type2;
-                        }
+    /// <summary>
+    /// <para>チェックポイントを開いている間に生成した型情報</para>
+    /// <para>型情報の型も書き換えの対象となるため、書き戻す前に型情報が破棄されないように全てのチェックポイントを閉じるまで保持する</para>
+    /// </summary>
+    std::vector<std::shared_ptr<TypeInfo>> retained = {};
 
-                        return ret ? ImplicitCastPattern::TYPECLASS : ImplicitCastPattern::NONE;
-                    }
-                    else if (std::holds_alternative<Type::Ref>(type1->kind)) {
-                        auto& k1 = std::get<Type::Ref>(type1->kind);
-                        auto& k2 = std::get<Type::Ref>(type2->kind);
-                        // 参照型同士では暗黙の型変換を無効
-                        unifyType(typeMap, k1.type, k2.type, false);
-
-                        // 参照型同士の場合はtype1 <- type2でリージョンも一致させる
-                        if (!convert(k1.region, k2.region)) {
-                            // リージョンに互換性がない
-                            assert(false);
-                        }
-                        if (k1.type == k2.type) {
-                            type1 = type2;
-                        }
-                    }
-                    else {
-                        // 部分型をもたないため型は一致しない
-                        throw std::runtime_error("型の不一致");
-                    }
-                }
-                else {
-                    // 型の種類が一致しない
-                    throw std::runtime_error("型の不一致");
-                }
-            }
+    /// <summary>
+    /// 開いているチェックポイントの数
+    /// </summary>
+    std::size_t open = 0;
+
+    /// <summary>
+    /// チェックポイントを開いていれば書き換える前の値を記録する
+    /// </summary>
+    /// <param name="slot">書き換える場所</param>
+    template <class T>
+    void save(T& slot) {
+        if (this->open > 0) {
+            this->records.push_back(Entry<T>{ .slot = std::addressof(slot), .value = slot });
         }
     }
-    return ImplicitCastPattern::NONE;
-}
-
-/// <summary>
-/// <para>参照型への暗黙の型変換付きの副作用付きの2つの型の単一化</para>
-/// <para>暗黙の型変換はtype1 &lt;- type2の方向で行われる</para>
-/// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="type1">単一化の対象の型1</param>
-/// <param name="type2">単一化の対象の型2</param>
-/// <returns>
-/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
-/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
-/// </returns>
-ImplicitCastPattern unifyWithRef(TypeMap& typeMap, RefType& type1, RefTypeInfo type2) {
-    // ジェネリック型を単一化に含まないことは論理エラーとする
-    assert(std::holds_alternative<RefType>(type2->type));
 
-    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
-    type1 = solved(type1);
-    auto& t2 = std::get<RefType>(type2->type);
-    t2 = solved(t2);
+    /// <summary>
+    /// チェックポイントを開いていれば型情報を保持する
+    /// </summary>
+    /// <param name="info">生成した型情報</param>
+    void retain(const std::shared_ptr<TypeInfo>& info) {
+        if (this->open > 0) {
+            this->retained.push_back(info);
+        }
+    }
 
-    if (type1->kind.index() != t2->kind.index() && !std::holds_alternative<Type::Variable>(t2->kind)) {
-        if (std::holds_alternative<Type::TypeClass>(type1->kind)) {
-            // type1 <- type2な型としての型クラスへの暗黙の型変換の検証
-            // type1に課された型クラスがtype2で実装されているか検証となる
-            auto& k1 = std::get<Type::TypeClass>(type1->kind);
-            typeMap.applyConstraint(t2, k1.typeClasses.list);
+    /// <summary>
+    /// 書き換え前の値を記録して書き換える
+    /// </summary>
+    /// <param name="slot">書き換える場所</param>
+    /// <param name="value">書き換え後の値</param>
+    template <class T>
+    void assign(T& slot, T value) {
+        if (slot != value) {
+            this->save(slot);
+            slot = std::move(value);
+        }
+    }
 
-            // 暗黙の型変換に成功したならばtype1の参照先のリージョンにtype2のリージョンを反映
-            if (!convert(type2->region, k1.region)) {
-                // リージョンに互換性がない
-                assert(false);
-            }
+    /// <summary>
+    /// チェックポイントを開く
+    /// </summary>
+    /// <returns>チェックポイント</returns>
+    [[nodiscard]] Checkpoint checkpoint() {
+        ++this->open;
+        return Checkpoint{ .size = this->records.size() };
+    }
 
-            return ImplicitCastPattern::TYPECLASS;
+    /// <summary>
+    /// チェックポイント以降の書き換えを巻き戻してチェックポイントを閉じる
+    /// </summary>
+    /// <param name="checkpoint">巻き戻し先のチェックポイント</param>
+    void rollback(Checkpoint checkpoint) {
+        while (this->records.size() > checkpoint.size) {
+            std::visit(fn{}, this->records.back());
+            this->records.pop_back();
         }
-        else if (std::holds_alternative<Type::Ref>(type1->kind)) {
-            // type1 <- type2な参照型ではない型から参照型への暗黙の型変換の検証
-            // 参照型の参照先の型との暗黙の型変換は無効化する
-            auto& k1 = std::get<Type::Ref>(type1->kind);
-            unifyType(typeMap, k1.type, t2, false);
+        this->close();
+    }
 
-            // 暗黙の型変換に成功したならばtype1の参照先のリージョンにtype2のリージョンを反映
-            if (!convert(type2->region, k1.region)) {
-                // リージョンに互換性がない
-                assert(false);
-            }
+    /// <summary>
+    /// <para>チェックポイント以降の書き換えを確定してチェックポイントを閉じる</para>
+    /// <para>外側のチェックポイントが開いている場合は外側で巻き戻せるように記録を残す</para>
+    /// </summary>
+    /// <param name="checkpoint">確定するチェックポイント</param>
+    void commit([[maybe_unused]] Checkpoint checkpoint) {
+        this->close();
+    }
 
-            return ImplicitCastPattern::REFERENCE;
+    /// <summary>
+    /// <para>処理を投機的に実行する</para>
+    /// <para>型推論の異常で失敗した場合は処理による書き換えを巻き戻す</para>
+    /// <para>それ以外の例外でもチェックポイントを開いたままにしないように巻き戻してから再送出する</para>
+    /// </summary>
+    /// <param name="f">実行する処理</param>
+    /// <returns>成功した場合はtrue、失敗して巻き戻した場合はfalse</returns>
+    template <class F>
+    bool speculate(F&& f) {
+        auto checkpoint = this->checkpoint();
+        try {
+            std::forward<F>(f)();
+        }
+        catch (const std::runtime_error&) {
+            this->rollback(checkpoint);
+            return false;
         }
+        catch (...) {
+            this->rollback(checkpoint);
+            throw;
+        }
+        this->commit(checkpoint);
+        return true;
     }
 
-    // 参照型に関する暗黙の型変換が生じないパターンでは通常の単一化を行う
-    return unifyType(typeMap, type1, t2, true);
-}
+    /// <summary>
+    /// チェックポイントを閉じ、全て閉じた場合は記録と保持した型情報を破棄する
+    /// </summary>
+    void close() {
+        assert(this->open > 0);
+        if (--this->open == 0) {
+            this->records.clear();
+            this->retained.clear();
+        }
+    }
+};
+/// <summary>
+/// スレッドごとの単一化による書き換えの記録
+/// </summary>
+constinit thread_local Trail trail = {};
 
 /// <summary>
-/// <para>暗黙の型変換付きの副作用付きの2つの関数型の単一化</para>
-/// <para>暗黙の型変換は引数型と戻り値型でそれぞれtype1 &lt;- type2の方向で行われる</para>
+/// <para>解決済みの型を取得する</para>
+/// <para>型変数の解決結果を代表元として辿り、経路上の型変数を全て代表元へ直接つなぎ替える</para>
 /// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="env">型環境</param>
-/// <param name="type1">単一化の対象の型1</param>
-/// <param name="type2p">単一化の対象の型2の引数型</param>
-/// <param name="type2r">単一化の対象の型2の戻り値型</param>
-/// <returns>
-/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
-/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
-/// </returns>
-std::variant<std::pair<ImplicitCastPattern, ImplicitCastPattern>, ImplicitCastPattern> unifyFunction(TypeMap& typeMap, TypeEnvironment& env, RefType type1, RefTypeInfo type2p, RefTypeInfo type2r) {
+/// <param name="type">チェックを行う型</param>
+/// <returns>解決済みの型</returns>
+RefType solved(RefType type) {
+    InferenceStats::Probe probe(inferenceStats.solved);
+
+    // 代表元を探索する
+    auto root = type;
+    while (std::holds_alternative<Type::Variable>(root->kind)) {
+        auto& val = std::get<Type::Variable>(root->kind);
+        if (!val.solve) {
+            break;
+        }
+        root = val.solve;
+        probe.add(1);
+    }
 
-    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
-    auto t1 = solved(type1);
+    // 解決結果が再適用されないように経路圧縮をしておく
+    while (type != root) {
+        auto& val = std::get<Type::Variable>(type->kind);
+        auto next = val.solve;
+        trail.assign(val.solve, root);
+        type = next;
+    }
+    return root;
+}
 
-    if (std::holds_alternative<Type::Function>(t1->kind)) {
-        auto& k1 = std::get<Type::Function>(t1->kind);
-        return std::pair{
-            unifyWithRef(typeMap, k1.paramType, type2p),
-            unifyWithRef(typeMap, k1.returnType, type2r)
-        };
+/// <summary>
+/// <para>未解決の型変数同士を併合する</para>
+/// <para>ランクの低い方をランクの高い方につなぎ、代表元のスコープの深さは浅い方に合わせる</para>
+/// </summary>
+/// <param name="type1">代表元である型変数1</param>
+/// <param name="type2">代表元である型変数2</param>
+/// <returns>併合結果の代表元</returns>
+RefType unite(RefType type1, RefType type2) {
+    auto& v1 = std::get<Type::Variable>(type1->kind);
+    auto& v2 = std::get<Type::Variable>(type2->kind);
+    auto depth = std::min(v1.depth, v2.depth);
+
+    // ランクが等しい場合は型の循環が起きないように外のスコープのものを代表元とする
+    if (v1.rank > v2.rank || (v1.rank == v2.rank && v1.depth < v2.depth)) {
+        // 型制約をマージする
+        trail.save(v1.constraints);
+        v1.constraints.merge(*v2.constraints);
+        trail.assign(v2.solve, type1);
+        trail.assign(v1.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v1.rank, v1.rank + 1);
+        }
+        return type1;
     }
     else {
-        // 関数型の引数型と戻り値型に関して個別の単一化ができない場合は通常の単一化を行う
-        // type1は型変数でなければ異常となる
-        if (std::holds_alternative<Type::Variable>(t1->kind)) {
-            std::get<Type::Variable>(t1->kind).solve = env.instantiate(typeMap, typeMap.builtin.fn, { std::get<RefType>(type2p->type), std::get<RefType>(type2r->type) });
-        }
-        else {
-            // 型の種類が一致しない
-            throw std::runtime_error("型の不一致");
+        // 型制約をマージする
+        trail.save(v2.constraints);
+        v2.constraints.merge(*v1.constraints);
+        trail.assign(v1.solve, type2);
+        trail.assign(v2.depth, depth);
+        if (v1.rank == v2.rank) {
+            trail.assign(v2.rank, v2.rank + 1);
         }
-        return ImplicitCastPattern::NONE;
+        return type2;
     }
 }
 
 /// <summary>
-/// インスタンス化されたクラスメソッドを取得する
+/// 型から参照型を除去した解決済みの型を取得する
 /// </summary>
-/// <param name="typeMap">型表</param>
-/// <param name="env">型環境</param>
-/// <param name="methodName">クラスメソッド名(存在するかについては呼び出し元で保証する)</param>
-/// <param name="type">クラスメソッドを呼び出す型</param>
-/// <returns></returns>
-[[nodiscard]] RefType TypeClass::getInstantiatedMethod(TypeMap& typeMap, TypeEnvironment& env, const std::string& methodName, RefTypeInfo type) {
-    assert(this->methods.contains(methodName));
-
-    // クラスメソッドがジェネリック型ならinstantiateする
-    // 型クラスを実装する対象の型についてもinstantiateする
-    auto& method = this->methods.at(methodName);
-    auto f = env.instantiate(typeMap, Generic{
-        .vals = { this->type },
-        .regionVals = {},
-        .type = (
-            std::holds_alternative<Generic>(method) ?
-            env.instantiate(typeMap, std::get<Generic>(method)) :
-            std::get<RefType>(method)
-        )
-        });
-
-    // 第一引数がtypeで呼び出し可能なクラスメソッドであるかを検査する
-    // 例えば、typeが参照型でfの第一引数が値型の場合は呼び出し不可
-    unifyWithRef(typeMap, std::get<Type::Function>(f->kind).paramType, type);
+/// <param name="type">参照型を除去する対象の型</param>
+/// <returns>参照型を除去した結果の型</returns>
+RefType unwrapRef(RefType type) {
+    auto t = solved(type);
+    while (std::holds_alternative<Type::Ref>(t->kind)) {
+        auto& t2 = std::get<Type::Ref>(t->kind).type;
+        trail.assign(t2, solved(t2));
+        t = t2;
+    }
+    return t;
+}
 
-    return std::get<Type::Function>(f->kind).returnType;
+/// <summary>
+/// 解決済みの型を取得する
+/// </summary>
+/// <param name="type">チェックを行う型</param>
+/// <returns>解決済みの型</returns>
+RefRegion solved(RefRegion type) {
+    if (std::holds_alternative<Region::Variable>(type->kind)) {
+        auto& val = std::get<Region::Variable>(type->kind);
+        if (val.solve) {
+            // 解決結果が再適用されないように適用しておく
+            trail.assign(val.solve, std::optional(solved(val.solve.value())));
+            return val.solve.value();
+        }
+    }
+    return type;
 }
 
 /// <summary>
-/// 式を示す構文木
+/// <para>型のアリーナ</para>
+/// <para>型推論のセッション中に生成した型を全て所有し、セッションの終了時に一括で解放する</para>
 /// </summary>
-struct Expression {
-    virtual ~Expression() {};
+struct TypeArena {
+    /// <summary>
+    /// <para>生成した型の実体</para>
+    /// <para>チャンク単位で確保されて要素のアドレスが移動しないためstd::dequeで保持する</para>
+    /// </summary>
+    std::deque<Type> types = {};
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 関数型を共有するためのキー(基底型としての意味を示す型と引数型と戻り値型の組)
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    virtual RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) = 0;
+    using FunctionKey = std::array<const Type*, 3>;
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// FunctionKeyのハッシュ関数
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    virtual void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) = 0;
-};
+    struct FunctionKeyHash {
+        [[nodiscard]] std::size_t operator()(const FunctionKey& key) const noexcept {
+            std::size_t seed = 0;
+            for (auto p : key) {
+                seed ^= std::hash<const Type*>{}(p) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            }
+            return seed;
+        }
+    };
 
-/// <summary>
-/// 定数を示す構文木(簡単のために値はもたない)
-/// </summary>
-struct Constant : Expression {
     /// <summary>
-    /// 定数の型
+    /// <para>型名から生成済みの基底型への表</para>
+    /// <para>同名の基底型は同一の実体を共有する</para>
     /// </summary>
-    RefType b;
+    std::unordered_map<Symbol, RefType> bases = {};
 
-    Constant(RefType b) : b(b) {}
-    ~Constant() override {}
+    /// <summary>
+    /// <para>部分型の組から生成済みの型変数を含まない関数型への表</para>
+    /// <para>部分型がすべて共有済みの場合のみ登録するため、部分型のアドレスの比較のみで構造的に等しいかを判定できる</para>
+    /// </summary>
+    std::unordered_map<FunctionKey, RefType, FunctionKeyHash> functions = {};
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 生成したリージョン型の実体
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J([[maybe_unused]] TypeMap& typeMap, TypeEnvironment& env) override {
-        return env.newTypeInfo(this->b, env.newRegion(Region::Temporary{}));
-    }
+    std::deque<Region> regions = {};
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// <para>型の生成</para>
+    /// <para>型変数を含まない基底型と関数型は構造的に等しい型が生成済みであればそれを返す(hash-consing)</para>
+    /// <para>参照型はリージョンが単一化により書き換えられるため共有しない</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, [[maybe_unused]] TypeEnvironment& env, RefTypeInfo rho) override {
-        // リテラルのインスタンスは常に一時オブジェクトとして扱う
-        unifyWithRef(typeMap, std::get<RefType>(rho->type), env.newTypeInfo(this->b, env.newRegion(Region::Temporary{})));
-        rho->region->kind = Region::Temporary{};
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        if (std::holds_alternative<Type::Base>(kind)) {
+            // 同名の基底型が生成済みの場合はそれを共有する
+            auto& name = std::get<Type::Base>(kind).name;
+            if (auto itr = this->bases.find(name); itr != this->bases.end()) {
+                return itr->second;
+            }
+            auto type = this->emplace(std::move(kind));
+            this->bases.insert({ std::get<Type::Base>(type->kind).name, type });
+            return type;
+        }
+        else if (std::holds_alternative<Type::Function>(kind)) {
+            auto& x = std::get<Type::Function>(kind);
+            FunctionKey key = { x.base, x.paramType, x.returnType };
+            if (std::ranges::all_of(key, [this](const Type* p) { return this->interned(p); })) {
+                // 部分型がすべて共有済みの場合は関数型も共有する
+                auto [itr, inserted] = this->functions.try_emplace(key, nullptr);
+                if (inserted) {
+                    itr->second = this->emplace(std::move(kind));
+                }
+                return itr->second;
+            }
+        }
+        return this->emplace(std::move(kind));
     }
-};
 
-/// <summary>
-/// 識別子を示す構文木
-/// </summary>
-struct Identifier : Expression {
     /// <summary>
-    /// 識別子名
+    /// 型が共有された型であるかの判定
     /// </summary>
-    std::string x;
-
-    Identifier(std::string_view x) : x(x) {}
-    ~Identifier() override {}
+    /// <param name="type">判定対象の型</param>
+    /// <returns>typeが共有された型である場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool interned(const Type* type) const {
+        if (std::holds_alternative<Type::Base>(type->kind)) {
+            auto itr = this->bases.find(std::get<Type::Base>(type->kind).name);
+            return itr != this->bases.end() && itr->second == type;
+        }
+        else if (std::holds_alternative<Type::Function>(type->kind)) {
+            auto& x = std::get<Type::Function>(type->kind);
+            auto itr = this->functions.find({ x.base, x.paramType, x.returnType });
+            return itr != this->functions.end() && itr->second == type;
+        }
+        return false;
+    }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 共有せずに型の実体を生成する
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
-        if (tau) {
-            // 使用済みであるかの検証は線型型をを未実装のためまだない
-            
-            auto& type = tau.value()->type;
-            if (std::holds_alternative<RefType>(type)) {
-                return tau.value();
-            }
-            else {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                // ジェネリック型のインスタンスは常に一時オブジェクトとして扱う
-                return env.newTypeInfo(env.instantiate(typeMap, std::get<Generic>(type)), env.newRegion(Region::Temporary{}));
-            }
-        }
-        throw std::runtime_error(std::format("不明な識別子：{}", this->x));
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType emplace(Type::kind_type&& kind) {
+        return std::addressof(this->types.emplace_back(Type{ .kind = std::move(kind) }));
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// リージョン型の生成
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        // 型環境から型を取り出す
-        auto tau = env.lookup(this->x);
-        if (tau) {
-            // 使用済みであるかの検証は線型型をを未実装のためまだない
-
-            auto& type = tau.value()->type;
-            if (std::holds_alternative<RefType>(type)) {
-                if (unifyWithRef(typeMap, std::get<RefType>(rho->type), tau.value()) == ImplicitCastPattern::NONE) {
-                    // 暗黙的な型変換が生じなかった場合はtauと同じリージョンをもたせる
-                    // rhoで与えられるリージョン型は基本的にenvと同じ型環境上の型変数と仮定しているため、convertによる変換は不可
-                    rho->region = tau.value()->region;
-                }
-                else {
-                    // 暗黙的な型変換が生じた場合は一時オブジェクトとして扱う
-                    rho->region->kind = Region::Temporary{};
-                }
-            }
-            else {
-                // 多相のためにinstantiateする(単相の場合は不要)
-                // ジェネリック型のインスタンスは常に一時オブジェクトとして扱う
-                unifyWithRef(typeMap, std::get<RefType>(rho->type), env.newTypeInfo(env.instantiate(typeMap, std::get<Generic>(type)), env.newRegion(Region::Temporary{})));
-                rho->region->kind = Region::Temporary{};
-            }
-        }
-        else {
-            throw std::runtime_error(std::format("不明な識別子：{}", this->x));
-        }
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成したリージョン型</returns>
+    [[nodiscard]] RefRegion newRegion(Region::kind_type&& kind) {
+        return std::addressof(this->regions.emplace_back(Region{ .kind = std::move(kind) }));
     }
 };
 
 /// <summary>
-/// ラムダ抽象を示す構文木
+/// 型環境で管理するコンテキスト情報付きの型情報
 /// </summary>
-struct Lambda : Expression {
+struct TypeInfo {
     /// <summary>
-    /// 引数名
+    /// 型情報本体
     /// </summary>
-    std::string x;
+    std::variant<RefType, Generic> type;
+
     /// <summary>
-    /// xの型制約
+    /// 識別子が定義されるリージョン
     /// </summary>
-    std::optional<RefType> constraint = std::nullopt;
+    RefRegion region;
+};
+
+/// <summary>
+/// 型環境で管理するコンテキスト情報付きの型情報への参照
+/// </summary>
+using RefTypeInfo = std::shared_ptr<TypeInfo>;
+
+/// <summary>
+/// <para>識別子の束縛の表</para>
+/// <para>シンボルごとに束縛のスタックをもち、型環境の生成と破棄に合わせて束縛をpush/popすることでスコープの深さによらず識別子を解決する</para>
+/// </summary>
+struct BindingTable {
     /// <summary>
-    /// 関数本体の式
+    /// 識別子の束縛
     /// </summary>
-    std::shared_ptr<Expression> e;
+    struct Binding {
+        /// <summary>
+        /// 束縛を行った型環境
+        /// </summary>
+        const TypeEnvironment* env;
 
-    Lambda(std::string_view x, std::shared_ptr<Expression> e) : x(x), e(e) {}
-    Lambda(std::string_view x, RefType constraint, std::shared_ptr<Expression> e) : x(x), constraint(constraint), e(e) {}
-    ~Lambda() override {}
+        /// <summary>
+        /// 束縛された型
+        /// </summary>
+        RefTypeInfo type;
+    };
 
     /// <summary>
-    /// typeについてラムダ抽象に関するダングリングが生じているかをチェックする
+    /// シンボルの識別番号ごとの束縛のスタック
     /// </summary>
-    /// <param name="env">ラムダ抽象のために構成された型環境(リージョン)</param>
-    /// <param name="type">ラムダ抽象結果のジェネリックではない戻り値型情報</param>
-    /// <returns>ダングリングが生じている場合はtrue、ダングリングが生じていない場合はfalse</returns>
-    static bool checkDangling(TypeEnvironment& env, RefTypeInfo type) {
-        // 戻り値型が参照型かつをenvに属しているかを判定する
-        auto& t = std::get<RefType>(type->type);
-        t = solved(t);
-        return std::holds_alternative<Type::Ref>(t->kind) && env.include(std::get<Type::Ref>(t->kind).region);
-    }
+    std::vector<std::vector<Binding>> stacks = {};
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// <para>束縛を行った順のシンボルの列</para>
+    /// <para>型環境の破棄時にその型環境で行った束縛を巻き戻すために利用する</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
-
-        // 型環境にxを登録してeを評価
-        auto t = env.newTypeInfo(
-            this->constraint ? this->constraint.value() : newEnv.newType(Type::Variable{ .depth = newEnv.depth }),
-            env.newRegion(Region::Base{ .env = std::addressof(newEnv)})
-        );
-        newEnv.map.insert({ this->x, t });
-        auto tau = this->e->J(typeMap, newEnv);
-
-        auto ret = env.newTypeInfo(env.instantiate(typeMap, typeMap.builtin.fn, { std::get<RefType>(t->type), std::get<RefType>(tau->type) }), env.newRegion(Region::Temporary{}));
-
-        if (Lambda::checkDangling(newEnv, ret)) {
-            throw std::runtime_error("ダングリング");
-        }
-
-        return ret;
-    }
+    std::vector<Symbol> trail = {};
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// シンボルに対応する束縛のスタックの取得
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        // 型環境を新しく構成
-        // 一引数単位で型環境を構築するのは効率が悪いため通常は複数の引数を一度に扱う
-        TypeEnvironment newEnv = {
-            .parent = std::addressof(env),
-            .depth = env.depth + 1
-        };
-
-        auto t1 = newEnv.newTypeInfo(
-            this->constraint ? this->constraint.value() : newEnv.newType(Type::Variable{ .depth = newEnv.depth }),
-            newEnv.newRegion(Region::Base{ .env = std::addressof(newEnv) })
-        );
-        auto t2 = newEnv.newTypeInfo(newEnv.newType(Type::Variable{ .depth = newEnv.depth }), newEnv.newRegion(Region::Variable{ .depth = newEnv.depth }));
-        unifyFunction(typeMap, env, std::get<RefType>(rho->type), t1, t2);
-
-        // 型環境にxを登録してeを評価
-        newEnv.map.insert({ this->x, t1 });
-        this->e->M(typeMap, newEnv, t2);
-
-        if (Lambda::checkDangling(newEnv, t2)) {
-            throw std::runtime_error("ダングリング");
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する束縛のスタック</returns>
+    [[nodiscard]] std::vector<Binding>& stack(Symbol name) {
+        if (name.id >= this->stacks.size()) {
+            this->stacks.resize(name.id + 1);
         }
+        return this->stacks[name.id];
     }
 };
 
 /// <summary>
-/// 関数適用を示す構文木
+/// 型環境
 /// </summary>
-struct Apply : Expression {
+struct TypeEnvironment {
     /// <summary>
-    /// 関数を示す式
+    /// スコープにおいて1つ上の型環境
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    TypeEnvironment* parent = nullptr;
+
     /// <summary>
-    /// 引数の式
+    /// スコープの深さ
     /// </summary>
-    std::shared_ptr<Expression> e2;
+    std::size_t depth = 1;
 
-    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), e2(e2) {}
-    ~Apply() override {}
+    /// <summary>
+    /// <para>型の生成先のアリーナの所有権</para>
+    /// <para>ルートの型環境のみが所有し、子の型環境はnullptrとする</para>
+    /// </summary>
+    std::shared_ptr<TypeArena> storage = std::make_shared<TypeArena>();
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// <para>型の生成先のアリーナ</para>
+    /// <para>子の型環境は親の型環境と同一のアリーナを参照する(子の型環境は親の型環境より先に破棄されるため所有権はもたない)</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau1 = this->e1->J(typeMap, env);
-        auto tau2 = this->e2->J(typeMap, env);
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Temporary{}));
+    TypeArena* arena = this->storage.get();
 
-        unifyFunction(typeMap, env, std::get<RefType>(tau1->type), tau2, t);
+    /// <summary>
+    /// <para>識別子の束縛の表</para>
+    /// <para>子の型環境は親の型環境と同一の表を共有する</para>
+    /// </summary>
+    std::shared_ptr<BindingTable> bindings = std::make_shared<BindingTable>();
 
-        return t;
+    /// <summary>
+    /// 型環境の生成時点での束縛の列の長さ(この型環境で行った束縛の開始位置)
+    /// </summary>
+    std::size_t mark = this->bindings->trail.size();
+
+    TypeEnvironment() = default;
+    TypeEnvironment(const TypeEnvironment&) = delete;
+    TypeEnvironment(TypeEnvironment&&) = delete;
+    TypeEnvironment& operator=(const TypeEnvironment&) = delete;
+    TypeEnvironment& operator=(TypeEnvironment&&) = delete;
+    ~TypeEnvironment() {
+        // この型環境で行った束縛を巻き戻す
+        auto& trail = this->bindings->trail;
+        while (trail.size() > this->mark) {
+            this->bindings->stacks[trail.back().id].pop_back();
+            trail.pop_back();
+        }
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 子の型環境を生成する
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+    /// <param name="depth">子の型環境のスコープの深さ</param>
+    /// <returns>この型環境とアリーナと束縛の表を共有し、アリーナの所有権をもたない型環境</returns>
+    [[nodiscard]] TypeEnvironment child(std::size_t depth) {
+        return TypeEnvironment(this, depth, this->arena, this->bindings);
+    }
 
-        this->e1->M(typeMap, env, env.newTypeInfo(env.instantiate(typeMap, typeMap.builtin.fn, { std::get<RefType>(t->type), std::get<RefType>(rho->type) }), env.newRegion(Region::Base{ .env = std::addressof(env) })));
-        this->e2->M(typeMap, env, t);
+    /// <summary>
+    /// <para>識別子に型を束縛する</para>
+    /// <para>この型環境で既に束縛済みの場合は上書きする</para>
+    /// </summary>
+    /// <param name="name">識別子のシンボル</param>
+    /// <param name="type">束縛する型</param>
+    void bind(Symbol name, RefTypeInfo type) {
+        auto& stack = this->bindings->stack(name);
+        if (!stack.empty() && stack.back().env == this) {
+            stack.back().type = std::move(type);
+        }
+        else {
+            stack.push_back({ .env = this, .type = std::move(type) });
+            this->bindings->trail.push_back(name);
+        }
     }
-};
 
-/// <summary>
-/// Let束縛を示す構文木
-/// </summary>
-struct Let : Expression {
     /// <summary>
-    /// 束縛先の識別子名
+    /// 識別子がこの型環境で束縛されているかを判定する
     /// </summary>
-    std::string x;
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>この型環境で束縛されている場合にtrue、そうでない場合にfalse</returns>
+    [[nodiscard]] bool contains(Symbol name) const {
+        auto& stacks = this->bindings->stacks;
+        return name.id < stacks.size() && !stacks[name.id].empty() && stacks[name.id].back().env == this;
+    }
+
     /// <summary>
-    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// 識別子のシンボルから型を取り出す
     /// </summary>
-    std::vector<RefType> params = {};
+    /// <param name="name">識別子のシンボル</param>
+    /// <returns>nameに対応する型</returns>
+    [[nodiscard]] std::optional<RefTypeInfo> lookup(Symbol name) {
+        InferenceStats::Probe probe(inferenceStats.lookup);
+        if (name.id < this->bindings->stacks.size()) {
+            auto& stack = this->bindings->stacks[name.id];
+            for (auto itr = stack.rbegin(); itr != stack.rend(); ++itr) {
+                probe.add(1);
+                // 生存中の子の型環境の束縛は参照しない
+                if (itr->env->depth <= this->depth) {
+                    return itr->type;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
     /// <summary>
-    /// 束縛する式
+    /// 型の生成
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefType newType(Type::kind_type&& kind) {
+        return this->arena->newType(std::move(kind));
+    }
+
     /// <summary>
-    /// xを利用する式
+    /// コンテキスト情報付きの型の生成
     /// </summary>
-    std::shared_ptr<Expression> e2;
+    /// <param name="type">型情報</param>
+    /// <param name="region">型情報が属するリージョン</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefTypeInfo newTypeInfo(RefType type, RefRegion region) {
+        auto info = RefTypeInfo(new TypeInfo({ .type = type, .region = region }));
+        trail.retain(info);
+        return info;
+    }
 
-    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    Let(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
-    ~Let() override {}
+    /// <summary>
+    /// コンテキスト情報付きの型の生成
+    /// </summary>
+    /// <param name="type">型情報</param>
+    /// <param name="region">型情報が属するリージョン</param>
+    /// <returns>生成した型</returns>
+    [[nodiscard]] RefTypeInfo newTypeInfo(Generic&& type, RefRegion region) {
+        auto info = RefTypeInfo(new TypeInfo({ .type = std::move(type), .region = region }));
+        trail.retain(info);
+        return info;
+    }
 
     /// <summary>
-    /// typeについてlet束縛に関するダングリングが生じているかをチェックする
+    /// リージョン型の生成
     /// </summary>
-    /// <param name="type">let束縛するジェネリックではない型情報</param>
-    /// <returns>ダングリングが生じている場合はtrue、ダングリングが生じていない場合はfalse</returns>
-    static bool checkDangling(RefTypeInfo type) {
-        // 一時オブジェクトへの参照をlet束縛しているかを判定する
-        auto& t = std::get<RefType>(type->type);
-        t = solved(t);
-        return std::holds_alternative<Type::Ref>(t->kind) && std::holds_alternative<Region::Temporary>(solved(std::get<Type::Ref>(t->kind).region)->kind);
+    /// <param name="kind">型の固有情報</param>
+    /// <returns>生成したリージョン型</returns>
+    [[nodiscard]] RefRegion newRegion(Region::kind_type&& kind) {
+        return this->arena->newRegion(std::move(kind));
     }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 自由な型変数について型をgeneralizeする
     /// </summary>
-    /// <param name="typeMap">型表</param>
+    /// <param name="type">複製対象の型</param>
     /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau1 = this->e1->J(typeMap, env);
-
-        if (Let::checkDangling(tau1)) {
-            throw std::runtime_error(std::format("ダングリング：{}", this->x));
-        }
-
-        // 識別子の多重定義の禁止
-        if (env.map.contains(this->x)) {
-            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x));
-        }
-        // 型環境にxを定義
-        auto g = env.generalize(std::get<RefType>(tau1->type), this->params);
-        auto region = env.newRegion(Region::Base{ .env = std::addressof(env) });
-        auto typeInfo = std::holds_alternative<Generic>(g) ? env.newTypeInfo(std::move(std::get<Generic>(g)), region) : env.newTypeInfo(std::get<RefType>(g), region);
-        env.map.insert({ this->x,  typeInfo });
-
-        return this->e2->J(typeMap, env);
-    }
+    /// <param name="vals">generalize対象の型変数のリスト</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] std::variant<RefType, Generic> generalize(RefType type, std::vector<RefType> vals = std::vector<RefType>());
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// ジェネリック型の型変数についてinstantiateする
     /// </summary>
     /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+    /// <param name="type">複製対象の型</param>
+    /// <param name="vals">型変数へ適用対象の型</param>
+    /// <returns>複製結果</returns>
+    [[nodiscard]] RefType instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals = std::vector<RefType>());
 
-        this->e1->M(typeMap, env, t);
+    /// <summary>
+    /// <para>組込みの関数型の生成</para>
+    /// <para>typeMap.builtin.fnのinstantiateと同一の型を汎用のinstantiateを経由せずに生成する</para>
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="paramType">引数型</param>
+    /// <param name="returnType">戻り値型</param>
+    /// <returns>生成した関数型</returns>
+    [[nodiscard]] RefType newFunction(TypeMap& typeMap, RefType paramType, RefType returnType);
 
-        if (Let::checkDangling(t)) {
-            throw std::runtime_error(std::format("ダングリング：{}", this->x));
+    /// <summary>
+    /// <para>regionが型環境に含まれるかを判定する</para>
+    /// <para>実装の詳細はconvertを参照</para>
+    /// </summary>
+    /// <param name="region">判定対象のリージョン</param>
+    /// <returns>含まれている場合はtrue, 含まれていない場合はfalse</returns>
+    [[nodiscard]] bool include(RefRegion& region) {
+        region = solved(region);
+ 
+        if (std::holds_alternative<Region::Temporary>(region->kind)) {
+            return true;
         }
-
-        // 識別子の多重定義の禁止
-        if (env.map.contains(this->x)) {
-            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x));
+        if (std::holds_alternative<Region::Base>(region->kind)) {
+            // regionがthisのスコープに含まれているかを見る
+            auto r1env = std::get<Region::Base>(region->kind).env;
+            auto r2env = this;
+            if (r1env->depth > r2env->depth) {
+                return false;
+            }
+            else {
+                // region2をregion1と同一階層に移動したときに型環境が一致するかを比較する
+                while (r1env->depth != r2env->depth) {
+                    r2env = r2env->parent;
+                }
+                return r1env == r2env;
+            }
+        }
+        else {
+            return false;
         }
-        // 型環境にxを定義
-        auto g = env.generalize(std::get<RefType>(t->type), this->params);
-        auto region = env.newRegion(Region::Base{ .env = std::addressof(env) });
-        auto typeInfo = std::holds_alternative<Generic>(g) ? env.newTypeInfo(std::move(std::get<Generic>(g)), region) : env.newTypeInfo(std::get<RefType>(g), region);
-        env.map.insert({ this->x,  typeInfo });
-
-        this->e2->M(typeMap, env, rho);
     }
+
+private:
+    /// <summary>
+    /// 子の型環境を生成する
+    /// </summary>
+    /// <param name="parent">スコープにおいて1つ上の型環境</param>
+    /// <param name="depth">スコープの深さ</param>
+    /// <param name="arena">親の型環境のアリーナ</param>
+    /// <param name="bindings">親の型環境の束縛の表</param>
+    TypeEnvironment(TypeEnvironment* parent, std::size_t depth, TypeArena* arena, std::shared_ptr<BindingTable> bindings)
+        : parent(parent), depth(depth), storage(nullptr), arena(arena), bindings(std::move(bindings)) {}
 };
 
 /// <summary>
-/// Letrec束縛を示す構文木
+/// <para>型の走査の作業領域</para>
+/// <para>出現検査やgeneralizeごとにヒープを確保しないようにスレッドごとに使い回し、走査済みの型の集合は世代番号を進めることで全要素をO(1)で削除する</para>
 /// </summary>
-struct Letrec : Expression {
+struct OccursBuffer {
     /// <summary>
-    /// 束縛先の識別子名
+    /// 走査済みの型の集合の要素
     /// </summary>
-    std::string x;
+    struct Slot {
+        /// <summary>
+        /// 走査済みの型
+        /// </summary>
+        const Type* type = nullptr;
+        /// <summary>
+        /// 登録した世代番号(現在の世代番号と異なる場合は空とみなす)
+        /// </summary>
+        std::uint32_t epoch = 0;
+    };
+
     /// <summary>
-    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// <para>走査済みの型の集合(開番地法のハッシュ表)</para>
+    /// <para>要素数は常に2の冪で、使用中の要素が半分を超えないように拡張する</para>
     /// </summary>
-    std::vector<RefType> params = {};
+    std::vector<Slot> slots = {};
+
     /// <summary>
-    /// 束縛する式
+    /// 現在の世代番号
     /// </summary>
-    std::shared_ptr<Expression> e1;
+    std::uint32_t epoch = 0;
+
     /// <summary>
-    /// xを利用する式
+    /// 現在の世代の要素数
     /// </summary>
-    std::shared_ptr<Expression> e2;
+    std::size_t size = 0;
 
-    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
-    Letrec(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
-    ~Letrec() override {}
+    /// <summary>
+    /// 検査対象の型のスタック
+    /// </summary>
+    std::vector<RefType> stack = {};
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 走査済みの型の集合と検査対象の型のスタックを空にする
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 識別子の多重定義の禁止
-        if (env.map.contains(this->x)) {
-            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x));
+    void clear() {
+        this->stack.clear();
+        this->size = 0;
+        if (++this->epoch == 0) {
+            // 世代番号が一周した場合は古い世代の要素と区別できないため実際に削除する
+            std::ranges::fill(this->slots, Slot{});
+            this->epoch = 1;
         }
-        // 型環境にxを定義
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
-        env.map.insert({ this->x,  t });
-
-        auto tau1 = this->e1->J(typeMap, env);
-        // tau1は一時オブジェクトのためリージョン型については単一化をしない
-        unifyType(typeMap, std::get<RefType>(t->type), std::get<RefType>(tau1->type), true);
+    }
 
-        if (Let::checkDangling(t)) {
-            throw std::runtime_error(std::format("ダングリング：{}", this->x));
+    /// <summary>
+    /// 走査済みの型を登録する
+    /// </summary>
+    /// <param name="type">登録する型</param>
+    /// <returns>新たに登録した場合はtrue、登録済みの場合はfalse</returns>
+    [[nodiscard]] bool insert(const Type* type) {
+        if ((this->size + 1) * 2 > this->slots.size()) {
+            // 現在の世代の要素のみを2倍の大きさの表に移す
+            std::vector<Slot> slots(std::max<std::size_t>(this->slots.size() * 2, 64));
+            std::swap(slots, this->slots);
+            for (const auto& slot : slots) {
+                if (slot.epoch == this->epoch) {
+                    *this->find(slot.type) = slot;
+                }
+            }
         }
-
-        t->type = env.generalize(std::get<RefType>(tau1->type), this->params);
-
-        return this->e2->J(typeMap, env);
+        auto slot = this->find(type);
+        if (slot->epoch == this->epoch) {
+            return false;
+        }
+        *slot = { .type = type, .epoch = this->epoch };
+        ++this->size;
+        return true;
     }
 
+private:
     /// <summary>
-    /// Algorithm Mの適用
+    /// 型が登録済みの要素もしくは登録先の空の要素を探索する
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        // 識別子の多重定義の禁止
-        if (env.map.contains(this->x)) {
-            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x));
+    /// <param name="type">探索する型</param>
+    /// <returns>探索結果の要素</returns>
+    [[nodiscard]] Slot* find(const Type* type) {
+        auto mask = this->slots.size() - 1;
+        // 型のアドレスは整列されていて下位のビットが偏るため乗算で攪拌する
+        auto hash = static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(type) >> 4) * 0x9e3779b97f4a7c15ull);
+        for (auto i = (hash ^ (hash >> 29)) & mask; ; i = (i + 1) & mask) {
+            auto& slot = this->slots[i];
+            if (slot.epoch != this->epoch || slot.type == type) {
+                return std::addressof(slot);
+            }
         }
-        // 型環境にxを定義
-        auto t1 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
-        auto t2 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Temporary{}));
-        env.map.insert({ this->x,  t1 });
+    }
+};
+/// <summary>
+/// スレッドごとの出現検査の作業領域
+/// </summary>
+constinit thread_local OccursBuffer occursBuffer = {};
+/// <summary>
+/// スレッドごとのgeneralizeの作業領域
+/// </summary>
+constinit thread_local OccursBuffer generalizeBuffer = {};
 
-        this->e1->M(typeMap, env, t2);
-        // t2は一時オブジェクトのためリージョン型については単一化をしない
-        unifyType(typeMap, std::get<RefType>(t1->type), std::get<RefType>(t2->type), true);
+/// <summary>
+/// 自由な型変数について型をgeneralizeする
+/// </summary>
+/// <param name="type">複製対象の型</param>
+/// <param name="env">型環境</param>
+/// <param name="vals">generalize対象の型変数のリスト</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] std::variant<RefType, Generic> TypeEnvironment::generalize(RefType type, std::vector<RefType> vals) {
+    InferenceStats::Probe probe(inferenceStats.generalize);
+    InferenceTrace::Span span("generalize", "generalize");
+    generalizeBuffer.clear();
 
-        if (Let::checkDangling(t1)) {
-            throw std::runtime_error(std::format("ダングリング：{}", this->x));
+    std::vector<RefRegion> regionVals;
+    // generalizeの対象の型もしくはリージョン型の参照先のスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<std::variant<RefType*, RefRegion*>> stack = { std::addressof(type) };
+
+    // 自由なリージョン型の型変数について型をgeneralizeする
+    auto generalizeRegion = [&](RefRegion& region) {
+        if (std::holds_alternative<Region::Variable>(region->kind)) {
+            // リージョン型に解決済みの別のリージョンが存在するならば解決しておく
+            auto& var = std::get<Region::Variable>(region->kind);
+            if (var.solve) {
+                trail.assign(region, solved(var.solve.value()));
+            }
+
+            // リージョン型の型変数をgeneralizeするか検査
+            if (std::holds_alternative<Region::Variable>(region->kind)) {
+                auto& var2 = std::get<Region::Variable>(region->kind);
+
+                if (this->depth < var2.depth) {
+                    // 自由な型変数のためgeneralizeする
+                    // 一度generalize済みならばx.solveに解決結果が記録されるため、ここにはgeneralize未の場合のみしか到達しない
+                    auto p = this->newRegion(Region::Param{ .index = regionVals.size() });
+                    trail.assign(var2.solve, std::optional(p));
+                    trail.assign(region, p);
+                    regionVals.push_back(p);
+                }
+            }
         }
+    };
 
-        t1->type = env.generalize(std::get<RefType>(t1->type), this->params);
+    struct fn {
+        RefType& t;
+        TypeEnvironment& e;
+        std::vector<RefType>& v;
+        std::vector<std::variant<RefType*, RefRegion*>>& s;
+        const RefType* r;
 
-        this->e2->M(typeMap, env, rho);
+        /// <summary>
+        /// <para>走査中の型の参照先を書き換える</para>
+        /// <para>型の節点の書き換えは巻き戻せるようにTrailに記録する(generalizeの対象の型自身は局所変数のため記録しない)</para>
+        /// </summary>
+        /// <param name="value">書き換え後の型</param>
+        void assign(RefType value) {
+            if (std::addressof(this->t) == this->r) {
+                this->t = value;
+            }
+            else {
+                trail.assign(this->t, value);
+            }
+        }
+
+        void operator()([[maybe_unused]] Type::Base& x) {
+            // generalizeしない
+        }
+        void operator()(Type::Function& x) {
+            if (this->e.arena->interned(this->t)) {
+                // 共有された関数型は型変数を含まないためgeneralizeしない
+                // 部分型の共有を木として展開して走査することになるため部分型も積まない
+                return;
+            }
+            if (!generalizeBuffer.insert(this->t)) {
+                // 走査済みの関数型は部分型の書き換えも済んでいるため再び走査しない
+                return;
+            }
+            // 引数型と戻り値型をgeneralizeする
+            // 引数型の型変数から順に番号を振るため戻り値型から積む
+            this->s.push_back(std::addressof(x.returnType));
+            this->s.push_back(std::addressof(x.paramType));
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                // 解決済みの型変数の場合は解決結果に対してgeneralizeする
+                // この際にGeneric型から完全に型変数を除去するために簡約
+                this->assign(solved(x.solve));
+                this->s.push_back(std::addressof(this->t));
+                return;
+            }
+
+            if (this->e.depth < x.depth) {
+                // 自由な型変数のためgeneralizeする
+                // 一度generalize済みならばx.solveに解決結果が記録されるため、ここにはgeneralize未の場合のみしか到達しない
+                // 導出した型変数に対する型制約は継承する
+                auto p = this->e.newType(Type::Param{ .constraints = std::move(x.constraints), .index = this->v.size() });
+                trail.assign(x.solve, p);
+                this->v.push_back(p);
+                this->assign(p);
+            }
+            // 束縛された型変数のためgeneralizeしない
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {
+            // 外のスコープから与えられた型変数もしくはgeneralize済みの型変数のためgeneralizeしない
+        }
+        void operator()(Type::TypeClass& x) {
+            // リージョン型に対してgeneralizeする
+            this->s.push_back(std::addressof(x.region));
+        }
+        void operator()(Type::Ref& x) {
+            if (!generalizeBuffer.insert(this->t)) {
+                // 走査済みの参照型は部分型の書き換えも済んでいるため再び走査しない
+                return;
+            }
+            // 参照先の型に対してgeneralizeしてからリージョン型に対してgeneralizeする
+            this->s.push_back(std::addressof(x.region));
+            this->s.push_back(std::addressof(x.type));
+        }
+    };
+
+    while (!stack.empty()) {
+        auto slot = stack.back();
+        stack.pop_back();
+        if (std::holds_alternative<RefRegion*>(slot)) {
+            generalizeRegion(*std::get<RefRegion*>(slot));
+            continue;
+        }
+        auto& t = *std::get<RefType*>(slot);
+        probe.add(1);
+        std::visit(fn{ .t = t, .e = *this, .v = vals, .s = stack, .r = std::addressof(type) }, t->kind);
     }
-};
+
+    if (vals.size() > 0 || regionVals.size() > 0) {
+        return Generic{ .vals = std::move(vals), .regionVals = std::move(regionVals), .type = std::move(type)};
+    }
+    else {
+        return type;
+    }
+}
 
 /// <summary>
-/// クラスメソッドへのアクセスを示す構文木
+/// <para>型クラス</para>
+/// <para>型クラスごとに一意のインスタンスを持つ</para>
 /// </summary>
-struct AccessToClassMethod : Expression {
+struct TypeClass {
     /// <summary>
-    /// 式
+    /// 型クラス名
     /// </summary>
-    std::shared_ptr<Expression> e;
+    const std::string name;
 
     /// <summary>
-    /// クラスメソッド名
+    /// <para>基底</para>
+    /// <para>基底のtypeはthisのtypeと一致する</para>
     /// </summary>
-    std::string x;
+    Constraints bases = {};
 
-    AccessToClassMethod(std::shared_ptr<Expression> e, std::string_view x) : e(e), x(x) {}
-    ~AccessToClassMethod() override {}
+    /// <summary>
+    /// <para>型クラスを実装する対象の型を示す型変数</para>
+    /// <para>制約なしの空なType::Paramである必要がある</para>
+    /// </summary>
+    RefType type;
 
     /// <summary>
-    /// 指定された型からクラスメソッドを抽出する
+    /// <para>クラスメソッド</para>
+    /// <para>第一引数はtype(self)固定</para>
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="type">クラスメソッドを実装した型</param>
-    /// <returns>クラスメソッドを示す型</returns>
-    RefTypeInfo getClassMethod(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo type) {
-        // typeがxをクラスメソッドとしてただ1つもつか検査
-        // 型クラスを実装しているかだけを見るため、クラスメソッドの実装方式などは見ない
-        auto& typeClassList = std::get<RefType>(type->type)->getTypeClassList(typeMap);
-        auto [typeClass, index] = typeClassList.getClassMethod(this->x);
+    std::unordered_map<std::string, std::variant<RefType, Generic>> methods = {};
 
-        if (typeClass) {
-            return env.newTypeInfo(
-                typeClass.value()->getInstantiatedMethod(typeMap, env, this->x, type),
-                env.newRegion(Region::Temporary{})
-            );
+    /// <summary>
+    /// <para>型クラスの通し番号</para>
+    /// <para>TypeMap::addTypeClassで登録した際に採番する</para>
+    /// </summary>
+    std::optional<std::size_t> id = std::nullopt;
+
+    /// <summary>
+    /// <para>自身を含む継承している型クラスの通し番号の集合</para>
+    /// <para>TypeMap::addTypeClassで登録した際に基底の推移閉包として事前計算する</para>
+    /// </summary>
+    TypeClassSet ancestors = {};
+
+    /// <summary>
+    /// thisが指定された型クラスを継承しているか判定
+    /// </summary>
+    /// <param name="typeClass">継承しているか判定する対象の型クラス</param>
+    /// <returns>継承している場合はtrue、継承していない場合はfalse</returns>
+    [[nodiscard]] bool derived(RefTypeClass typeClass) const {
+        if (this->id) {
+            // 登録済みの型クラスの基底は全て登録済みのため事前計算した集合で判定する
+            return typeClass->id && this->ancestors.contains(typeClass->id.value());
         }
-        else {
-            throw std::runtime_error(std::format("クラスメソッドが実装されていない：{}", this->x));
+
+        // 未登録の型クラスは基底を辿って判定する
+        // 型クラス/インスタンスの一意性に基づき評価する
+        if (this == typeClass.get()) {
+            return true;
         }
+        return this->bases.has(typeClass);
     }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// インスタンス化されたクラスメソッドを取得する
     /// </summary>
     /// <param name="typeMap">型表</param>
     /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        auto tau = this->e->J(typeMap, env);
-
-        // クラスメソッドを取得して部分適用結果の型を取得する
-        return this->getClassMethod(typeMap, env, tau);
-    }
+    /// <param name="methodName">クラスメソッド名(存在するかについては呼び出し元で保証する)</param>
+    /// <param name="type">クラスメソッドを呼び出す型</param>
+    /// <returns></returns>
+    [[nodiscard]] RefType getInstantiatedMethod(TypeMap& typeMap, TypeEnvironment& env, const std::string& methodName, RefTypeInfo type);
+};
+
+/// <summary>
+/// 型クラスを登録して通し番号を採番する
+/// </summary>
+/// <param name="typeClass">登録する型クラス</param>
+/// <param name="ancestors">基底が継承している型クラスの通し番号の集合</param>
+void TypeClassTable::add(const RefTypeClass& typeClass, TypeClassSet ancestors) {
+    std::lock_guard lock(this->mutex);
+    typeClass->id = this->typeClasses.size();
+    ancestors.insert(typeClass->id.value());
+    typeClass->ancestors = std::move(ancestors);
+    this->typeClasses.push_back(typeClass);
+}
+
+/// <summary>
+/// 型クラスのリストから型制約を構築する
+/// </summary>
+/// <param name="typeClasses">型制約とする型クラス</param>
+
+Constraints::Constraints(std::initializer_list<RefTypeClass> typeClasses) {
+    for (const auto& typeClass : typeClasses) {
+        this->insert(typeClass);
+    }
+}
+
+/// <summary>
+/// 型制約を追加する
+/// </summary>
+/// <param name="typeClass">追加する型クラス(登録済みである必要がある)</param>
+void Constraints::insert(const RefTypeClass& typeClass) {
+    if (!typeClass->id) {
+        throw std::runtime_error(std::format("型クラス{}は事前に定義が必要", typeClass->name));
+    }
+    if (this->closure.contains(typeClass->id.value())) {
+        // 既に同じ型クラスもしくは派生の型クラスが存在する
+        return;
+    }
+    this->set.insert(typeClass->id.value());
+    this->closure |= typeClass->ancestors;
+    this->reduce();
+}
+
+/// <summary>
+/// <para>型制約をマージする</para>
+/// <para>型クラスの継承関係により縮約を適用しながらマージを行う</para>
+/// </summary>
+/// <param name="constraints">マージ対象の型クラス</param>
+void Constraints::merge(const Constraints& constraints) {
+    if (constraints.empty() || this->includes(constraints)) {
+        return;
+    }
+
+    if (this->empty()) {
+        // もともと制約がない場合は単純コピーをする
+        *this = constraints;
+    }
+    else {
+        // 和集合を取ってからより制約が強いものに縮約する
+        this->set |= constraints.set;
+        this->closure |= constraints.closure;
+        this->reduce();
+    }
+}
+
+/// <summary>
+/// 他の型クラスの基底となっている型クラスをsetから除去する
+/// </summary>
+void Constraints::reduce() {
+    auto& table = TypeClassTable::instance();
+    // setの型クラスの真の基底の集合
+    TypeClassSet bases;
+    this->set.forEach([&](std::size_t id) {
+        auto ancestors = table.typeClasses[id]->ancestors;
+        ancestors.erase(id);
+        bases |= ancestors;
+    });
+    this->set -= bases;
+}
+
+/// <summary>
+/// 制約を持つか検査
+/// </summary>
+/// <param name="typeClass">制約を持つか検査する型クラス</param>
+[[nodiscard]] bool Constraints::has(const RefTypeClass& typeClass) const {
+    // 全てのtypeが実装している型クラスの継承関係を事前に集約しているため1度の判定で済む
+    return typeClass->id && this->closure.contains(typeClass->id.value());
+}
 
+/// <summary>
+/// 型に関するデータ
+/// </summary>
+struct TypeData {
     /// <summary>
-    /// Algorithm Mの適用
+    /// 型の表現
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
-        this->e->M(typeMap, env, t);
+    std::variant<RefType, Generic> type;
 
-        // クラスメソッドを取得して部分適用結果の型を取得する
-        // クラスメソッドは常に一時オブジェクトとして扱う
-        unifyWithRef(typeMap, std::get<RefType>(rho->type), this->getClassMethod(typeMap, env, t));
-        rho->region->kind = Region::Temporary{};
-    }
+    /// <summary>
+    /// 実装している型クラス(制約)
+    /// </summary>
+    Constraints typeclasses = {};
 };
 
 /// <summary>
-/// 二項演算を示す構文木
+/// <para>型表</para>
+/// <para>freezeで凍結した型表は変更されないため、任意の数の型推論から同時に参照できる</para>
+/// <para>型推論ごとの追加はoverlayで凍結した型表の上に重ねた型表に対して行う</para>
 /// </summary>
-struct BinaryExpression : Expression {
+struct TypeMap {
     /// <summary>
-    /// 左項
+    /// <para>下層の凍結した型表</para>
+    /// <para>自身に登録されていない型と型クラスは下層から探索する</para>
     /// </summary>
-    std::shared_ptr<Expression> lhs;
+    const TypeMap* prelude = nullptr;
+
     /// <summary>
-    /// 右項
+    /// 凍結済みか
     /// </summary>
-    std::shared_ptr<Expression> rhs;
+    bool frozen = false;
 
-    BinaryExpression(std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : lhs(lhs), rhs(rhs) {}
-    ~BinaryExpression() override {}
+    /// <summary>
+    /// 型の表
+    /// </summary>
+    std::unordered_map<std::string, TypeData> typeMap = {};
 
     /// <summary>
-    /// クラスメソッドを抽出する
+    /// 型クラスの表
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="type">クラスメソッドを実装した型</param>
-    /// <returns>クラスメソッドを示す型</returns>
-    RefType getClassMethod(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo type) {
-        auto& typeClass = this->getTypeClass();
-        auto& methodName = this->getMethodName();
-        // クラスメソッドがないのは論理エラーとする
-        assert(typeClass->methods.contains(methodName));
+    std::unordered_map<std::string, RefTypeClass> typeClassMap = {};
 
-        return typeClass->getInstantiatedMethod(typeMap, env, methodName, type);
+    /// <summary>
+    /// <para>クラスメソッド名からクラスメソッドを定義している型クラスの通し番号の集合への索引</para>
+    /// <para>基底から継承したクラスメソッドは含まない</para>
+    /// </summary>
+    std::unordered_map<Symbol, TypeClassSet> methodIndex = {};
+
+    /// <summary>
+    /// クラスメソッドの解決結果のキャッシュのキー(縮約された型制約とクラスメソッド名の組)
+    /// </summary>
+    struct MethodKey {
+        /// <summary>
+        /// 縮約された型制約
+        /// </summary>
+        TypeClassSet set;
+        /// <summary>
+        /// クラスメソッド名
+        /// </summary>
+        Symbol name;
+
+        [[nodiscard]] bool operator==(const MethodKey&) const = default;
+    };
+
+    /// <summary>
+    /// MethodKeyのハッシュ関数
+    /// </summary>
+    struct MethodKeyHash {
+        [[nodiscard]] std::size_t operator()(const MethodKey& key) const noexcept {
+            std::size_t seed = std::hash<TypeClassSet>{}(key.set);
+            seed ^= std::hash<Symbol>{}(key.name) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            return seed;
+        }
+    };
+
+    /// <summary>
+    /// <para>クラスメソッドの解決結果のキャッシュ</para>
+    /// <para>型クラスの追加では既存の型制約の継承関係は変化しないため無効化は不要</para>
+    /// <para>凍結後は更新しない</para>
+    /// </summary>
+    std::unordered_map<MethodKey, std::optional<RefTypeClass>, MethodKeyHash> methodCache = {};
+
+    /// <summary>
+    /// <para>組込み型の定義</para>
+    /// <para>型の生成時は必ずこれを経由する</para>
+    /// </summary>
+    struct {
+        /// <summary>
+        /// 関数型
+        /// </summary>
+        Generic fn;
+        /// <summary>
+        /// 参照型
+        /// </summary>
+        Generic ref;
+    } builtin;
+
+    TypeMap() = default;
+    TypeMap(TypeMap&&) = default;
+    ~TypeMap() {
+        // 型の実体は型表より長く生存しうるため、freezeで基底型へ記録した自身の型に関するデータを消去する
+        // 記録は移動しても変化しない自身の要素のアドレスで識別する
+        if (!this->frozen) {
+            return;
+        }
+        for (const auto& [name, data] : this->typeMap) {
+            auto type = std::holds_alternative<Generic>(data.type) ? std::get<Generic>(data.type).type : std::get<RefType>(data.type);
+            auto& x = std::get<Type::Base>(Type::getBaseType(type)->kind);
+            if (x.data == std::addressof(data)) {
+                x.data = nullptr;
+                x.owner = nullptr;
+            }
+        }
     }
 
     /// <summary>
-    /// 二項演算を示す型クラスを取得する
+    /// 型名から型に関するデータを探索する
     /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    virtual const RefTypeClass& getTypeClass() const = 0;
+    /// <param name="name">型名</param>
+    /// <returns>型に関するデータ(存在しない場合はnullptr)</returns>
+    [[nodiscard]] const TypeData* findType(const std::string& name) const {
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->typeMap.find(name); itr != typeMap->typeMap.end()) {
+                return std::addressof(itr->second);
+            }
+        }
+        return nullptr;
+    }
 
     /// <summary>
-    /// 二項演算をクラスメソッド名を取得する
+    /// 型クラス名から型クラスを探索する
     /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    virtual const std::string& getMethodName() const = 0;
+    /// <param name="name">型クラス名</param>
+    /// <returns>型クラス(存在しない場合はnullptr)</returns>
+    [[nodiscard]] RefTypeClass findTypeClass(const std::string& name) const {
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->typeClassMap.find(name); itr != typeMap->typeClassMap.end()) {
+                return itr->second;
+            }
+        }
+        return nullptr;
+    }
 
     /// <summary>
-    /// Algorithm Jの適用
+    /// 型クラス名から型クラスを取得する
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <returns>評価結果の型</returns>
-    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
-        // 左項については型制約の適用・検査
-        auto tau1 = this->lhs->J(typeMap, env);
-        typeMap.applyConstraint(std::get<RefType>(tau1->type), { this->getTypeClass() });
-        auto tau2 = this->rhs->J(typeMap, env);
+    /// <param name="name">型クラス名</param>
+    /// <returns>型クラス</returns>
+    [[nodiscard]] RefTypeClass getTypeClass(const std::string& name) const {
+        auto typeClass = this->findTypeClass(name);
+        if (!typeClass) {
+            throw std::runtime_error(std::format("型クラス{}が定義されていない", name));
+        }
+        return typeClass;
+    }
 
-        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
-        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Temporary{}));
-        unifyFunction(typeMap, env, this->getClassMethod(typeMap, env, tau1), tau2, t);
+    /// <summary>
+    /// <para>型表を凍結する</para>
+    /// <para>型推論中に遅延して構築するinstantiateの雛形を事前に構築し、以降の変更を禁止する</para>
+    /// </summary>
+    void freeze() {
+        auto build = [](const Generic& generic) {
+            if (!generic.spine) {
+                generic.spine = GenericTemplate::build(generic);
+            }
+        };
+        build(this->builtin.fn);
+        build(this->builtin.ref);
+        for (const auto& [name, data] : this->typeMap) {
+            if (std::holds_alternative<Generic>(data.type)) {
+                build(std::get<Generic>(data.type));
+            }
+            // 型名による探索を避けるために基底型へ型に関するデータを記録する
+            // 凍結後は変更しないため型推論中は読み取りのみとなる
+            auto type = std::holds_alternative<Generic>(data.type) ? std::get<Generic>(data.type).type : std::get<RefType>(data.type);
+            auto& x = std::get<Type::Base>(Type::getBaseType(type)->kind);
+            x.data = std::addressof(data);
+            x.owner = this;
+        }
+        for (const auto& [name, typeClass] : this->typeClassMap) {
+            for (const auto& [methodName, method] : typeClass->methods) {
+                if (std::holds_alternative<Generic>(method)) {
+                    build(std::get<Generic>(method));
+                }
+            }
+        }
+        this->frozen = true;
+    }
 
-        return t;
+    /// <summary>
+    /// <para>凍結した型表の上に型推論ごとの型表を重ねる</para>
+    /// <para>重ねた型表への追加は凍結した型表に影響しない</para>
+    /// </summary>
+    /// <returns>重ねた型表</returns>
+    [[nodiscard]] TypeMap overlay() const {
+        if (!this->frozen) {
+            throw std::runtime_error("凍結していない型表には重ねられない");
+        }
+        TypeMap typeMap;
+        typeMap.prelude = this;
+        typeMap.builtin = this->builtin;
+        return typeMap;
     }
 
     /// <summary>
-    /// Algorithm Mの適用
+    /// 型定義の追加
     /// </summary>
-    /// <param name="typeMap">型表</param>
-    /// <param name="env">型環境</param>
-    /// <param name="rho">式が推測される型</param>
-    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
-        auto t1 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
-        // 左項については型制約の適用・検査
-        this->lhs->M(typeMap, env, t1);
-        typeMap.applyConstraint(std::get<RefType>(t1->type), { this->getTypeClass() });
+    /// <param name="type">追加する型</param>
+    /// <returns>追加した型</returns>
+    auto& addType(RefType type) {
+        // 型から型名を取り出して登録する
+        auto typeName = type->getTypeName();
+        assert(!!typeName);
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型{}は追加できない", *typeName.value()));
+        }
+        if (this->prelude && this->prelude->findType(*typeName.value())) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type }});
+        if (!ret) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        return *itr;
+    }
 
-        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
-        auto t2 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
-        unifyFunction(typeMap, env, this->getClassMethod(typeMap, env, t1), t2, rho);
+    /// <summary>
+    /// 型定義の追加
+    /// </summary>
+    /// <param name="type">追加する型</param>
+    /// <returns>追加した型</returns>
+    auto& addType(const Generic& type) {
+        // 型から型名を取り出して登録する
+        auto typeName = type.type->getTypeName();
+        assert(!!typeName);
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型{}は追加できない", *typeName.value()));
+        }
+        if (this->prelude && this->prelude->findType(*typeName.value())) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        auto [itr, ret] = this->typeMap.insert({ *typeName.value(), { .type = type } });
+        if (!ret) {
+            throw std::runtime_error(std::format("型{}が多重定義された", *typeName.value()));
+        }
+        return *itr;
+    }
 
-        this->rhs->M(typeMap, env, t2);
+    /// <summary>
+    /// 型クラスの定義の追加
+    /// </summary>
+    /// <param name="typeClass">追加する型クラス</param>
+    /// <returns>追加した型クラス</returns>
+    auto& addTypeClass(RefTypeClass typeClass) {
+        if (this->frozen) {
+            throw std::runtime_error(std::format("凍結した型表に型クラス{}は追加できない", typeClass->name));
+        }
+        if (typeClass->id || (this->prelude && this->prelude->findTypeClass(typeClass->name))) {
+            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
+        }
+        // 基底の継承関係は登録済みのため基底の集合の和として継承関係を構成する
+        TypeClassSet ancestors;
+        typeClass->bases.forEach([&](const RefTypeClass& base) {
+            ancestors |= base->ancestors;
+        });
+
+        auto [itr, ret] = this->typeClassMap.insert({ typeClass->name, typeClass });
+        if (!ret) {
+            throw std::runtime_error(std::format("型クラス{}が多重定義された", typeClass->name));
+        }
+        // 通し番号を採番する
+        TypeClassTable::instance().add(typeClass, std::move(ancestors));
+
+        // クラスメソッドの索引に登録する
+        for (const auto& method : typeClass->methods) {
+            this->methodIndex[Symbol(method.first)].insert(typeClass->id.value());
+        }
+        return *itr;
     }
-};
 
-/// <summary>
-/// 加算を示す構文木
-/// </summary>
-struct Add : BinaryExpression {
     /// <summary>
-    /// 加算の定義についての型クラス
+    /// <para>型制約から指定されたクラスメソッドを定義している型クラスを解決する</para>
+    /// <para>基底よりも派生の型クラスを優先して探索し、解決結果は型制約とクラスメソッド名の組ごとにキャッシュする</para>
+    /// <para>下層の型表のキャッシュも参照するが、更新するのは凍結していない自身のキャッシュのみ</para>
     /// </summary>
-    static RefTypeClass typeClass;
+    /// <param name="constraints">クラスメソッドを探索する型制約</param>
+    /// <param name="name">クラスメソッド名</param>
+    /// <returns>クラスメソッドを定義している型クラス(存在しない場合はstd::nullopt)</returns>
+    [[nodiscard]] std::optional<RefTypeClass> getClassMethod(const Constraints& constraints, Symbol name) {
+        auto key = MethodKey{ .set = constraints.set, .name = name };
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->methodCache.find(key); itr != typeMap->methodCache.end()) {
+                return itr->second;
+            }
+        }
+
+        // 型制約が継承している型クラスのうちnameを定義している型クラスを抽出する
+        TypeClassSet defined;
+        for (const TypeMap* typeMap = this; typeMap; typeMap = typeMap->prelude) {
+            if (auto itr = typeMap->methodIndex.find(name); itr != typeMap->methodIndex.end()) {
+                defined |= itr->second;
+            }
+        }
+        auto candidates = constraints.closure;
+        candidates &= defined;
+
+        // nameを定義している型クラスの基底はnameを定義していても無視する
+        // 要は基底よりも派生の方をクラスメソッドの探索対象として優先する
+        auto& table = TypeClassTable::instance();
+        Constraints resolved;
+        candidates.forEach([&](std::size_t id) { resolved.insert(table.typeClasses[id]); });
+        if (resolved.size() > 1) {
+            throw std::runtime_error(std::format("クラスメソッドが一意に特定できない：{}", name.name()));
+        }
+
+        std::optional<RefTypeClass> typeClass = std::nullopt;
+        resolved.forEach([&typeClass](const RefTypeClass& t) { typeClass = t; });
+        if (!this->frozen) {
+            this->methodCache.insert({ std::move(key), typeClass });
+        }
+        return typeClass;
+    }
+
     /// <summary>
-    /// 加算尾定義についてのクラスメソッド名
+    /// 型に制約としての型クラスを適用する
     /// </summary>
-    static std::string methodName;
+    /// <param name="type">適用対象の型</param>
+    /// <param name="typeClass">適用対象の型クラス</param>
+    void applyConstraint(RefType type, const Constraints& typeClasses) {
+        InferenceStats::Probe probe(inferenceStats.applyConstraint);
+
+        // 解決済みの型変数および参照型が存在すればそれを解消してから制約の適用を行う
+        auto t = unwrapRef(type);
+
+        if (std::holds_alternative<Type::Variable>(t->kind)) {
+            // 通常の型変数に対しては後からでも自由に型制約を追加可能
+
+            // 型制約にtypeClassesを追加
+            auto& constraints = std::get<Type::Variable>(t->kind).constraints;
+            trail.save(constraints);
+            constraints.merge(typeClasses);
+        }
+        else {
+            // トップレベルが型変数ではない通常の型の場合は後から型制約の追加は禁止
+            // 型がtypeClassesを実装しているか検査する
+            probe.add(1);
+
+            auto& constraints = t->getTypeClassList(*this);
+            if (constraints.includes(typeClasses)) {
+                return;
+            }
+
+            typeClasses.forEach([&](const RefTypeClass& typeClass) {
+                // typeがtypeClassを実装しているか検査する
+                // 実装していない型クラスが見つかった場合は異常とする
+                if (!constraints.has(typeClass)) {
+                    // 登録済みの型クラスは登録された型クラス名をそのまま保持している
+                    if (typeClass->id) {
+                        if (std::holds_alternative<Type::Param>(t->kind)) {
+                            throw std::runtime_error(std::format("ジェネリック型における型変数は事前に制約{}の宣言が必要", typeClass->name));
+                        }
+                        throw std::runtime_error(std::format("型クラス{}を実装していない", typeClass->name));
+                    }
+                    else {
+                        // 匿名の型クラス（未実装）を制約として課そうとしたときの異常のため
+                        // ここに到達することは論理エラーとする
+                        assert(false);
+                    }
+                }
+            });
+        }
+    }
+};
+
+/// <summary>
+/// 型に紐づく型クラスのリストの取得
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <returns>型に紐づく型クラスのリスト</returns>
+const Constraints& Type::getTypeClassList(TypeMap& typeMap) const {
+    // 型変数の場合は型制約としての型クラスのリストを返す
+    if (std::holds_alternative<Type::Variable>(this->kind)) {
+        return *std::get<Type::Variable>(this->kind).constraints;
+    }
+    else if (std::holds_alternative<Type::Param>(this->kind)) {
+        return *std::get<Type::Param>(this->kind).constraints;
+    }
+    else if (std::holds_alternative<Type::TypeClass>(this->kind)) {
+        // 型としての型クラスはそのまま保持している型クラスのリストを返す
+        return *std::get<Type::TypeClass>(this->kind).typeClasses;
+    }
+    else if (std::holds_alternative<Type::Ref>(this->kind)) {
+        // 参照型の場合は参照型を解除してから型クラスのリストを取得する
+        // Type::Variableの場合の動作に合わせるためにsolvedは適用しない
+        return std::get<Type::Ref>(this->kind).type->getTypeClassList(typeMap);
+    }
+
+    // それ以外の型(明示的に型名を持つ型)は型表に登録された型に関するデータから取得する
+    return this->getTypeData(typeMap).typeclasses;
+}
+
+/// <summary>
+/// 明示的に型名を持つ型について型表に登録された型に関するデータを取得する
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <returns>型に関するデータ</returns>
+const TypeData& Type::getTypeData(const TypeMap& typeMap) const {
+    auto& x = std::get<Type::Base>(Type::getBaseType(this)->kind);
+
+    // 凍結時に記録した型表がtypeMapの下層にある場合のみ記録を利用する
+    if (x.data) {
+        for (const TypeMap* map = std::addressof(typeMap); map; map = map->prelude) {
+            if (map == x.owner) {
+                return *x.data;
+            }
+        }
+    }
+
+    // 記録がない型推論ごとの型は型名で型表を探索する
+    auto data = typeMap.findType(x.name.name());
+    assert(data);
+    return *data;
+}
+
+/// <summary>
+/// <para>組込みの関数型の生成</para>
+/// <para>typeMap.builtin.fnのinstantiateと同一の型を汎用のinstantiateを経由せずに生成する</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="paramType">引数型</param>
+/// <param name="returnType">戻り値型</param>
+/// <returns>生成した関数型</returns>
+[[nodiscard]] RefType TypeEnvironment::newFunction(TypeMap& typeMap, RefType paramType, RefType returnType) {
+    // 組込みの関数型の型変数は型制約をもたないため制約の検査は不要
+    return this->newType(Type::Function{
+        .base = std::get<Type::Function>(typeMap.builtin.fn.type->kind).base,
+        .paramType = paramType,
+        .returnType = returnType
+    });
+}
+
+/// <summary>
+/// ジェネリック型の型変数についてinstantiateする
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="type">複製対象の型</param>
+/// <param name="vals">型変数へ適用対象の型</param>
+/// <returns>複製結果</returns>
+[[nodiscard]] RefType TypeEnvironment::instantiate(TypeMap& typeMap, const Generic& type, std::vector<RefType> vals) {
+    InferenceStats::Probe probe(inferenceStats.instantiate);
+
+    // instantiateした対象の型変数のリスト
+    vals.resize(type.vals.size());
+    std::vector<RefRegion> regionVals;
+    regionVals.reserve(type.regionVals.size());
+
+    // デフォルトでvalsが要素をもつときは型制約を適用・検査する
+    for (decltype(type.vals.size()) i = 0; i < type.vals.size(); ++i) {
+        auto& param = std::get<Type::Param>(type.vals[i]->kind);
+        if (!vals[i]) {
+            // 型が割当たっていない場合は型変数を割り当てる
+            // 型変数に課された制約を継承する
+            vals[i] = this->newType(Type::Variable{ .constraints = param.constraints, .depth = this->depth });
+        }
+        else {
+            typeMap.applyConstraint(vals[i], *param.constraints);
+        }
+    }
+    for (decltype(type.regionVals.size()) i = 0; i < type.regionVals.size(); ++i) {
+        regionVals.push_back(this->newRegion(Region::Variable{ .depth = this->depth }));
+    }
+
+    if (!type.spine) {
+        type.spine = GenericTemplate::build(type);
+    }
+
+    // instantiateした骨格の節点のリスト
+    std::vector<RefType> nodes(type.spine->nodes.size());
+
+    auto get = [&](const GenericTemplate::Operand& operand) {
+        switch (operand.kind) {
+        case GenericTemplate::Operand::Kind::VAL:
+            return vals[operand.index];
+        case GenericTemplate::Operand::Kind::NODE:
+            return nodes[operand.index];
+        default:
+            return operand.type;
+        }
+    };
+    auto getRegion = [&](const GenericTemplate::RegionOperand& operand) {
+        return operand.kind == GenericTemplate::Operand::Kind::VAL ? regionVals[operand.index] : operand.region;
+    };
+
+    // 後行順に並んでいるため子は常に生成済み
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        auto& node = type.spine->nodes[i];
+        if (std::holds_alternative<Type::Function>(node.source->kind)) {
+            // 組込み型である関数型なので基底を継承する
+            auto& x = std::get<Type::Function>(node.source->kind);
+            nodes[i] = this->newType(Type::Function{ .base = x.base, .paramType = get(node.first), .returnType = get(node.second) });
+        }
+        else if (std::holds_alternative<Type::Ref>(node.source->kind)) {
+            // 組込み型である参照型なので基底を継承する
+            auto& x = std::get<Type::Ref>(node.source->kind);
+            nodes[i] = this->newType(Type::Ref{ .base = x.base, .type = get(node.first), .region = getRegion(node.region) });
+        }
+        else {
+            auto& x = std::get<Type::TypeClass>(node.source->kind);
+            nodes[i] = this->newType(Type::TypeClass{ .typeClasses = x.typeClasses, .region = getRegion(node.region) });
+        }
+    }
+    probe.add(nodes.size());
+    return get(type.spine->root);
+}
+
+/// <summary>
+/// <para>region2からregion1へ暗黙の型変換をする</para>
+/// <para>束でいうならば型変数をtop、Region::Temporaryをbottomとしてregion2≧region1の場合に変換する</para>
+/// </summary>
+/// <param name="region1">変換先のリージョン</param>
+/// <param name="region2">変換元のリージョン</param>
+/// <returns>変換を実施した場合はtrue, 変換を実施していない場合はfalse</returns>
+[[nodiscard]] bool convert(RefRegion& region1, RefRegion& region2) {
+    InferenceStats::Probe probe(inferenceStats.convert);
+
+    // 型解決のネストを解消する
+    trail.assign(region1, solved(region1));
+    trail.assign(region2, solved(region2));
+
+    if (std::holds_alternative<Region::Temporary>(region1->kind)) {
+        // 変換先がbottomであるため常に変換可能
+        if (std::holds_alternative<Region::Variable>(region2->kind)) {
+            trail.assign(std::get<Region::Variable>(region2->kind).solve, std::optional(region1));
+        }
+        trail.assign(region2, region1);
+        return true;
+    }
+    if (!std::holds_alternative<Region::Temporary>(region2->kind)) {
+        if (std::holds_alternative<Region::Variable>(region2->kind)) {
+            // topのため常に変換可能
+            trail.assign(std::get<Region::Variable>(region2->kind).solve, std::optional(region1));
+            trail.assign(region2, region1);
+            return true;
+        }
+        else if (std::holds_alternative<Region::Variable>(region1->kind)) {
+            // region2がtopならばregion1もtopである必要があるため変換不可
+            return false;
+        }
+        else if (std::holds_alternative<Region::Param>(region1->kind) || std::holds_alternative<Region::Param>(region2->kind)) {
+            // region1とregion2のどちらかがジェネリック型に出現する型変数の場合は同じリージョンでなければ変換不可
+            return region1 == region2;
+        }
+        else {
+            auto r1env = std::get<Region::Base>(region2->kind).env;
+            auto r2env = std::get<Region::Base>(region1->kind).env;
+            if (r1env->depth > r2env->depth) {
+                // 深いスコープから浅いスコープへの変換は不可にする
+                // リージョン推論などによりスコープの変換が可能な場合はその限りではない
+                return false;
+            }
+            else {
+                // region2をregion1と同一階層に移動したときに型環境が一致するかを比較する
+                while (r1env->depth != r2env->depth) {
+                    r2env = r2env->parent;
+                }
+                if (r1env == r2env) {
+                    trail.assign(region2, region1);
+                    return true;
+                }
+                return false;
+            }
+        }
+    }
+    else {
+        // region1がbottomならばregion2もbottomである必要があるため変換不可
+        return false;
+    }
+}
+
+/// <summary>
+/// <para>型変数targetがtypeに出現するかの判定(出現検査)</para>
+/// <para>検査と同時にtypeに出現する自由な型変数のスコープの深さをtargetの深さまで引き下げる</para>
+/// <para>共有された部分型は1度の検査につき1度のみ走査する</para>
+/// </summary>
+/// <param name="type">検査対象の型</param>
+/// <param name="target">出現を検査する型変数</param>
+/// <returns>typeにtargetが出現する場合にtrue、出現しない場合にfalse</returns>
+[[nodiscard]] bool occurs(RefType type, RefType target) {
+    InferenceStats::Probe probe(inferenceStats.occurs);
+
+    // 走査済みの型と検査対象の型のスタックはスレッドごとに使い回す
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    auto& visited = occursBuffer;
+    auto& stack = occursBuffer.stack;
+    visited.clear();
+    stack.push_back(type);
+
+    struct fn {
+        const std::size_t depth;
+        std::vector<RefType>& stack;
+
+        void operator()([[maybe_unused]] Type::Base& x) {}
+        void operator()(Type::Function& x) {
+            // 引数型から先に検査するため戻り値型から積む
+            this->stack.push_back(x.returnType);
+            this->stack.push_back(x.paramType);
+        }
+        void operator()(Type::Variable& x) {
+            if (x.solve) {
+                this->stack.push_back(solved(x.solve));
+                return;
+            }
+            // targetより深いスコープでgeneralizeされないようにスコープの深さを引き下げる
+            trail.assign(x.depth, std::min(x.depth, this->depth));
+        }
+        void operator()([[maybe_unused]] Type::Param& x) {}
+        void operator()([[maybe_unused]] Type::TypeClass& x) {}
+        void operator()(Type::Ref& x) {
+            this->stack.push_back(x.type);
+        }
+    };
+
+    const auto depth = std::get<Type::Variable>(target->kind).depth;
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (t == target) {
+            return true;
+        }
+        if (!visited.insert(t)) {
+            // 走査済みの部分型は再度検査しない
+            continue;
+        }
+        probe.add(1);
+        std::visit(fn{ .depth = depth, .stack = stack }, t->kind);
+    }
+    return false;
+}
+
+
+/// <summary>
+/// 暗黙の型変換のパターンの列挙
+/// </summary>
+enum struct ImplicitCastPattern {
+    /// <summary>
+    /// 参照型への変換
+    /// </summary>
+    REFERENCE,
+    /// <summary>
+    /// 型としての型クラスへの変換
+    /// </summary>
+    TYPECLASS,
+
+    /// <summary>
+    /// 暗黙の型変換はなし
+    /// </summary>
+    NONE
+};
+
+/// <summary>
+/// <para>暗黙の型変換付きの副作用付きの2つの型の単一化</para>
+/// <para>暗黙の型変換はtype1 &lt;- type2の方向で行われる</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="type1">単一化の対象の型1</param>
+/// <param name="type2">単一化の対象の型2</param>
+/// <param name="implicitCast">暗黙の型変換が有効であるか</param>
+/// <returns>
+/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
+/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
+/// </returns>
+ImplicitCastPattern unifyType(TypeMap& typeMap, RefType& type1, RefType& type2, bool implicitCast) {
+    InferenceStats::Probe probe(inferenceStats.unify);
+    InferenceTrace::Span span("unify", "unifyType");
+
+    /// <summary>
+    /// 単一化の処理単位
+    /// </summary>
+    struct Frame {
+        /// <summary>
+        /// 単一化の対象の型1への参照
+        /// </summary>
+        RefType* type1;
+        /// <summary>
+        /// 単一化の対象の型2への参照
+        /// </summary>
+        RefType* type2;
+        /// <summary>
+        /// 暗黙の型変換が有効であるか(トップレベルの型のみ有効)
+        /// </summary>
+        bool implicitCast = false;
+        /// <summary>
+        /// 部分型の単一化後に行う後処理であるか
+        /// </summary>
+        bool post = false;
+    };
+
+    // 単一化の処理単位のスタック
+    // 深い型でもネイティブのスタックを消費しないように再帰呼び出しの代わりに明示的なスタックで部分型を走査する
+    std::vector<Frame> stack = { { .type1 = std::addressof(type1), .type2 = std::addressof(type2), .implicitCast = implicitCast } };
+    while (!stack.empty()) {
+
+        auto frame = stack.back();
+        stack.pop_back();
+        probe.add(1);
+        auto& t1 = *frame.type1;
+        auto& t2 = *frame.type2;
+
+        if (frame.post) {
+            // 部分型の単一化後の後処理
+            if (std::holds_alternative<Type::Function>(t1->kind)) {
+                auto& k1 = std::get<Type::Function>(t1->kind);
+                auto& k2 = std::get<Type::Function>(t2->kind);
+                if (k1.paramType == k2.paramType && k1.returnType == k2.returnType) {
+                    trail.assign(t1, t2);
+                }
+            }
+            else {
+                auto& k1 = std::get<Type::Ref>(t1->kind);
+                auto& k2 = std::get<Type::Ref>(t2->kind);
+                // 参照型同士の場合はt1 <- t2でリージョンも一致させる
+                if (!convert(k1.region, k2.region)) {
+                    // リージョンに互換性がない
+                    assert(false);
+                }
+                if (k1.type == k2.type) {
+                    trail.assign(t1, t2);
+                }
+            }
+            continue;
+        }
+
+        // 解決済みの型変数が存在すればそれを適用してから単一化を行う
+        trail.assign(t1, solved(t1));
+        trail.assign(t2, solved(t2));
+
+        if (t1 != t2) {
+            if (std::holds_alternative<Type::Variable>(t1->kind)) {
+                auto& t1v = std::get<Type::Variable>(t1->kind);
+
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    // 型変数同士の場合は併合して代表元にそろえる
+                    auto root = unite(t1, t2);
+                    trail.assign(t1, root);
+                    trail.assign(t2, root);
+                }
+                else {
+                    if (occurs(t2, t1)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    // t2がt1の制約を満たすかを検証する
+                    typeMap.applyConstraint(t2, *t1v.constraints);
+                    trail.assign(t1v.solve, t2);
+                    trail.assign(t1, t2);
+                }
+            }
+            else {
+                if (std::holds_alternative<Type::Variable>(t2->kind)) {
+                    auto& t2v = std::get<Type::Variable>(t2->kind);
+                    if (occurs(t1, t2)) {
+                        // 再帰的な単一化は決定不能のため異常(ex. x -> x xのような関数)
+                        throw std::runtime_error("再帰的単一化");
+                    }
+                    // 一方のみが型変数の場合はもう一方と型を一致させる
+                    // t1がt2の制約を満たすかを検証する
+                    typeMap.applyConstraint(t1, *t2v.constraints);
+                    trail.assign(t2v.solve, t1);
+                    trail.assign(t2, t1);
+                }
+                else {
+                    // 型が一致する場合に部分型について単一化
+                    if (t1->kind.index() == t2->kind.index()) {
+                        if (std::holds_alternative<Type::Function>(t1->kind)) {
+                            auto& k1 = std::get<Type::Function>(t1->kind);
+                            auto& k2 = std::get<Type::Function>(t2->kind);
+                            // t2 <: t1を仮定すると引数型は反変、戻り値型は共変なサブタイピングが行えるが
+                            // バイナリレベルでの互換性はないため暗黙の型変換は無効
+                            // 引数型、戻り値型、後処理の順に処理するため逆順に積む
+                            stack.push_back({ .type1 = std::addressof(t1), .type2 = std::addressof(t2), .post = true });
+                            stack.push_back({ .type1 = std::addressof(k1.returnType), .type2 = std::addressof(k2.returnType) });
+                            stack.push_back({ .type1 = std::addressof(k1.paramType), .type2 = std::addressof(k2.paramType) });
+                        }
+                        else if (frame.implicitCast && std::holds_alternative<Type::TypeClass>(t1->kind)) {
+                            auto& k1 = std::get<Type::TypeClass>(t1->kind);
+                            auto& k2 = std::get<Type::TypeClass>(t2->kind);
+
+                            // 型クラス同士が一致していない場合は暗黙の型変換が実施可能か検証する
+                            bool ret = k1.typeClasses != k2.typeClasses;
+                            if (ret) {
+                                // t1に課された型クラスがt2で実装されているか検証
+                                typeMap.applyConstraint(t2, *k1.typeClasses);
+                            }
+
+                            // 型クラス同士の場合はt1 <- t2でリージョンも一致させる
+                            if (!convert(k1.region, k2.region)) {
+                                // リージョンに互換性がない
+                                assert(false);
+                            }
+                            if (!ret) {
+                                trail.assign(t1, t2);
+                            }
+
+                            return ret ? ImplicitCastPattern::TYPECLASS : ImplicitCastPattern::NONE;
+                        }
+                        else if (std::holds_alternative<Type::Ref>(t1->kind)) {
+                            auto& k1 = std::get<Type::Ref>(t1->kind);
+                            auto& k2 = std::get<Type::Ref>(t2->kind);
+                            // 参照型同士では暗黙の型変換を無効
+                            // 参照先の型の単一化後にリージョンを一致させるため後処理を先に積む
+                            stack.push_back({ .type1 = std::addressof(t1), .type2 = std::addressof(t2), .post = true });
+                            stack.push_back({ .type1 = std::addressof(k1.type), .type2 = std::addressof(k2.type) });
+                        }
+                        else {
+                            // 部分型をもたないため型は一致しない
+                            throw std::runtime_error("型の不一致");
+                        }
+                    }
+                    else {
+                        // 型の種類が一致しない
+                        throw std::runtime_error("型の不一致");
+                    }
+                }
+            }
+        }
+    }
+    return ImplicitCastPattern::NONE;
+}
+
+/// <summary>
+/// <para>参照型への暗黙の型変換付きの副作用付きの2つの型の単一化</para>
+/// <para>暗黙の型変換はtype1 &lt;- type2の方向で行われる</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="type1">単一化の対象の型1</param>
+/// <param name="type2">単一化の対象の型2</param>
+/// <returns>
+/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
+/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
+/// </returns>
+ImplicitCastPattern unifyWithRef(TypeMap& typeMap, RefType& type1, RefTypeInfo type2) {
+    // ジェネリック型を単一化に含まないことは論理エラーとする
+    assert(std::holds_alternative<RefType>(type2->type));
+
+    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
+    trail.assign(type1, solved(type1));
+    auto& t2 = std::get<RefType>(type2->type);
+    trail.assign(t2, solved(t2));
+
+    if (type1->kind.index() != t2->kind.index() && !std::holds_alternative<Type::Variable>(t2->kind)) {
+        if (std::holds_alternative<Type::TypeClass>(type1->kind)) {
+            // type1 <- type2な型としての型クラスへの暗黙の型変換の検証
+            // type1に課された型クラスがtype2で実装されているか検証となる
+            auto& k1 = std::get<Type::TypeClass>(type1->kind);
+            typeMap.applyConstraint(t2, *k1.typeClasses);
+
+            // 暗黙の型変換に成功したならばtype1の参照先のリージョンにtype2のリージョンを反映
+            if (!convert(type2->region, k1.region)) {
+                // リージョンに互換性がない
+                assert(false);
+            }
+
+            return ImplicitCastPattern::TYPECLASS;
+        }
+        else if (std::holds_alternative<Type::Ref>(type1->kind)) {
+            // type1 <- type2な参照型ではない型から参照型への暗黙の型変換の検証
+            // 参照型の参照先の型との暗黙の型変換は無効化する
+            auto& k1 = std::get<Type::Ref>(type1->kind);
+            unifyType(typeMap, k1.type, t2, false);
+
+            // 暗黙の型変換に成功したならばtype1の参照先のリージョンにtype2のリージョンを反映
+            if (!convert(type2->region, k1.region)) {
+                // リージョンに互換性がない
+                assert(false);
+            }
+
+            return ImplicitCastPattern::REFERENCE;
+        }
+    }
+
+    // 参照型に関する暗黙の型変換が生じないパターンでは通常の単一化を行う
+    return unifyType(typeMap, type1, t2, true);
+}
+
+/// <summary>
+/// <para>暗黙の型変換付きの副作用付きの2つの関数型の単一化</para>
+/// <para>暗黙の型変換は引数型と戻り値型でそれぞれtype1 &lt;- type2の方向で行われる</para>
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="env">型環境</param>
+/// <param name="type1">単一化の対象の型1</param>
+/// <param name="type2p">単一化の対象の型2の引数型</param>
+/// <param name="type2r">単一化の対象の型2の戻り値型</param>
+/// <returns>
+/// <para>暗黙の型変換が生じたかを示すImplicitCastPatternの値</para>
+/// <para>NONE以外の場合は暗黙の型変換が生じたため、明示的なキャストの構文を構文木に挿入する対処が必要</para>
+/// </returns>
+std::variant<std::pair<ImplicitCastPattern, ImplicitCastPattern>, ImplicitCastPattern> unifyFunction(TypeMap& typeMap, TypeEnvironment& env, RefType type1, RefTypeInfo type2p, RefTypeInfo type2r) {
+
+    // 解決済みの型変数が存在すればそれを適用してから単一化を行う
+    auto t1 = solved(type1);
+
+    if (std::holds_alternative<Type::Function>(t1->kind)) {
+        auto& k1 = std::get<Type::Function>(t1->kind);
+        return std::pair{
+            unifyWithRef(typeMap, k1.paramType, type2p),
+            unifyWithRef(typeMap, k1.returnType, type2r)
+        };
+    }
+    else {
+        // 関数型の引数型と戻り値型に関して個別の単一化ができない場合は通常の単一化を行う
+        // type1は型変数でなければ異常となる
+        if (std::holds_alternative<Type::Variable>(t1->kind)) {
+            trail.assign(std::get<Type::Variable>(t1->kind).solve, env.newFunction(typeMap, std::get<RefType>(type2p->type), std::get<RefType>(type2r->type)));
+        }
+        else {
+            // 型の種類が一致しない
+            throw std::runtime_error("型の不一致");
+        }
+        return ImplicitCastPattern::NONE;
+    }
+}
+
+/// <summary>
+/// インスタンス化されたクラスメソッドを取得する
+/// </summary>
+/// <param name="typeMap">型表</param>
+/// <param name="env">型環境</param>
+/// <param name="methodName">クラスメソッド名(存在するかについては呼び出し元で保証する)</param>
+/// <param name="type">クラスメソッドを呼び出す型</param>
+/// <returns></returns>
+[[nodiscard]] RefType TypeClass::getInstantiatedMethod(TypeMap& typeMap, TypeEnvironment& env, const std::string& methodName, RefTypeInfo type) {
+    assert(this->methods.contains(methodName));
+
+    // クラスメソッドがジェネリック型ならinstantiateする
+    // 型クラスを実装する対象の型についてもinstantiateする
+    auto& method = this->methods.at(methodName);
+    auto f = env.instantiate(typeMap, Generic{
+        .vals = { this->type },
+        .regionVals = {},
+        .type = (
+            std::holds_alternative<Generic>(method) ?
+            env.instantiate(typeMap, std::get<Generic>(method)) :
+            std::get<RefType>(method)
+        )
+        });
+
+    // 第一引数がtypeで呼び出し可能なクラスメソッドであるかを検査する
+    // 例えば、typeが参照型でfの第一引数が値型の場合は呼び出し不可
+    unifyWithRef(typeMap, std::get<Type::Function>(f->kind).paramType, type);
+
+    return std::get<Type::Function>(f->kind).returnType;
+}
+
+/// <summary>
+/// 式を示す構文木
+/// </summary>
+struct Expression {
+    virtual ~Expression() {};
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    virtual RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) = 0;
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    virtual void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) = 0;
+};
+
+/// <summary>
+/// 定数を示す構文木(簡単のために値はもたない)
+/// </summary>
+struct Constant : Expression {
+    /// <summary>
+    /// 定数の型
+    /// </summary>
+    RefType b;
+
+    Constant(RefType b) : b(b) {}
+    ~Constant() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J([[maybe_unused]] TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Constant");
+
+        return env.newTypeInfo(this->b, env.newRegion(Region::Temporary{}));
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, [[maybe_unused]] TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Constant");
+
+        // リテラルのインスタンスは常に一時オブジェクトとして扱う
+        unifyWithRef(typeMap, std::get<RefType>(rho->type), env.newTypeInfo(this->b, env.newRegion(Region::Temporary{})));
+        trail.save(rho->region->kind);
+        rho->region->kind = Region::Temporary{};
+    }
+};
+
+/// <summary>
+/// 識別子を示す構文木
+/// </summary>
+struct Identifier : Expression {
+    /// <summary>
+    /// 識別子名
+    /// </summary>
+    Symbol x;
+
+    Identifier(std::string_view x) : x(x) {}
+    ~Identifier() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Identifier", this->x);
+
+        // 型環境から型を取り出す
+        auto tau = env.lookup(this->x);
+        if (tau) {
+            // 使用済みであるかの検証は線型型をを未実装のためまだない
+            
+            auto& type = tau.value()->type;
+            if (std::holds_alternative<RefType>(type)) {
+                return tau.value();
+            }
+            else {
+                // 多相のためにinstantiateする(単相の場合は不要)
+                // ジェネリック型のインスタンスは常に一時オブジェクトとして扱う
+                return env.newTypeInfo(env.instantiate(typeMap, std::get<Generic>(type)), env.newRegion(Region::Temporary{}));
+            }
+        }
+        throw std::runtime_error(std::format("不明な識別子：{}", this->x.name()));
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Identifier", this->x);
+
+        // 型環境から型を取り出す
+        auto tau = env.lookup(this->x);
+        if (tau) {
+            // 使用済みであるかの検証は線型型をを未実装のためまだない
+
+            auto& type = tau.value()->type;
+            if (std::holds_alternative<RefType>(type)) {
+                if (unifyWithRef(typeMap, std::get<RefType>(rho->type), tau.value()) == ImplicitCastPattern::NONE) {
+                    // 暗黙的な型変換が生じなかった場合はtauと同じリージョンをもたせる
+                    // rhoで与えられるリージョン型は基本的にenvと同じ型環境上の型変数と仮定しているため、convertによる変換は不可
+                    trail.assign(rho->region, tau.value()->region);
+                }
+                else {
+                    // 暗黙的な型変換が生じた場合は一時オブジェクトとして扱う
+                    trail.save(rho->region->kind);
+                    rho->region->kind = Region::Temporary{};
+                }
+            }
+            else {
+                // 多相のためにinstantiateする(単相の場合は不要)
+                // ジェネリック型のインスタンスは常に一時オブジェクトとして扱う
+                unifyWithRef(typeMap, std::get<RefType>(rho->type), env.newTypeInfo(env.instantiate(typeMap, std::get<Generic>(type)), env.newRegion(Region::Temporary{})));
+                trail.save(rho->region->kind);
+                rho->region->kind = Region::Temporary{};
+            }
+        }
+        else {
+            throw std::runtime_error(std::format("不明な識別子：{}", this->x.name()));
+        }
+    }
+};
+
+/// <summary>
+/// <para>ラムダ抽象を示す構文木</para>
+/// <para>複数の引数はカリー化された関数として扱い、1つの型環境ですべての引数を束縛する</para>
+/// </summary>
+struct Lambda : Expression {
+    /// <summary>
+    /// 引数
+    /// </summary>
+    struct Parameter {
+        /// <summary>
+        /// 引数名
+        /// </summary>
+        Symbol x;
+        /// <summary>
+        /// xの型制約
+        /// </summary>
+        std::optional<RefType> constraint = std::nullopt;
+    };
+
+    /// <summary>
+    /// 引数のリスト
+    /// </summary>
+    std::vector<Parameter> params;
+    /// <summary>
+    /// 関数本体の式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+
+    Lambda(std::string_view x, std::shared_ptr<Expression> e) : params{ Parameter{ .x = Symbol(x) } }, e(e) {}
+    Lambda(std::string_view x, RefType constraint, std::shared_ptr<Expression> e) : params{ Parameter{ .x = Symbol(x), .constraint = constraint } }, e(e) {}
+    Lambda(std::vector<Parameter> params, std::shared_ptr<Expression> e) : params(std::move(params)), e(e) {
+        assert(!this->params.empty());
+    }
+    ~Lambda() override {}
+
+    /// <summary>
+    /// typeについてラムダ抽象に関するダングリングが生じているかをチェックする
+    /// </summary>
+    /// <param name="env">ラムダ抽象のために構成された型環境(リージョン)</param>
+    /// <param name="type">ラムダ抽象結果のジェネリックではない戻り値型情報</param>
+    /// <returns>ダングリングが生じている場合はtrue、ダングリングが生じていない場合はfalse</returns>
+    static bool checkDangling(TypeEnvironment& env, RefTypeInfo type) {
+        // 戻り値型が参照型かつをenvに属しているかを判定する
+        // 型情報への書き戻しはTrailに記録されないため解決済みの型は局所変数に取り出す
+        auto t = solved(std::get<RefType>(type->type));
+        return std::holds_alternative<Type::Ref>(t->kind) && env.include(std::get<Type::Ref>(t->kind).region);
+    }
+
+    /// <summary>
+    /// 引数を型環境に登録する
+    /// </summary>
+    /// <param name="env">ラムダ抽象のために構成された型環境</param>
+    /// <returns>引数型情報のリスト</returns>
+    std::vector<RefTypeInfo> bindParams(TypeEnvironment& env) {
+        std::vector<RefTypeInfo> types;
+        types.reserve(this->params.size());
+        for (auto& p : this->params) {
+            auto t = env.newTypeInfo(
+                p.constraint ? p.constraint.value() : env.newType(Type::Variable{ .depth = env.depth }),
+                env.newRegion(Region::Base{ .env = std::addressof(env) })
+            );
+            env.bind(p.x, t);
+            types.push_back(t);
+        }
+        return types;
+    }
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Lambda", this->params.empty() ? std::nullopt : std::optional(this->params.front().x));
+
+        // 型環境を新しく構成
+        TypeEnvironment newEnv = env.child(env.depth + 1);
+
+        // 型環境に引数を登録してeを評価
+        auto ts = this->bindParams(newEnv);
+        auto tau = this->e->J(typeMap, newEnv);
+
+        // 末尾の引数から順に関数型を構成する
+        auto f = std::get<RefType>(tau->type);
+        for (auto itr = ts.rbegin(); itr != ts.rend(); ++itr) {
+            f = env.newFunction(typeMap, std::get<RefType>((*itr)->type), f);
+        }
+        auto ret = env.newTypeInfo(f, env.newRegion(Region::Temporary{}));
+
+        if (Lambda::checkDangling(newEnv, ret)) {
+            throw std::runtime_error("ダングリング");
+        }
+
+        return ret;
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Lambda", this->params.empty() ? std::nullopt : std::optional(this->params.front().x));
+
+        // 型環境を新しく構成
+        TypeEnvironment newEnv = env.child(env.depth + 1);
+
+        // 型環境に引数を登録する
+        auto ts = this->bindParams(newEnv);
+        auto t2 = newEnv.newTypeInfo(newEnv.newType(Type::Variable{ .depth = newEnv.depth }), newEnv.newRegion(Region::Variable{ .depth = newEnv.depth }));
+
+        // 先頭の引数から順に関数型を単一化する
+        // 途中の戻り値型は残りの引数をとる関数型となる
+        auto f = std::get<RefType>(rho->type);
+        for (std::size_t i = 0; i + 1 < ts.size(); ++i) {
+            auto r = newEnv.newTypeInfo(newEnv.newType(Type::Variable{ .depth = newEnv.depth }), newEnv.newRegion(Region::Variable{ .depth = newEnv.depth }));
+            unifyFunction(typeMap, env, f, ts[i], r);
+            f = std::get<RefType>(r->type);
+        }
+        unifyFunction(typeMap, env, f, ts.back(), t2);
+
+        // eを評価
+        this->e->M(typeMap, newEnv, t2);
+
+        if (Lambda::checkDangling(newEnv, t2)) {
+            throw std::runtime_error("ダングリング");
+        }
+    }
+};
+
+/// <summary>
+/// <para>関数適用を示す構文木</para>
+/// <para>複数の引数は先頭から順に1つずつ適用する</para>
+/// </summary>
+struct Apply : Expression {
+    /// <summary>
+    /// 関数を示す式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// 引数の式のリスト
+    /// </summary>
+    std::vector<std::shared_ptr<Expression>> args;
+
+    Apply(std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : e1(e1), args{ e2 } {}
+    Apply(std::shared_ptr<Expression> e1, std::vector<std::shared_ptr<Expression>> args) : e1(e1), args(std::move(args)) {}
+    ~Apply() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Apply");
+
+        auto tau1 = this->e1->J(typeMap, env);
+        std::vector<RefTypeInfo> ts(this->args.size());
+        for (std::size_t i = 0; i < this->args.size(); ++i) {
+            ts[i] = this->args[i]->J(typeMap, env);
+        }
+        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Temporary{}));
+
+        // 引数ごとに戻り値型を新たな型変数と単一化すると出現検査で残りの関数型を繰り返し走査するため
+        // 関数型である間は引数型のみを暗黙の型変換付きで単一化して戻り値型をそのままたどる
+        auto f = std::get<RefType>(tau1->type);
+        std::size_t i = 0;
+        for (; i + 1 < ts.size(); ++i) {
+            auto g = solved(f);
+            if (!std::holds_alternative<Type::Function>(g->kind)) {
+                break;
+            }
+            auto& k = std::get<Type::Function>(g->kind);
+            unifyWithRef(typeMap, k.paramType, ts[i]);
+            f = k.returnType;
+        }
+
+        // 残りの引数は末尾の引数から関数型を1度だけ構成して単一化する
+        auto r = t;
+        if (i + 1 < ts.size()) {
+            auto rest = std::get<RefType>(t->type);
+            for (auto j = ts.size(); j-- > i + 1;) {
+                rest = env.newFunction(typeMap, std::get<RefType>(ts[j]->type), rest);
+            }
+            r = env.newTypeInfo(rest, env.newRegion(Region::Temporary{}));
+        }
+        unifyFunction(typeMap, env, f, ts[i], r);
+
+        return t;
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Apply");
+
+        std::vector<RefTypeInfo> ts(this->args.size());
+        auto f = std::get<RefType>(rho->type);
+        for (auto i = this->args.size(); i-- > 0;) {
+            ts[i] = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+            f = env.newFunction(typeMap, std::get<RefType>(ts[i]->type), f);
+        }
+
+        this->e1->M(typeMap, env, env.newTypeInfo(f, env.newRegion(Region::Base{ .env = std::addressof(env) })));
+        for (std::size_t i = 0; i < this->args.size(); ++i) {
+            this->args[i]->M(typeMap, env, ts[i]);
+        }
+    }
+};
+
+/// <summary>
+/// Let束縛を示す構文木
+/// </summary>
+struct Let : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// </summary>
+    std::vector<RefType> params = {};
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Let(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    Let(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
+    ~Let() override {}
+
+    /// <summary>
+    /// typeについてlet束縛に関するダングリングが生じているかをチェックする
+    /// </summary>
+    /// <param name="type">let束縛するジェネリックではない型情報</param>
+    /// <returns>ダングリングが生じている場合はtrue、ダングリングが生じていない場合はfalse</returns>
+    static bool checkDangling(RefTypeInfo type) {
+        // 一時オブジェクトへの参照をlet束縛しているかを判定する
+        // 型情報への書き戻しはTrailに記録されないため解決済みの型は局所変数に取り出す
+        auto t = solved(std::get<RefType>(type->type));
+        return std::holds_alternative<Type::Ref>(t->kind) && std::holds_alternative<Region::Temporary>(solved(std::get<Type::Ref>(t->kind).region)->kind);
+    }
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Let", this->x);
+
+        auto tau1 = this->e1->J(typeMap, env);
+
+        if (Let::checkDangling(tau1)) {
+            throw std::runtime_error(std::format("ダングリング：{}", this->x.name()));
+        }
+
+        // 識別子の多重定義の禁止
+        if (env.contains(this->x)) {
+            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x.name()));
+        }
+        // 型環境にxを定義
+        auto g = env.generalize(std::get<RefType>(tau1->type), this->params);
+        auto region = env.newRegion(Region::Base{ .env = std::addressof(env) });
+        auto typeInfo = std::holds_alternative<Generic>(g) ? env.newTypeInfo(std::move(std::get<Generic>(g)), region) : env.newTypeInfo(std::get<RefType>(g), region);
+        env.bind(this->x, typeInfo);
+
+        return this->e2->J(typeMap, env);
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Let", this->x);
+
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth + 1 }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+
+        this->e1->M(typeMap, env, t);
+
+        if (Let::checkDangling(t)) {
+            throw std::runtime_error(std::format("ダングリング：{}", this->x.name()));
+        }
+
+        // 識別子の多重定義の禁止
+        if (env.contains(this->x)) {
+            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x.name()));
+        }
+        // 型環境にxを定義
+        auto g = env.generalize(std::get<RefType>(t->type), this->params);
+        auto region = env.newRegion(Region::Base{ .env = std::addressof(env) });
+        auto typeInfo = std::holds_alternative<Generic>(g) ? env.newTypeInfo(std::move(std::get<Generic>(g)), region) : env.newTypeInfo(std::get<RefType>(g), region);
+        env.bind(this->x, typeInfo);
+
+        this->e2->M(typeMap, env, rho);
+    }
+};
+
+/// <summary>
+/// Letrec束縛を示す構文木
+/// </summary>
+struct Letrec : Expression {
+    /// <summary>
+    /// 束縛先の識別子名
+    /// </summary>
+    Symbol x;
+    /// <summary>
+    /// 明示的に宣言されたジェネリック型に出現する型変数
+    /// </summary>
+    std::vector<RefType> params = {};
+    /// <summary>
+    /// 束縛する式
+    /// </summary>
+    std::shared_ptr<Expression> e1;
+    /// <summary>
+    /// xを利用する式
+    /// </summary>
+    std::shared_ptr<Expression> e2;
+
+    Letrec(std::string_view x, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), e1(e1), e2(e2) {}
+    Letrec(std::string_view x, const std::vector<RefType>& params, std::shared_ptr<Expression> e1, std::shared_ptr<Expression> e2) : x(x), params(params), e1(e1), e2(e2) {}
+    ~Letrec() override {}
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "Letrec", this->x);
+
+        // 識別子の多重定義の禁止
+        if (env.contains(this->x)) {
+            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x.name()));
+        }
+        // 型環境にxを定義
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth + 1 }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+        env.bind(this->x, t);
+
+        auto tau1 = this->e1->J(typeMap, env);
+        // tau1は一時オブジェクトのためリージョン型については単一化をしない
+        unifyType(typeMap, std::get<RefType>(t->type), std::get<RefType>(tau1->type), true);
+
+        if (Let::checkDangling(t)) {
+            throw std::runtime_error(std::format("ダングリング：{}", this->x.name()));
+        }
+
+        auto g = env.generalize(std::get<RefType>(tau1->type), this->params);
+        trail.save(t->type);
+        t->type = std::move(g);
+
+        return this->e2->J(typeMap, env);
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "Letrec", this->x);
+
+        // 識別子の多重定義の禁止
+        if (env.contains(this->x)) {
+            throw std::runtime_error(std::format("識別子が同一スコープで多重定義されている：{}", this->x.name()));
+        }
+        // 型環境にxを定義
+        // 束縛する式の型はgeneralizeの対象となるように1段深いスコープの型変数とする
+        auto t1 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth + 1 }), env.newRegion(Region::Base{ .env = std::addressof(env) }));
+        auto t2 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth + 1 }), env.newRegion(Region::Temporary{}));
+        env.bind(this->x, t1);
+
+        this->e1->M(typeMap, env, t2);
+        // t2は一時オブジェクトのためリージョン型については単一化をしない
+        unifyType(typeMap, std::get<RefType>(t1->type), std::get<RefType>(t2->type), true);
+
+        if (Let::checkDangling(t1)) {
+            throw std::runtime_error(std::format("ダングリング：{}", this->x.name()));
+        }
+
+        auto g = env.generalize(std::get<RefType>(t1->type), this->params);
+        trail.save(t1->type);
+        t1->type = std::move(g);
+
+        this->e2->M(typeMap, env, rho);
+    }
+};
+
+/// <summary>
+/// クラスメソッドへのアクセスを示す構文木
+/// </summary>
+struct AccessToClassMethod : Expression {
+    /// <summary>
+    /// 式
+    /// </summary>
+    std::shared_ptr<Expression> e;
+
+    /// <summary>
+    /// クラスメソッド名
+    /// </summary>
+    Symbol x;
+
+    AccessToClassMethod(std::shared_ptr<Expression> e, std::string_view x) : e(e), x(Symbol(x)) {}
+    ~AccessToClassMethod() override {}
+
+    /// <summary>
+    /// 指定された型からクラスメソッドを抽出する
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="type">クラスメソッドを実装した型</param>
+    /// <returns>クラスメソッドを示す型</returns>
+    RefTypeInfo getClassMethod(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo type) {
+        // typeがxをクラスメソッドとしてただ1つもつか検査
+        // 型クラスを実装しているかだけを見るため、クラスメソッドの実装方式などは見ない
+        auto& typeClassList = std::get<RefType>(type->type)->getTypeClassList(typeMap);
+        auto typeClass = typeMap.getClassMethod(typeClassList, this->x);
+
+        if (typeClass) {
+            return env.newTypeInfo(
+                typeClass.value()->getInstantiatedMethod(typeMap, env, this->x.name(), type),
+                env.newRegion(Region::Temporary{})
+            );
+        }
+        else {
+            throw std::runtime_error(std::format("クラスメソッドが実装されていない：{}", this->x.name()));
+        }
+    }
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "AccessToClassMethod", this->x);
+
+        auto tau = this->e->J(typeMap, env);
+
+        // クラスメソッドを取得して部分適用結果の型を取得する
+        return this->getClassMethod(typeMap, env, tau);
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "AccessToClassMethod", this->x);
+
+        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
+        this->e->M(typeMap, env, t);
+
+        // クラスメソッドを取得して部分適用結果の型を取得する
+        // クラスメソッドは常に一時オブジェクトとして扱う
+        unifyWithRef(typeMap, std::get<RefType>(rho->type), this->getClassMethod(typeMap, env, t));
+        trail.save(rho->region->kind);
+        rho->region->kind = Region::Temporary{};
+    }
+};
+
+/// <summary>
+/// 二項演算を示す構文木
+/// </summary>
+struct BinaryExpression : Expression {
+    /// <summary>
+    /// 左項
+    /// </summary>
+    std::shared_ptr<Expression> lhs;
+    /// <summary>
+    /// 右項
+    /// </summary>
+    std::shared_ptr<Expression> rhs;
+
+    BinaryExpression(std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : lhs(lhs), rhs(rhs) {}
+    ~BinaryExpression() override {}
+
+    /// <summary>
+    /// クラスメソッドを抽出する
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="type">クラスメソッドを実装した型</param>
+    /// <returns>クラスメソッドを示す型</returns>
+    RefType getClassMethod(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo type) {
+        auto& typeClass = this->getTypeClass();
+        auto& methodName = this->getMethodName();
+        // クラスメソッドがないのは論理エラーとする
+        assert(typeClass->methods.contains(methodName));
+
+        return typeClass->getInstantiatedMethod(typeMap, env, methodName, type);
+    }
+
+    /// <summary>
+    /// 二項演算を示す型クラスを取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    virtual const RefTypeClass& getTypeClass() const = 0;
+
+    /// <summary>
+    /// 二項演算をクラスメソッド名を取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    virtual const std::string& getMethodName() const = 0;
+
+    /// <summary>
+    /// Algorithm Jの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <returns>評価結果の型</returns>
+    RefTypeInfo J(TypeMap& typeMap, TypeEnvironment& env) override {
+        InferenceTrace::Span span("J", "BinaryExpression", this->getMethodName());
+
+        // 左項については型制約の適用・検査
+        auto tau1 = this->lhs->J(typeMap, env);
+        typeMap.applyConstraint(std::get<RefType>(tau1->type), { this->getTypeClass() });
+        auto tau2 = this->rhs->J(typeMap, env);
+
+        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
+        auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Temporary{}));
+        unifyFunction(typeMap, env, this->getClassMethod(typeMap, env, tau1), tau2, t);
+
+        return t;
+    }
+
+    /// <summary>
+    /// Algorithm Mの適用
+    /// </summary>
+    /// <param name="typeMap">型表</param>
+    /// <param name="env">型環境</param>
+    /// <param name="rho">式が推測される型</param>
+    void M(TypeMap& typeMap, TypeEnvironment& env, RefTypeInfo rho) override {
+        InferenceTrace::Span span("M", "BinaryExpression", this->getMethodName());
+
+        auto t1 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
+        // 左項については型制約の適用・検査
+        this->lhs->M(typeMap, env, t1);
+        typeMap.applyConstraint(std::get<RefType>(t1->type), { this->getTypeClass() });
+
+        // クラスメソッドに対して単一化を行って二項演算の結果型を得る
+        auto t2 = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
+        unifyFunction(typeMap, env, this->getClassMethod(typeMap, env, t1), t2, rho);
+
+        this->rhs->M(typeMap, env, t2);
+    }
+};
+
+/// <summary>
+/// 加算を示す構文木
+/// </summary>
+struct Add : BinaryExpression {
+    /// <summary>
+    /// <para>加算の定義についての型クラス</para>
+    /// <para>型表ごとに異なり得るため構文木の構築時に型表から取得して保持する</para>
+    /// </summary>
+    RefTypeClass typeClass;
+    /// <summary>
+    /// 加算の定義についてのクラスメソッド名
+    /// </summary>
+    static inline const std::string methodName = "add";
+
+    Add(RefTypeClass typeClass, std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) : BinaryExpression(lhs, rhs), typeClass(typeClass) {}
+    ~Add() override {}
+
+    /// <summary>
+    /// 二項演算を示す型クラスを取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    const RefTypeClass& getTypeClass() const override {
+        return this->typeClass;
+    }
+
+    /// <summary>
+    /// 二項演算をクラスメソッド名を取得する
+    /// </summary>
+    /// <returns>二項演算を示す型クラス</returns>
+    const std::string& getMethodName() const override {
+        return Add::methodName;
+    }
+};
+
+/// <summary>
+/// <para>型推論済みの型環境と型表を保存したモジュールインターフェース</para>
+/// <para>型、リージョン型、型制約、型クラスをポインタの代わりに出現順のインデックスで参照する32bitのワードの列で表現する</para>
+/// <para>アドレスに依存しないためファイルをメモリマップした領域をそのままloadに渡すことができ、読み込みは全体を検査した後に参照される型のみを生成し直すのみで構文解析や型推論をやり直さない</para>
+/// </summary>
+struct ModuleInterface {
+    /// <summary>
+    /// 先頭のワード(バイト順の異なる環境で保存したものを検出する)
+    /// </summary>
+    static constexpr std::uint32_t MAGIC = 0x49524d48;
+
+    /// <summary>
+    /// 形式の版(型の表現を変更した場合に上げる)
+    /// </summary>
+    static constexpr std::uint32_t VERSION = 2;
+
+    /// <summary>
+    /// ヘッダのワード数(先頭のワード、形式の版、内容の識別子の下位と上位の32bit)
+    /// </summary>
+    static constexpr std::size_t HEADER = 4;
+
+    /// <summary>
+    /// 型の種類
+    /// </summary>
+    enum struct TypeTag : std::uint32_t {
+        /// <summary>
+        /// 基底型(型名)
+        /// </summary>
+        BASE,
+        /// <summary>
+        /// 関数型(基底型、引数型、戻り値型)
+        /// </summary>
+        FUNCTION,
+        /// <summary>
+        /// 未解決の型変数(型制約、スコープの深さ、ランク)
+        /// </summary>
+        VARIABLE,
+        /// <summary>
+        /// ジェネリック型に出現する型変数(型制約、インデックス)
+        /// </summary>
+        PARAM,
+        /// <summary>
+        /// 型としての型クラス(型制約、リージョン型)
+        /// </summary>
+        TYPE_CLASS,
+        /// <summary>
+        /// 参照型(基底型、参照先の型、リージョン型)
+        /// </summary>
+        REF
+    };
+
+    /// <summary>
+    /// リージョン型の種類
+    /// </summary>
+    enum struct RegionTag : std::uint32_t {
+        /// <summary>
+        /// 保存対象の型環境で定義された識別子のリージョン
+        /// </summary>
+        BASE,
+        /// <summary>
+        /// 一時オブジェクト
+        /// </summary>
+        TEMPORARY,
+        /// <summary>
+        /// 未解決の型変数(スコープの深さ)
+        /// </summary>
+        VARIABLE,
+        /// <summary>
+        /// ジェネリック型に出現する型変数(インデックス)
+        /// </summary>
+        PARAM
+    };
+
+    /// <summary>
+    /// 型スキームの種類
+    /// </summary>
+    enum struct SchemeTag : std::uint32_t {
+        /// <summary>
+        /// 単相の型
+        /// </summary>
+        TYPE,
+        /// <summary>
+        /// ジェネリック型(型変数のリスト、リージョン型の型変数のリスト、本体の型)
+        /// </summary>
+        GENERIC
+    };
+
+    /// <summary>
+    /// <para>保存したワードの列</para>
+    /// <para>ヘッダ、文字列、型クラス、型制約、リージョン型、型の各表と、それらを参照する型クラスのメソッド、型表、組込み型、束縛の順に並べる</para>
+    /// <para>ヘッダにはヘッダ以降のワードの列から求めた内容の識別子を含め、読み込み時は検査で識別子を求め直してヘッダと照合してから読み込み済みのものと照合する</para>
+    /// </summary>
+    std::vector<std::uint32_t> words = {};
+
+    /// <summary>
+    /// <para>保存の途中経過</para>
+    /// <para>参照される側を先に読み込めるように表ごとにワードの列を分けて構築し、最後に連結する</para>
+    /// </summary>
+    struct Writer {
+        /// <summary>
+        /// 保存対象の型環境
+        /// </summary>
+        const TypeEnvironment& env;
+
+        /// <summary>
+        /// 文字列の表
+        /// </summary>
+        std::vector<std::uint32_t> strings = {};
+        /// <summary>
+        /// 型クラスの表(型クラス名、基底、クラスメソッド名)
+        /// </summary>
+        std::vector<std::uint32_t> typeClasses = {};
+        /// <summary>
+        /// 型制約の表
+        /// </summary>
+        std::vector<std::uint32_t> constraints = {};
+        /// <summary>
+        /// リージョン型の表
+        /// </summary>
+        std::vector<std::uint32_t> regions = {};
+        /// <summary>
+        /// 型の表(部分型が先に出現するように後行順に並べる)
+        /// </summary>
+        std::vector<std::uint32_t> types = {};
+        /// <summary>
+        /// 各表を参照する本体
+        /// </summary>
+        std::vector<std::uint32_t> body = {};
+
+        /// <summary>
+        /// 保存済みの文字列のインデックス
+        /// </summary>
+        std::unordered_map<std::string, std::uint32_t> stringIds = {};
+        /// <summary>
+        /// 型クラスの通し番号から保存した型クラスのインデックスへの表
+        /// </summary>
+        std::unordered_map<std::size_t, std::uint32_t> typeClassIds = {};
+        /// <summary>
+        /// 型制約の識別番号から保存した型制約のインデックスへの表
+        /// </summary>
+        std::unordered_map<std::uint32_t, std::uint32_t> constraintsIds = {};
+        /// <summary>
+        /// 保存済みのリージョン型のインデックス
+        /// </summary>
+        std::unordered_map<const Region*, std::uint32_t> regionIds = {};
+        /// <summary>
+        /// 保存済みの型のインデックス
+        /// </summary>
+        std::unordered_map<const Type*, std::uint32_t> typeIds = {};
+
+        /// <summary>
+        /// 整数を1ワードに収まるか検査して変換する
+        /// </summary>
+        /// <param name="value">変換対象の整数</param>
+        /// <returns>変換結果</returns>
+        [[nodiscard]] static std::uint32_t narrow(std::size_t value) {
+            if (value > UINT32_MAX) {
+                throw std::runtime_error(std::format("モジュールインターフェースに保存できない大きさ：{}", value));
+            }
+            return static_cast<std::uint32_t>(value);
+        }
+
+        /// <summary>
+        /// 文字列を保存する
+        /// </summary>
+        /// <param name="value">保存対象の文字列</param>
+        /// <returns>文字列のインデックス</returns>
+        [[nodiscard]] std::uint32_t string(const std::string& value) {
+            auto [itr, inserted] = this->stringIds.try_emplace(value, narrow(this->stringIds.size()));
+            if (inserted) {
+                // 長さに続けてワード境界まで0で埋めたバイト列を置く
+                auto offset = this->strings.size();
+                this->strings.push_back(narrow(value.size()));
+                this->strings.resize(offset + 1 + (value.size() + 3) / 4, 0);
+                std::memcpy(this->strings.data() + offset + 1, value.data(), value.size());
+            }
+            return itr->second;
+        }
+
+        /// <summary>
+        /// 型制約を保存する
+        /// </summary>
+        /// <param name="value">保存対象の型制約</param>
+        /// <returns>型制約のインデックス</returns>
+        [[nodiscard]] std::uint32_t constraint(RefConstraints value) {
+            if (auto itr = this->constraintsIds.find(value.id); itr != this->constraintsIds.end()) {
+                return itr->second;
+            }
+            this->constraints.push_back(narrow(value->size()));
+            value->forEach([this](const RefTypeClass& typeClass) {
+                auto itr = this->typeClassIds.find(typeClass->id.value());
+                if (itr == this->typeClassIds.end()) {
+                    throw std::runtime_error(std::format("型表に登録されていない型クラス{}は保存できない", typeClass->name));
+                }
+                this->constraints.push_back(itr->second);
+            });
+            auto id = narrow(this->constraintsIds.size());
+            this->constraintsIds.insert({ value.id, id });
+            return id;
+        }
+
+        /// <summary>
+        /// 解決済みのリージョン型を保存する
+        /// </summary>
+        /// <param name="region">保存対象のリージョン型</param>
+        /// <returns>リージョン型のインデックス</returns>
+        [[nodiscard]] std::uint32_t region(RefRegion region) {
+            region = solved(region);
+            if (auto itr = this->regionIds.find(region); itr != this->regionIds.end()) {
+                return itr->second;
+            }
+            if (std::holds_alternative<Region::Base>(region->kind)) {
+                // 型環境はアドレスで参照するため保存対象の型環境に限り読み込み先の型環境に置き換える
+                if (std::get<Region::Base>(region->kind).env != std::addressof(this->env)) {
+                    throw std::runtime_error("保存対象の型環境以外で定義されたリージョンは保存できない");
+                }
+                this->regions.push_back(static_cast<std::uint32_t>(RegionTag::BASE));
+            }
+            else if (std::holds_alternative<Region::Temporary>(region->kind)) {
+                this->regions.push_back(static_cast<std::uint32_t>(RegionTag::TEMPORARY));
+            }
+            else if (std::holds_alternative<Region::Variable>(region->kind)) {
+                this->regions.push_back(static_cast<std::uint32_t>(RegionTag::VARIABLE));
+                this->regions.push_back(narrow(std::get<Region::Variable>(region->kind).depth));
+            }
+            else {
+                this->regions.push_back(static_cast<std::uint32_t>(RegionTag::PARAM));
+                this->regions.push_back(narrow(std::get<Region::Param>(region->kind).index));
+            }
+            auto id = narrow(this->regionIds.size());
+            this->regionIds.insert({ region, id });
+            return id;
+        }
+
+        /// <summary>
+        /// <para>解決済みの型を保存する</para>
+        /// <para>共有された部分型は1度のみ保存し、読み込み時も同一の実体を参照させる</para>
+        /// </summary>
+        /// <param name="type">保存対象の型</param>
+        /// <returns>型のインデックス</returns>
+        [[nodiscard]] std::uint32_t type(RefType type) {
+            struct fn {
+                Writer& w;
+
+                void operator()(const Type::Base& x) {
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::BASE));
+                    this->w.types.push_back(this->w.string(x.name.name()));
+                }
+                void operator()(const Type::Function& x) {
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::FUNCTION));
+                    this->w.types.push_back(this->w.typeIds.at(solved(x.base)));
+                    this->w.types.push_back(this->w.typeIds.at(solved(x.paramType)));
+                    this->w.types.push_back(this->w.typeIds.at(solved(x.returnType)));
+                }
+                void operator()(const Type::Variable& x) {
+                    auto constraints = this->w.constraint(x.constraints);
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::VARIABLE));
+                    this->w.types.push_back(constraints);
+                    this->w.types.push_back(narrow(x.depth));
+                    this->w.types.push_back(narrow(x.rank));
+                }
+                void operator()(const Type::Param& x) {
+                    auto constraints = this->w.constraint(x.constraints);
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::PARAM));
+                    this->w.types.push_back(constraints);
+                    this->w.types.push_back(narrow(x.index));
+                }
+                void operator()(const Type::TypeClass& x) {
+                    auto constraints = this->w.constraint(x.typeClasses);
+                    auto region = this->w.region(x.region);
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::TYPE_CLASS));
+                    this->w.types.push_back(constraints);
+                    this->w.types.push_back(region);
+                }
+                void operator()(const Type::Ref& x) {
+                    auto region = this->w.region(x.region);
+                    this->w.types.push_back(static_cast<std::uint32_t>(TypeTag::REF));
+                    this->w.types.push_back(this->w.typeIds.at(solved(x.base)));
+                    this->w.types.push_back(this->w.typeIds.at(solved(x.type)));
+                    this->w.types.push_back(region);
+                }
+            };
+
+            // 深い型でもネイティブのスタックを消費しないように明示的なスタックで後行順に走査する
+            type = solved(type);
+            std::vector<std::pair<RefType, bool>> stack = { { type, false } };
+            while (!stack.empty()) {
+                auto [t, expanded] = stack.back();
+                if (this->typeIds.contains(t)) {
+                    stack.pop_back();
+                    continue;
+                }
+                if (!expanded) {
+                    // 部分型を先に保存する
+                    stack.back().second = true;
+                    if (std::holds_alternative<Type::Function>(t->kind)) {
+                        auto& x = std::get<Type::Function>(t->kind);
+                        stack.push_back({ solved(x.returnType), false });
+                        stack.push_back({ solved(x.paramType), false });
+                        stack.push_back({ solved(x.base), false });
+                    }
+                    else if (std::holds_alternative<Type::Ref>(t->kind)) {
+                        auto& x = std::get<Type::Ref>(t->kind);
+                        stack.push_back({ solved(x.type), false });
+                        stack.push_back({ solved(x.base), false });
+                    }
+                    continue;
+                }
+                stack.pop_back();
+                std::visit(fn{ .w = *this }, t->kind);
+                this->typeIds.insert({ t, narrow(this->typeIds.size()) });
+            }
+            return this->typeIds.at(type);
+        }
+
+        /// <summary>
+        /// 型スキームを本体に保存する
+        /// </summary>
+        /// <param name="scheme">保存対象の型スキーム</param>
+        void scheme(const std::variant<RefType, Generic>& scheme) {
+            if (std::holds_alternative<RefType>(scheme)) {
+                auto type = this->type(std::get<RefType>(scheme));
+                this->body.push_back(static_cast<std::uint32_t>(SchemeTag::TYPE));
+                this->body.push_back(type);
+                return;
+            }
+            auto& generic = std::get<Generic>(scheme);
+            this->body.push_back(static_cast<std::uint32_t>(SchemeTag::GENERIC));
+            this->body.push_back(narrow(generic.vals.size()));
+            for (auto val : generic.vals) {
+                this->body.push_back(this->type(val));
+            }
+            this->body.push_back(narrow(generic.regionVals.size()));
+            for (auto val : generic.regionVals) {
+                this->body.push_back(this->region(val));
+            }
+            this->body.push_back(this->type(generic.type));
+        }
+    };
+
+    /// <summary>
+    /// 読み込みの途中経過
+    /// </summary>
+    struct Reader {
+        /// <summary>
+        /// 読み込み対象のワードの列
+        /// </summary>
+        std::span<const std::uint32_t> words;
+
+        /// <summary>
+        /// 次に読み込む位置
+        /// </summary>
+        std::size_t position = 0;
+
+        /// <summary>
+        /// 1ワード読み込む
+        /// </summary>
+        /// <returns>読み込んだワード</returns>
+        [[nodiscard]] std::uint32_t next() {
+            if (this->position >= this->words.size()) {
+                throw std::runtime_error("モジュールインターフェースが途中で終わっている");
+            }
+            return this->words[this->position++];
+        }
+
+        /// <summary>
+        /// <para>要素数を読み込む</para>
+        /// <para>不正な要素数で巨大な領域を確保しないように、残りのワード数に収まらない要素数は拒否する</para>
+        /// </summary>
+        /// <param name="width">要素あたりの最小のワード数</param>
+        /// <returns>読み込んだ要素数</returns>
+        [[nodiscard]] std::size_t count(std::size_t width) {
+            auto count = static_cast<std::size_t>(this->next());
+            if (count > (this->words.size() - this->position) / width) {
+                throw std::runtime_error(std::format("モジュールインターフェースの要素数が残りの大きさを超える：{}", count));
+            }
+            return count;
+        }
+
+        /// <summary>
+        /// 表のインデックスを読み込む
+        /// </summary>
+        /// <param name="size">読み込み済みの表の要素数</param>
+        /// <returns>読み込んだインデックス</returns>
+        [[nodiscard]] std::uint32_t index(std::size_t size) {
+            auto index = this->next();
+            if (index >= size) {
+                throw std::runtime_error(std::format("モジュールインターフェースの参照が範囲外：{}", index));
+            }
+            return index;
+        }
+
+        /// <summary>
+        /// インデックスを読み込んで読み込み済みの表の要素を取得する
+        /// </summary>
+        /// <param name="table">読み込み済みの表</param>
+        /// <returns>インデックスに対応する要素</returns>
+        template <class T>
+        [[nodiscard]] const T& at(const std::vector<T>& table) {
+            return table[this->index(table.size())];
+        }
+
+        /// <summary>
+        /// <para>文字列を読み込む</para>
+        /// <para>読み込み対象のワードの列を直接参照するため複製しない</para>
+        /// </summary>
+        /// <returns>読み込んだ文字列</returns>
+        [[nodiscard]] std::string_view string() {
+            auto size = this->next();
+            auto count = (static_cast<std::size_t>(size) + 3) / 4;
+            if (count > this->words.size() - this->position) {
+                throw std::runtime_error("モジュールインターフェースが途中で終わっている");
+            }
+            auto data = reinterpret_cast<const char*>(this->words.data() + this->position);
+            this->position += count;
+            return std::string_view(data, size);
+        }
+    };
+
+    /// <summary>
+    /// <para>型環境と型表を保存する</para>
+    /// <para>型表は下層の型表も含めて1つの型表として保存し、型環境はその型環境自身で行った束縛のみを保存する</para>
+    /// </summary>
+    /// <param name="typeMap">保存対象の型表</param>
+    /// <param name="env">保存対象の型環境</param>
+    /// <returns>保存結果</returns>
+    [[nodiscard]] static ModuleInterface save(const TypeMap& typeMap, const TypeEnvironment& env) {
+        Writer writer = { .env = env };
+
+        // 読み込み時に基底から順に登録できるように型クラスは通し番号の順に保存する
+        std::vector<RefTypeClass> typeClasses;
+        std::size_t typeCount = 0;
+        for (const TypeMap* map = std::addressof(typeMap); map; map = map->prelude) {
+            for (const auto& [name, typeClass] : map->typeClassMap) {
+                typeClasses.push_back(typeClass);
+            }
+            typeCount += map->typeMap.size();
+        }
+        std::ranges::sort(typeClasses, {}, [](const RefTypeClass& typeClass) { return typeClass->id.value(); });
+        for (const auto& typeClass : typeClasses) {
+            writer.typeClassIds.insert({ typeClass->id.value(), Writer::narrow(writer.typeClassIds.size()) });
+        }
+
+        for (const auto& typeClass : typeClasses) {
+            writer.typeClasses.push_back(writer.string(typeClass->name));
+            writer.typeClasses.push_back(Writer::narrow(typeClass->bases.size()));
+            typeClass->bases.forEach([&](const RefTypeClass& base) {
+                writer.typeClasses.push_back(writer.typeClassIds.at(base->id.value()));
+            });
+            writer.typeClasses.push_back(Writer::narrow(typeClass->methods.size()));
+            for (const auto& [methodName, method] : typeClass->methods) {
+                writer.typeClasses.push_back(writer.string(methodName));
+            }
+        }
+
+        // 型クラスの型とクラスメソッド
+        for (const auto& typeClass : typeClasses) {
+            writer.body.push_back(writer.type(typeClass->type));
+            for (const auto& [methodName, method] : typeClass->methods) {
+                writer.body.push_back(writer.string(methodName));
+                writer.scheme(method);
+            }
+        }
+
+        // 型表と組込み型
+        writer.body.push_back(Writer::narrow(typeCount));
+        for (const TypeMap* map = std::addressof(typeMap); map; map = map->prelude) {
+            for (const auto& [name, data] : map->typeMap) {
+                writer.scheme(data.type);
+                writer.body.push_back(writer.constraint(data.typeclasses));
+            }
+        }
+        writer.scheme(typeMap.builtin.fn);
+        writer.scheme(typeMap.builtin.ref);
+
+        // 型環境自身で行った束縛を束縛した順に保存する
+        std::vector<std::pair<Symbol, RefTypeInfo>> bindings;
+        for (auto i = env.mark; i < env.bindings->trail.size(); ++i) {
+            auto name = env.bindings->trail[i];
+            auto& stack = env.bindings->stacks[name.id];
+            auto itr = std::ranges::find(stack, std::addressof(env), &BindingTable::Binding::env);
+            if (itr != stack.end()) {
+                bindings.push_back({ name, itr->type });
+            }
+        }
+        writer.body.push_back(Writer::narrow(bindings.size()));
+        for (const auto& [name, info] : bindings) {
+            writer.body.push_back(writer.string(name.name()));
+            writer.scheme(info->type);
+            writer.body.push_back(writer.region(info->region));
+        }
+
+        ModuleInterface result;
+        auto& words = result.words;
+        words = { MAGIC, VERSION, 0, 0, Writer::narrow(writer.stringIds.size()) };
+        words.insert(words.end(), writer.strings.begin(), writer.strings.end());
+        words.push_back(Writer::narrow(typeClasses.size()));
+        words.insert(words.end(), writer.typeClasses.begin(), writer.typeClasses.end());
+        words.push_back(Writer::narrow(writer.constraintsIds.size()));
+        words.insert(words.end(), writer.constraints.begin(), writer.constraints.end());
+        words.push_back(Writer::narrow(writer.regionIds.size()));
+        words.insert(words.end(), writer.regions.begin(), writer.regions.end());
+        words.push_back(Writer::narrow(writer.typeIds.size()));
+        words.insert(words.end(), writer.types.begin(), writer.types.end());
+        words.insert(words.end(), writer.body.begin(), writer.body.end());
+        auto id = ModuleInterface::contentId(std::span(words).subspan(HEADER));
+        words[2] = static_cast<std::uint32_t>(id);
+        words[3] = static_cast<std::uint32_t>(id >> 32);
+        return result;
+    }
+
+    /// <summary>
+    /// <para>内容の識別子を求める</para>
+    /// <para>ヘッダ以降のワードの列の64bitのFNV-1aハッシュ値で、保存時に求めてヘッダに記録し、読み込み時の検査で求め直して照合する</para>
+    /// </summary>
+    /// <param name="words">ヘッダ以降のワードの列</param>
+    /// <returns>内容の識別子</returns>
+    [[nodiscard]] static std::uint64_t contentId(std::span<const std::uint32_t> words) {
+        std::uint64_t seed = 0xcbf29ce484222325;
+        for (auto word : words) {
+            seed = (seed ^ word) * 0x100000001b3;
+        }
+        return seed;
+    }
+
+    /// <summary>
+    /// <para>読み込み済みのモジュールインターフェースの型クラスの登録簿</para>
+    /// <para>型クラスの通し番号は全ての型表で共通で解放されないため、同じ内容の識別子のモジュールインターフェースを再度読み込んだ場合は初回に登録した型クラスを再利用して採番し直さない</para>
+    /// <para>型クラスと型表の型は登録簿が所有する凍結した型表に登録して読み込んだ型表の下層に重ねるため、再度の読み込みでは型クラスの登録も型表の型の生成も行わず束縛のみを行う</para>
+    /// </summary>
+    struct Registry {
+        /// <summary>
+        /// 読み込み済みのモジュールインターフェースごとの記録
+        /// </summary>
+        struct Entry {
+            /// <summary>
+            /// 初回の読み込みの排他制御(並行して同じ内容を読み込んだ場合は初回の読み込みによる登録の完了を待つ)
+            /// </summary>
+            std::once_flag once;
+            /// <summary>
+            /// <para>読み込み先の型環境より長く生存する型表の型を所有するアリーナ</para>
+            /// <para>型表の破棄で型を参照するため型表より先に宣言する</para>
+            /// </summary>
+            TypeArena arena;
+            /// <summary>
+            /// 型クラス、型表の型、組込み型を登録した凍結した型表
+            /// </summary>
+            TypeMap typeMap;
+            /// <summary>
+            /// 型クラスを参照する型制約の表
+            /// </summary>
+            std::vector<RefConstraints> constraints;
+            /// <summary>
+            /// <para>型の表のインデックスごとの基底型(基底型以外はnullptr)</para>
+            /// <para>基底型は変更されないため、束縛の型からも共有して凍結時に記録した型に関するデータを参照させる</para>
+            /// </summary>
+            std::vector<RefType> bases;
+        };
+
+        /// <summary>
+        /// <para>内容の識別子から記録への表</para>
+        /// <para>記録は削除せず、要素のアドレスは追加により移動しない</para>
+        /// </summary>
+        std::unordered_map<std::uint64_t, Entry> entries = {};
+
+        /// <summary>
+        /// 登録と検索の排他制御
+        /// </summary>
+        std::mutex mutex = {};
+
+        /// <summary>
+        /// 内容の識別子に対する記録を取得する(未登録の場合は空の記録を追加する)
+        /// </summary>
+        /// <param name="id">内容の識別子</param>
+        /// <returns>記録</returns>
+        [[nodiscard]] Entry& acquire(std::uint64_t id) {
+            std::lock_guard lock(this->mutex);
+            return this->entries[id];
+        }
+
+        /// <summary>
+        /// 登録簿のインスタンスを取得する
+        /// </summary>
+        /// <returns>登録簿</returns>
+        static Registry& instance() {
+            static Registry registry;
+            return registry;
+        }
+    };
+
+    /// <summary>
+    /// <para>ワードの列がsaveで保存した形式であるか検査する</para>
+    /// <para>内容の識別子、タグ、要素数、インデックスの範囲、ジェネリック型の型変数の種類、型クラス名とクラスメソッド名と型表の型名の重複を全体にわたって検査し、型の生成や型クラスの登録は行わない</para>
+    /// </summary>
+    /// <param name="words">検査対象のワードの列</param>
+    static void validate(std::span<const std::uint32_t> words) {
+        Reader reader = { .words = words };
+        if (reader.next() != MAGIC) {
+            throw std::runtime_error("モジュールインターフェースではない");
+        }
+        if (auto version = reader.next(); version != VERSION) {
+            throw std::runtime_error(std::format("モジュールインターフェースの版が異なる：{}", version));
+        }
+        // 内容の識別子はヘッダ以降から求め直して照合し、ヘッダを残して内容のみが変わったものを読み込み済みのものと取り違えないようにする
+        std::uint64_t id = reader.next();
+        id |= static_cast<std::uint64_t>(reader.next()) << 32;
+        if (id != ModuleInterface::contentId(words.subspan(HEADER))) {
+            throw std::runtime_error("モジュールインターフェースの内容の識別子が一致しない");
+        }
+
+        // 名前の重複は同じ内容の文字列が別のインデックスで保存されていても検出するように文字列で比較する
+        std::vector<std::string_view> strings(reader.count(1));
+        for (auto& string : strings) {
+            string = reader.string();
+        }
+
+        // 型クラスごとのクラスメソッド名
+        std::vector<std::vector<std::string_view>> methods(reader.count(3));
+        std::vector<std::string_view> names(methods.size());
+        for (std::size_t i = 0; i < methods.size(); ++i) {
+            names[i] = reader.at(strings);
+            for (auto n = reader.count(1); n > 0; --n) {
+                // 基底は先に登録済みである必要がある
+                (void)reader.index(i);
+            }
+            methods[i].resize(reader.count(1));
+            for (auto& method : methods[i]) {
+                method = reader.at(strings);
+            }
+            if (std::ranges::sort(methods[i]); std::ranges::adjacent_find(methods[i]) != methods[i].end()) {
+                throw std::runtime_error("モジュールインターフェースの型クラスのクラスメソッド名が重複している");
+            }
+        }
+        if (std::ranges::sort(names); std::ranges::adjacent_find(names) != names.end()) {
+            throw std::runtime_error("モジュールインターフェースの型クラス名が重複している");
+        }
+
+        auto constraints = reader.count(1);
+        for (auto i = constraints; i > 0; --i) {
+            for (auto n = reader.count(1); n > 0; --n) {
+                (void)reader.index(methods.size());
+            }
+        }
+
+        std::vector<RegionTag> regions(reader.count(1));
+        for (auto& region : regions) {
+            region = static_cast<RegionTag>(reader.next());
+            switch (region) {
+            case RegionTag::BASE:
+            case RegionTag::TEMPORARY:
+                break;
+            case RegionTag::VARIABLE:
+            case RegionTag::PARAM:
+                (void)reader.next();
+                break;
+            default:
+                throw std::runtime_error("モジュールインターフェースに不明なリージョン型がある");
+            }
+        }
+
+        std::vector<TypeTag> types(reader.count(2));
+        // 型が保存対象の型環境のリージョンを参照するか
+        std::vector<bool> local(types.size());
+        // 型名をもつ型の型名
+        std::vector<std::string_view> typeNames(types.size());
+        // 関数型と参照型の基底は基底型である必要がある
+        auto base = [&](std::size_t i) {
+            auto index = reader.index(i);
+            if (types[index] != TypeTag::BASE) {
+                throw std::runtime_error("モジュールインターフェースの型の基底が基底型ではない");
+            }
+            return index;
+        };
+        for (std::size_t i = 0; i < types.size(); ++i) {
+            types[i] = static_cast<TypeTag>(reader.next());
+            switch (types[i]) {
+            case TypeTag::BASE:
+                typeNames[i] = reader.at(strings);
+                break;
+            case TypeTag::FUNCTION: {
+                // 部分型は先に保存されている
+                auto b = base(i);
+                auto paramType = reader.index(i);
+                auto returnType = reader.index(i);
+                local[i] = local[b] || local[paramType] || local[returnType];
+                typeNames[i] = typeNames[b];
+                break;
+            }
+            case TypeTag::VARIABLE:
+                (void)reader.index(constraints);
+                (void)reader.next();
+                (void)reader.next();
+                break;
+            case TypeTag::PARAM:
+                (void)reader.index(constraints);
+                (void)reader.next();
+                break;
+            case TypeTag::TYPE_CLASS:
+                (void)reader.index(constraints);
+                local[i] = regions[reader.index(regions.size())] == RegionTag::BASE;
+                break;
+            case TypeTag::REF: {
+                auto b = base(i);
+                auto target = reader.index(i);
+                local[i] = local[b] || local[target] || regions[reader.index(regions.size())] == RegionTag::BASE;
+                typeNames[i] = typeNames[b];
+                break;
+            }
+            default:
+                throw std::runtime_error("モジュールインターフェースに不明な型がある");
+            }
+        }
+
+        // 型スキームの種類と本体の型のインデックスの組を返す
+        auto scheme = [&]() -> std::pair<SchemeTag, std::uint32_t> {
+            auto tag = static_cast<SchemeTag>(reader.next());
+            switch (tag) {
+            case SchemeTag::TYPE:
+                return { tag, reader.index(types.size()) };
+            case SchemeTag::GENERIC:
+                for (auto n = reader.count(1); n > 0; --n) {
+                    if (types[reader.index(types.size())] != TypeTag::PARAM) {
+                        throw std::runtime_error("モジュールインターフェースのジェネリック型の型変数が型変数ではない");
+                    }
+                }
+                for (auto n = reader.count(1); n > 0; --n) {
+                    if (regions[reader.index(regions.size())] != RegionTag::PARAM) {
+                        throw std::runtime_error("モジュールインターフェースのジェネリック型のリージョン変数がリージョン変数ではない");
+                    }
+                }
+                return { tag, reader.index(types.size()) };
+            default:
+                throw std::runtime_error("モジュールインターフェースに不明な型スキームがある");
+            }
+        };
+
+        for (std::size_t i = 0; i < methods.size(); ++i) {
+            if (types[reader.index(types.size())] != TypeTag::PARAM) {
+                throw std::runtime_error("モジュールインターフェースの型クラスの型が型変数ではない");
+            }
+            for (auto n = methods[i].size(); n > 0; --n) {
+                if (std::ranges::find(methods[i], reader.at(strings)) == methods[i].end()) {
+                    throw std::runtime_error("モジュールインターフェースの型クラスに宣言されていないクラスメソッドがある");
+                }
+                // 型クラスの型、型表の型、組込み型は読み込み先の型環境より長く生存するため型環境のリージョンを参照できない
+                if (local[scheme().second]) {
+                    throw std::runtime_error("モジュールインターフェースのクラスメソッドの型が型環境のリージョンを参照している");
+                }
+            }
+        }
+
+        // 型表の型名は型表への登録で型クラスを登録した後に重複が発覚しないように先に検査する
+        std::vector<std::string_view> entries(reader.count(3));
+        for (auto& entry : entries) {
+            // 型表には型名をもつ型のみを追加できる
+            auto type = scheme().second;
+            if (auto tag = types[type]; tag != TypeTag::BASE && tag != TypeTag::FUNCTION && tag != TypeTag::REF) {
+                throw std::runtime_error("モジュールインターフェースの型表に型名をもたない型がある");
+            }
+            if (local[type]) {
+                throw std::runtime_error("モジュールインターフェースの型表の型が型環境のリージョンを参照している");
+            }
+            (void)reader.index(constraints);
+            entry = typeNames[type];
+        }
+        if (std::ranges::sort(entries); std::ranges::adjacent_find(entries) != entries.end()) {
+            throw std::runtime_error("モジュールインターフェースの型表の型名が重複している");
+        }
+        for (auto n = 2; n > 0; --n) {
+            auto [tag, type] = scheme();
+            if (tag != SchemeTag::GENERIC) {
+                throw std::runtime_error("モジュールインターフェースの組込み型がジェネリック型ではない");
+            }
+            if (local[type]) {
+                throw std::runtime_error("モジュールインターフェースの組込み型が型環境のリージョンを参照している");
+            }
+        }
+
+        for (auto n = reader.count(4); n > 0; --n) {
+            (void)reader.index(strings.size());
+            (void)scheme();
+            (void)reader.index(regions.size());
+        }
+        if (reader.position != words.size()) {
+            throw std::runtime_error("モジュールインターフェースの末尾に余分なデータがある");
+        }
+    }
+
+    /// <summary>
+    /// <para>型とリージョン型の表の要素の生成</para>
+    /// <para>表の要素は参照されたときに初めて生成するため、読み込み先から参照されない要素は生成しない</para>
+    /// </summary>
+    struct Materializer {
+        /// <summary>
+        /// 読み込み対象のワードの列
+        /// </summary>
+        std::span<const std::uint32_t> words;
+        /// <summary>
+        /// 文字列の表
+        /// </summary>
+        const std::vector<std::string_view>& strings;
+        /// <summary>
+        /// 型制約の表
+        /// </summary>
+        const std::vector<RefConstraints>& constraints;
+        /// <summary>
+        /// リージョン型の表の要素の位置
+        /// </summary>
+        const std::vector<std::size_t>& regionPositions;
+        /// <summary>
+        /// 型の表の要素の位置
+        /// </summary>
+        const std::vector<std::size_t>& typePositions;
+        /// <summary>
+        /// 生成先のアリーナ
+        /// </summary>
+        TypeArena& arena;
+        /// <summary>
+        /// <para>保存対象の型環境のリージョンの読み込み先の型環境</para>
+        /// <para>登録簿のアリーナに生成する型はそのようなリージョンを参照しないためnullptr</para>
+        /// </summary>
+        TypeEnvironment* env;
+        /// <summary>
+        /// 生成済みのリージョン型
+        /// </summary>
+        std::vector<RefRegion> regions;
+        /// <summary>
+        /// 生成済みの型
+        /// </summary>
+        std::vector<RefType> types;
+
+        /// <summary>
+        /// リージョン型を取得する
+        /// </summary>
+        /// <param name="i">リージョン型のインデックス</param>
+        /// <returns>リージョン型</returns>
+        [[nodiscard]] RefRegion region(std::uint32_t i) {
+            if (this->regions[i]) {
+                return this->regions[i];
+            }
+            Reader reader = { .words = this->words, .position = this->regionPositions[i] };
+            switch (static_cast<RegionTag>(reader.next())) {
+            case RegionTag::BASE:
+                assert(this->env);
+                this->regions[i] = this->arena.newRegion(Region::Base{ .env = this->env });
+                break;
+            case RegionTag::TEMPORARY:
+                this->regions[i] = this->arena.newRegion(Region::Temporary{});
+                break;
+            case RegionTag::VARIABLE:
+                this->regions[i] = this->arena.newRegion(Region::Variable{ .depth = reader.next() });
+                break;
+            default:
+                this->regions[i] = this->arena.newRegion(Region::Param{ .index = reader.next() });
+                break;
+            }
+            return this->regions[i];
+        }
+
+        /// <summary>
+        /// <para>型を取得する</para>
+        /// <para>未生成の部分型を先に生成してから型を生成する</para>
+        /// </summary>
+        /// <param name="i">型のインデックス</param>
+        /// <returns>型</returns>
+        [[nodiscard]] RefType type(std::uint32_t i) {
+            // 深い型でもネイティブのスタックを消費しないように明示的なスタックで部分型を先に生成する
+            std::vector<std::uint32_t> stack = { i };
+            while (!stack.empty()) {
+                auto j = stack.back();
+                if (this->types[j]) {
+                    stack.pop_back();
+                    continue;
+                }
+                Reader reader = { .words = this->words, .position = this->typePositions[j] };
+                auto tag = static_cast<TypeTag>(reader.next());
+                if (tag == TypeTag::FUNCTION || tag == TypeTag::REF) {
+                    auto pending = stack.size();
+                    for (auto n = tag == TypeTag::FUNCTION ? 3 : 2; n > 0; --n) {
+                        if (auto k = reader.next(); !this->types[k]) {
+                            stack.push_back(k);
+                        }
+                    }
+                    if (stack.size() != pending) {
+                        continue;
+                    }
+                    reader.position = this->typePositions[j] + 1;
+                }
+                stack.pop_back();
+                this->types[j] = this->create(tag, reader);
+            }
+            return this->types[i];
+        }
+
+        /// <summary>
+        /// 部分型が生成済みの型を生成する
+        /// </summary>
+        /// <param name="tag">型の種類</param>
+        /// <param name="reader">型の種類の直後を指す読み込みの途中経過</param>
+        /// <returns>生成した型</returns>
+        [[nodiscard]] RefType create(TypeTag tag, Reader& reader) {
+            // 基底型と関数型はアリーナで共有される
+            switch (tag) {
+            case TypeTag::BASE:
+                return this->arena.newType(Type::Base{ .name = Symbol(this->strings[reader.next()]) });
+            case TypeTag::FUNCTION: {
+                auto base = this->types[reader.next()];
+                auto paramType = this->types[reader.next()];
+                auto returnType = this->types[reader.next()];
+                return this->arena.newType(Type::Function{ .base = base, .paramType = paramType, .returnType = returnType });
+            }
+            case TypeTag::VARIABLE: {
+                auto constraint = this->constraints[reader.next()];
+                auto depth = reader.next();
+                auto rank = reader.next();
+                return this->arena.newType(Type::Variable{ .constraints = constraint, .depth = depth, .rank = rank });
+            }
+            case TypeTag::PARAM: {
+                auto constraint = this->constraints[reader.next()];
+                return this->arena.newType(Type::Param{ .constraints = constraint, .index = reader.next() });
+            }
+            case TypeTag::TYPE_CLASS: {
+                auto constraint = this->constraints[reader.next()];
+                return this->arena.newType(Type::TypeClass{ .typeClasses = constraint, .region = this->region(reader.next()) });
+            }
+            default: {
+                auto base = this->types[reader.next()];
+                auto target = this->types[reader.next()];
+                return this->arena.newType(Type::Ref{ .base = base, .type = target, .region = this->region(reader.next()) });
+            }
+            }
+        }
+
+        /// <summary>
+        /// 型スキームを読み込む
+        /// </summary>
+        /// <param name="reader">型スキームを指す読み込みの途中経過</param>
+        /// <returns>型スキーム</returns>
+        [[nodiscard]] std::variant<RefType, Generic> scheme(Reader& reader) {
+            if (static_cast<SchemeTag>(reader.next()) == SchemeTag::TYPE) {
+                return this->type(reader.next());
+            }
+            Generic generic = { .vals = {}, .regionVals = {}, .type = nullptr };
+            generic.vals.resize(reader.next());
+            for (auto& val : generic.vals) {
+                val = this->type(reader.next());
+            }
+            generic.regionVals.resize(reader.next());
+            for (auto& val : generic.regionVals) {
+                val = this->region(reader.next());
+            }
+            generic.type = this->type(reader.next());
+            return generic;
+        }
+
+        /// <summary>
+        /// 型を生成せずに型スキームを読み飛ばす
+        /// </summary>
+        /// <param name="reader">型スキームを指す読み込みの途中経過</param>
+        static void skip(Reader& reader) {
+            if (static_cast<SchemeTag>(reader.next()) == SchemeTag::GENERIC) {
+                reader.position += reader.next();
+                reader.position += reader.next();
+            }
+            reader.position += 1;
+        }
+    };
+
+    /// <summary>
+    /// <para>保存した型環境と型表を読み込む</para>
+    /// <para>先にvalidateで全体を検査してから、束縛の型のみをenvのアリーナに生成して束縛はenvに行う</para>
+    /// <para>型クラスと型表の型はヘッダの内容の識別子で初回の読み込みの場合のみ新たに通し番号を採番して登録簿の型表に登録し、読み込んだ型表はその型表に重ねる</para>
+    /// <para>読み込んだ型表は凍結済みのため、型推論はoverlayで重ねた型表に対して行う</para>
+    /// </summary>
+    /// <param name="words">saveで保存したワードの列(メモリマップしたファイルの領域でもよい)</param>
+    /// <param name="env">読み込み先の新たに生成した型環境</param>
+    /// <returns>読み込んだ型表</returns>
+    [[nodiscard]] static TypeMap load(std::span<const std::uint32_t> words, TypeEnvironment& env) {
+        ModuleInterface::validate(words);
+
+        // 検査済みのため以降は形式の検査を省く
+        Reader reader = { .words = words, .position = 2 };
+        std::uint64_t id = reader.next();
+        id |= static_cast<std::uint64_t>(reader.next()) << 32;
+
+        std::vector<std::string_view> strings(reader.next());
+        for (auto& string : strings) {
+            string = reader.string();
+        }
+
+        // 型クラスと型制約の表は初回の読み込みでのみ読み込むため、ここでは位置のみを記録して読み飛ばす
+        auto typeClassPosition = reader.position;
+        std::vector<std::uint32_t> methodCounts(reader.next());
+        for (auto& methodCount : methodCounts) {
+            reader.position += 1;
+            reader.position += reader.next();
+            methodCount = reader.next();
+            reader.position += methodCount;
+        }
+        auto constraintCount = reader.next();
+        for (auto n = constraintCount; n > 0; --n) {
+            reader.position += reader.next();
+        }
+
+        // リージョン型と型は参照されたときに生成するため、ここでは表の要素の位置のみを記録する
+        std::vector<std::size_t> regionPositions(reader.next());
+        for (auto& position : regionPositions) {
+            position = reader.position;
+            auto tag = static_cast<RegionTag>(reader.next());
+            reader.position += tag == RegionTag::VARIABLE || tag == RegionTag::PARAM ? 1 : 0;
+        }
+        std::vector<std::size_t> typePositions(reader.next());
+        for (auto& position : typePositions) {
+            position = reader.position;
+            switch (static_cast<TypeTag>(reader.next())) {
+            case TypeTag::BASE:
+                reader.position += 1;
+                break;
+            case TypeTag::PARAM:
+            case TypeTag::TYPE_CLASS:
+                reader.position += 2;
+                break;
+            default:
+                reader.position += 3;
+                break;
+            }
+        }
+
+        // 型クラスの型とクラスメソッドの型、型表、組込み型
+        auto classTypePosition = reader.position;
+        for (auto methodCount : methodCounts) {
+            reader.position += 1;
+            for (auto n = methodCount; n > 0; --n) {
+                reader.position += 1;
+                Materializer::skip(reader);
+            }
+        }
+        for (auto n = reader.next(); n > 0; --n) {
+            Materializer::skip(reader);
+            reader.position += 1;
+        }
+        Materializer::skip(reader);
+        Materializer::skip(reader);
+
+        auto& entry = Registry::instance().acquire(id);
+        std::call_once(entry.once, [&] {
+            // クラスメソッドの索引を構築するためにクラスメソッド名のみを先に登録し、型はクラスメソッドの型が参照する型制約を読み込んでから設定する
+            // 型は全て登録簿のアリーナに生成する
+            Reader r = { .words = words, .position = typeClassPosition };
+            std::vector<RefTypeClass> typeClasses(r.next());
+            for (auto& typeClass : typeClasses) {
+                auto name = std::string(r.at(strings));
+                Constraints bases;
+                for (auto n = r.next(); n > 0; --n) {
+                    bases.insert(r.at(typeClasses));
+                }
+                typeClass = RefTypeClass(new TypeClass({ .name = std::move(name), .bases = std::move(bases), .type = nullptr }));
+                for (auto n = r.next(); n > 0; --n) {
+                    typeClass->methods.insert({ std::string(r.at(strings)), RefType(nullptr) });
+                }
+                entry.typeMap.addTypeClass(typeClass);
+            }
+
+            entry.constraints.resize(r.next());
+            for (auto& constraint : entry.constraints) {
+                Constraints value;
+                for (auto n = r.next(); n > 0; --n) {
+                    value.insert(r.at(typeClasses));
+                }
+                constraint = value;
+            }
+
+            auto materializer = Materializer{
+                .words = words, .strings = strings, .constraints = entry.constraints, .regionPositions = regionPositions, .typePositions = typePositions,
+                .arena = entry.arena, .env = nullptr, .regions = std::vector<RefRegion>(regionPositions.size()), .types = std::vector<RefType>(typePositions.size())
+            };
+            r.position = classTypePosition;
+            for (const auto& typeClass : typeClasses) {
+                typeClass->type = materializer.type(r.next());
+                for (auto n = typeClass->methods.size(); n > 0; --n) {
+                    auto& method = typeClass->methods.at(std::string(r.at(strings)));
+                    method = materializer.scheme(r);
+                }
+            }
+            for (auto n = r.next(); n > 0; --n) {
+                auto type = materializer.scheme(r);
+                auto& data = std::holds_alternative<RefType>(type) ? entry.typeMap.addType(std::get<RefType>(type)) : entry.typeMap.addType(std::get<Generic>(type));
+                data.second.typeclasses = *r.at(entry.constraints);
+            }
+            entry.typeMap.builtin.fn = std::get<Generic>(materializer.scheme(r));
+            entry.typeMap.builtin.ref = std::get<Generic>(materializer.scheme(r));
+
+            entry.bases.resize(typePositions.size());
+            for (std::uint32_t i = 0; i < typePositions.size(); ++i) {
+                if (static_cast<TypeTag>(words[typePositions[i]]) == TypeTag::BASE) {
+                    entry.bases[i] = materializer.type(i);
+                }
+            }
+            entry.typeMap.freeze();
+        });
+        // 内容の識別子が衝突した場合でも範囲外を参照しないように表の大きさを照合する
+        if (entry.typeMap.typeClassMap.size() != methodCounts.size() || entry.constraints.size() != constraintCount || entry.bases.size() != typePositions.size()) {
+            throw std::runtime_error("モジュールインターフェースの内容が同じ識別子で読み込み済みのものと異なる");
+        }
 
-    using BinaryExpression::BinaryExpression;
-    ~Add() override {}
+        auto typeMap = TypeMap();
+        typeMap.prelude = std::addressof(entry.typeMap);
+        typeMap.builtin = entry.typeMap.builtin;
+        auto materializer = Materializer{
+            .words = words, .strings = strings, .constraints = entry.constraints, .regionPositions = regionPositions, .typePositions = typePositions,
+            .arena = *env.arena, .env = std::addressof(env), .regions = std::vector<RefRegion>(regionPositions.size()), .types = entry.bases
+        };
+
+        for (auto n = reader.next(); n > 0; --n) {
+            auto name = Symbol(strings[reader.next()]);
+            auto type = materializer.scheme(reader);
+            auto region = materializer.region(reader.next());
+            env.bind(name, std::holds_alternative<RefType>(type) ? env.newTypeInfo(std::get<RefType>(type), region) : env.newTypeInfo(std::get<Generic>(std::move(type)), region));
+        }
+        typeMap.freeze();
+        return typeMap;
+    }
 
     /// <summary>
-    /// 二項演算を示す型クラスを取得する
+    /// ファイルへ書き出す
     /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    const RefTypeClass& getTypeClass() const override {
-        return Add::typeClass;
+    /// <param name="path">書き出し先のファイル名</param>
+    void write(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(this->words.data()), static_cast<std::streamsize>(this->words.size() * sizeof(std::uint32_t)));
+        if (!file) {
+            throw std::runtime_error(std::format("モジュールインターフェースを書き出せない：{}", path));
+        }
     }
 
     /// <summary>
-    /// 二項演算をクラスメソッド名を取得する
+    /// <para>ファイルから読み込む</para>
+    /// <para>ファイルの内容を1度の読み出しでワードの列に複製する(メモリマップした場合はその領域を直接loadに渡せばよい)</para>
     /// </summary>
-    /// <returns>二項演算を示す型クラス</returns>
-    const std::string& getMethodName() const override {
-        return Add::methodName;
+    /// <param name="path">読み込むファイル名</param>
+    /// <returns>読み込み結果</returns>
+    [[nodiscard]] static ModuleInterface read(const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error(std::format("モジュールインターフェースを開けない：{}", path));
+        }
+        auto size = static_cast<std::size_t>(file.tellg());
+        if (size % sizeof(std::uint32_t) != 0) {
+            throw std::runtime_error(std::format("モジュールインターフェースの大きさが不正：{}", path));
+        }
+        ModuleInterface result = { .words = std::vector<std::uint32_t>(size / sizeof(std::uint32_t)) };
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(result.words.data()), static_cast<std::streamsize>(size));
+        if (!file) {
+            throw std::runtime_error(std::format("モジュールインターフェースを読み込めない：{}", path));
+        }
+        return result;
     }
 };
-RefTypeClass Add::typeClass = nullptr;
-std::string Add::methodName = "";
 
 /// <summary>
 /// RefTypeの標準出力
@@ -2056,7 +5479,7 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
         /// </summary>
         /// <param name="type">出力の型</param>
         void printRegion(RefRegion region) {
-            auto r = solved(region).get();
+            auto r = solved(region);
             // 一時オブジェクトは⊥で出力
             if (std::holds_alternative<Region::Temporary>(r->kind)) {
                 this->o << " at ⊥";
@@ -2075,7 +5498,7 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
         }
 
         void operator()(const Type::Base& x) {
-            this->o << x.name;
+            this->o << x.name.name();
         }
         void operator()(const Type::Function& x) {
             // 括弧付きで出力するかを判定
@@ -2098,7 +5521,7 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
         void operator()(const Type::Variable& x) {
             if (x.solve) {
                 // 解決済みの型変数の場合は解決結果の型に対して出力
-                std::visit(*this, solved(x.solve.value())->kind);
+                std::visit(*this, solved(x.solve)->kind);
             }
             else {
                 // 雑に[a, z]の範囲で型変数を出力
@@ -2113,14 +5536,15 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
                 }
 
                 // 型クラスの情報を出力
-                if (x.constraints.list.size() == 1) {
-                    this->o << ": " << x.constraints.list[0]->name;
+                if (x.constraints->size() == 1) {
+                    x.constraints->forEach([this](const RefTypeClass& typeClass) { this->o << ": " << typeClass->name; });
                 }
-                else if (x.constraints.list.size() > 1) {
-                    this->o << ":(" << x.constraints.list[0]->name;
-                    for (auto itr = x.constraints.list.begin() + 1; itr != x.constraints.list.end(); ++itr) {
-                        this->o << " + " << (*itr)->name;
-                    }
+                else if (x.constraints->size() > 1) {
+                    auto first = true;
+                    x.constraints->forEach([this, &first](const RefTypeClass& typeClass) {
+                        this->o << (first ? ":(" : " + ") << typeClass->name;
+                        first = false;
+                    });
                     this->o << ")";
                 }
             }
@@ -2132,19 +5556,20 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
             this->o << '\'' << static_cast<char>(c <= 'z' ? c : '_');
 
             // 型クラスの情報を出力
-            if (x.constraints.list.size() == 1) {
-                this->o << ": " << x.constraints.list[0]->name;
+            if (x.constraints->size() == 1) {
+                x.constraints->forEach([this](const RefTypeClass& typeClass) { this->o << ": " << typeClass->name; });
             }
-            else if (x.constraints.list.size() > 1) {
-                this->o << ":(" << x.constraints.list[0]->name;
-                for (auto itr = x.constraints.list.begin() + 1; itr != x.constraints.list.end(); ++itr) {
-                    this->o << " + " << (*itr)->name;
-                }
+            else if (x.constraints->size() > 1) {
+                auto first = true;
+                x.constraints->forEach([this, &first](const RefTypeClass& typeClass) {
+                    this->o << (first ? ":(" : " + ") << typeClass->name;
+                    first = false;
+                });
                 this->o << ")";
             }
         }
         void operator()(const Type::TypeClass& x) {
-            auto size = x.typeClasses.list.size();
+            auto size = x.typeClasses->size();
             if (size == 0) {
                 // 空を出力
                 this->o << "()";
@@ -2155,18 +5580,14 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
                     this->o << '(';
                 }
                 // 型クラスとわかるようにプレフィックスとして「:」を付けて出力する
-                for (decltype(x.typeClasses.list.size()) i = 0; i < x.typeClasses.list.size(); ++i) {
-                    auto& l = x.typeClasses.list[i];
-                    if (auto itr = std::ranges::find_if(x.typeClasses.list, [&l](auto& typeClass) { return typeClass == l; }); itr != x.typeClasses.list.end()) {
-                        if (i > 0) {
-                            this->o << " + ";
-                        }
-                        this->o << ':' << (*itr)->name;
-                    }
-                    else {
-                        assert(false);
+                auto first = true;
+                x.typeClasses->forEach([this, &first](const RefTypeClass& typeClass) {
+                    if (!first) {
+                        this->o << " + ";
                     }
-                }
+                    this->o << ':' << typeClass->name;
+                    first = false;
+                });
                 if (size > 1) {
                     this->o << ')';
                 }
@@ -2185,13 +5606,13 @@ std::ostream& operator<<(std::ostream& os, RefType type) {
 }
 
 // 雑に型を短く書くための関数
-RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = name }); }
+RefType base(TypeEnvironment& env, const std::string& name) { return env.newType(Type::Base{ .name = Symbol(name) }); }
 RefType var(TypeEnvironment& env) { return env.newType(Type::Variable{ .depth = env.depth + 1 }); }
 RefType param(TypeEnvironment& env, std::size_t index = 0) { return env.newType(Type::Param{ .index = index }); }
 RefType fun(TypeEnvironment& env, RefType base, RefType paramType, RefType returnType) { return env.newType(Type::Function{ .base = base, .paramType = paramType, .returnType = returnType }); }
-RefType fun(TypeMap& typeMap, TypeEnvironment& env, RefType paramType, RefType returnType) { return env.instantiate(typeMap, typeMap.builtin.fn, { paramType, returnType }); }
+RefType fun(TypeMap& typeMap, TypeEnvironment& env, RefType paramType, RefType returnType) { return env.newFunction(typeMap, paramType, returnType); }
 template <class... Types>
-RefType tc(TypeEnvironment& env, Types&&... args) { return env.newType(Type::TypeClass{ .typeClasses{.list = { std::forward<Types>(args)...}}, .region = env.newRegion(Region::Variable{.depth = env.depth + 1 }) }); }
+RefType tc(TypeEnvironment& env, Types&&... args) { return env.newType(Type::TypeClass{ .typeClasses{ std::forward<Types>(args)... }, .region = env.newRegion(Region::Variable{.depth = env.depth + 1 }) }); }
 RefType ref(TypeEnvironment& env, RefType base, RefType type) { return env.newType(Type::Ref{ .base = base, .type = type, .region = env.newRegion(Region::Variable{.depth = env.depth + 1 }) }); }
 RefType ref(TypeMap& typeMap, TypeEnvironment& env, RefType type) { return env.instantiate(typeMap, typeMap.builtin.ref, { type }); }
 RefTypeInfo info(TypeEnvironment& env, RefType type) { return env.newTypeInfo(type, env.newRegion(Region::Base{ .env = std::addressof(env) })); }
@@ -2202,17 +5623,897 @@ std::shared_ptr<Expression> c(RefType type) { return std::shared_ptr<Expression>
 std::shared_ptr<Expression> id(const std::string& name) { return std::shared_ptr<Expression>(new Identifier(name)); }
 std::shared_ptr<Expression> lambda(const std::string& name, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, expr)); }
 std::shared_ptr<Expression> lambda(const std::string& name, RefType constraint, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(name, constraint, expr)); }
+std::shared_ptr<Expression> lambda(std::vector<Lambda::Parameter> params, std::shared_ptr<Expression> expr) { return std::shared_ptr<Expression>(new Lambda(std::move(params), expr)); }
 std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Apply(expr1, expr2)); }
-template <class Head, class... Tail>
-std::shared_ptr<Expression> apply(Head&& head1, Head&& head2, Tail&&... tail) { return apply(std::shared_ptr<Expression>(new Apply(head1, head2)), std::forward<Tail>(tail)...); }
+template <class... Tail>
+std::shared_ptr<Expression> apply(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2, Tail&&... tail) { return std::shared_ptr<Expression>(new Apply(expr1, { expr2, std::forward<Tail>(tail)... })); }
 std::shared_ptr<Expression> let(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, expr1, expr2)); }
 std::shared_ptr<Expression> let(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Let(name, params, expr1, expr2)); }
 std::shared_ptr<Expression> letrec(const std::string& name, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, expr1, expr2)); }
 std::shared_ptr<Expression> letrec(const std::string& name, const std::vector<RefType>& params, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Letrec(name, params, expr1, expr2)); }
 std::shared_ptr<Expression> dot(std::shared_ptr<Expression> expr, const std::string& name) { return std::shared_ptr<Expression>(new AccessToClassMethod(expr, name)); }
-std::shared_ptr<Expression> add(std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Add(expr1, expr2)); }
+std::shared_ptr<Expression> add(const TypeMap& typeMap, std::shared_ptr<Expression> expr1, std::shared_ptr<Expression> expr2) { return std::shared_ptr<Expression>(new Add(typeMap.getTypeClass("Add"), expr1, expr2)); }
+
+#ifdef BENCHMARK
+/// <summary>
+/// ベンチマーク用のヒープの使用状況
+/// </summary>
+struct HeapStats {
+    /// <summary>
+    /// 確保の回数
+    /// </summary>
+    std::size_t allocations = 0;
+    /// <summary>
+    /// 確保中のバイト数
+    /// </summary>
+    std::size_t bytes = 0;
+    /// <summary>
+    /// 確保中のバイト数の最大値
+    /// </summary>
+    std::size_t peak = 0;
+};
+constinit thread_local HeapStats heapStats = {};
+
+// 確保の回数と確保中のバイト数を計測する
+// 解放されたバイト数はサイズ付きのdeleteでのみ得られるため、サイズなしのdeleteの分は確保中のままとして扱う
+// GCCはインライン展開後にoperator newの結果をfreeで解放していると誤検知するため警告を抑制する
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    auto p = std::malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    ++heapStats.allocations;
+    heapStats.bytes += size;
+    heapStats.peak = std::max(heapStats.peak, heapStats.bytes);
+    return p;
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t size) noexcept {
+    heapStats.bytes -= size;
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/// <summary>
+/// 組込みの型と型クラスを定義した型推論の環境
+/// </summary>
+struct Fixture {
+    /// <summary>
+    /// 型環境
+    /// </summary>
+    TypeEnvironment env = {};
+    /// <summary>
+    /// 型表
+    /// </summary>
+    TypeMap typeMap = {};
+    /// <summary>
+    /// 数値型
+    /// </summary>
+    RefType numberT = nullptr;
+    /// <summary>
+    /// Boolean型
+    /// </summary>
+    RefType booleanT = nullptr;
+
+    Fixture() {
+        auto& env = this->env;
+        auto& typeMap = this->typeMap;
+        typeMap.builtin.fn = std::get<Generic>(env.generalize(fun(env, base(env, "fn"), var(env), var(env))));
+        typeMap.addType(typeMap.builtin.fn);
+        typeMap.builtin.ref = std::get<Generic>(env.generalize(ref(env, base(env, "ref"), var(env))));
+        typeMap.addType(typeMap.builtin.ref);
+        this->numberT = std::get<RefType>(typeMap.addType(base(env, "number")).second.type);
+        auto& [booleanN, booleanTD] = typeMap.addType(base(env, "boolean"));
+        this->booleanT = std::get<RefType>(booleanTD.type);
+
+        typeMap.addTypeClass(([&] {
+            auto valT = param(env);
+            return RefTypeClass(new TypeClass({
+                .name = "Add",
+                .type = valT,
+                .methods = {
+                    { Add::methodName, fun(typeMap, env, valT, fun(typeMap, env, valT, valT)) }
+                }
+            }));
+        })());
+        typeMap.addTypeClass(([&] {
+            auto valT = param(env);
+            return RefTypeClass(new TypeClass({
+                .name = "TypeClass",
+                .type = valT,
+                .methods = {
+                    { "method", fun(typeMap, env, valT, fun(typeMap, env, valT, valT)) }
+                }
+            }));
+        })());
+        booleanTD.typeclasses.insert(typeMap.getTypeClass("TypeClass"));
+    }
+
+    /// <summary>
+    /// 保存したモジュールインターフェースから組込みの型と型クラスを読み込む
+    /// </summary>
+    /// <param name="image">読み込むモジュールインターフェース</param>
+    explicit Fixture(const ModuleInterface& image) : typeMap(ModuleInterface::load(image.words, this->env)) {
+        this->numberT = std::get<RefType>(this->typeMap.findType("number")->type);
+        this->booleanT = std::get<RefType>(this->typeMap.findType("boolean")->type);
+    }
+};
+
+/// <summary>
+/// ベンチマーク用に生成したプログラム
+/// </summary>
+struct Program {
+    /// <summary>
+    /// プログラムの構文木
+    /// </summary>
+    std::shared_ptr<Expression> expr = nullptr;
+    /// <summary>
+    /// 構文木のノード数
+    /// </summary>
+    std::size_t nodes = 0;
+
+    /// <summary>
+    /// 構文木のノードを数える
+    /// </summary>
+    /// <param name="e">生成したノード</param>
+    /// <returns>e</returns>
+    std::shared_ptr<Expression> operator()(std::shared_ptr<Expression> e) {
+        ++this->nodes;
+        return e;
+    }
+};
+
+/// <summary>
+/// <para>深いlet束縛の入れ子</para>
+/// <para>let x0 = n -> n in let x1 = n -> x0 n in ... in xn</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+Program deepLet([[maybe_unused]] Fixture& fixture, std::size_t n) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(n)));
+    for (auto i = n; i > 0; --i) {
+        e = p(let(x(i), p(lambda("n", p(apply(p(id(x(i - 1))), p(id("n")))))), e));
+    }
+    p.expr = p(let(x(0), p(lambda("n", p(id("n")))), e));
+    return p;
+}
+
+/// <summary>
+/// <para>多相な束縛の多数の利用</para>
+/// <para>let id = x -> x in let k = a -> b -> b in k (id 1) (k (id true) (... (id 1)))</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">idの利用回数</param>
+/// <returns>生成したプログラム</returns>
+Program widePolymorphism(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto arg = [&](std::size_t i) { return p(c(i % 2 == 0 ? fixture.numberT : fixture.booleanT)); };
+    auto e = p(apply(p(id("id")), arg(0)));
+    for (std::size_t i = 1; i < n; ++i) {
+        e = p(apply(p(id("k")), p(apply(p(id("id")), arg(i))), e));
+    }
+    auto k = p(lambda({ Lambda::Parameter{ .x = Symbol("a") }, Lambda::Parameter{ .x = Symbol("b") } }, p(id("b"))));
+    p.expr = p(let("id", p(lambda("x", p(id("x")))), p(let("k", k, e))));
+    return p;
+}
+
+/// <summary>
+/// <para>長いカリー化された関数適用</para>
+/// <para>let f = x0 -> x1 -> ... -> xn -> x0 in f 1 1 ... 1</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">引数の数</param>
+/// <returns>生成したプログラム</returns>
+Program longApply(Fixture& fixture, std::size_t n) {
+    Program p;
+    std::vector<Lambda::Parameter> params;
+    std::vector<std::shared_ptr<Expression>> args;
+    for (std::size_t i = 0; i < n; ++i) {
+        params.push_back({ .x = Symbol(std::format("x{}", i)) });
+        args.push_back(p(c(fixture.numberT)));
+    }
+    auto f = p(lambda(std::move(params), p(id("x0"))));
+    p.expr = p(let("f", f, p(std::shared_ptr<Expression>(new Apply(p(id("f")), std::move(args))))));
+    return p;
+}
+
+/// <summary>
+/// <para>型制約を多数伴う式</para>
+/// <para>let f = n -> n + n + ... + n in true.method (true.method (... true))</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">加算とクラスメソッドの呼び出しのそれぞれの回数</param>
+/// <returns>生成したプログラム</returns>
+Program classConstraints(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto sum = p(id("n"));
+    for (std::size_t i = 0; i < n; ++i) {
+        sum = p(add(fixture.typeMap, sum, p(id("n"))));
+    }
+    auto e = p(c(fixture.booleanT));
+    for (std::size_t i = 0; i < n; ++i) {
+        e = p(apply(p(dot(p(c(fixture.booleanT)), "method")), e));
+    }
+    p.expr = p(let("f", p(lambda("n", sum)), e));
+    return p;
+}
+
+/// <summary>
+/// <para>参照型の引数をとる関数の連鎖</para>
+/// <para>let g0 = n: 'a& -> 1 in let g1 = n: 'b& -> g0 n in ... in gn true</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">関数の数</param>
+/// <returns>生成したプログラム</returns>
+Program refParams(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto& env = fixture.env;
+    auto g = [](std::size_t i) { return std::format("g{}", i); };
+    auto e = p(apply(p(id(g(n))), p(c(fixture.booleanT))));
+    for (auto i = n; i > 0; --i) {
+        e = p(let(g(i), p(lambda("n", ref(fixture.typeMap, env, var(env)), p(apply(p(id(g(i - 1))), p(id("n")))))), e));
+    }
+    p.expr = p(let(g(0), p(lambda("n", ref(fixture.typeMap, env, var(env)), p(c(fixture.numberT)))), e));
+    return p;
+}
+
+/// <summary>
+/// <para>参照を受け渡すlet束縛の連鎖</para>
+/// <para>let r = n: 'a& -> n in let a0 = true in let a1 = r a0 in ... in an</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">束縛の数</param>
+/// <returns>生成したプログラム</returns>
+Program refBindings(Fixture& fixture, std::size_t n) {
+    Program p;
+    auto& env = fixture.env;
+    auto a = [](std::size_t i) { return std::format("a{}", i); };
+    auto e = p(id(a(n)));
+    for (auto i = n; i > 0; --i) {
+        e = p(let(a(i), p(apply(p(id("r")), p(id(a(i - 1))))), e));
+    }
+    auto r = p(lambda("n", ref(fixture.typeMap, env, var(env)), p(id("n"))));
+    p.expr = p(let("r", r, p(let(a(0), p(c(fixture.booleanT)), e))));
+    return p;
+}
+
+/// <summary>
+/// <para>プログラムの生成と型推論を繰り返して計測結果を出力する</para>
+/// <para>生成は計測に含めず、ノードあたりの時間、確保回数、確保中のバイト数の最大値を出力する</para>
+/// </summary>
+/// <param name="name">プログラム名</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="n">生成器に与える大きさ</param>
+/// <param name="repeat">繰り返し回数</param>
+void benchmark(const std::string& name, Program(*generate)(Fixture&, std::size_t), std::size_t n, std::size_t repeat) {
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::size_t nodes = 0;
+        std::size_t allocations = 0;
+        std::size_t peak = 0;
+        std::chrono::steady_clock::duration elapsed = {};
+
+        for (std::size_t i = 0; i < repeat; ++i) {
+            auto program = generate(fixture, n);
+            nodes = program.nodes;
+
+            // 同一スコープでの多重定義は禁止のため繰り返しごとに同じ深さの型環境で束縛する
+            TypeEnvironment env = fixture.env.child(fixture.env.depth);
+
+            auto before = heapStats;
+            heapStats.peak = heapStats.bytes;
+            auto start = std::chrono::steady_clock::now();
+            if (algorithm == 'J') {
+                (void)program.expr->J(fixture.typeMap, env);
+            }
+            else {
+                auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
+                program.expr->M(fixture.typeMap, env, t);
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            allocations += heapStats.allocations - before.allocations;
+            peak = std::max(peak, heapStats.peak - before.bytes);
+        }
+
+        auto count = static_cast<double>(nodes * repeat);
+        std::cout << std::format(
+            "{:<20} {} {:>8} {:>12.1f} {:>12.2f} {:>16.1f}",
+            name,
+            algorithm,
+            nodes,
+            std::chrono::duration<double, std::nano>(elapsed).count() / count,
+            allocations / count,
+            static_cast<double>(peak) / nodes
+        ) << std::endl;
+    }
+}
+
+/// <summary>
+/// 型のグラフとしてのノード数を数える(共有された部分型は1度のみ数える)
+/// </summary>
+/// <param name="type">数える対象の型</param>
+/// <returns>typeから到達可能な型のノード数</returns>
+std::size_t countTypeNodes(RefType type) {
+    struct fn {
+        std::vector<RefType>& stack;
+
+        void operator()([[maybe_unused]] const Type::Base& x) {}
+        void operator()(const Type::Function& x) {
+            this->stack.push_back(x.base);
+            this->stack.push_back(x.paramType);
+            this->stack.push_back(x.returnType);
+        }
+        void operator()(const Type::Variable& x) {
+            if (x.solve) {
+                this->stack.push_back(x.solve);
+            }
+        }
+        void operator()([[maybe_unused]] const Type::Param& x) {}
+        void operator()([[maybe_unused]] const Type::TypeClass& x) {}
+        void operator()(const Type::Ref& x) {
+            this->stack.push_back(x.base);
+            this->stack.push_back(x.type);
+        }
+    };
+
+    std::unordered_set<const Type*> visited;
+    std::vector<RefType> stack = { type };
+    while (!stack.empty()) {
+        auto t = stack.back();
+        stack.pop_back();
+        if (visited.insert(t).second) {
+            std::visit(fn{ .stack = stack }, t->kind);
+        }
+    }
+    return visited.size();
+}
+
+/// <summary>
+/// <para>組を入れ子にするlet束縛の連鎖</para>
+/// <para>let pair = a -> b -> f -> f a b in let x0 = 1 in let x1 = pair x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">連鎖の長さ</param>
+/// <returns>生成したプログラム</returns>
+Program pairChain(Fixture& fixture, std::size_t k) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(k)));
+    for (auto i = k; i > 0; --i) {
+        e = p(let(x(i), p(apply(p(apply(p(id("pair")), p(id(x(i - 1))))), p(id(x(i - 1))))), e));
+    }
+    auto pair = p(lambda("a", p(lambda("b", p(lambda("f", p(apply(p(apply(p(id("f")), p(id("a")))), p(id("b"))))))))));
+    p.expr = p(let("pair", pair, p(let(x(0), p(c(fixture.numberT)), e))));
+    return p;
+}
+
+/// <summary>
+/// <para>多相な束縛を2回ずつ利用する入れ子</para>
+/// <para>let x0 = n -> n in let x1 = y -> y x0 x0 in ... in xk</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">入れ子の深さ</param>
+/// <returns>生成したプログラム</returns>
+Program polymorphicNest([[maybe_unused]] Fixture& fixture, std::size_t k) {
+    Program p;
+    auto x = [](std::size_t i) { return std::format("x{}", i); };
+    auto e = p(id(x(k)));
+    for (auto i = k; i > 0; --i) {
+        e = p(let(x(i), p(lambda("y", p(apply(p(apply(p(id("y")), p(id(x(i - 1))))), p(id(x(i - 1))))))), e));
+    }
+    p.expr = p(let(x(0), p(lambda("n", p(id("n")))), e));
+    return p;
+}
+
+/// <summary>
+/// <para>型変数を含まない大きな型を返す多相な関数の多数の利用</para>
+/// <para>Tk = Tk-1 -> Tk-1とする、let g = y -> (_: Tk) in let k = a -> b -> b in k (g 1) (k (g 1) (... (g 1)))</para>
+/// <para>Tkは木としては2^k個のノードをもつが、instantiateでTkを共有する限り生成する型の数はkに依存しない</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="k">Tkの深さ</param>
+/// <returns>生成したプログラム</returns>
+Program groundSharing(Fixture& fixture, std::size_t k) {
+    Program p;
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < k; ++i) {
+        t = fun(fixture.typeMap, fixture.env, t, t);
+    }
+    auto use = [&] { return p(apply(p(id("g")), p(c(fixture.numberT)))); };
+    auto e = use();
+    for (std::size_t i = 1; i < 64; ++i) {
+        e = p(apply(p(apply(p(id("k")), use())), e));
+    }
+    p.expr = p(let("g", p(lambda("y", p(c(t)))), p(let("k", p(lambda("a", p(lambda("b", p(id("b")))))), e))));
+    return p;
+}
+
+/// <summary>
+/// <para>instantiateが型変数を含まない部分型を共有しているかの検査</para>
+/// <para>a -> Tkをgeneralizeしてinstantiateした結果の戻り値型がTkそのものであり、雛形がTkを展開していないことを確認する</para>
+/// </summary>
+/// <returns>共有している場合はtrue、そうでない場合はfalse</returns>
+bool checkSharing() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto t = fixture.numberT;
+    for (std::size_t i = 0; i < 16; ++i) {
+        t = fun(fixture.typeMap, env, t, t);
+    }
+    auto g = env.generalize(fun(fixture.typeMap, env, var(env), t));
+    auto& generic = std::get<Generic>(g);
+    auto f = env.instantiate(fixture.typeMap, generic);
+
+    if (std::get<Type::Function>(f->kind).returnType != t || generic.spine->nodes.size() != 1) {
+        std::cout << std::format("instantiate: 型変数を含まない部分型が共有されていない(雛形の節点数：{})", generic.spine->nodes.size()) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>投機的な単一化の巻き戻しの検査</para>
+/// <para>'a -> 'aとnumber -> booleanの単一化は'aを束縛した後に失敗するため、巻き戻して'aが未解決に戻り別の型と単一化できることを確認する</para>
+/// <para>let束縛を含む型推論を巻き戻した場合にgeneralizeによる型の書き換えも巻き戻されることを確認する</para>
+/// <para>型推論による束縛済みの型情報とリージョン型の書き換えも巻き戻されることを確認する</para>
+/// <para>型推論の異常以外の例外で中断した場合も巻き戻されてチェックポイントが閉じられることを確認する</para>
+/// </summary>
+/// <returns>巻き戻せている場合はtrue、そうでない場合はfalse</returns>
+bool checkRollback() {
+    Fixture fixture;
+    auto& env = fixture.env;
+    auto a = var(env);
+    auto t = fun(fixture.typeMap, env, a, a);
+    auto print = [&] {
+        std::ostringstream os;
+        os << t;
+        return os.str();
+    };
+    auto before = print();
+
+    auto numberToBoolean = fun(fixture.typeMap, env, fixture.numberT, fixture.booleanT);
+    if (trail.speculate([&] { (void)unifyType(fixture.typeMap, t, numberToBoolean, true); })) {
+        std::cout << "rollback: 単一化が失敗していない" << std::endl;
+        return false;
+    }
+    if (print() != before || std::get<Type::Variable>(a->kind).solve) {
+        std::cout << std::format("rollback: 巻き戻し後の型が一致しない({} -> {})", before, print()) << std::endl;
+        return false;
+    }
+
+    auto booleanToBoolean = fun(fixture.typeMap, env, fixture.booleanT, fixture.booleanT);
+    if (!trail.speculate([&] { (void)unifyType(fixture.typeMap, t, booleanToBoolean, true); }) || solved(a) != fixture.booleanT) {
+        std::cout << "rollback: 巻き戻し後の単一化に失敗した" << std::endl;
+        return false;
+    }
+
+    // let g = (u -> f) (k x) in 1 1
+    // f : 'b -> number、x : 'b、k : boolean -> numberとし、'bはlet束縛の型推論中にfの型を経由せずに解決される
+    // gのgeneralizeがfの型の引数型を解決結果に書き換えてから型推論が失敗する
+    auto b = env.newType(Type::Variable{ .depth = env.depth });
+    auto h = fun(fixture.typeMap, env, b, fixture.numberT);
+    auto region = [&] { return env.newRegion(Region::Base{ .env = std::addressof(env) }); };
+    env.bind(Symbol("f"), env.newTypeInfo(h, region()));
+    env.bind(Symbol("x"), env.newTypeInfo(b, region()));
+    env.bind(Symbol("k"), env.newTypeInfo(fun(fixture.typeMap, env, fixture.booleanT, fixture.numberT), region()));
+    auto expr = let("g", apply(lambda("u", id("f")), apply(id("k"), id("x"))), apply(c(fixture.numberT), c(fixture.numberT)));
+    if (trail.speculate([&] { (void)expr->J(fixture.typeMap, env); })) {
+        std::cout << "rollback: let束縛を含む型推論が失敗していない" << std::endl;
+        return false;
+    }
+    if (std::get<Type::Function>(h->kind).paramType != b || std::get<Type::Variable>(b->kind).solve) {
+        std::cout << "rollback: let束縛のgeneralizeによる書き換えが巻き戻されていない" << std::endl;
+        return false;
+    }
+
+    // 'cをnumberに解決してから let y = z in 1 1
+    // z : 'cとし、yの束縛でzの型情報を解決結果に書き換えてから型推論が失敗する
+    auto d = env.newType(Type::Variable{ .depth = env.depth });
+    auto z = env.newTypeInfo(d, region());
+    env.bind(Symbol("z"), z);
+    expr = let("y", id("z"), apply(c(fixture.numberT), c(fixture.numberT)));
+    if (trail.speculate([&] {
+        auto numberT = fixture.numberT;
+        (void)unifyType(fixture.typeMap, d, numberT, true);
+        (void)expr->J(fixture.typeMap, env);
+    })) {
+        std::cout << "rollback: 型情報を参照するlet束縛を含む型推論が失敗していない" << std::endl;
+        return false;
+    }
+    if (std::get<Type::Variable>(d->kind).solve || std::get<RefType>(env.lookup(Symbol("z")).value()->type) != d) {
+        std::cout << "rollback: let束縛による型情報の書き換えが巻き戻されていない" << std::endl;
+        return false;
+    }
+
+    // rho : 'eとし、1をrhoとして推論してrhoのリージョン型を一時オブジェクトに書き換えてから'eとbooleanの単一化が失敗する
+    auto e = env.newType(Type::Variable{ .depth = env.depth });
+    auto rho = env.newTypeInfo(e, env.newRegion(Region::Variable{ .depth = env.depth }));
+    auto rhoRegion = rho->region;
+    if (trail.speculate([&] {
+        auto booleanT = fixture.booleanT;
+        c(fixture.numberT)->M(fixture.typeMap, env, rho);
+        (void)unifyType(fixture.typeMap, e, booleanT, true);
+    })) {
+        std::cout << "rollback: リージョン型を書き換える型推論が失敗していない" << std::endl;
+        return false;
+    }
+    if (std::get<Type::Variable>(e->kind).solve || rho->region != rhoRegion || !std::holds_alternative<Region::Variable>(rho->region->kind)) {
+        std::cout << "rollback: 型推論によるリージョン型の書き換えが巻き戻されていない" << std::endl;
+        return false;
+    }
+
+    // 型推論の異常以外の例外でも書き換えを巻き戻し、チェックポイントを閉じてから再送出する
+    auto u = var(env);
+    try {
+        (void)trail.speculate([&] {
+            (void)unifyType(fixture.typeMap, u, fixture.numberT, true);
+            throw std::out_of_range("speculate");
+        });
+        std::cout << "rollback: 型推論の異常以外の例外が再送出されていない" << std::endl;
+        return false;
+    }
+    catch (const std::out_of_range&) {}
+    if (trail.open != 0 || std::get<Type::Variable>(u->kind).solve) {
+        std::cout << "rollback: 型推論の異常以外の例外で巻き戻されていない" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// <para>大きさを変えながらプログラムの族について型推論を行い、計測結果を出力する</para>
+/// <para>型推論中に生成した型の数と、結果の型のグラフとしてのノード数を出力する</para>
+/// </summary>
+/// <param name="name">プログラムの族の名前</param>
+/// <param name="generate">プログラムの生成器</param>
+/// <param name="sizes">生成器に与える大きさのリスト(昇順)</param>
+/// <param name="shared">生成する型の数が大きさに依存しないことを検査する場合はtrue</param>
+/// <param name="linear">生成する型の数と結果の型のノード数が大きさに比例し、束縛1つあたりに走査する型の数が高々大きさに比例することを検査する場合はtrue(走査する型の数はINFERENCE_STATSを定義した場合のみ検査する)</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool stress(const std::string& name, Program(*generate)(Fixture&, std::size_t), std::initializer_list<std::size_t> sizes, bool shared = false, bool linear = false) {
+    auto ok = true;
+    for (auto algorithm : { 'J', 'M' }) {
+        Fixture fixture;
+        std::optional<std::size_t> first = std::nullopt;
+        // 最初の大きさでの計測結果(大きさ、生成した型の数、結果の型のノード数、走査した型の数)
+        std::optional<std::tuple<std::size_t, std::size_t, std::size_t, std::size_t>> base = std::nullopt;
+
+        for (auto k : sizes) {
+            auto program = generate(fixture, k);
+
+            // 同一スコープでの多重定義は禁止のため大きさごとに同じ深さの型環境で束縛する
+            TypeEnvironment env = fixture.env.child(fixture.env.depth);
+
+            auto types = env.arena->types.size();
+            auto traversed = inferenceStats.traversed();
+            auto start = std::chrono::steady_clock::now();
+            RefType t = nullptr;
+            if (algorithm == 'J') {
+                t = std::get<RefType>(program.expr->J(fixture.typeMap, env)->type);
+            }
+            else {
+                auto info = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
+                program.expr->M(fixture.typeMap, env, info);
+                t = std::get<RefType>(info->type);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            auto created = env.arena->types.size() - types;
+            auto us = std::chrono::duration<double, std::micro>(elapsed).count();
+            auto nodes = countTypeNodes(t);
+            auto visits = inferenceStats.traversed() - traversed;
+
+            std::cout << std::format(
+                "{:<20} {} {:>4} {:>8} {:>12.1f} {:>12} {:>12}",
+                name,
+                algorithm,
+                k,
+                program.nodes,
+                us,
+                created,
+                nodes
+            ) << std::endl;
+
+            // 型変数を含まない部分型を共有している限り、生成する型の数は大きさに依存しない
+            if (shared && first && created > first.value()) {
+                std::cout << std::format("{}: 型変数を含まない部分型が共有されていない({} -> {})", name, first.value(), created) << std::endl;
+                ok = false;
+            }
+            first = first.value_or(created);
+
+            if (linear && base) {
+                auto [k0, created0, nodes0, visits0] = base.value();
+                auto ratio = static_cast<double>(k) / k0;
+                // 計測の誤差を含む時間ではなく決定的な型の数で検査する
+                // 定数項は大きさによらないため、型の数は余裕をもたせずに大きさに比例する上限で検査できる
+                if (created > created0 * ratio || nodes > nodes0 * ratio) {
+                    std::cout << std::format("{}: 型の数が大きさに比例しない({} -> {}, {} -> {})", name, created0, created, nodes0, nodes) << std::endl;
+                    ok = false;
+                    break;
+                }
+                // 束縛ごとに出現検査とgeneralizeがその時点の型を1回ずつ走査するため、束縛1つあたりに走査する型の数は大きさに比例してよい
+                if (visits > visits0 * ratio * ratio) {
+                    std::cout << std::format("{}: 束縛1つあたりに走査する型の数が大きさに比例しない({:.1f} -> {:.1f})", name, static_cast<double>(visits0) / k0, static_cast<double>(visits) / k) << std::endl;
+                    ok = false;
+                    // 指数的に増加する場合に続く大きさの計測が終わらないため打ち切る
+                    break;
+                }
+            }
+            else if (linear) {
+                base = std::tuple(k, created, nodes, visits);
+            }
+        }
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>凍結した1つの型表を共有した複数の型推論を並行に実行して計測結果を出力する</para>
+/// <para>型推論ごとに型表を重ね、スレッド数によらず推論結果の型が一致することを検査する</para>
+/// </summary>
+/// <param name="n">class-constraintsの大きさ</param>
+/// <param name="sessions">型推論の回数</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool sharedPrelude(std::size_t n, std::size_t sessions) {
+    auto ok = true;
+    Fixture fixture;
+    fixture.typeMap.freeze();
+    auto program = classConstraints(fixture, n);
+
+    std::optional<double> sequential = std::nullopt;
+    std::vector<std::string> expected;
+    // 実行環境のコア数によらず並行な型推論の経路を通すため2スレッド以上で比較する
+    auto concurrency = std::max<std::size_t>(std::thread::hardware_concurrency(), 2);
+    for (auto threads : { std::size_t(1), concurrency }) {
+        std::vector<std::string> actual(sessions);
+        std::atomic<std::size_t> next = 0;
+        auto worker = [&] {
+            for (auto i = next++; i < sessions; i = next++) {
+                auto env = TypeEnvironment();
+                auto typeMap = fixture.typeMap.overlay();
+                std::ostringstream os;
+                os << std::get<RefType>(program.expr->J(typeMap, env)->type);
+                actual[i] = os.str();
+            }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+#ifdef INFERENCE_STATS
+        auto& stats = inferenceStats;
+#endif
+        for (std::size_t i = 1; i < threads; ++i) {
+            pool.emplace_back([&] {
+                worker();
+#ifdef INFERENCE_STATS
+                stats.merge(inferenceStats);
+#endif
+            });
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sequential = sequential.value_or(elapsed);
+
+        if (expected.empty()) {
+            expected = std::move(actual);
+        }
+        else if (actual != expected) {
+            std::cout << std::format("shared-prelude: スレッド数{}で推論結果が一致しない", threads) << std::endl;
+            ok = false;
+        }
+
+        std::cout << std::format("{:<20} {:>8} {:>8} {:>12.1f} {:>8.2f}", "shared-prelude", threads, sessions, elapsed, sequential.value() / elapsed) << std::endl;
+    }
+    return ok;
+}
+
+/// <summary>
+/// <para>型クラスの階層と型と束縛を組込みの環境に追加する</para>
+/// <para>Class{i}はClass{i-1}を継承してジェネリック型のクラスメソッドm{i}をもち、型T{i}はClass{i}を実装し、v{i}はClass{i}の制約付きの型変数とリージョン型の型変数をもつジェネリック型に束縛する</para>
+/// </summary>
+/// <param name="fixture">型推論の環境</param>
+/// <param name="n">追加する型クラスの数</param>
+void extendPrelude(Fixture& fixture, std::size_t n) {
+    auto& env = fixture.env;
+    auto& typeMap = fixture.typeMap;
+    for (std::size_t i = 0; i < n; ++i) {
+        auto valT = param(env);
+        auto typeClass = RefTypeClass(new TypeClass({
+            .name = std::format("Class{}", i),
+            .bases = i > 0 ? Constraints{ typeMap.getTypeClass(std::format("Class{}", i - 1)) } : Constraints{},
+            .type = valT,
+            .methods = {
+                { std::format("m{}", i), env.generalize(fun(typeMap, env, valT, fun(typeMap, env, var(env), valT))) }
+            }
+        }));
+        typeMap.addTypeClass(typeClass);
+        typeMap.addType(base(env, std::format("T{}", i))).second.typeclasses.insert(typeClass);
+
+        auto a = env.newType(Type::Variable{ .constraints = { typeClass }, .depth = env.depth + 1 });
+        env.bind(Symbol(std::format("v{}", i)), info(env, std::get<Generic>(env.generalize(fun(typeMap, env, a, ref(env, base(env, "ref"), a))))));
+    }
+}
+
+/// <summary>
+/// <para>組込みの環境の構築とモジュールインターフェースからの読み込みを繰り返して計測結果を出力する</para>
+/// <para>読み込みは型クラスを登録する初回と登録済みの型クラスを再利用する2回目以降を分けて出力する</para>
+/// <para>読み込んだ環境での推論結果の型が構築した環境での推論結果の型と一致し、2回目以降の読み込みで型クラスの通し番号が増えないことを検査する</para>
+/// <para>ヘッダを残して内容を書き換えたものと型表の型名が重複するものが型クラスを登録せずに拒否されることも検査する</para>
+/// </summary>
+/// <param name="n">追加する型クラスの数</param>
+/// <param name="repeat">繰り返し回数</param>
+/// <returns>検査に失敗した場合はfalse、そうでない場合はtrue</returns>
+bool moduleInterface(std::size_t n, std::size_t repeat) {
+    // 環境ごとに型クラス、型、束縛を利用する式の推論結果を出力する
+    auto infer = [n](Fixture& fixture) {
+        std::vector<std::string> results;
+        auto run = [&](const std::shared_ptr<Expression>& expr) {
+            try {
+                // 組込みの束縛を参照するため同じ深さの型環境で推論する
+                TypeEnvironment env = fixture.env.child(fixture.env.depth);
+                auto typeMap = fixture.typeMap.overlay();
+                std::ostringstream os;
+                os << std::get<RefType>(expr->J(typeMap, env)->type);
+                results.push_back(os.str());
+            }
+            catch (const std::runtime_error& e) {
+                results.push_back(e.what());
+            }
+        };
+        run(classConstraints(fixture, 20).expr);
+        for (std::size_t i = 0; i < n; i += std::max<std::size_t>(n / 8, 1)) {
+            auto t = c(std::get<RefType>(fixture.typeMap.findType(std::format("T{}", i))->type));
+            run(apply(id(std::format("v{}", i)), apply(dot(t, std::format("m{}", i)), t)));
+            // クラスメソッドの関数型自身を型制約と照合して関数型の型に関するデータを参照する
+            run(apply(id(std::format("v{}", i)), dot(t, std::format("m{}", i))));
+        }
+        return results;
+    };
+
+    // 構築では型クラスの通し番号が構築ごとに新たに採番されて型クラスの集合が大きくなるため、構築と読み込みを交互に計測する
+    auto path = (std::filesystem::temp_directory_path() / "module_interface.bin").string();
+    auto ok = true;
+    std::size_t bytes = 0;
+    std::chrono::steady_clock::duration build = {};
+    std::chrono::steady_clock::duration first = {};
+    std::chrono::steady_clock::duration load = {};
+    for (std::size_t i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        Fixture fixture;
+        extendPrelude(fixture, n);
+        fixture.typeMap.freeze();
+        build += std::chrono::steady_clock::now() - start;
+        if (i == 0) {
+            auto image = ModuleInterface::save(fixture.typeMap, fixture.env);
+            image.write(path);
+            bytes = image.words.size() * sizeof(std::uint32_t);
+        }
+
+        auto registered = TypeClassTable::instance().typeClasses.size();
+        start = std::chrono::steady_clock::now();
+        Fixture loaded(ModuleInterface::read(path));
+        (i == 0 ? first : load) += std::chrono::steady_clock::now() - start;
+        if (infer(loaded) != infer(fixture)) {
+            std::cout << "module-interface: 読み込んだ環境で推論結果が一致しない" << std::endl;
+            ok = false;
+        }
+        if (i > 0 && TypeClassTable::instance().typeClasses.size() != registered) {
+            std::cout << "module-interface: 再度の読み込みで型クラスが登録し直された" << std::endl;
+            ok = false;
+        }
+    }
+
+    // 内容を書き換えたものや型表の型名が重複するものは型クラスを登録せずに拒否する
+    auto reject = [&](const ModuleInterface& image, std::string_view message) {
+        auto registered = TypeClassTable::instance().typeClasses.size();
+        try {
+            Fixture loaded(image);
+            std::cout << std::format("module-interface: {}", message) << std::endl;
+            ok = false;
+        }
+        catch (const std::runtime_error&) {}
+        if (TypeClassTable::instance().typeClasses.size() != registered) {
+            std::cout << "module-interface: 拒否した読み込みで型クラスが登録された" << std::endl;
+            ok = false;
+        }
+    };
+    // 文字列の表の文字列を同じ長さの文字列に書き換える(形式としては正しいまま内容のみが変わる)
+    auto rename = [image = ModuleInterface::read(path)](std::string_view from, std::string_view to) {
+        auto result = image;
+        auto& words = result.words;
+        for (std::size_t position = ModuleInterface::HEADER + 1, count = words[ModuleInterface::HEADER]; count > 0; --count) {
+            auto data = reinterpret_cast<char*>(words.data() + position + 1);
+            if (std::string_view(data, words[position]) == from) {
+                std::ranges::copy(to, data);
+            }
+            position += 1 + (words[position] + 3) / 4;
+        }
+        return result;
+    };
+    // ヘッダを残したまま束縛名を書き換える
+    reject(rename("v0", "w0"), "ヘッダを残して内容を書き換えたものが読み込まれた");
+    // 型名T1をT0に書き換えて内容の識別子を求め直す
+    auto duplicated = rename("T1", "T0");
+    auto id = ModuleInterface::contentId(std::span(duplicated.words).subspan(ModuleInterface::HEADER));
+    duplicated.words[2] = static_cast<std::uint32_t>(id);
+    duplicated.words[3] = static_cast<std::uint32_t>(id >> 32);
+    reject(duplicated, "型表の型名が重複するものが読み込まれた");
+    std::filesystem::remove(path);
+
+    std::cout << std::format(
+        "{:<20} {:>8} {:>10} {:>12.2f} {:>12.2f} {:>12.2f}",
+        "module-interface",
+        n,
+        bytes,
+        std::chrono::duration<double, std::milli>(build).count() / repeat,
+        std::chrono::duration<double, std::milli>(first).count(),
+        std::chrono::duration<double, std::milli>(load).count() / std::max<std::size_t>(repeat - 1, 1)
+    ) << std::endl;
+    return ok;
+}
 
 int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
+    std::cout << std::format("{:<20} {} {:>8} {:>12} {:>12} {:>16}", "program", "A", "nodes", "ns/node", "allocs/node", "peak bytes/node") << std::endl;
+    benchmark("deep-let", deepLet, 1000, 20);
+    benchmark("wide-polymorphism", widePolymorphism, 1000, 20);
+    benchmark("long-apply", longApply, 1000, 20);
+    benchmark("class-constraints", classConstraints, 1000, 20);
+    benchmark("ref-params", refParams, 1000, 20);
+    benchmark("ref-bindings", refBindings, 1000, 20);
+
+    // 型が指数的に大きくなりうるプログラムの族
+    std::cout << std::endl << std::format("{:<20} {} {:>4} {:>8} {:>12} {:>12} {:>12}", "family", "A", "k", "nodes", "us", "new types", "type nodes") << std::endl;
+    auto ok = checkSharing();
+    ok = checkRollback() && ok;
+    ok = stress("pair-chain", pairChain, { 8, 16, 32, 64, 128, 256 }, false, true) && ok;
+    ok = stress("polymorphic-nest", polymorphicNest, { 2, 4, 6, 8, 10, 12 }) && ok;
+    ok = stress("ground-sharing", groundSharing, { 4, 8, 16, 32, 64 }, true) && ok;
+
+    // 凍結した型表を共有する並行な型推論
+    std::cout << std::endl << std::format("{:<20} {:>8} {:>8} {:>12} {:>8}", "prelude", "threads", "sessions", "ms", "speedup") << std::endl;
+    ok = sharedPrelude(200, 256) && ok;
+
+    // 組込みの環境の構築とモジュールインターフェースからの読み込み
+    std::cout << std::endl << std::format("{:<20} {:>8} {:>10} {:>12} {:>12} {:>12}", "interface", "classes", "bytes", "build ms", "first ms", "reload ms") << std::endl;
+    ok = moduleInterface(500, 20) && ok;
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main() {
+#ifdef INFERENCE_TRACE
+    // 型推論の区間をChromeのトレースビューアで読み込める形式で出力する
+    inferenceTrace.open("inference_trace.json");
+#endif
     // 型環境
     auto env = TypeEnvironment();
     // 型表
@@ -2241,7 +6542,10 @@ int main() {
         }));
     })());
     // Boolean型に型クラスTypeClassを実装する
-    booleanTD.typeclasses.list.push_back(typeMap.typeClassMap["TypeClass"]);
+    booleanTD.typeclasses.insert(typeMap.getTypeClass("TypeClass"));
+
+    // 登録を終えた型表は凍結して各式の型推論で共有する
+    typeMap.freeze();
 
     // 定数のつもりの構文を宣言しておく
     auto _true = c(booleanT);
@@ -2252,7 +6556,7 @@ int main() {
             // let f = n: (:TypeClass) -> n.method n in f
             // 引数型に型を明示的に指定してクラスメソッドを呼び出す例
             // 型としての型クラスは参照型の一形態のためリージョン情報も出力される
-            let("f", lambda("n", tc(env, typeMap.typeClassMap["TypeClass"]), apply(dot(id("n"), "method"), id("n"))), apply(id("f"), _true)),
+            let("f", lambda("n", tc(env, typeMap.getTypeClass("TypeClass")), apply(dot(id("n"), "method"), id("n"))), apply(id("f"), _true)),
             // let g = n: 'a& at a -> 1 in g true
             // 暗黙の型推論により値型から参照型へ変換される例
             let("g", lambda("n", ref(typeMap, env, var(env)), _1), apply(id("g"), _true)),
@@ -2261,9 +6565,15 @@ int main() {
             let("h", lambda("n", ref(typeMap, env, var(env)), id("n")), let("i", apply(id("h"), _true), id("i")))
         })
     {
+        // INFERENCE_STATSを定義した場合は式ごとに計測結果を出力する
+#ifdef INFERENCE_STATS
+        inferenceStats.reset();
+#endif
         try {
             // 型環境の使いまわしは不可のためAlgorithm JとAlgorithm Mの両方を同時に動かすことは不可
-            std::cout << std::get<RefType>(expr->J(typeMap, env)->type) << std::endl;
+            // 型推論は凍結した型表に重ねた型表で行う
+            auto session = typeMap.overlay();
+            std::cout << std::get<RefType>(expr->J(session, env)->type) << std::endl;
             //auto t = env.newTypeInfo(env.newType(Type::Variable{ .depth = env.depth }), env.newRegion(Region::Variable{ .depth = env.depth }));
             //expr->M(typeMap, env, t);
             //std::cout << std::get<RefType>(t->type) << std::endl;
@@ -2271,5 +6581,12 @@ int main() {
         catch (const std::runtime_error& e) {
             std::cout << e.what() << std::endl;
         }
+#ifdef INFERENCE_STATS
+        inferenceStats.dump(std::cout);
+#endif
     }
-}
\ No newline at end of file
+#ifdef INFERENCE_TRACE
+    inferenceTrace.close();
+#endif
+}
+#endif
\ No newline at end of file